@@ -0,0 +1,821 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+
+#include "common/small-byte-map.hpp"
+#include "common/eytzinger-byte-map.hpp"
+#include "common/byte-map-hash-index.hpp"
+#include "common/byte-map-set-ops.hpp"
+#include "common/front-coded-byte-map.hpp"
+#include "common/interpolation-search.hpp"
+#include "common/byte-map-bloom-filter.hpp"
+#include "common/static-byte-map.hpp"
+#include "common/radix-byte-map.hpp"
+#include "common/persistent-byte-map.hpp"
+#include "common/sharded-byte-map.hpp"
+#include "common/stride-search.hpp"
+#include "common/stride-sort.hpp"
+
+// Benchmarks for small_byte_map_view lookups. Run with --benchmark_filter=Find to compare the linear (SIMD) search
+// against binary search at the same sizes: the size at which BM_BinaryFind overtakes BM_LinearFind is the data-driven
+// choice of LinearExtent for that key extent.
+
+namespace {
+
+    constexpr std::size_t bench_value_extent = 8;
+
+    // Sorted, unique, random keys followed by their values, as build_from_contiguous_bytes expects.
+    template<size_t K>
+    std::vector<std::byte> make_sorted_entries(std::size_t n, std::uint32_t seed = 1) {
+        std::mt19937_64 rng(seed);
+        std::vector<std::vector<std::byte>> keys(n, std::vector<std::byte>(K));
+        for (std::size_t i = 0; i < n; ++i) {
+            for (auto &b : keys[i]) {
+                b = std::byte(rng() & 0xFF);
+            }
+            // Make the keys unique, whatever K is, by writing the index into the tail.
+            for (std::size_t b = 0; b < std::min<std::size_t>(K, 4); ++b) {
+                keys[i][K - 1 - b] = std::byte((i >> (8 * b)) & 0xFF);
+            }
+        }
+        std::sort(keys.begin(), keys.end());
+        std::vector<std::byte> bytes(n * (K + bench_value_extent));
+        for (std::size_t i = 0; i < n; ++i) {
+            std::copy(keys[i].begin(), keys[i].end(), bytes.begin() + i * K);
+        }
+        return bytes;
+    }
+
+    // Probe order, so the branch predictor can't learn the positions.
+    std::vector<std::size_t> make_probes(std::size_t n, std::size_t count = 1024) {
+        std::mt19937_64 rng(7);
+        std::vector<std::size_t> probes(count);
+        for (auto &p : probes) {
+            p = rng() % n;
+        }
+        return probes;
+    }
+
+    template<size_t K, size_t LinearExtent>
+    void run_find(benchmark::State &state) {
+        const auto n = static_cast<std::size_t>(state.range(0));
+        auto bytes = make_sorted_entries<K>(n);
+        auto view = gnt::small_byte_map_view<K, bench_value_extent, std::byte, LinearExtent>::build_from_contiguous_bytes(bytes, true);
+        const auto probes = make_probes(n);
+        std::size_t i = 0;
+        for (auto _ : state) {
+            auto key = gnt::stride<std::byte, K>(bytes.data() + probes[i++ % probes.size()] * K, K);
+            benchmark::DoNotOptimize(view.find(key));
+        }
+        state.SetLabel(view.linear_mode() ? "linear" : "binary");
+    }
+
+    template<size_t K>
+    void BM_LinearFind(benchmark::State &state) {
+        run_find<K, std::numeric_limits<std::size_t>::max()>(state);
+    }
+
+    template<size_t K>
+    void BM_BinaryFind(benchmark::State &state) {
+        run_find<K, 0>(state);
+    }
+
+    // Baseline for the vectorised search: the same linear scan one memcmp at a time.
+    template<size_t K>
+    void BM_ScalarLinearFind(benchmark::State &state) {
+        const auto n = static_cast<std::size_t>(state.range(0));
+        auto bytes = make_sorted_entries<K>(n);
+        const auto probes = make_probes(n);
+        std::size_t i = 0;
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(gnt::find_stride_scalar<K>(bytes.data(), n, bytes.data() + probes[i++ % probes.size()] * K));
+        }
+    }
+
+    // Sorted-mode lookups on large maps: the fitted complexity should come out as O(lgN).
+    template<size_t K>
+    void BM_SortedFindScaling(benchmark::State &state) {
+        const auto n = static_cast<std::size_t>(state.range(0));
+        auto bytes = make_sorted_entries<K>(n);
+        auto view = gnt::small_byte_map_view<K, bench_value_extent>::build_from_contiguous_bytes(bytes, true);
+        const auto probes = make_probes(n);
+        std::size_t i = 0;
+        for (auto _ : state) {
+            auto key = gnt::stride<std::byte, K>(bytes.data() + probes[i++ % probes.size()] * K, K);
+            benchmark::DoNotOptimize(view.find(key));
+        }
+        state.SetComplexityN(state.range(0));
+    }
+
+    // Sorted (binary search) against Eytzinger lookups over the same entries, from in-cache sizes to well past L2.
+    template<size_t K, bool Eytzinger>
+    void BM_LayoutFind(benchmark::State &state) {
+        const auto n = static_cast<std::size_t>(state.range(0));
+        auto bytes = make_sorted_entries<K>(n);
+        auto view = gnt::small_byte_map_view<K, bench_value_extent, std::byte, 0>::build_from_contiguous_bytes(bytes, true);
+        gnt::eytzinger_byte_map<K, bench_value_extent> emap(view);
+        const auto probes = make_probes(n);
+        std::size_t i = 0;
+        for (auto _ : state) {
+            auto key = gnt::stride<std::byte, K>(bytes.data() + probes[i++ % probes.size()] * K, K);
+            if constexpr (Eytzinger) {
+                benchmark::DoNotOptimize(emap.find(key));
+            } else {
+                benchmark::DoNotOptimize(view.find(key));
+            }
+        }
+        state.counters["map_bytes"] = static_cast<double>(bytes.size());
+    }
+
+    // Point lookups through the hash index, to compare with BM_LayoutFind at the same sizes.
+    template<size_t K>
+    void BM_HashIndexFind(benchmark::State &state) {
+        const auto n = static_cast<std::size_t>(state.range(0));
+        auto bytes = make_sorted_entries<K>(n);
+        auto view = gnt::hash_indexed_byte_map_view<K, bench_value_extent>::build_from_contiguous_bytes(bytes, true);
+        view.index();
+        const auto probes = make_probes(n);
+        std::size_t i = 0;
+        for (auto _ : state) {
+            auto key = gnt::stride<std::byte, K>(bytes.data() + probes[i++ % probes.size()] * K, K);
+            benchmark::DoNotOptimize(view.find(key));
+        }
+        state.counters["index_bytes"] = static_cast<double>(view.index().memory_bytes());
+    }
+
+    // Resolving a batch of 256 keys (as a request handler would) one find at a time (Mode 0), with find_many on
+    // unsorted needles (Mode 1) and with find_many on sorted needles (Mode 2).
+    template<int Mode>
+    void BM_FindMany(benchmark::State &state) {
+        using view_type = gnt::small_byte_map_view<8, bench_value_extent, std::byte, 0>;
+        const auto n = static_cast<std::size_t>(state.range(0));
+        auto bytes = make_sorted_entries<8>(n);
+        auto view = view_type::build_from_contiguous_bytes(bytes, true);
+        auto probes = make_probes(n, 256);
+        if (Mode == 2) {
+            std::sort(probes.begin(), probes.end());
+        }
+        std::vector<view_type::key_stride> needles;
+        for (auto p : probes) {
+            needles.emplace_back(bytes.data() + p * 8, 8);
+        }
+        std::vector<view_type::iterator> found(needles.size());
+        for (auto _ : state) {
+            if constexpr (Mode == 0) {
+                for (std::size_t i = 0; i < needles.size(); ++i) {
+                    found[i] = view.find(needles[i]);
+                }
+            } else {
+                view.find_many(needles, found);
+            }
+            benchmark::ClobberMemory();
+        }
+        state.SetItemsProcessed(state.iterations() * needles.size());
+    }
+
+    // Joining a sorted map of m keys against one of 1M: merge_join against a find in the large map per small map key.
+    template<bool Merge>
+    void BM_Join(benchmark::State &state) {
+        using view_type = gnt::small_byte_map_view<8, bench_value_extent>;
+        const std::size_t n = 1 << 20, m = static_cast<std::size_t>(state.range(0));
+        auto large_bytes = make_sorted_entries<8>(n);
+        auto large = view_type::build_from_contiguous_bytes(large_bytes, true);
+        // Every other key of an evenly spaced sample of the large map, so half of the probes hit
+        std::vector<std::byte> small_bytes(m * (8 + bench_value_extent));
+        for (std::size_t i = 0; i < m; ++i) {
+            std::copy_n(large_bytes.data() + (i * (n / m)) * 8, 8, small_bytes.data() + i * 8);
+            small_bytes[i * 8 + 7] ^= std::byte(i & 1);
+        }
+        auto small = view_type::build_from_contiguous_bytes(small_bytes, true);
+        for (auto _ : state) {
+            std::size_t hits = 0;
+            if constexpr (Merge) {
+                hits = gnt::merge_join(small, large, [](const auto &, const auto &, const auto &) {});
+            } else {
+                for (auto &kv : small) {
+                    hits += large.find(kv.first) != large.end();
+                }
+            }
+            benchmark::DoNotOptimize(hits);
+        }
+        state.SetItemsProcessed(state.iterations() * m);
+    }
+
+    // Sorted uuid + timestamp keys (24 bytes, as pack_uuid then pack_int write them) followed by their values: n / 64
+    // ids with 64 increasing timestamps each.
+    std::vector<std::byte> make_uuid_time_entries(std::size_t n) {
+        constexpr std::size_t K = 24;
+        std::mt19937_64 rng(5);
+        std::vector<std::array<std::byte, K>> keys(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            auto &key = keys[i];
+            if (i % 64 == 0) {
+                for (std::size_t b = 0; b < 16; ++b) {
+                    key[b] = std::byte(rng() & 0xFF);
+                }
+            } else {
+                std::copy_n(keys[i - 1].begin(), 16, key.begin());
+            }
+            const std::uint64_t timestamp = 1600000000000 + (i % 64) * 60000 + rng() % 60000;
+            for (std::size_t b = 0; b < 8; ++b) {
+                key[16 + b] = std::byte((timestamp >> (8 * (7 - b))) & 0xFF);
+            }
+        }
+        std::sort(keys.begin(), keys.end());
+        std::vector<std::byte> bytes(n * (K + bench_value_extent));
+        for (std::size_t i = 0; i < n; ++i) {
+            std::copy(keys[i].begin(), keys[i].end(), bytes.begin() + i * K);
+        }
+        return bytes;
+    }
+
+    // Lookups of uuid + timestamp keys in a plain sorted map (RestartInterval 0) and in front coded maps, with the
+    // bytes each spends on keys.
+    template<std::size_t RestartInterval>
+    void BM_FrontCodedFind(benchmark::State &state) {
+        constexpr std::size_t K = 24;
+        const auto n = static_cast<std::size_t>(state.range(0));
+        auto bytes = make_uuid_time_entries(n);
+        auto view = gnt::small_byte_map_view<K, bench_value_extent, std::byte, 0>::build_from_contiguous_bytes(bytes, true);
+        gnt::front_coded_byte_map<K, bench_value_extent> coded(view, RestartInterval == 0 ? 1 : RestartInterval);
+        const auto probes = make_probes(n);
+        std::size_t i = 0;
+        for (auto _ : state) {
+            auto key = gnt::stride<std::byte, K>(bytes.data() + probes[i++ % probes.size()] * K, K);
+            if constexpr (RestartInterval == 0) {
+                benchmark::DoNotOptimize(view.find(key));
+            } else {
+                benchmark::DoNotOptimize(coded.find(key));
+            }
+        }
+        const std::size_t key_bytes = RestartInterval == 0 ? n * K : coded.key_bytes();
+        state.counters["key_bytes"] = static_cast<double>(key_bytes);
+        state.counters["key_ratio"] = static_cast<double>(n * K) / static_cast<double>(key_bytes);
+    }
+
+    // std::lower_bound with stride_less, the search sorted views used before search policies, as a baseline.
+    struct std_search_policy {
+        template<size_t K, size_t Pitch = K>
+        static std::size_t lower_bound(const void *keys, std::size_t n, const void *needle) noexcept {
+            const auto *bytes = static_cast<const unsigned char *>(keys);
+            std::size_t first = 0;
+            while (n > 0) {
+                const std::size_t half = n / 2;
+                if (gnt::less_strides<K>(bytes + (first + half) * Pitch, needle)) {
+                    first += half + 1;
+                    n -= half + 1;
+                } else {
+                    n = half;
+                }
+            }
+            return first;
+        }
+    };
+
+    enum key_distribution { uniform_keys, zipf_keys, clustered_keys };
+
+    // Sorted pack_int keys of n 64 bit values followed by their values: uniform, power law (most values small, with
+    // a long tail) or in 16 dense clusters at random points.
+    std::vector<std::byte> make_distributed_entries(std::size_t n, key_distribution distribution) {
+        std::mt19937_64 rng(11);
+        std::vector<std::uint64_t> centers(16);
+        for (auto &c : centers) {
+            c = rng();
+        }
+        std::vector<std::uint64_t> values(n);
+        for (auto &v : values) {
+            if (distribution == uniform_keys) {
+                v = rng();
+            } else if (distribution == zipf_keys) {
+                const double rank = 1.0 + static_cast<double>(rng() % 10000000);
+                v = static_cast<std::uint64_t>(std::ldexp(1.0, 62) / std::pow(rank, 1.2)) + (rng() & 0xFFFF);
+            } else {
+                v = centers[rng() % centers.size()] + rng() % (1 << 24);
+            }
+        }
+        std::sort(values.begin(), values.end());
+        std::vector<std::byte> bytes(n * (8 + bench_value_extent));
+        for (std::size_t i = 0; i < n; ++i) {
+            for (std::size_t b = 0; b < 8; ++b) {
+                bytes[i * 8 + b] = std::byte((values[i] >> (8 * (7 - b))) & 0xFF);
+            }
+        }
+        return bytes;
+    }
+
+    // Sorted finds of 8 byte keys with each search policy, on each key distribution.
+    template<key_distribution Distribution, typename Policy>
+    void BM_SearchPolicy(benchmark::State &state) {
+        const auto n = static_cast<std::size_t>(state.range(0));
+        auto bytes = make_distributed_entries(n, Distribution);
+        auto view = gnt::small_byte_map_view<8, bench_value_extent, std::byte, 0, Policy>::build_from_contiguous_bytes(bytes, true);
+        const auto probes = make_probes(n);
+        std::size_t i = 0;
+        for (auto _ : state) {
+            auto key = gnt::stride<std::byte, 8>(bytes.data() + probes[i++ % probes.size()] * 8, 8);
+            benchmark::DoNotOptimize(view.find(key));
+        }
+    }
+
+    // contains() on a sorted map where 70% of the lookups miss, without a filter (BitsPerKey 0) and behind Bloom filters
+    // of a few sizes, with the filter's reported false positive rate.
+    template<std::size_t BitsPerKey>
+    void BM_FilteredContains(benchmark::State &state) {
+        using view_type = gnt::filtered_byte_map_view<8, bench_value_extent>;
+        const auto n = static_cast<std::size_t>(state.range(0));
+        auto map_bytes = make_sorted_entries<8>(n);
+        auto map = gnt::small_byte_map_view<8, bench_value_extent>::build_from_contiguous_bytes(map_bytes, true);
+        std::vector<std::byte> bytes;
+        if constexpr (BitsPerKey > 0) {
+            gnt::small_byte_map<8, bench_value_extent> owning;
+            owning.assign_sorted(map_bytes.data(), map_bytes.size());
+            gnt::to_filtered_range(owning, bytes, BitsPerKey);
+        }
+        auto view = BitsPerKey > 0 ? view_type::build_from_contiguous_bytes(bytes, true) : view_type(map, {});
+        std::mt19937_64 rng(17);
+        std::vector<std::byte> needles(1024 * 8);
+        for (std::size_t i = 0; i < 1024; ++i) {
+            if (i % 10 < 3) {
+                std::copy_n(map_bytes.data() + (rng() % n) * 8, 8, needles.data() + i * 8);
+            } else {
+                const auto k = rng();
+                std::memcpy(needles.data() + i * 8, &k, 8);
+            }
+        }
+        std::size_t i = 0;
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(view.contains(gnt::stride<std::byte, 8>(needles.data() + (i++ % 1024) * 8, 8)));
+        }
+        state.counters["fpr"] = view.filter().empty() ? 1.0 : view.filter().false_positive_rate();
+        state.counters["filter_bytes"] = static_cast<double>(view.filter().size_bytes());
+    }
+
+    // A find followed by a read of the value, with keys and values in separate ranges or interleaved as [key|value]
+    // records (see byte-map-layout.hpp), for a value that shares the key's cache line and for ones that do not.
+    template<size_t V, bool Interleaved>
+    void BM_LayoutFindValue(benchmark::State &state) {
+        using layout = std::conditional_t<Interleaved, gnt::interleaved_layout, gnt::separate_layout>;
+        using map_type = gnt::small_byte_map<8, V, std::byte, 128, 128, 128, gnt::binary_search_policy, layout>;
+        const auto n = static_cast<std::size_t>(state.range(0));
+        auto keys = make_sorted_entries<8>(n);
+        std::vector<std::byte> values(n * V);
+        for (std::size_t i = 0; i < values.size(); ++i) {
+            values[i] = std::byte(i & 0xFF);
+        }
+        map_type map;
+        map.assign_sorted(keys.data(), values.data(), n);
+        const auto probes = make_probes(n);
+        std::size_t i = 0;
+        for (auto _ : state) {
+            auto it = map.find(gnt::stride<std::byte, 8>(keys.data() + probes[i++ % probes.size()] * 8, 8));
+            std::uint64_t word;
+            std::memcpy(&word, it->second.data(), sizeof(word));
+            benchmark::DoNotOptimize(word);
+        }
+        state.counters["map_bytes"] = static_cast<double>(n * (8 + V));
+    }
+
+    // A lookup table of N scattered packed ids known at build time
+    template<size_t N>
+    constexpr std::array<gnt::static_byte_map_entry<8, bench_value_extent>, N> make_static_entries() {
+        std::array<gnt::static_byte_map_entry<8, bench_value_extent>, N> entries{};
+        for (std::size_t i = 0; i < N; ++i) {
+            entries[i] = {gnt::packed_bytes<8>((i + 1) * 0x9e3779b97f4a7c15ULL), gnt::packed_bytes<bench_value_extent>(i)};
+        }
+        return entries;
+    }
+
+    // Hits in that table: the small_byte_map filled at startup (Mode 0), the static_byte_map's perfect hash (Mode 1)
+    // and its sorted view (Mode 2).
+    template<size_t N, int Mode>
+    void BM_StaticFind(benchmark::State &state) {
+        static constexpr gnt::static_byte_map<8, bench_value_extent, N> table(make_static_entries<N>());
+        const auto entries = make_static_entries<N>();
+        gnt::small_byte_map<8, bench_value_extent> map;
+        for (const auto &e : entries) {
+            map.insert(std::make_pair(gnt::stride<std::byte, 8>(const_cast<std::byte *>(e.key.data()), 8),
+                                      gnt::stride<std::byte, bench_value_extent>(const_cast<std::byte *>(e.value.data()), bench_value_extent)));
+        }
+        const auto view = table.view();
+        const auto probes = make_probes(N);
+        std::size_t i = 0;
+        for (auto _ : state) {
+            const gnt::stride<const std::byte, 8> key(entries[probes[i++ % probes.size()]].key.data(), 8);
+            if constexpr (Mode == 0) {
+                benchmark::DoNotOptimize(map.find(gnt::stride<std::byte, 8>(const_cast<std::byte *>(key.data()), 8)));
+            } else if constexpr (Mode == 1) {
+                benchmark::DoNotOptimize(table.find(key));
+            } else {
+                benchmark::DoNotOptimize(view.find(key));
+            }
+        }
+        state.counters["table_bytes"] = static_cast<double>(sizeof(table));
+    }
+
+    // What the static table saves at startup: filling the same small_byte_map one insert at a time
+    template<size_t N>
+    void BM_StaticFillAtStartup(benchmark::State &state) {
+        const auto entries = make_static_entries<N>();
+        for (auto _ : state) {
+            gnt::small_byte_map<8, bench_value_extent> map;
+            for (const auto &e : entries) {
+                map.insert(std::make_pair(gnt::stride<std::byte, 8>(const_cast<std::byte *>(e.key.data()), 8),
+                                          gnt::stride<std::byte, bench_value_extent>(const_cast<std::byte *>(e.value.data()), bench_value_extent)));
+            }
+            benchmark::DoNotOptimize(map.size());
+        }
+    }
+
+    // Composite routing keys: one of 64 16 byte tenant ids followed by a variable length service path
+    std::vector<std::string> make_route_keys(std::size_t n) {
+        std::mt19937_64 rng(18);
+        std::vector<std::string> tenants(64);
+        for (auto &t : tenants) {
+            for (int b = 0; b < 16; ++b) {
+                t.push_back(static_cast<char>(rng() & 0xFF));
+            }
+        }
+        std::vector<std::string> keys;
+        keys.reserve(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            keys.push_back(tenants[i % tenants.size()] + "/service-" + std::to_string(rng() % 100000) + "/method-" + std::to_string(i));
+        }
+        return keys;
+    }
+
+    nonstd::span<const std::byte> route_span(const std::string &key) {
+        return {reinterpret_cast<const std::byte *>(key.data()), key.size()};
+    }
+
+    // Hits in random order, radix_byte_map against the std::map<std::string, ...> it replaces
+    template<bool Radix>
+    void BM_RouteFind(benchmark::State &state) {
+        const auto n = static_cast<std::size_t>(state.range(0));
+        const auto keys = make_route_keys(n);
+        std::vector<std::size_t> order(4096);
+        std::mt19937_64 rng(5);
+        for (auto &o : order) {
+            o = rng() % n;
+        }
+        gnt::radix_byte_map<std::uint32_t> radix;
+        std::map<std::string, std::uint32_t> tree;
+        for (std::size_t i = 0; i < n; ++i) {
+            if (Radix) {
+                radix.insert(route_span(keys[i]), static_cast<std::uint32_t>(i));
+            } else {
+                tree.emplace(keys[i], static_cast<std::uint32_t>(i));
+            }
+        }
+        std::size_t i = 0;
+        for (auto _ : state) {
+            const auto &key = keys[order[i++ & 4095]];
+            if (Radix) {
+                benchmark::DoNotOptimize(radix.find(route_span(key))->second);
+            } else {
+                benchmark::DoNotOptimize(tree.find(key)->second);
+            }
+        }
+    }
+
+    // Visits every route of one tenant: a prefix scan over 1/64 of the keys
+    template<bool Radix>
+    void BM_RoutePrefixScan(benchmark::State &state) {
+        const auto n = static_cast<std::size_t>(state.range(0));
+        const auto keys = make_route_keys(n);
+        gnt::radix_byte_map<std::uint32_t> radix;
+        std::map<std::string, std::uint32_t> tree;
+        for (std::size_t i = 0; i < n; ++i) {
+            if (Radix) {
+                radix.insert(route_span(keys[i]), static_cast<std::uint32_t>(i));
+            } else {
+                tree.emplace(keys[i], static_cast<std::uint32_t>(i));
+            }
+        }
+        std::size_t t = 0;
+        for (auto _ : state) {
+            const std::string tenant = keys[t++ % 64].substr(0, 16);
+            std::uint32_t sum = 0;
+            if (Radix) {
+                const auto range = radix.prefix_range(route_span(tenant));
+                for (auto it = range.first; it != range.second; ++it) {
+                    sum += it->second;
+                }
+            } else {
+                for (auto it = tree.lower_bound(tenant); it != tree.end() && it->first.compare(0, 16, tenant) == 0; ++it) {
+                    sum += it->second;
+                }
+            }
+            benchmark::DoNotOptimize(sum);
+        }
+    }
+
+    template<bool Radix>
+    void BM_RouteInsert(benchmark::State &state) {
+        const auto n = static_cast<std::size_t>(state.range(0));
+        const auto keys = make_route_keys(n);
+        for (auto _ : state) {
+            if (Radix) {
+                gnt::radix_byte_map<std::uint32_t> radix;
+                for (std::size_t i = 0; i < n; ++i) {
+                    radix.insert(route_span(keys[i]), static_cast<std::uint32_t>(i));
+                }
+                benchmark::DoNotOptimize(radix.size());
+            } else {
+                std::map<std::string, std::uint32_t> tree;
+                for (std::size_t i = 0; i < n; ++i) {
+                    tree.emplace(keys[i], static_cast<std::uint32_t>(i));
+                }
+                benchmark::DoNotOptimize(tree.size());
+            }
+        }
+    }
+
+    // One update cycle for readers in other actors: insert or replace one entry, then hand out a snapshot. A
+    // small_byte_map snapshot is a whole copy, a persistent_byte_map one shares all but the updated path.
+    template<bool Persistent>
+    void BM_SnapshotUpdate(benchmark::State &state) {
+        const auto n = static_cast<std::size_t>(state.range(0));
+        std::mt19937_64 rng(19);
+        std::vector<std::byte> keys(n * 8), values(n * bench_value_extent);
+        for (std::size_t i = 0; i < n; ++i) {
+            auto key = gnt::packed_bytes<8>(i * 2);
+            std::copy(key.begin(), key.end(), keys.begin() + i * 8);
+        }
+        gnt::small_byte_map<8, bench_value_extent> small;
+        small.assign_sorted(keys.data(), values.data(), n);
+        gnt::persistent_byte_map<8, bench_value_extent> persistent(small);
+        std::array<std::byte, bench_value_extent> value{};
+        for (auto _ : state) {
+            const auto key = gnt::packed_bytes<8>(rng() % (2 * n));
+            if (Persistent) {
+                persistent.insert_or_assign(gnt::persistent_byte_map<8, bench_value_extent>::key_stride(key.data(), 8),
+                                            gnt::persistent_byte_map<8, bench_value_extent>::value_stride(value.data(), bench_value_extent));
+                auto snapshot = persistent;
+                benchmark::DoNotOptimize(snapshot.size());
+            } else {
+                small.insert_or_assign(gnt::stride<std::byte, 8>(const_cast<std::byte *>(key.data()), 8),
+                                       gnt::stride<std::byte, bench_value_extent>(value.data(), bench_value_extent));
+                auto snapshot = small;
+                benchmark::DoNotOptimize(snapshot.size());
+            }
+        }
+    }
+
+    template<bool Persistent>
+    void BM_SnapshotFind(benchmark::State &state) {
+        const auto n = static_cast<std::size_t>(state.range(0));
+        std::vector<std::byte> keys(n * 8), values(n * bench_value_extent);
+        for (std::size_t i = 0; i < n; ++i) {
+            auto key = gnt::packed_bytes<8>(i * 2);
+            std::copy(key.begin(), key.end(), keys.begin() + i * 8);
+        }
+        gnt::small_byte_map<8, bench_value_extent> small;
+        small.assign_sorted(keys.data(), values.data(), n);
+        const gnt::persistent_byte_map<8, bench_value_extent> persistent(small);
+        std::mt19937_64 rng(7);
+        std::vector<std::array<std::byte, 8>> needles(4096);
+        for (auto &needle : needles) {
+            needle = gnt::packed_bytes<8>((rng() % n) * 2);
+        }
+        std::size_t i = 0;
+        for (auto _ : state) {
+            auto &needle = needles[i++ & 4095];
+            if (Persistent) {
+                benchmark::DoNotOptimize(persistent.find(gnt::persistent_byte_map<8, bench_value_extent>::key_stride(needle.data(), 8)));
+            } else {
+                benchmark::DoNotOptimize(small.find(gnt::stride<std::byte, 8>(needle.data(), 8)));
+            }
+        }
+    }
+
+    // A shared index under a mixed load, 90% lookups and 10% insert_or_assigns over 64k keys, from 1 to 64 threads:
+    // one small_byte_map behind a global std::mutex, as now, against sharded_byte_map. Items per second is the
+    // total over all threads.
+    template<bool Sharded>
+    void BM_ConcurrentMixed(benchmark::State &state) {
+        constexpr std::size_t n = 1 << 16;
+        using sharded_map = gnt::sharded_byte_map<8, bench_value_extent, std::byte, 64>;
+        static std::mutex global_mutex;
+        static std::unique_ptr<gnt::small_byte_map<8, bench_value_extent>> global_map;
+        static std::unique_ptr<sharded_map> sharded;
+        if (state.thread_index() == 0) {
+            std::vector<std::byte> keys(n * 8), values(n * bench_value_extent);
+            for (std::size_t i = 0; i < n; ++i) {
+                auto key = gnt::packed_bytes<8>(i);
+                std::copy(key.begin(), key.end(), keys.begin() + i * 8);
+            }
+            if (Sharded) {
+                sharded = std::make_unique<sharded_map>();
+                sharded->insert_bulk(keys.data(), values.data(), n);
+            } else {
+                global_map = std::make_unique<gnt::small_byte_map<8, bench_value_extent>>();
+                global_map->assign_sorted(keys.data(), values.data(), n);
+            }
+        }
+        std::mt19937_64 rng(state.thread_index());
+        std::array<std::byte, bench_value_extent> value{};
+        for (auto _ : state) {
+            auto key = gnt::packed_bytes<8>(rng() % n);
+            const gnt::stride<std::byte, 8> key_stride(key.data(), 8);
+            const bool write = rng() % 10 == 0;
+            if (Sharded) {
+                if (write) {
+                    sharded->insert_or_assign(key_stride, gnt::stride<std::byte, bench_value_extent>(value.data(), bench_value_extent));
+                } else {
+                    sharded->visit(key_stride, [](nonstd::span<const std::byte, bench_value_extent> found) { benchmark::DoNotOptimize(found[0]); });
+                }
+            } else {
+                std::lock_guard<std::mutex> lock(global_mutex);
+                if (write) {
+                    global_map->insert_or_assign(key_stride, gnt::stride<std::byte, bench_value_extent>(value.data(), bench_value_extent));
+                } else {
+                    benchmark::DoNotOptimize(global_map->find(key_stride)->second[0]);
+                }
+            }
+        }
+        state.SetItemsProcessed(state.iterations());
+        if (state.thread_index() == 0) {
+            sharded.reset();
+            global_map.reset();
+        }
+    }
+
+    // Sorting the key and value regions, as force_linear_mode does when a map leaves linear mode.
+    template<size_t K, bool Radix>
+    void BM_SortStrides(benchmark::State &state) {
+        const auto n = static_cast<std::size_t>(state.range(0));
+        std::mt19937_64 rng(3);
+        std::vector<std::byte> unsorted(n * (K + bench_value_extent));
+        for (auto &b : unsorted) {
+            b = std::byte(rng() & 0xFF);
+        }
+        std::vector<std::byte> bytes(unsorted.size());
+        for (auto _ : state) {
+            state.PauseTiming();
+            std::copy(unsorted.begin(), unsorted.end(), bytes.begin());
+            state.ResumeTiming();
+            if constexpr (Radix) {
+                gnt::radix_sort_strides<K, bench_value_extent>(bytes.data(), bytes.data() + n * K, n);
+            } else {
+                gnt::comparison_sort_strides<K, bench_value_extent>(bytes.data(), bytes.data() + n * K, n);
+            }
+            benchmark::ClobberMemory();
+        }
+        state.SetItemsProcessed(state.iterations() * n);
+    }
+
+    // Loading n random entries into an empty map: one insert at a time against a single insert_bulk.
+    template<bool Bulk>
+    void BM_LoadMap(benchmark::State &state) {
+        const auto n = static_cast<std::size_t>(state.range(0));
+        std::mt19937_64 rng(9);
+        std::vector<std::byte> keys(n * 8), values(n * bench_value_extent);
+        for (auto &b : keys) {
+            b = std::byte(rng() & 0xFF);
+        }
+        using map_type = gnt::small_byte_map<8, bench_value_extent>;
+        for (auto _ : state) {
+            map_type smap;
+            if constexpr (Bulk) {
+                smap.insert_bulk(keys.data(), values.data(), n);
+            } else {
+                for (std::size_t i = 0; i < n; ++i) {
+                    smap.insert(std::make_pair(map_type::key_stride(keys.data() + i * 8, 8),
+                                               map_type::value_stride(values.data() + i * bench_value_extent, bench_value_extent)));
+                }
+            }
+            benchmark::DoNotOptimize(smap.size());
+        }
+        state.SetItemsProcessed(state.iterations() * n);
+    }
+
+    // Random single inserts into a sorted map of n entries, with and without a write buffer.
+    template<std::size_t WriteBuffer>
+    void BM_SortedInsert(benchmark::State &state) {
+        const auto n = static_cast<std::size_t>(state.range(0));
+        std::mt19937_64 rng(13);
+        std::vector<std::byte> keys(n * 8), values(n * bench_value_extent);
+        for (auto &b : keys) {
+            b = std::byte(rng() & 0xFF);
+        }
+        using map_type = gnt::small_byte_map<8, bench_value_extent>;
+        map_type smap;
+        smap.insert_bulk(keys.data(), values.data(), n);
+        smap.set_write_buffer(WriteBuffer);
+        std::byte key[8], value[bench_value_extent] = {};
+        for (auto _ : state) {
+            const auto k = rng();
+            std::memcpy(key, &k, sizeof(k));
+            smap.insert(std::make_pair(map_type::key_stride(key, 8), map_type::value_stride(value, bench_value_extent)));
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+
+}
+
+BENCHMARK_TEMPLATE(BM_LinearFind, 4)->RangeMultiplier(2)->Range(4, 1024);
+BENCHMARK_TEMPLATE(BM_BinaryFind, 4)->RangeMultiplier(2)->Range(4, 1024);
+BENCHMARK_TEMPLATE(BM_LinearFind, 8)->RangeMultiplier(2)->Range(4, 1024);
+BENCHMARK_TEMPLATE(BM_BinaryFind, 8)->RangeMultiplier(2)->Range(4, 1024);
+BENCHMARK_TEMPLATE(BM_ScalarLinearFind, 8)->RangeMultiplier(2)->Range(4, 1024);
+BENCHMARK_TEMPLATE(BM_LinearFind, 16)->RangeMultiplier(2)->Range(4, 1024);
+BENCHMARK_TEMPLATE(BM_BinaryFind, 16)->RangeMultiplier(2)->Range(4, 1024);
+BENCHMARK_TEMPLATE(BM_ScalarLinearFind, 16)->RangeMultiplier(2)->Range(4, 1024);
+BENCHMARK_TEMPLATE(BM_LinearFind, 32)->RangeMultiplier(2)->Range(4, 1024);
+BENCHMARK_TEMPLATE(BM_BinaryFind, 32)->RangeMultiplier(2)->Range(4, 1024);
+
+BENCHMARK_TEMPLATE(BM_SortedFindScaling, 8)->RangeMultiplier(10)->Range(10000, 1000000)->Complexity(benchmark::oLogN);
+BENCHMARK_TEMPLATE(BM_SortedFindScaling, 16)->RangeMultiplier(10)->Range(10000, 1000000)->Complexity(benchmark::oLogN);
+
+BENCHMARK_TEMPLATE(BM_LayoutFind, 8, false)->RangeMultiplier(8)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(BM_LayoutFind, 8, true)->RangeMultiplier(8)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(BM_LayoutFind, 16, false)->RangeMultiplier(8)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(BM_LayoutFind, 16, true)->RangeMultiplier(8)->Range(1 << 10, 1 << 22);
+
+BENCHMARK_TEMPLATE(BM_HashIndexFind, 8)->RangeMultiplier(8)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(BM_HashIndexFind, 16)->RangeMultiplier(8)->Range(1 << 10, 1 << 22);
+
+BENCHMARK_TEMPLATE(BM_FindMany, 0)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(BM_FindMany, 1)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(BM_FindMany, 2)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+
+BENCHMARK_TEMPLATE(BM_Join, false)->RangeMultiplier(16)->Range(16, 1 << 20);
+BENCHMARK_TEMPLATE(BM_Join, true)->RangeMultiplier(16)->Range(16, 1 << 20);
+
+BENCHMARK_TEMPLATE(BM_FrontCodedFind, 0)->RangeMultiplier(16)->Range(1 << 12, 1 << 20);
+BENCHMARK_TEMPLATE(BM_FrontCodedFind, 8)->RangeMultiplier(16)->Range(1 << 12, 1 << 20);
+BENCHMARK_TEMPLATE(BM_FrontCodedFind, 16)->RangeMultiplier(16)->Range(1 << 12, 1 << 20);
+BENCHMARK_TEMPLATE(BM_FrontCodedFind, 32)->RangeMultiplier(16)->Range(1 << 12, 1 << 20);
+
+BENCHMARK_TEMPLATE(BM_SearchPolicy, uniform_keys, std_search_policy)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(BM_SearchPolicy, uniform_keys, gnt::binary_search_policy)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(BM_SearchPolicy, uniform_keys, gnt::interpolation_search_policy<>)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(BM_SearchPolicy, zipf_keys, std_search_policy)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(BM_SearchPolicy, zipf_keys, gnt::binary_search_policy)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(BM_SearchPolicy, zipf_keys, gnt::interpolation_search_policy<>)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(BM_SearchPolicy, clustered_keys, std_search_policy)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(BM_SearchPolicy, clustered_keys, gnt::binary_search_policy)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(BM_SearchPolicy, clustered_keys, gnt::interpolation_search_policy<>)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+
+BENCHMARK_TEMPLATE(BM_FilteredContains, 0)->RangeMultiplier(16)->Range(1 << 12, 1 << 22);
+BENCHMARK_TEMPLATE(BM_FilteredContains, 6)->RangeMultiplier(16)->Range(1 << 12, 1 << 22);
+BENCHMARK_TEMPLATE(BM_FilteredContains, 10)->RangeMultiplier(16)->Range(1 << 12, 1 << 22);
+BENCHMARK_TEMPLATE(BM_FilteredContains, 16)->RangeMultiplier(16)->Range(1 << 12, 1 << 22);
+
+BENCHMARK_TEMPLATE(BM_LayoutFindValue, 8, false)->RangeMultiplier(16)->Range(16, 1 << 20);
+BENCHMARK_TEMPLATE(BM_LayoutFindValue, 8, true)->RangeMultiplier(16)->Range(16, 1 << 20);
+BENCHMARK_TEMPLATE(BM_LayoutFindValue, 64, false)->RangeMultiplier(16)->Range(16, 1 << 20);
+BENCHMARK_TEMPLATE(BM_LayoutFindValue, 64, true)->RangeMultiplier(16)->Range(16, 1 << 20);
+BENCHMARK_TEMPLATE(BM_LayoutFindValue, 256, false)->RangeMultiplier(16)->Range(16, 1 << 18);
+BENCHMARK_TEMPLATE(BM_LayoutFindValue, 256, true)->RangeMultiplier(16)->Range(16, 1 << 18);
+
+BENCHMARK_TEMPLATE(BM_StaticFind, 16, 0);
+BENCHMARK_TEMPLATE(BM_StaticFind, 16, 1);
+BENCHMARK_TEMPLATE(BM_StaticFind, 16, 2);
+BENCHMARK_TEMPLATE(BM_StaticFind, 256, 0);
+BENCHMARK_TEMPLATE(BM_StaticFind, 256, 1);
+BENCHMARK_TEMPLATE(BM_StaticFind, 256, 2);
+BENCHMARK_TEMPLATE(BM_StaticFind, 4096, 0);
+BENCHMARK_TEMPLATE(BM_StaticFind, 4096, 1);
+BENCHMARK_TEMPLATE(BM_StaticFind, 4096, 2);
+BENCHMARK_TEMPLATE(BM_StaticFillAtStartup, 16)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_StaticFillAtStartup, 256)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_StaticFillAtStartup, 4096)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_TEMPLATE(BM_RouteFind, false)->RangeMultiplier(16)->Range(256, 1 << 20);
+BENCHMARK_TEMPLATE(BM_RouteFind, true)->RangeMultiplier(16)->Range(256, 1 << 20);
+BENCHMARK_TEMPLATE(BM_RoutePrefixScan, false)->RangeMultiplier(16)->Range(1 << 12, 1 << 20)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_RoutePrefixScan, true)->RangeMultiplier(16)->Range(1 << 12, 1 << 20)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_RouteInsert, false)->RangeMultiplier(16)->Range(256, 1 << 20)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_RouteInsert, true)->RangeMultiplier(16)->Range(256, 1 << 20)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_TEMPLATE(BM_SnapshotUpdate, false)->RangeMultiplier(16)->Range(1 << 10, 1 << 20)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_SnapshotUpdate, true)->RangeMultiplier(16)->Range(1 << 10, 1 << 20)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_SnapshotFind, false)->RangeMultiplier(16)->Range(1 << 10, 1 << 20);
+BENCHMARK_TEMPLATE(BM_SnapshotFind, true)->RangeMultiplier(16)->Range(1 << 10, 1 << 20);
+
+BENCHMARK_TEMPLATE(BM_ConcurrentMixed, false)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_ConcurrentMixed, true)->ThreadRange(1, 64)->UseRealTime();
+
+BENCHMARK_TEMPLATE(BM_SortStrides, 8, false)->RangeMultiplier(8)->Range(64, 1 << 19)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_SortStrides, 8, true)->RangeMultiplier(8)->Range(64, 1 << 19)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_SortStrides, 16, false)->RangeMultiplier(8)->Range(64, 1 << 19)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_SortStrides, 16, true)->RangeMultiplier(8)->Range(64, 1 << 19)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_TEMPLATE(BM_LoadMap, false)->RangeMultiplier(4)->Range(1 << 10, 1 << 14)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_LoadMap, true)->RangeMultiplier(4)->Range(1 << 10, 1 << 20)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_TEMPLATE(BM_SortedInsert, 0)->RangeMultiplier(10)->Range(1000, 1000000);
+BENCHMARK_TEMPLATE(BM_SortedInsert, 256)->RangeMultiplier(10)->Range(1000, 1000000);
+BENCHMARK_TEMPLATE(BM_SortedInsert, 4096)->RangeMultiplier(10)->Range(1000, 1000000);
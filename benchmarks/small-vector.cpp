@@ -0,0 +1,231 @@
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+
+#include "common/small-vector.hpp"
+#include "common/stack-vector.hpp"
+#include "common/record.hpp"
+
+// small_vector against std::vector. The small sizes stay in small_vector's inline storage (17 uint64_t's by default),
+// where it should win by not allocating; past that both are one heap buffer and should be level.
+
+namespace {
+
+    using std_vector = std::vector<std::uint64_t>;
+    using small_vector = gnt::small_vector<std::uint64_t>;
+
+    struct pod32 {
+        std::uint64_t words[4];
+    };
+
+    // Owns its value through a pointer, so it is only relocated by memmove once it opts in (relocatable_box below)
+    template<bool Relocatable>
+    struct box {
+        std::unique_ptr<std::uint64_t> value;
+
+        box(std::uint64_t v) : value(std::make_unique<std::uint64_t>(v)) {}
+    };
+
+    using plain_box = box<false>;
+    using relocatable_box = box<true>;
+
+    template<typename T>
+    T make_element(std::uint64_t i) {
+        if constexpr (std::is_same_v<T, pod32>) {
+            return pod32{{i, i, i, i}};
+        } else if constexpr (std::is_same_v<T, std::byte>) {
+            return std::byte(i & 0xFF);
+        } else {
+            return T(i);
+        }
+    }
+
+    // Builds a fresh vector of n elements with push_back each iteration, so small sizes include the allocation
+    template<typename Vec>
+    void BM_VectorPushBack(benchmark::State &state) {
+        const auto n = static_cast<std::uint64_t>(state.range(0));
+        for (auto _ : state) {
+            Vec vec;
+            for (std::uint64_t i = 0; i < n; ++i) {
+                vec.push_back(i);
+            }
+            benchmark::DoNotOptimize(vec.data());
+            benchmark::ClobberMemory();
+        }
+        state.SetItemsProcessed(state.iterations() * n);
+    }
+
+    // Builds a fresh vector of n elements by inserting each one in the middle, which moves half the tail every time
+    template<typename Vec>
+    void BM_VectorInsertMiddle(benchmark::State &state) {
+        const auto n = static_cast<std::uint64_t>(state.range(0));
+        for (auto _ : state) {
+            Vec vec;
+            for (std::uint64_t i = 0; i < n; ++i) {
+                vec.insert(vec.begin() + vec.size() / 2, i);
+            }
+            benchmark::DoNotOptimize(vec.data());
+            benchmark::ClobberMemory();
+        }
+        state.SetItemsProcessed(state.iterations() * n);
+    }
+
+    // Sums n elements through begin()/end()
+    template<typename Vec>
+    void BM_VectorIterate(benchmark::State &state) {
+        const auto n = static_cast<std::uint64_t>(state.range(0));
+        Vec vec;
+        for (std::uint64_t i = 0; i < n; ++i) {
+            vec.push_back(i);
+        }
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(vec.data());
+            benchmark::DoNotOptimize(std::accumulate(vec.begin(), vec.end(), std::uint64_t(0)));
+        }
+        state.SetItemsProcessed(state.iterations() * n);
+    }
+
+    // Grows a fresh small_vector<T> to n elements, through the switch from inline to heap storage and every doubling
+    template<typename T>
+    void BM_RelocateGrow(benchmark::State &state) {
+        const auto n = static_cast<std::uint64_t>(state.range(0));
+        for (auto _ : state) {
+            gnt::small_vector<T, 16> vec;
+            for (std::uint64_t i = 0; i < n; ++i) {
+                vec.emplace_back(make_element<T>(i));
+            }
+            benchmark::DoNotOptimize(vec.data());
+            benchmark::ClobberMemory();
+        }
+        state.SetItemsProcessed(state.iterations() * n);
+    }
+
+    // Inserts at the front of a small_vector<T> of n elements and erases it again, moving the whole tail both ways
+    template<typename T>
+    void BM_RelocateInsertErase(benchmark::State &state) {
+        const auto n = static_cast<std::uint64_t>(state.range(0));
+        gnt::small_vector<T, 16> vec;
+        for (std::uint64_t i = 0; i < n; ++i) {
+            vec.emplace_back(make_element<T>(i));
+        }
+        for (auto _ : state) {
+            vec.emplace(vec.begin(), make_element<T>(n));
+            vec.erase(vec.begin());
+            benchmark::DoNotOptimize(vec.data());
+        }
+        state.SetItemsProcessed(state.iterations() * n);
+    }
+
+    // As above, in a stack_vector<T, 64> holding 48 elements
+    template<typename T>
+    void BM_StackRelocateInsertErase(benchmark::State &state) {
+        gnt::stack_vector<T, 64> vec;
+        for (std::uint64_t i = 0; i < 48; ++i) {
+            vec.emplace_back(make_element<T>(i));
+        }
+        for (auto _ : state) {
+            vec.emplace(vec.begin(), make_element<T>(48));
+            vec.erase(vec.begin());
+            benchmark::DoNotOptimize(vec.data());
+        }
+    }
+
+    // One message's worth of serialisation: eight single-field records of range(0) bytes made with make_vector, each
+    // spilling past its inline storage. With Arena they spill into a monotonic arena over a per-thread buffer, released
+    // in one go at the end of the message, instead of going through the global heap.
+    template<bool Arena>
+    void BM_MessageSpill(benchmark::State &state) {
+        const auto n = static_cast<std::size_t>(state.range(0));
+        thread_local std::vector<std::byte> arena_buffer(64 * 1024);
+        std::vector<std::byte> payload(n, std::byte(0x2A));
+        const gnt::record_view<1> record{nonstd::span<std::byte>(payload.data(), payload.size())};
+        for (auto _ : state) {
+            std::pmr::monotonic_buffer_resource arena(arena_buffer.data(), arena_buffer.size());
+            std::pmr::memory_resource *resource = Arena ? static_cast<std::pmr::memory_resource *>(&arena) : std::pmr::new_delete_resource();
+            for (int field = 0; field < 8; ++field) {
+                auto bytes = gnt::make_vector(record, std::pmr::polymorphic_allocator<std::byte>(resource));
+                benchmark::DoNotOptimize(bytes.data());
+            }
+            benchmark::ClobberMemory();
+        }
+        state.SetItemsProcessed(state.iterations() * 8);
+    }
+
+    // Per-connection state: a long-lived vector that bursts to range(0) elements and drains back to 4, over and over.
+    // Reports the bytes still held between bursts alongside the time a burst costs.
+    template<typename GrowthPolicy>
+    void BM_BurstyState(benchmark::State &state) {
+        const auto n = static_cast<std::uint64_t>(state.range(0));
+        gnt::small_vector<std::uint64_t, 8, std::allocator<std::uint64_t>, GrowthPolicy> vec;
+        for (auto _ : state) {
+            for (std::uint64_t i = 0; i < n; ++i) {
+                vec.push_back(i);
+            }
+            while (vec.size() > 4) {
+                vec.pop_back();
+            }
+            benchmark::DoNotOptimize(vec.data());
+        }
+        state.counters["held_bytes"] = static_cast<double>(vec.capacity() * sizeof(std::uint64_t));
+        state.SetItemsProcessed(state.iterations() * n);
+    }
+
+    // Creates a stack_vector of strings per iteration and puts range(0) short strings in it, as a per message buffer would
+    template<size_t Extent>
+    void BM_StackVectorOfStrings(benchmark::State &state) {
+        const auto n = static_cast<std::size_t>(state.range(0));
+        for (auto _ : state) {
+            gnt::stack_vector<std::string, Extent> vec;
+            for (std::size_t i = 0; i < n; ++i) {
+                vec.emplace_back("key");
+            }
+            benchmark::DoNotOptimize(vec.data());
+            benchmark::ClobberMemory();
+        }
+    }
+
+}
+
+namespace gnt {
+    template<>
+    struct is_trivially_relocatable<relocatable_box> : std::true_type {};
+}
+
+BENCHMARK_TEMPLATE(BM_VectorPushBack, std_vector)->RangeMultiplier(4)->Range(4, 1 << 16);
+BENCHMARK_TEMPLATE(BM_VectorPushBack, small_vector)->RangeMultiplier(4)->Range(4, 1 << 16);
+
+BENCHMARK_TEMPLATE(BM_VectorInsertMiddle, std_vector)->RangeMultiplier(4)->Range(4, 1 << 12);
+BENCHMARK_TEMPLATE(BM_VectorInsertMiddle, small_vector)->RangeMultiplier(4)->Range(4, 1 << 12);
+
+BENCHMARK_TEMPLATE(BM_VectorIterate, std_vector)->RangeMultiplier(4)->Range(4, 1 << 16);
+BENCHMARK_TEMPLATE(BM_VectorIterate, small_vector)->RangeMultiplier(4)->Range(4, 1 << 16);
+
+BENCHMARK_TEMPLATE(BM_StackVectorOfStrings, 32)->Arg(0)->Arg(2)->Arg(32);
+
+BENCHMARK_TEMPLATE(BM_RelocateGrow, std::byte)->RangeMultiplier(16)->Range(64, 1 << 16);
+BENCHMARK_TEMPLATE(BM_RelocateGrow, std::uint64_t)->RangeMultiplier(16)->Range(64, 1 << 16);
+BENCHMARK_TEMPLATE(BM_RelocateGrow, pod32)->RangeMultiplier(16)->Range(64, 1 << 16);
+BENCHMARK_TEMPLATE(BM_RelocateGrow, plain_box)->RangeMultiplier(16)->Range(64, 1 << 16);
+BENCHMARK_TEMPLATE(BM_RelocateGrow, relocatable_box)->RangeMultiplier(16)->Range(64, 1 << 16);
+BENCHMARK_TEMPLATE(BM_RelocateInsertErase, std::byte)->RangeMultiplier(16)->Range(64, 1 << 16);
+BENCHMARK_TEMPLATE(BM_RelocateInsertErase, std::uint64_t)->RangeMultiplier(16)->Range(64, 1 << 16);
+BENCHMARK_TEMPLATE(BM_RelocateInsertErase, pod32)->RangeMultiplier(16)->Range(64, 1 << 16);
+BENCHMARK_TEMPLATE(BM_RelocateInsertErase, plain_box)->RangeMultiplier(16)->Range(64, 1 << 16);
+BENCHMARK_TEMPLATE(BM_RelocateInsertErase, relocatable_box)->RangeMultiplier(16)->Range(64, 1 << 16);
+BENCHMARK_TEMPLATE(BM_StackRelocateInsertErase, std::byte);
+BENCHMARK_TEMPLATE(BM_StackRelocateInsertErase, std::uint64_t);
+BENCHMARK_TEMPLATE(BM_StackRelocateInsertErase, pod32);
+BENCHMARK_TEMPLATE(BM_StackRelocateInsertErase, plain_box);
+BENCHMARK_TEMPLATE(BM_StackRelocateInsertErase, relocatable_box);
+
+BENCHMARK_TEMPLATE(BM_MessageSpill, false)->Arg(256)->Arg(1024)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_MessageSpill, true)->Arg(256)->Arg(1024)->ThreadRange(1, 8)->UseRealTime();
+
+BENCHMARK_TEMPLATE(BM_BurstyState, gnt::default_growth_policy)->RangeMultiplier(16)->Range(64, 1 << 16);
+BENCHMARK_TEMPLATE(BM_BurstyState, gnt::bursty_growth_policy)->RangeMultiplier(16)->Range(64, 1 << 16);
@@ -0,0 +1,205 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "small-byte-map.hpp"
+#include "stride-compare.hpp"
+#include "stride-hash.hpp"
+
+namespace gnt {
+
+    // Open addressing hash index over a contiguous array of K byte keys that it does not own (e.g. the key range of a
+    // small_byte_map_view). Each slot is a 32 bit fingerprint (the high hash bits) and the key's position, so a lookup
+    // is one hash, usually one cache line of slots, and one key compare to confirm: O(1) expected instead of the log n
+    // cache misses of a binary search. Linear probing at a load factor of at most 3/4, 8 bytes per slot.
+    // Equal keys (multimaps) are indexed by their first position, which in sorted mode is the first of the run.
+    template<size_t K_Extent>
+    class stride_hash_index {
+
+    public:
+
+        stride_hash_index() = default;
+
+        stride_hash_index(const void *keys, std::size_t num_keys) {
+            if (num_keys >= empty_position) {
+                throw std::length_error("stride_hash_index supports up to 2^32 - 1 keys"); //Fixme: 64 bit positions
+            }
+            std::size_t capacity = 8;
+            while (capacity * 3 < num_keys * 4) {
+                capacity *= 2;
+            }
+            _slots.assign(capacity, slot{0, empty_position});
+            _mask = capacity - 1;
+            const auto *bytes = static_cast<const unsigned char *>(keys);
+            for (std::size_t i = 0; i < num_keys; ++i) {
+                const std::uint64_t h = hash_stride<K_Extent>(bytes + i * K_Extent);
+                const auto fingerprint = static_cast<std::uint32_t>(h >> 32);
+                for (std::size_t s = h & _mask;; s = (s + 1) & _mask) {
+                    if (_slots[s].position == empty_position) {
+                        _slots[s] = slot{fingerprint, static_cast<std::uint32_t>(i)};
+                        ++_size;
+                        break;
+                    }
+                    if (_slots[s].fingerprint == fingerprint && equal_strides<K_Extent>(bytes + _slots[s].position * K_Extent, bytes + i * K_Extent)) {
+                        break; // A repeat of an earlier key, which keeps the slot
+                    }
+                }
+            }
+        }
+
+        // Position of needle in keys (the same array the index was built over), or num_keys if it is not there.
+        std::size_t find(const void *keys, std::size_t num_keys, const void *needle) const noexcept {
+            if (_slots.empty()) {
+                return num_keys;
+            }
+            const auto *bytes = static_cast<const unsigned char *>(keys);
+            const std::uint64_t h = hash_stride<K_Extent>(needle);
+            const auto fingerprint = static_cast<std::uint32_t>(h >> 32);
+            for (std::size_t s = h & _mask;; s = (s + 1) & _mask) {
+                const slot candidate = _slots[s];
+                if (candidate.position == empty_position) {
+                    return num_keys;
+                }
+                if (candidate.fingerprint == fingerprint && equal_strides<K_Extent>(bytes + candidate.position * K_Extent, needle)) {
+                    return candidate.position;
+                }
+            }
+        }
+
+        // Number of distinct keys indexed
+        std::size_t size() const noexcept {
+            return _size;
+        }
+
+        std::size_t capacity() const noexcept {
+            return _slots.size();
+        }
+
+        std::size_t memory_bytes() const noexcept {
+            return _slots.size() * sizeof(slot);
+        }
+
+    private:
+
+        struct slot {
+            std::uint32_t fingerprint;
+            std::uint32_t position;
+        };
+
+        constexpr static std::uint32_t empty_position = 0xFFFFFFFF;
+
+        std::vector<slot> _slots;
+        std::size_t _mask = 0;
+        std::size_t _size = 0;
+
+    };
+
+    // A small_byte_map_view with a hash index for point lookups, built lazily on the first lookup (or by index()).
+    // The keys keep their layout, so iteration, range scans and serialisation are those of the underlying view. Maps
+    // up to LinearExtent are searched as before, since a SIMD scan of that few keys beats hashing.
+    // The index is shared between copies of the view. Like the view it assumes the bytes underneath don't change: call
+    // reindex() if they do. Building is not synchronised, so call index() before sharing a view between threads.
+    template<size_t K_Extent = 1, size_t V_Extent = 1, typename byte_type = std::byte, size_t LinearExtent = 128>
+    class hash_indexed_byte_map_view : public small_byte_map_view<K_Extent, V_Extent, byte_type, LinearExtent> {
+
+    public:
+
+        using super = small_byte_map_view<K_Extent, V_Extent, byte_type, LinearExtent>;
+        using iterator = typename super::iterator;
+        using const_iterator = typename super::const_iterator;
+        using size_type = typename super::size_type;
+        using key_stride = typename super::key_stride;
+        using value_stride = typename super::value_stride;
+
+        static auto build_from_contiguous_bytes(byte_type *data, size_type size_bytes, bool sorted_hint = false) {
+            return hash_indexed_byte_map_view(super::build_from_contiguous_bytes(data, size_bytes, sorted_hint));
+        }
+
+        template<template<typename, typename> typename C, typename Alloc>
+        static auto build_from_contiguous_bytes(C<byte_type, Alloc> &cont, bool sorted_hint = false) {
+            return build_from_contiguous_bytes(cont.data(), cont.size(), sorted_hint);
+        }
+
+        hash_indexed_byte_map_view() = default;
+
+        explicit hash_indexed_byte_map_view(const super &view) : super(view) {}
+
+        const stride_hash_index<K_Extent> &index() const {
+            if (!_index) {
+                _index = std::make_shared<const stride_hash_index<K_Extent>>(keys_data(), this->size());
+            }
+            return *_index;
+        }
+
+        bool indexed() const noexcept {
+            return static_cast<bool>(_index);
+        }
+
+        // Drops the index so that the next lookup rebuilds it
+        void reindex() noexcept {
+            _index.reset();
+        }
+
+        iterator find(const key_stride &key) {
+            if (!use_index()) {
+                return super::find(key);
+            }
+            const size_type pos = index().find(keys_data(), this->size(), key.data());
+            return pos == this->size() ? this->end() : this->begin() + pos;
+        }
+
+        const_iterator find(const key_stride &key) const {
+            if (!use_index()) {
+                return super::find(key);
+            }
+            const size_type pos = index().find(keys_data(), this->size(), key.data());
+            return pos == this->size() ? this->end() : this->begin() + pos;
+        }
+
+        bool contains(const key_stride &key) const {
+            if (!use_index()) {
+                return super::contains(key);
+            }
+            return index().find(keys_data(), this->size(), key.data()) != this->size();
+        }
+
+        size_type count(const key_stride &key) const {
+            if (!use_index() || this->linear_mode()) { // Equal keys are only adjacent in sorted mode
+                return super::count(key);
+            }
+            const size_type n = this->size();
+            const auto *keys = keys_data();
+            size_type pos = index().find(keys, n, key.data()), count = 0;
+            for (; pos < n && equal_strides<K_Extent>(keys + pos * K_Extent, key.data()); ++pos) {
+                ++count;
+            }
+            return count;
+        }
+
+        value_stride at(const key_stride &key) const {
+            auto it = find(key);
+            if (it == this->end()) {
+                throw std::out_of_range("key is not in hash_indexed_byte_map_view");
+            }
+            return value_stride(const_cast<byte_type *>(it->second.data()), V_Extent);
+        }
+
+    private:
+
+        bool use_index() const noexcept {
+            return this->size() > LinearExtent;
+        }
+
+        const byte_type *keys_data() const noexcept {
+            return this->empty() ? nullptr : this->begin()->first.data();
+        }
+
+        mutable std::shared_ptr<const stride_hash_index<K_Extent>> _index;
+
+    };
+
+} //ns gnt
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+namespace gnt {
+
+    // Layout policies pick how the entries of a small_byte_map (and the bytes a small_byte_map_view is built over) are
+    // stored. Both are addressed the same way: entry i has its key at keys + i * key_pitch and its value at
+    // values + i * value_pitch, so the searches only need to know the pitch.
+    //
+    // separate_layout keeps every key in one contiguous range followed by every value: lookups touch only key bytes,
+    // so more keys share a cache line, and linear searches over 4 to 32 byte keys are vectorised.
+    // interleaved_layout keeps [key|value] records side by side, so a view can be built straight over bytes that are
+    // already records (fixed width rows from elsewhere) without transposing them, a hit's value is next to its key,
+    // and inserts and erases move one range instead of two. Lookups pay for it: fewer keys per cache line for the
+    // last steps of a binary search, and scalar linear searches. BM_LayoutFindValue measures find plus a value read
+    // for both, at small and large V_Extent.
+
+    struct separate_layout {
+
+        constexpr const static bool interleaved = false;
+
+        template<size_t K, size_t V>
+        constexpr const static std::size_t key_pitch = K;
+
+        template<size_t K, size_t V>
+        constexpr const static std::size_t value_pitch = V;
+
+        // Where the values of n entries start in their contiguous serialised bytes, which start with the first key
+        template<size_t K, size_t V>
+        constexpr static std::size_t value_offset(std::size_t n) noexcept {
+            return n * K;
+        }
+
+        // Copies count entries between two non-overlapping maps of this layout
+        template<size_t K, size_t V, typename byte_type>
+        static void copy_entries(byte_type *to_keys, byte_type *to_values, const byte_type *from_keys, const byte_type *from_values,
+                                 std::size_t count) noexcept {
+            std::memcpy(to_keys, from_keys, count * K);
+            std::memcpy(to_values, from_values, count * V);
+        }
+
+        // Moves the count entries starting at index from to index to, in the same map (the ranges may overlap)
+        template<size_t K, size_t V, typename byte_type>
+        static void move_entries(byte_type *keys, byte_type *values, std::size_t to, std::size_t from, std::size_t count) noexcept {
+            std::memmove(keys + to * K, keys + from * K, count * K);
+            std::memmove(values + to * V, values + from * V, count * V);
+        }
+
+    };
+
+    struct interleaved_layout {
+
+        constexpr const static bool interleaved = true;
+
+        template<size_t K, size_t V>
+        constexpr const static std::size_t key_pitch = K + V;
+
+        template<size_t K, size_t V>
+        constexpr const static std::size_t value_pitch = K + V;
+
+        template<size_t K, size_t V>
+        constexpr static std::size_t value_offset(std::size_t) noexcept {
+            return K;
+        }
+
+        // values is always keys + K, so the records are copied and moved as one range
+        template<size_t K, size_t V, typename byte_type>
+        static void copy_entries(byte_type *to_keys, byte_type *, const byte_type *from_keys, const byte_type *, std::size_t count) noexcept {
+            std::memcpy(to_keys, from_keys, count * (K + V));
+        }
+
+        template<size_t K, size_t V, typename byte_type>
+        static void move_entries(byte_type *keys, byte_type *, std::size_t to, std::size_t from, std::size_t count) noexcept {
+            std::memmove(keys + to * (K + V), keys + from * (K + V), count * (K + V));
+        }
+
+    };
+
+    // Bytes spanned by n keys or n values stored at the given pitch (the last one ends before the next pitch would)
+    template<size_t Extent, size_t Pitch>
+    constexpr std::size_t pitched_bytes(std::size_t n) noexcept {
+        return n == 0 ? 0 : (n - 1) * Pitch + Extent;
+    }
+
+    // For the consumers that read the keys (or values) of a view as one contiguous range
+    template<typename View>
+    constexpr bool has_separate_layout = !View::layout::interleaved;
+
+} //ns gnt
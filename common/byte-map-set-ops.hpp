@@ -0,0 +1,199 @@
+#pragma once
+
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "small-byte-map.hpp"
+#include "stride-compare.hpp"
+#include "stride-search.hpp"
+
+namespace gnt {
+
+    // Merge based set operations and joins between sorted byte maps with the same K_Extent.
+    // Both inputs are walked once, and whenever one side is behind the search for where it catches up gallops
+    // (doubling steps then a binary search), so a run of n entries is skipped in O(log n) compares and copied with one
+    // memcpy. Disjoint inputs therefore cost O(log n), interleaved ones O(n + m), and very differently sized ones a
+    // binary search of the large side per entry of the small one.
+    // Equal keys follow the std:: algorithms: an entry pairs off with one equal entry of the other side, so multimaps
+    // get std::set_union / set_intersection / set_difference multiplicities, and values come from the left map where
+    // both have a key.
+    // Results are written in order into a small_byte_map with append_sorted, replacing its contents but keeping its
+    // storage, so a preallocated (reserve'd) output map is filled without reallocating.
+    // Inputs are any sorted views with the separate layout, small_byte_maps included (whose write buffers must be
+    // compacted first). The output map may use either layout.
+
+    namespace detail {
+
+        template<typename View>
+        const auto *set_op_keys(const View &view) {
+            static_assert(has_separate_layout<View>, "byte map set operations need views with separate key and value ranges");
+            return view.empty() ? nullptr : view.begin()->first.data();
+        }
+
+        template<typename View>
+        const auto *set_op_values(const View &view) {
+            return view.empty() ? nullptr : view.begin()->second.data();
+        }
+
+        template<typename View>
+        void require_set_op_sorted(const View &view) {
+            if (!view.is_sorted()) {
+                throw std::logic_error("byte map set operations need sorted keys");
+            }
+        }
+
+        // Above this many entries of one side per entry of the other, the runs of the larger side are long enough that
+        // a plain (branch free) binary search over the rest of it beats galloping, whose doubling steps are each a
+        // dependent cache miss.
+        constexpr std::size_t set_op_skew = 64;
+
+        // Index of the first of [from, n) not less than needle, given that from is already known to be less. Looks at
+        // a few neighbours first, since in interleaved inputs most runs are short, and then gallops. For the larger
+        // side of a skewed pair (skewed == true) it binary searches instead.
+        template<size_t K, typename byte_type>
+        std::size_t set_op_advance(const byte_type *keys, std::size_t n, std::size_t from, const byte_type *needle, bool skewed) noexcept {
+            if (skewed) {
+                // Over the whole side rather than just what is left: every search then shares the same first few
+                // probes, which stay in cache. Everything before from is less than needle, so the result is past it.
+                return lower_bound_stride<K>(keys, n, needle);
+            }
+            ++from;
+            constexpr std::size_t linear_steps = 4;
+            for (std::size_t step = 0; step < linear_steps && from < n; ++step, ++from) {
+                if (!less_strides<K>(keys + from * K, needle)) {
+                    return from;
+                }
+            }
+            return gallop_lower_bound_stride<K>(keys, n, from, needle);
+        }
+
+        inline bool set_op_skewed(std::size_t n, std::size_t other_n) noexcept {
+            return n / (other_n + 1) >= set_op_skew;
+        }
+
+        // Which of the two sides the caller wants the entries of each kind of run from
+        enum set_op_emit : unsigned {
+            emit_left_only = 1,
+            emit_right_only = 2,
+            emit_both = 4
+        };
+
+        template<unsigned Emit, typename ViewA, typename ViewB, typename Map>
+        void set_operation(const ViewA &a, const ViewB &b, Map &out) {
+            constexpr std::size_t K = ViewA::key_extent;
+            constexpr std::size_t V = ViewA::value_extent;
+            static_assert(K == ViewB::key_extent && K == Map::key_extent, "Set operations need the same K_Extent");
+            static_assert(V == ViewB::value_extent && V == Map::value_extent, "Set operations need the same V_Extent");
+            require_set_op_sorted(a);
+            require_set_op_sorted(b);
+            out.clear();
+            const auto *a_keys = set_op_keys(a), *a_values = set_op_values(a);
+            const auto *b_keys = set_op_keys(b), *b_values = set_op_values(b);
+            const std::size_t na = a.size(), nb = b.size();
+            const bool a_skewed = set_op_skewed(na, nb), b_skewed = set_op_skewed(nb, na);
+            std::size_t i = 0, j = 0;
+            while (i < na && j < nb) {
+                const int cmp = compare_strides<K>(a_keys + i * K, b_keys + j * K);
+                if (cmp < 0) {
+                    const std::size_t run_end = set_op_advance<K>(a_keys, na, i, b_keys + j * K, a_skewed);
+                    if constexpr ((Emit & emit_left_only) != 0) {
+                        out.append_sorted(a_keys + i * K, a_values + i * V, run_end - i);
+                    }
+                    i = run_end;
+                } else if (cmp > 0) {
+                    const std::size_t run_end = set_op_advance<K>(b_keys, nb, j, a_keys + i * K, b_skewed);
+                    if constexpr ((Emit & emit_right_only) != 0) {
+                        out.append_sorted(b_keys + j * K, b_values + j * V, run_end - j);
+                    }
+                    j = run_end;
+                } else {
+                    if constexpr ((Emit & emit_both) != 0) {
+                        out.append_sorted(a_keys + i * K, a_values + i * V, 1);
+                    }
+                    ++i;
+                    ++j;
+                }
+            }
+            if constexpr ((Emit & emit_left_only) != 0) {
+                out.append_sorted(a_keys + i * K, a_values + i * V, na - i);
+            }
+            if constexpr ((Emit & emit_right_only) != 0) {
+                out.append_sorted(b_keys + j * K, b_values + j * V, nb - j);
+            }
+        }
+
+    } //ns detail
+
+    // Entries of a and b (a's where both have a key)
+    template<typename ViewA, typename ViewB, typename Map>
+    void set_union(const ViewA &a, const ViewB &b, Map &out) {
+        detail::set_operation<detail::emit_left_only | detail::emit_right_only | detail::emit_both>(a, b, out);
+    }
+
+    // Entries of a whose keys are in b
+    template<typename ViewA, typename ViewB, typename Map>
+    void set_intersection(const ViewA &a, const ViewB &b, Map &out) {
+        detail::set_operation<detail::emit_both>(a, b, out);
+    }
+
+    // Entries of a whose keys are not in b
+    template<typename ViewA, typename ViewB, typename Map>
+    void set_difference(const ViewA &a, const ViewB &b, Map &out) {
+        detail::set_operation<detail::emit_left_only>(a, b, out);
+    }
+
+    // Entries of a or b whose keys are not in both
+    template<typename ViewA, typename ViewB, typename Map>
+    void set_symmetric_difference(const ViewA &a, const ViewB &b, Map &out) {
+        detail::set_operation<detail::emit_left_only | detail::emit_right_only>(a, b, out);
+    }
+
+    // Calls join(key, a_value, b_value) for every pair of entries of a and b with equal keys, in key order (for equal
+    // key runs in a multimap that is every pairing of the two runs). The value extents may differ. Returns the number
+    // of calls.
+    template<typename ViewA, typename ViewB, typename Join>
+    std::size_t merge_join(const ViewA &a, const ViewB &b, Join &&join) {
+        constexpr std::size_t K = ViewA::key_extent;
+        constexpr std::size_t VA = ViewA::value_extent;
+        constexpr std::size_t VB = ViewB::value_extent;
+        static_assert(K == ViewB::key_extent, "merge_join needs the same K_Extent");
+        detail::require_set_op_sorted(a);
+        detail::require_set_op_sorted(b);
+        const auto *a_keys = detail::set_op_keys(a), *a_values = detail::set_op_values(a);
+        const auto *b_keys = detail::set_op_keys(b), *b_values = detail::set_op_values(b);
+        using key_type = nonstd::span<std::remove_pointer_t<decltype(a_keys)>, K>;
+        using a_value_type = nonstd::span<std::remove_pointer_t<decltype(a_values)>, VA>;
+        using b_value_type = nonstd::span<std::remove_pointer_t<decltype(b_values)>, VB>;
+        const std::size_t na = a.size(), nb = b.size();
+        const bool a_skewed = detail::set_op_skewed(na, nb), b_skewed = detail::set_op_skewed(nb, na);
+        std::size_t i = 0, j = 0, calls = 0;
+        while (i < na && j < nb) {
+            const int cmp = compare_strides<K>(a_keys + i * K, b_keys + j * K);
+            if (cmp < 0) {
+                i = detail::set_op_advance<K>(a_keys, na, i, b_keys + j * K, a_skewed);
+            } else if (cmp > 0) {
+                j = detail::set_op_advance<K>(b_keys, nb, j, a_keys + i * K, b_skewed);
+            } else {
+                std::size_t a_end = i + 1, b_end = j + 1;
+                while (a_end < na && equal_strides<K>(a_keys + a_end * K, a_keys + i * K)) {
+                    ++a_end;
+                }
+                while (b_end < nb && equal_strides<K>(b_keys + b_end * K, b_keys + j * K)) {
+                    ++b_end;
+                }
+                for (std::size_t x = i; x < a_end; ++x) {
+                    for (std::size_t y = j; y < b_end; ++y) {
+                        join(key_type(a_keys + x * K, K), a_value_type(a_values + x * VA, VA), b_value_type(b_values + y * VB, VB));
+                        ++calls;
+                    }
+                }
+                i = a_end;
+                j = b_end;
+            }
+        }
+        return calls;
+    }
+
+} //ns gnt
@@ -1,25 +1,99 @@
 #pragma once
 
 #include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 namespace gnt {
 
+    // Whether a T can be moved to other storage by copying its bytes, the original then counting as gone without its
+    // destructor running. That is true of trivially copyable types, and of most types that only own their resources
+    // through pointers (e.g. a struct holding a std::unique_ptr), which can opt in by specialising this to true.
+    // A type must not opt in if it points into itself, as libstdc++'s std::string does for short strings.
+    template<typename T>
+    struct is_trivially_relocatable : std::is_trivially_copyable<T> {};
+
+    template<typename T>
+    inline constexpr bool is_trivially_relocatable_v = is_trivially_relocatable<T>::value;
+
+    // Whether relocate can't throw: it copies bytes or uses a move constructor that doesn't throw
+    template<typename T>
+    inline constexpr bool is_nothrow_relocatable_v = is_trivially_relocatable_v<T> || std::is_nothrow_move_constructible_v<T>;
+
     // Some slightly more descriptive aliases for copy in cases where InputIt == OutputIt
 
-    // Returns InputIt one past last copied.
+    // Shifts [first, last) right by n, to [first + n, last + n), and returns first + n, the start of the shifted range.
     // Note: requires random access iterator
-    // Note: requires last+n to be strictly less than the end of the range, or undefined behaviour
+    // Note: requires last+n to be at most the end of the range, or undefined behaviour
+    // These assign over live elements, so the byte copy is for trivially copyable types only, not relocatable ones.
     template<class InputIt>
     InputIt displace_right_n(InputIt first, InputIt last, std::size_t n) {
-        return std::copy_backward(first, last, first+n);
+        using T = typename std::iterator_traits<InputIt>::value_type;
+        if constexpr (std::is_pointer_v<InputIt> && std::is_trivially_copyable_v<T>) {
+            if (first != last) {
+                std::memmove(static_cast<void *>(first + n), static_cast<const void *>(first), (last - first) * sizeof(T));
+            }
+            return first + n;
+        } else {
+            std::copy_backward(first, last, last + n);
+            return first + n;
+        }
     }
 
-    // Returns InputIt one past last copied.
+    // Shifts [first, last) left by n, to [first - n, last - n), and returns last - n, one past the last element written.
     // Note: requires bidirectional random access iterator
     // Note: requires last-n to be greater or equal to the start of the range.
     template<class InputIt>
     InputIt displace_left_n(InputIt first, InputIt last, std::size_t n) {
-        return std::copy(first, last, first-n);
+        using T = typename std::iterator_traits<InputIt>::value_type;
+        if constexpr (std::is_pointer_v<InputIt> && std::is_trivially_copyable_v<T>) {
+            if (first != last) {
+                std::memmove(static_cast<void *>(first - n), static_cast<const void *>(first), (last - first) * sizeof(T));
+            }
+            return last - n;
+        } else {
+            return std::copy(first, last, first-n);
+        }
+    }
+
+    // Moves [first, last) into the uninitialised storage at dest and ends the lifetime of the originals, for containers
+    // that manage raw storage. The ranges may overlap in either direction. One memmove for trivially relocatable types.
+    template<typename T>
+    void relocate(T *first, T *last, T *dest) noexcept(is_trivially_relocatable_v<T> || std::is_nothrow_move_constructible_v<T>) {
+        if (first == dest || first == last) {
+            return;
+        }
+        if constexpr (is_trivially_relocatable_v<T>) {
+            std::memmove(static_cast<void *>(dest), static_cast<const void *>(first), (last - first) * sizeof(T));
+        } else if (dest < first) {
+            for (; first != last; ++first, ++dest) {
+                ::new (static_cast<void *>(dest)) T(std::move(*first));
+                first->~T();
+            }
+        } else {
+            for (T *to = dest + (last - first); last != first;) {
+                --last;
+                --to;
+                ::new (static_cast<void *>(to)) T(std::move(*last));
+                last->~T();
+            }
+        }
+    }
+
+    // Builds [first, last) in the uninitialised, non-overlapping dest by moving, or by copying when the move could throw
+    // and T can be copied (as std::move_if_noexcept chooses), and returns the end of dest. The originals are left for
+    // the caller to destroy once everything is across; if a construction throws, what was built is destroyed first.
+    template<typename T>
+    T *uninitialized_move_if_noexcept(T *first, T *last, T *dest) {
+        if constexpr (std::is_nothrow_move_constructible_v<T> || !std::is_copy_constructible_v<T>) {
+            return std::uninitialized_move(first, last, dest);
+        } else {
+            return std::uninitialized_copy(first, last, dest);
+        }
     }
 
 } //ns gnt
@@ -0,0 +1,395 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "small-byte-map.hpp"
+#include "stride-compare.hpp"
+#include "stride-sort.hpp"
+
+namespace gnt {
+
+    // Eytzinger (BFS) layout for large, read-mostly byte maps.
+    // A binary search over a sorted stride array touches a new cache line on every level once the map is bigger than
+    // the cache. Storing the sorted keys in the breadth first order of the implicit search tree instead puts the first
+    // levels of every search in the same few (always hot) cache lines, makes the descent branch free, and lets us
+    // prefetch the cache line holding a node's descendants several levels before we need it.
+    // Positions are 1-based as in a binary heap: the children of node k are 2k and 2k + 1, and 0 means "no node".
+    // The entry at position k lives at index k - 1 of the key and value regions.
+
+    namespace detail {
+
+        // Position of the smallest key (the leftmost node), or 0 for an empty tree
+        inline std::size_t eytzinger_first(std::size_t n) noexcept {
+            if (n == 0) {
+                return 0;
+            }
+            std::size_t k = 1;
+            while (2 * k <= n) {
+                k *= 2;
+            }
+            return k;
+        }
+
+        // Position of the next key in sorted order, or 0 after the last one
+        inline std::size_t eytzinger_next(std::size_t k, std::size_t n) noexcept {
+            if (2 * k + 1 <= n) { // Leftmost node of the right subtree
+                k = 2 * k + 1;
+                while (2 * k <= n) {
+                    k *= 2;
+                }
+                return k;
+            }
+            // Climb past every right-child link, then one more step up to the parent we are the left child of
+            return k >> (__builtin_ctzll(~static_cast<unsigned long long>(k)) + 1);
+        }
+
+        // The descendants of node k at d levels down are the 2^d contiguous positions from 2^d * k, so with 2^d keys
+        // per cache line one prefetch fetches that whole level. Largest power of two keys that fit in 64 bytes.
+        constexpr std::size_t eytzinger_prefetch_span(std::size_t key_extent) noexcept {
+            std::size_t span = 1;
+            while (2 * span * key_extent <= 64) {
+                span *= 2;
+            }
+            return span;
+        }
+
+        // Position of the first key not less than needle, or 0 if every key is less.
+        template<size_t K>
+        inline std::size_t eytzinger_lower_bound(const void *keys, std::size_t n, const void *needle) noexcept {
+            const auto *bytes = static_cast<const unsigned char *>(keys);
+            constexpr std::size_t span = eytzinger_prefetch_span(K);
+            std::size_t k = 1;
+            while (k <= n) {
+                // May point past the end of the tree near the leaves; a prefetch never faults so we skip the branch.
+                // The address is formed as an integer so we never do out of range pointer arithmetic.
+                __builtin_prefetch(reinterpret_cast<const void *>(reinterpret_cast<std::uintptr_t>(bytes) + (span * k - 1) * K));
+                k = 2 * k + static_cast<std::size_t>(less_strides<K>(bytes + (k - 1) * K, needle));
+            }
+            // Every right turn after the last left turn went past keys less than needle, so undo them and the left turn
+            return k >> (__builtin_ctzll(~static_cast<unsigned long long>(k)) + 1);
+        }
+
+        // Copies n sorted entries into Eytzinger order. Reads are sequential, writes follow an in-order walk of the tree.
+        template<size_t K, size_t V, typename from_byte_type, typename to_byte_type>
+        void eytzinger_from_sorted(const from_byte_type *sorted_keys, const from_byte_type *sorted_values, std::size_t n,
+                                   to_byte_type *keys, to_byte_type *values) noexcept {
+            std::size_t k = eytzinger_first(n);
+            for (std::size_t i = 0; i < n; ++i, k = eytzinger_next(k, n)) {
+                std::memcpy(keys + (k - 1) * K, sorted_keys + i * K, K);
+                std::memcpy(values + (k - 1) * V, sorted_values + i * V, V);
+            }
+        }
+
+    } //ns detail
+
+    // Iterates an Eytzinger ordered map in key order. Forward only: each step is an in-order tree successor.
+    template<size_t K_Extent, size_t V_Extent, typename byte_type = std::byte>
+    struct eytzinger_byte_map_iterator {
+
+        using key_stride = nonstd::span<byte_type, K_Extent>;
+        using value_stride = nonstd::span<byte_type, V_Extent>;
+
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::pair<key_stride, value_stride>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = value_type *;
+        using reference = value_type &;
+
+        eytzinger_byte_map_iterator() : eytzinger_byte_map_iterator(nullptr, nullptr, 0, 0) {}
+
+        eytzinger_byte_map_iterator(byte_type *keys, byte_type *values, std::size_t num_elems, std::size_t position)
+            : _keys(keys), _values(values), _num_elems(num_elems), _position(position),
+              impl(key_stride((byte_type *) nullptr, (size_t) 0), value_stride((byte_type *) nullptr, (size_t) 0)) {}
+
+        // iterator -> const_iterator
+        template<typename other_byte_type, typename = std::enable_if_t<std::is_same_v<const other_byte_type, byte_type> && !std::is_same_v<other_byte_type, byte_type>>>
+        eytzinger_byte_map_iterator(const eytzinger_byte_map_iterator<K_Extent, V_Extent, other_byte_type> &other)
+            : eytzinger_byte_map_iterator(other.keys_data(), other.values_data(), other.num_elems(), other.position()) {}
+
+        value_type &operator*() {
+            impl = value_type(key_stride(_keys + (_position - 1) * K_Extent, K_Extent),
+                              value_stride(_values + (_position - 1) * V_Extent, V_Extent));
+            return impl;
+        }
+
+        value_type *operator->() {
+            return &**this;
+        }
+
+        eytzinger_byte_map_iterator &operator++() {
+            _position = detail::eytzinger_next(_position, _num_elems);
+            return *this;
+        }
+
+        eytzinger_byte_map_iterator operator++(int) {
+            auto prev = *this;
+            ++(*this);
+            return prev;
+        }
+
+        bool operator==(const eytzinger_byte_map_iterator &b) const {
+            return _position == b._position;
+        }
+
+        bool operator!=(const eytzinger_byte_map_iterator &b) const {
+            return _position != b._position;
+        }
+
+        // 1-based position in the Eytzinger order (the entry is at index position() - 1), 0 for end()
+        std::size_t position() const noexcept {
+            return _position;
+        }
+
+        byte_type *keys_data() const noexcept {
+            return _keys;
+        }
+
+        byte_type *values_data() const noexcept {
+            return _values;
+        }
+
+        std::size_t num_elems() const noexcept {
+            return _num_elems;
+        }
+
+    private:
+
+        byte_type *_keys;
+        byte_type *_values;
+        std::size_t _num_elems;
+        std::size_t _position;
+        value_type impl;
+
+    };
+
+    // A read-only view over keys and values stored in Eytzinger order, with the lookup API of small_byte_map_view.
+    // Serialised the same way as small_byte_map (key range then value range), only in Eytzinger rather than sorted order,
+    // so build_from_contiguous_bytes works on the output of eytzinger_byte_map::to_vector.
+    // Multimaps are fine: equal keys come out next to each other when iterating, and find returns the first of them.
+    template<size_t K_Extent = 1, size_t V_Extent = 1, typename byte_type = std::byte>
+    class eytzinger_byte_map_view {
+
+    public:
+
+        using iterator = eytzinger_byte_map_iterator<K_Extent, V_Extent, byte_type>;
+        using const_iterator = eytzinger_byte_map_iterator<K_Extent, V_Extent, const byte_type>;
+        using size_type = std::size_t;
+        using key_stride = nonstd::span<byte_type, K_Extent>;
+        using value_stride = nonstd::span<byte_type, V_Extent>;
+
+        static auto build_from_contiguous_bytes(byte_type *data, size_type size_bytes) {
+            if ((size_bytes % (K_Extent + V_Extent)) != 0) {
+                throw std::range_error("eytzinger_byte_map_view cannot be built from contiguous bytes that are no divisible by K_Extent + V_step");
+            }
+            const size_type num_elems = size_bytes / (K_Extent + V_Extent);
+            return eytzinger_byte_map_view(data, data + K_Extent * num_elems, num_elems);
+        }
+
+        template<template<typename, typename> typename C, typename Alloc>
+        static auto build_from_contiguous_bytes(C<byte_type, Alloc> &cont) {
+            return build_from_contiguous_bytes(cont.data(), cont.size());
+        }
+
+        eytzinger_byte_map_view() : _keys(nullptr), _values(nullptr), _num_elems(0) {}
+
+        // k_ptr and v_ptr must already be in Eytzinger order (see eytzinger_byte_map for building from sorted data)
+        eytzinger_byte_map_view(byte_type *k_ptr, byte_type *v_ptr, size_type num_elems)
+            : _keys(k_ptr), _values(v_ptr), _num_elems(num_elems) {}
+
+    protected:
+
+        void reset(byte_type *k_ptr, byte_type *v_ptr, size_type num_elems) {
+            _keys = k_ptr;
+            _values = v_ptr;
+            _num_elems = num_elems;
+        }
+
+    public:
+
+        iterator begin() noexcept {
+            return iterator(_keys, _values, _num_elems, detail::eytzinger_first(_num_elems));
+        }
+
+        const_iterator begin() const noexcept {
+            return const_iterator(_keys, _values, _num_elems, detail::eytzinger_first(_num_elems));
+        }
+
+        const_iterator cbegin() const noexcept {
+            return begin();
+        }
+
+        iterator end() noexcept {
+            return iterator(_keys, _values, _num_elems, 0);
+        }
+
+        const_iterator end() const noexcept {
+            return const_iterator(_keys, _values, _num_elems, 0);
+        }
+
+        const_iterator cend() const noexcept {
+            return end();
+        }
+
+        [[nodiscard]] bool empty() const noexcept {
+            return _num_elems == 0;
+        }
+
+        // Number of entries (not bytes)
+        size_type size() const noexcept {
+            return _num_elems;
+        }
+
+        // First entry whose key is not less than key, in key order
+        iterator lower_bound(const key_stride &key) noexcept {
+            return iterator(_keys, _values, _num_elems, detail::eytzinger_lower_bound<K_Extent>(_keys, _num_elems, key.data()));
+        }
+
+        const_iterator lower_bound(const key_stride &key) const noexcept {
+            return const_iterator(_keys, _values, _num_elems, detail::eytzinger_lower_bound<K_Extent>(_keys, _num_elems, key.data()));
+        }
+
+        iterator find(const key_stride &key) noexcept {
+            const size_type k = find_position(key);
+            return iterator(_keys, _values, _num_elems, k);
+        }
+
+        const_iterator find(const key_stride &key) const noexcept {
+            const size_type k = find_position(key);
+            return const_iterator(_keys, _values, _num_elems, k);
+        }
+
+        bool contains(const key_stride &key) const noexcept {
+            return find_position(key) != 0;
+        }
+
+        size_type count(const key_stride &key) const noexcept {
+            size_type n = 0;
+            for (size_type k = find_position(key); k != 0 && equal_strides<K_Extent>(_keys + (k - 1) * K_Extent, key.data());
+                 k = detail::eytzinger_next(k, _num_elems)) {
+                ++n;
+            }
+            return n;
+        }
+
+        value_stride at(const key_stride &key) const {
+            const size_type k = find_position(key);
+            if (k == 0) {
+                throw std::out_of_range("key is not in eytzinger_byte_map_view");
+            }
+            return value_stride(_values + (k - 1) * V_Extent, V_Extent);
+        }
+
+        // Keys then values in sorted order, i.e. what small_byte_map_view::build_from_contiguous_bytes(..., true) takes
+        std::vector<std::remove_const_t<byte_type>> to_sorted_vector() const {
+            std::vector<std::remove_const_t<byte_type>> vec(_num_elems * (K_Extent + V_Extent));
+            auto *sorted_keys = vec.data();
+            auto *sorted_values = vec.data() + _num_elems * K_Extent;
+            size_type i = 0;
+            for (size_type k = detail::eytzinger_first(_num_elems); k != 0; k = detail::eytzinger_next(k, _num_elems), ++i) {
+                std::memcpy(sorted_keys + i * K_Extent, _keys + (k - 1) * K_Extent, K_Extent);
+                std::memcpy(sorted_values + i * V_Extent, _values + (k - 1) * V_Extent, V_Extent);
+            }
+            return vec;
+        }
+
+    private:
+
+        size_type find_position(const key_stride &key) const noexcept {
+            const size_type k = detail::eytzinger_lower_bound<K_Extent>(_keys, _num_elems, key.data());
+            if (k != 0 && equal_strides<K_Extent>(_keys + (k - 1) * K_Extent, key.data())) {
+                return k;
+            }
+            return 0;
+        }
+
+        byte_type *_keys;
+        byte_type *_values;
+        size_type _num_elems;
+
+    };
+
+    // Owning Eytzinger map, built once from a small_byte_map (or view) and then only queried.
+    template<size_t K_Extent = 1, size_t V_Extent = 1, typename byte_type = std::byte>
+    class eytzinger_byte_map : public eytzinger_byte_map_view<K_Extent, V_Extent, byte_type> {
+
+    public:
+
+        using super = eytzinger_byte_map_view<K_Extent, V_Extent, byte_type>;
+        using size_type = typename super::size_type;
+
+        eytzinger_byte_map() = default;
+
+        // Builds from n entries given as sorted key and value regions (as in a sorted small_byte_map_view).
+        eytzinger_byte_map(const byte_type *sorted_keys, const byte_type *sorted_values, size_type num_elems)
+            : _impl(num_elems * (K_Extent + V_Extent)) {
+            detail::eytzinger_from_sorted<K_Extent, V_Extent>(sorted_keys, sorted_values, num_elems, _impl.data(), _impl.data() + num_elems * K_Extent);
+            sync();
+        }
+
+        // Builds from any small_byte_map_view (a small_byte_map's write buffer must be compacted first). Views still
+        // in linear mode are not sorted, so they are copied and sorted on the way in.
+        template<typename other_byte_type, size_t LinearExtent>
+        explicit eytzinger_byte_map(const small_byte_map_view<K_Extent, V_Extent, other_byte_type, LinearExtent> &view) {
+            const size_type n = view.size();
+            if (n == 0) {
+                return;
+            }
+            auto first = view.begin();
+            const auto *keys = reinterpret_cast<const byte_type *>(first->first.data());
+            const auto *values = reinterpret_cast<const byte_type *>(first->second.data());
+            if (!view.linear_mode()) {
+                *this = eytzinger_byte_map(keys, values, n);
+                return;
+            }
+            std::vector<byte_type> sorted(keys, keys + n * K_Extent);
+            sorted.insert(sorted.end(), values, values + n * V_Extent);
+            sort_strides<K_Extent, V_Extent>(sorted.data(), sorted.data() + n * K_Extent, n);
+            *this = eytzinger_byte_map(sorted.data(), sorted.data() + n * K_Extent, n);
+        }
+
+        // The view base points into our own storage, so copies and moves must re-point it.
+        eytzinger_byte_map(const eytzinger_byte_map &other) : super(other), _impl(other._impl) {
+            sync();
+        }
+
+        eytzinger_byte_map(eytzinger_byte_map &&other) noexcept : super(other), _impl(std::move(other._impl)) {
+            sync();
+            other.sync();
+        }
+
+        eytzinger_byte_map &operator=(const eytzinger_byte_map &other) {
+            _impl = other._impl;
+            sync();
+            return *this;
+        }
+
+        eytzinger_byte_map &operator=(eytzinger_byte_map &&other) noexcept {
+            _impl = std::move(other._impl);
+            sync();
+            other.sync();
+            return *this;
+        }
+
+        // Keys then values, in Eytzinger order: eytzinger_byte_map_view::build_from_contiguous_bytes reads this back
+        const std::vector<byte_type> &to_vector() const noexcept {
+            return _impl;
+        }
+
+    private:
+
+        void sync() {
+            const size_type n = _impl.size() / (K_Extent + V_Extent);
+            super::reset(_impl.data(), _impl.data() + n * K_Extent, n);
+        }
+
+        std::vector<byte_type> _impl;
+
+    };
+
+} //ns gnt
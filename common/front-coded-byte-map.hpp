@@ -0,0 +1,462 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "small-byte-map.hpp"
+#include "stride-compare.hpp"
+#include "stride-search.hpp"
+#include "var-byte-map.hpp"
+
+namespace gnt {
+
+    // Read optimised sorted byte maps whose keys are front coded (prefix compressed), for large maps of keys that
+    // share long prefixes, e.g. a pack_uuid followed by a pack_int timestamp.
+    // Entries are cut into blocks of restart_interval. The first key of each block (its restart key) is stored whole,
+    // and every other key as the length of the prefix it shares with the key before it and the rest of its bytes.
+    // Serialised layout (all integers big-endian, like pack_int):
+    //   [n: 4 bytes][restart_interval: 4 bytes][restart keys: num_blocks * K_Extent bytes]
+    //   [num_blocks + 1 block offsets: 4 bytes each][values: n * V_Extent bytes][blocks of coded keys]
+    // where a coded key is [shared prefix length: 1 byte, 2 if K_Extent > 255][K_Extent - shared bytes].
+    // The restart keys are contiguous, so a lookup is a binary search over them (lower_bound_stride) and then a decode
+    // of at most restart_interval - 1 keys of one block. Values are not coded, so they are still found by position.
+
+    template<size_t K_Extent, size_t V_Extent, typename byte_type>
+    class front_coded_byte_map_view;
+
+    // Decodes the keys of a front_coded_byte_map_view in order. The key span of an entry points into the iterator
+    // itself, so it is only valid until the iterator is advanced or destroyed; copy it out to keep it.
+    template<size_t K_Extent, size_t V_Extent, typename byte_type>
+    struct front_coded_byte_map_iterator {
+
+        using view_type = front_coded_byte_map_view<K_Extent, V_Extent, byte_type>;
+        using iterator_category = std::forward_iterator_tag;
+        using key_stride = nonstd::span<byte_type, K_Extent>;
+        using value_stride = nonstd::span<byte_type, V_Extent>;
+        using value_type = std::pair<key_stride, value_stride>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = value_type *;
+        using reference = value_type &;
+        using size_type = std::size_t;
+
+        front_coded_byte_map_iterator() : front_coded_byte_map_iterator(nullptr, 0) {}
+
+        // Positioned at the start of block (or at the end if pos is the view's size)
+        front_coded_byte_map_iterator(const view_type *view, size_type pos)
+            : _view(view), _pos(pos),
+              impl(key_stride(static_cast<byte_type *>(nullptr), (size_t) 0), value_stride(static_cast<byte_type *>(nullptr), (size_t) 0)) {
+            if (_view != nullptr && _pos < _view->size()) {
+                restart();
+            }
+        }
+
+        value_type &operator*() {
+            impl = value_type(key_stride(_key.data(), K_Extent), _view->value_at(_pos));
+            return impl;
+        }
+
+        value_type *operator->() {
+            return &**this;
+        }
+
+        front_coded_byte_map_iterator &operator++() {
+            if (++_pos < _view->size()) {
+                if (_pos % _view->restart_interval() == 0) {
+                    restart();
+                } else {
+                    _cursor = view_type::decode(_cursor, _key.data());
+                }
+            }
+            return *this;
+        }
+
+        front_coded_byte_map_iterator operator++(int) {
+            auto prev = *this;
+            ++(*this);
+            return prev;
+        }
+
+        bool operator==(const front_coded_byte_map_iterator &b) const {
+            return _pos == b._pos;
+        }
+
+        bool operator!=(const front_coded_byte_map_iterator &b) const {
+            return _pos != b._pos;
+        }
+
+        size_type position() const noexcept {
+            return _pos;
+        }
+
+    private:
+
+        friend view_type;
+
+        void restart() {
+            const size_type block = _pos / _view->restart_interval();
+            std::memcpy(_key.data(), _view->restart_key(block), K_Extent);
+            _cursor = _view->block_begin(block);
+        }
+
+        const view_type *_view;
+        size_type _pos;
+        const byte_type *_cursor = nullptr; // The next coded key of the current block
+        std::array<byte_type, K_Extent> _key{};
+        value_type impl;
+
+    };
+
+    // A view over the serialised layout above. Always sorted (duplicate keys, as in a multimap, are kept in order).
+    template<size_t K_Extent = 1, size_t V_Extent = 1, typename byte_type = std::byte>
+    class front_coded_byte_map_view {
+
+    public:
+
+        using size_type = std::size_t;
+        using key_stride = nonstd::span<byte_type, K_Extent>;
+        using value_stride = nonstd::span<byte_type, V_Extent>;
+        using iterator = front_coded_byte_map_iterator<K_Extent, V_Extent, byte_type>;
+        using const_iterator = iterator;
+
+        constexpr const static std::size_t key_extent = K_Extent;
+        constexpr const static std::size_t value_extent = V_Extent;
+        constexpr const static size_type header_bytes = 8;
+        constexpr const static size_type offset_bytes = 4;
+        constexpr const static size_type shared_bytes = K_Extent > 255 ? 2 : 1;
+        constexpr const static size_type default_restart_interval = 16;
+
+        static front_coded_byte_map_view build_from_contiguous_bytes(byte_type *data, size_type size_bytes) {
+            if (size_bytes < header_bytes) {
+                throw std::range_error("front_coded_byte_map_view cannot be built from fewer bytes than its header");
+            }
+            const size_type n = detail::load_big_endian<std::uint32_t>(data);
+            const size_type interval = detail::load_big_endian<std::uint32_t>(data + 4);
+            if (interval == 0) {
+                throw std::range_error("front_coded_byte_map_view restart interval must be positive");
+            }
+            const size_type num_blocks = (n + interval - 1) / interval;
+            const size_type fixed_bytes = header_bytes + num_blocks * K_Extent + (num_blocks + 1) * offset_bytes + n * V_Extent;
+            if (fixed_bytes > size_bytes) {
+                throw std::range_error("front_coded_byte_map_view bytes are too short for their entry count");
+            }
+            front_coded_byte_map_view view(data, n, interval);
+            if (fixed_bytes + view.block_offset(num_blocks) != size_bytes) {
+                throw std::range_error("front_coded_byte_map_view bytes do not match their block sizes");
+            }
+            // Check every block decodes to exactly its bytes, so that lookups need not check shared lengths
+            for (size_type block = 0; block < num_blocks; ++block) {
+                const byte_type *cursor = view.block_begin(block), *block_end = view.block_begin(block + 1);
+                const size_type coded_keys = std::min(interval, n - block * interval) - 1;
+                for (size_type i = 0; i < coded_keys; ++i) {
+                    if (block_end - cursor < static_cast<std::ptrdiff_t>(shared_bytes)) {
+                        throw std::range_error("front_coded_byte_map_view block is too short for its keys");
+                    }
+                    const size_type shared = load_shared(cursor);
+                    if (shared > K_Extent || static_cast<size_type>(block_end - cursor) < shared_bytes + K_Extent - shared) {
+                        throw std::range_error("front_coded_byte_map_view block has a malformed key");
+                    }
+                    cursor += shared_bytes + K_Extent - shared;
+                }
+                if (cursor != block_end) {
+                    throw std::range_error("front_coded_byte_map_view block offsets do not match their keys");
+                }
+            }
+            return view;
+        }
+
+        template<template<typename, typename> typename C, typename Alloc>
+        static front_coded_byte_map_view build_from_contiguous_bytes(C<byte_type, Alloc> &cont) {
+            return build_from_contiguous_bytes(cont.data(), cont.size());
+        }
+
+        front_coded_byte_map_view() = default;
+
+        iterator begin() const {
+            return iterator(this, 0);
+        }
+
+        iterator end() const {
+            return iterator(this, _num_elems);
+        }
+
+        [[nodiscard]] bool empty() const noexcept {
+            return _num_elems == 0;
+        }
+
+        // Number of entries (not bytes)
+        size_type size() const noexcept {
+            return _num_elems;
+        }
+
+        size_type restart_interval() const noexcept {
+            return _restart_interval;
+        }
+
+        size_type block_count() const noexcept {
+            return _num_blocks;
+        }
+
+        // Bytes of the serialised form
+        size_type size_bytes() const noexcept {
+            return static_cast<size_type>(_blocks - _data) + block_offset(_num_blocks);
+        }
+
+        // Bytes of the keys alone (restart keys, block offsets and coded keys), to compare with n * K_Extent
+        size_type key_bytes() const noexcept {
+            return size_bytes() - header_bytes - _num_elems * V_Extent;
+        }
+
+        // First entry whose key is not less than key
+        iterator lower_bound(const key_stride &key) const {
+            // The last restart key less than key starts the only block that can hold the answer, unless none of that
+            // block's keys reach key, in which case it is the next block's restart key
+            const size_type first_not_less = lower_bound_stride<K_Extent>(restart_key(0), _num_blocks, key.data());
+            if (first_not_less == 0) {
+                return begin();
+            }
+            iterator it(this, (first_not_less - 1) * _restart_interval);
+            const size_type block_end = std::min(first_not_less * _restart_interval, _num_elems);
+            while (++it._pos < block_end) {
+                it._cursor = decode(it._cursor, it._key.data());
+                if (!less_strides<K_Extent>(it._key.data(), key.data())) {
+                    return it;
+                }
+            }
+            return iterator(this, block_end);
+        }
+
+        iterator find(const key_stride &key) const {
+            auto it = lower_bound(key);
+            if (it._pos < _num_elems && equal_strides<K_Extent>(it._key.data(), key.data())) {
+                return it;
+            }
+            return end();
+        }
+
+        bool contains(const key_stride &key) const {
+            return find(key) != end();
+        }
+
+        size_type count(const key_stride &key) const {
+            size_type count = 0;
+            for (auto it = lower_bound(key); it._pos < _num_elems && equal_strides<K_Extent>(it._key.data(), key.data()); ++it) {
+                ++count;
+            }
+            return count;
+        }
+
+        value_stride at(const key_stride &key) const {
+            auto it = find(key);
+            if (it == end()) {
+                throw std::out_of_range("key is not in front_coded_byte_map_view");
+            }
+            return value_at(it._pos);
+        }
+
+        // Value of the entry at pos, without decoding any keys
+        value_stride value_at(size_type pos) const {
+            return value_stride(const_cast<byte_type *>(_values) + pos * V_Extent, V_Extent);
+        }
+
+    private:
+
+        friend iterator;
+
+        template<size_t K, size_t V, typename B>
+        friend class front_coded_byte_map;
+
+        front_coded_byte_map_view(byte_type *data, size_type num_elems, size_type restart_interval)
+            : _data(data), _num_elems(num_elems), _restart_interval(restart_interval),
+              _num_blocks((num_elems + restart_interval - 1) / restart_interval) {
+            _restart_keys = data + header_bytes;
+            _offsets = _restart_keys + _num_blocks * K_Extent;
+            _values = _offsets + (_num_blocks + 1) * offset_bytes;
+            _blocks = _values + _num_elems * V_Extent;
+        }
+
+        static size_type load_shared(const byte_type *coded) noexcept {
+            if constexpr (shared_bytes == 1) {
+                return static_cast<unsigned char>(*coded);
+            } else {
+                return detail::load_big_endian<std::uint16_t>(coded);
+            }
+        }
+
+        // Applies the coded key at coded to key (the key before it) and returns the next coded key
+        static const byte_type *decode(const byte_type *coded, byte_type *key) noexcept {
+            const size_type shared = load_shared(coded);
+            std::memcpy(key + shared, coded + shared_bytes, K_Extent - shared);
+            return coded + shared_bytes + K_Extent - shared;
+        }
+
+        const byte_type *restart_key(size_type block) const noexcept {
+            return _restart_keys + block * K_Extent;
+        }
+
+        size_type block_offset(size_type block) const noexcept {
+            return detail::load_big_endian<std::uint32_t>(_offsets + block * offset_bytes);
+        }
+
+        const byte_type *block_begin(size_type block) const noexcept {
+            return _blocks + block_offset(block);
+        }
+
+        byte_type *_data = nullptr;
+        size_type _num_elems = 0;
+        size_type _restart_interval = default_restart_interval;
+        size_type _num_blocks = 0;
+        byte_type *_restart_keys = nullptr;
+        byte_type *_offsets = nullptr;
+        byte_type *_values = nullptr;
+        byte_type *_blocks = nullptr;
+
+    };
+
+    // Owns the serialised bytes of a front coded map, built from any sorted view (e.g. a small_byte_map) with the same
+    // extents. Read only: rebuild it to change its entries.
+    template<size_t K_Extent = 1, size_t V_Extent = 1, typename byte_type = std::byte>
+    class front_coded_byte_map {
+
+    public:
+
+        using view_type = front_coded_byte_map_view<K_Extent, V_Extent, byte_type>;
+        using size_type = std::size_t;
+        using key_stride = typename view_type::key_stride;
+        using value_stride = typename view_type::value_stride;
+        using iterator = typename view_type::iterator;
+        using const_iterator = iterator;
+
+        constexpr const static std::size_t key_extent = K_Extent;
+        constexpr const static std::size_t value_extent = V_Extent;
+
+        front_coded_byte_map() : front_coded_byte_map(small_byte_map_view<K_Extent, V_Extent, byte_type>()) {}
+
+        // Smaller restart intervals make lookups decode fewer keys, larger ones store fewer whole keys
+        template<typename View>
+        explicit front_coded_byte_map(const View &sorted, size_type restart_interval = view_type::default_restart_interval) {
+            static_assert(View::key_extent == K_Extent && View::value_extent == V_Extent, "front_coded_byte_map needs the same extents as its source");
+            if (!sorted.is_sorted()) {
+                throw std::logic_error("front_coded_byte_map needs sorted keys");
+            }
+            if (restart_interval == 0) {
+                throw std::invalid_argument("front_coded_byte_map restart interval must be positive");
+            }
+            const size_type n = sorted.size();
+            if (n > 0xFFFFFFFF || restart_interval > 0xFFFFFFFF) {
+                throw std::length_error("front_coded_byte_map holds up to 2^32 - 1 entries"); //Fixme: 64 bit sizes
+            }
+            const size_type num_blocks = (n + restart_interval - 1) / restart_interval;
+            std::vector<byte_type> restart_keys, offsets((num_blocks + 1) * view_type::offset_bytes), values, blocks;
+            restart_keys.reserve(num_blocks * K_Extent);
+            values.reserve(n * V_Extent);
+            blocks.reserve(n * (view_type::shared_bytes + K_Extent / 4)); // Roughly what shared prefixes are here for
+            size_type i = 0;
+            const byte_type *previous = nullptr;
+            for (auto it = sorted.begin(); it != sorted.end(); ++it, ++i) {
+                const auto *key = it->first.data();
+                if (i % restart_interval == 0) {
+                    set_block_offset(offsets, i / restart_interval, blocks.size());
+                    restart_keys.insert(restart_keys.end(), key, key + K_Extent);
+                } else {
+                    const size_type shared = common_prefix_length<K_Extent>(previous, key);
+                    if constexpr (view_type::shared_bytes == 1) {
+                        blocks.push_back(static_cast<byte_type>(shared));
+                    } else {
+                        blocks.push_back(static_cast<byte_type>(shared >> 8));
+                        blocks.push_back(static_cast<byte_type>(shared & 0xFF));
+                    }
+                    blocks.insert(blocks.end(), key + shared, key + K_Extent);
+                }
+                values.insert(values.end(), it->second.data(), it->second.data() + V_Extent);
+                previous = key; // Keys of sorted views are contiguous, so this stays valid while iterating
+            }
+            set_block_offset(offsets, num_blocks, blocks.size());
+
+            _bytes.resize(view_type::header_bytes);
+            detail::store_big_endian_u32(_bytes.data(), static_cast<std::uint32_t>(n));
+            detail::store_big_endian_u32(_bytes.data() + 4, static_cast<std::uint32_t>(restart_interval));
+            for (const auto *part : {&restart_keys, &offsets, &values, &blocks}) {
+                _bytes.insert(_bytes.end(), part->begin(), part->end());
+            }
+            _view = view_type(_bytes.data(), n, restart_interval);
+        }
+
+        front_coded_byte_map(const front_coded_byte_map &other)
+            : _bytes(other._bytes), _view(_bytes.data(), other.size(), other.restart_interval()) {}
+
+        front_coded_byte_map(front_coded_byte_map &&other) noexcept = default; // Moving the vector keeps its buffer
+
+        front_coded_byte_map &operator=(front_coded_byte_map other) noexcept {
+            _bytes.swap(other._bytes);
+            std::swap(_view, other._view);
+            return *this;
+        }
+
+        const view_type &view() const noexcept {
+            return _view;
+        }
+
+        // Write the serialised layout - the input of front_coded_byte_map_view::build_from_contiguous_bytes
+        std::vector<byte_type> to_vector() const {
+            return _bytes;
+        }
+
+        template<template<typename, typename> typename C, typename Alloc>
+        C<byte_type, Alloc> to_range() const {
+            C<byte_type, Alloc> cont;
+            to_range(cont);
+            return cont;
+        }
+
+        template<template<typename, typename> typename C, typename Alloc>
+        void to_range(C<byte_type, Alloc> &target) const {
+            target.resize(_bytes.size());
+            std::copy(_bytes.begin(), _bytes.end(), target.begin());
+        }
+
+        iterator begin() const { return _view.begin(); }
+
+        iterator end() const { return _view.end(); }
+
+        [[nodiscard]] bool empty() const noexcept { return _view.empty(); }
+
+        size_type size() const noexcept { return _view.size(); }
+
+        size_type restart_interval() const noexcept { return _view.restart_interval(); }
+
+        size_type size_bytes() const noexcept { return _bytes.size(); }
+
+        size_type key_bytes() const noexcept { return _view.key_bytes(); }
+
+        iterator lower_bound(const key_stride &key) const { return _view.lower_bound(key); }
+
+        iterator find(const key_stride &key) const { return _view.find(key); }
+
+        bool contains(const key_stride &key) const { return _view.contains(key); }
+
+        size_type count(const key_stride &key) const { return _view.count(key); }
+
+        value_stride at(const key_stride &key) const { return _view.at(key); }
+
+    private:
+
+        static void set_block_offset(std::vector<byte_type> &offsets, size_type block, size_type offset) {
+            if (offset > 0xFFFFFFFF) {
+                throw std::length_error("front_coded_byte_map holds up to 4GB of coded keys"); //Fixme: 64 bit offsets
+            }
+            detail::store_big_endian_u32(offsets.data() + block * view_type::offset_bytes, static_cast<std::uint32_t>(offset));
+        }
+
+        std::vector<byte_type> _bytes;
+        view_type _view;
+
+    };
+
+} //ns gnt
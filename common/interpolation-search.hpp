@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "stride-compare.hpp"
+#include "stride-search.hpp"
+
+namespace gnt {
+
+    // Interpolation search over sorted K-byte strides, as a search policy for small_byte_map_view (see
+    // binary_search_policy). For keys that are pack_int encodings of roughly uniform integers (ids, timestamps), the
+    // position of a key is close to linear in its value, so guessing it from the first and last keys' values lands
+    // within a few entries in one or two steps instead of the log n dependent cache misses of a binary search.
+    // Each step probes the guessed position and a guard Guard entries further on, which brackets the key into one
+    // cache line whenever the guess is close. Skewed (e.g. zipfian or clustered) keys make poor guesses, so after
+    // MaxSteps, or once the range is down to a couple of guards, the rest is binary searched: never much worse than
+    // the default.
+    // Keys are compared as 8 byte big-endian words starting after the prefix that all keys share (e.g. a common uuid
+    // in front of a timestamp), which is what varies.
+
+    namespace detail {
+
+        // Where the 8 bytes that are interpolated on start, given the length of the prefix the keys share
+        template<size_t K>
+        constexpr std::size_t interpolation_window(std::size_t shared) noexcept {
+            return K <= 8 ? 0 : std::min(shared, K - 8);
+        }
+
+        template<size_t K>
+        std::uint64_t interpolation_rank(const unsigned char *key, std::size_t window) noexcept {
+            if constexpr (K >= 8) {
+                return load_big_endian<std::uint64_t>(key + window);
+            } else {
+                unsigned char word[8] = {};
+                std::memcpy(word, key, K);
+                return load_big_endian<std::uint64_t>(word);
+            }
+        }
+
+    } //ns detail
+
+    template<std::size_t MaxSteps = 3, std::size_t Guard = 8>
+    struct interpolation_search_policy {
+
+        static_assert(Guard > 0, "interpolation_search_policy needs a positive Guard");
+
+        template<size_t K, size_t Pitch = K>
+        static std::size_t lower_bound(const void *keys, std::size_t n, const void *needle) noexcept {
+            const auto *bytes = static_cast<const unsigned char *>(keys);
+            if (n <= 2 * Guard) {
+                return lower_bound_stride<K, Pitch>(keys, n, needle);
+            }
+            if (!less_strides<K>(bytes, needle)) {
+                return 0;
+            }
+            if (less_strides<K>(bytes + (n - 1) * Pitch, needle)) {
+                return n;
+            }
+            // From here keys[lo] < needle <= keys[hi], so the needle shares the keys' prefix and the ranks of keys[lo],
+            // the needle and keys[hi] are in order
+            const std::size_t window = detail::interpolation_window<K>(common_prefix_length<K>(bytes, bytes + (n - 1) * Pitch));
+            const std::uint64_t needle_rank = detail::interpolation_rank<K>(static_cast<const unsigned char *>(needle), window);
+            std::size_t lo = 0, hi = n - 1;
+            for (std::size_t step = 0; step < MaxSteps && hi - lo > 2 * Guard; ++step) {
+                const std::uint64_t lo_rank = detail::interpolation_rank<K>(bytes + lo * Pitch, window);
+                const std::uint64_t hi_rank = detail::interpolation_rank<K>(bytes + hi * Pitch, window);
+                if (lo_rank == hi_rank) { // The keys differ after the window, nothing to interpolate
+                    break;
+                }
+                const double fraction = static_cast<double>(needle_rank - lo_rank) / static_cast<double>(hi_rank - lo_rank);
+                const auto guess = lo + static_cast<std::size_t>(fraction * static_cast<double>(hi - lo));
+                const std::size_t pos = std::min(std::max(guess, lo + 1), hi - 1);
+                if (less_strides<K>(bytes + pos * Pitch, needle)) {
+                    lo = pos;
+                    if (pos + Guard < hi) {
+                        if (less_strides<K>(bytes + (pos + Guard) * Pitch, needle)) {
+                            lo = pos + Guard;
+                        } else {
+                            hi = pos + Guard;
+                        }
+                    }
+                } else {
+                    hi = pos;
+                    if (pos > lo + Guard) {
+                        if (less_strides<K>(bytes + (pos - Guard) * Pitch, needle)) {
+                            lo = pos - Guard;
+                        } else {
+                            hi = pos - Guard;
+                        }
+                    }
+                }
+            }
+            return lo + 1 + lower_bound_stride<K, Pitch>(bytes + (lo + 1) * Pitch, hi - lo - 1, needle);
+        }
+
+    };
+
+} //ns gnt
@@ -0,0 +1,525 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "small-byte-map.hpp"
+#include "stride-compare.hpp"
+#include "stride-search.hpp"
+#include "stride-sort.hpp"
+
+namespace gnt {
+
+    // An immutable, ordered byte map with structural sharing, for handing snapshots of large maps to readers in other
+    // actors without copying them.
+    // Entries live in sorted chunks of at most ChunkEntries, each in the contiguous layout of small_byte_map::to_vector
+    // (keys then values), under a B+tree of branches with at most Fanout children. Nodes are never modified once built:
+    // an update copies the chunk it touches and the branches on the path down to it (path copying), and shares every
+    // other node with the map it was made from. So
+    //   - copying a persistent_byte_map is a snapshot: O(1), one shared_ptr copy
+    //   - insert, insert_or_assign and erase copy O(log n) nodes, one chunk and one branch per level
+    //   - snapshots are safe to read from any thread while the map they came from is updated
+    // Each chunk is a valid sorted small_byte_map_view (chunk_for, for_each_chunk), so code written against views keeps
+    // working on a part of the map.
+    // Iterators hold plain pointers into the nodes, so they are invalidated by updates of the map they came from (which
+    // may free the old nodes): iterate a copy to keep reading while updating.
+
+    namespace detail {
+
+        template<typename byte_type>
+        struct persistent_byte_map_node {
+
+            using ptr = std::shared_ptr<const persistent_byte_map_node>;
+
+            bool leaf() const noexcept {
+                return children.empty();
+            }
+
+            std::size_t size = 0; // Entries in this subtree
+            // A chunk's entries, keys then values; a branch's copy of the first key of each child. Either way a node's
+            // first key is its first K bytes.
+            std::vector<byte_type> bytes;
+            std::vector<ptr> children; // Empty for chunks
+
+        };
+
+    } //ns detail
+
+    template<typename Map>
+    struct persistent_byte_map_iterator {
+
+        using iterator_category = std::forward_iterator_tag;
+        using key_stride = typename Map::key_stride;
+        using value_stride = typename Map::value_stride;
+        using value_type = std::pair<key_stride, value_stride>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = value_type *;
+        using reference = value_type &;
+        using size_type = std::size_t;
+        using node = typename Map::node;
+
+        persistent_byte_map_iterator() : persistent_byte_map_iterator(nullptr, nullptr, 0) {}
+
+        persistent_byte_map_iterator(const node *root, const node *chunk, size_type pos)
+            : _root(root), _chunk(chunk), _pos(pos), impl(key_stride(static_cast<typename key_stride::pointer>(nullptr), (size_t) 0),
+                                                          value_stride(static_cast<typename value_stride::pointer>(nullptr), (size_t) 0)) {}
+
+        value_type &operator*() {
+            const auto *keys = _chunk->bytes.data();
+            impl = value_type(key_stride(keys + _pos * Map::key_extent, Map::key_extent),
+                              value_stride(keys + _chunk->size * Map::key_extent + _pos * Map::value_extent, Map::value_extent));
+            return impl;
+        }
+
+        value_type *operator->() {
+            return &**this;
+        }
+
+        // Walks on to the next chunk through a descent from the root, once per chunk
+        persistent_byte_map_iterator &operator++() {
+            if (++_pos == _chunk->size) {
+                _chunk = Map::next_chunk(_root, _chunk->bytes.data() + (_chunk->size - 1) * Map::key_extent);
+                _pos = 0;
+            }
+            return *this;
+        }
+
+        persistent_byte_map_iterator operator++(int) {
+            auto prev = *this;
+            ++(*this);
+            return prev;
+        }
+
+        bool operator==(const persistent_byte_map_iterator &b) const {
+            return _chunk == b._chunk && _pos == b._pos;
+        }
+
+        bool operator!=(const persistent_byte_map_iterator &b) const {
+            return !(*this == b);
+        }
+
+    private:
+
+        const node *_root;
+        const node *_chunk; // nullptr at the end
+        size_type _pos;
+        value_type impl;
+
+    };
+
+    template<size_t K_Extent = 1, size_t V_Extent = 1, typename byte_type = std::byte, size_t ChunkEntries = 64, size_t Fanout = 32>
+    class persistent_byte_map {
+
+    public:
+
+        using node = detail::persistent_byte_map_node<byte_type>;
+        using node_ptr = typename node::ptr;
+        using view_type = small_byte_map_view<K_Extent, V_Extent, const byte_type, 0>;
+        using key_stride = typename view_type::key_stride;
+        using value_stride = typename view_type::value_stride;
+        using value_type = std::pair<key_stride, value_stride>;
+        using iterator = persistent_byte_map_iterator<persistent_byte_map>;
+        using const_iterator = iterator;
+        using size_type = std::size_t;
+
+        constexpr const static std::size_t key_extent = K_Extent;
+        constexpr const static std::size_t value_extent = V_Extent;
+        constexpr const static std::size_t chunk_entries = ChunkEntries;
+        constexpr const static std::size_t fanout = Fanout;
+
+        static_assert(ChunkEntries >= 4 && Fanout >= 4, "persistent_byte_map needs at least 4 entries per chunk and 4 children per branch");
+
+        persistent_byte_map() = default;
+
+        // Bulk loads the entries of a view (e.g. of the small_byte_map being snapshotted) into full chunks. Of repeated
+        // keys, as in a multimap, one is kept.
+        template<typename View>
+        explicit persistent_byte_map(const View &view) {
+            static_assert(View::key_extent == K_Extent && View::value_extent == V_Extent, "persistent_byte_map needs a view with the same extents");
+            const size_type n = view.size();
+            std::vector<byte_type> keys(n * K_Extent), values(n * V_Extent);
+            size_type i = 0;
+            for (auto it = view.begin(); it != view.end(); ++it, ++i) {
+                std::memcpy(keys.data() + i * K_Extent, it->first.data(), K_Extent);
+                std::memcpy(values.data() + i * V_Extent, it->second.data(), V_Extent);
+            }
+            if (view.linear_mode()) {
+                sort_strides<K_Extent, V_Extent>(keys.data(), values.data(), n);
+            }
+            size_type unique = 0;
+            for (i = 0; i < n; ++i) {
+                if (unique > 0 && equal_strides<K_Extent>(keys.data() + (unique - 1) * K_Extent, keys.data() + i * K_Extent)) {
+                    continue;
+                }
+                std::memmove(keys.data() + unique * K_Extent, keys.data() + i * K_Extent, K_Extent);
+                std::memmove(values.data() + unique * V_Extent, values.data() + i * V_Extent, V_Extent);
+                ++unique;
+            }
+            std::vector<node_ptr> level;
+            for (i = 0; i < unique; i += ChunkEntries) {
+                const size_type count = std::min(ChunkEntries, unique - i);
+                level.push_back(make_chunk(keys.data() + i * K_Extent, values.data() + i * V_Extent, count));
+            }
+            while (level.size() > 1) {
+                std::vector<node_ptr> parents;
+                for (i = 0; i < level.size(); i += Fanout) {
+                    parents.push_back(make_branch(level.data() + i, std::min(Fanout, level.size() - i)));
+                }
+                level = std::move(parents);
+            }
+            _root = level.empty() ? nullptr : level.front();
+        }
+
+        size_type size() const noexcept {
+            return _root ? _root->size : 0;
+        }
+
+        [[nodiscard]] bool empty() const noexcept {
+            return size() == 0;
+        }
+
+        iterator begin() const noexcept {
+            return iterator(_root.get(), _root ? first_chunk(_root.get()) : nullptr, 0);
+        }
+
+        iterator end() const noexcept {
+            return iterator(_root.get(), nullptr, 0);
+        }
+
+        iterator find(const key_stride &key) const noexcept {
+            if (!_root) {
+                return end();
+            }
+            const node *chunk = chunk_node(key.data());
+            const size_type pos = lower_bound_stride<K_Extent>(chunk->bytes.data(), chunk->size, key.data());
+            if (pos == chunk->size || !equal_strides<K_Extent>(chunk->bytes.data() + pos * K_Extent, key.data())) {
+                return end();
+            }
+            return iterator(_root.get(), chunk, pos);
+        }
+
+        bool contains(const key_stride &key) const noexcept {
+            return find(key) != end();
+        }
+
+        size_type count(const key_stride &key) const noexcept {
+            return contains(key) ? 1 : 0;
+        }
+
+        value_stride at(const key_stride &key) const {
+            auto it = find(key);
+            if (it == end()) {
+                throw std::out_of_range("key is not in persistent_byte_map");
+            }
+            return it->second;
+        }
+
+        // The first entry whose key is not less than key
+        iterator lower_bound(const key_stride &key) const noexcept {
+            if (!_root) {
+                return end();
+            }
+            const node *chunk = chunk_node(key.data());
+            const size_type pos = lower_bound_stride<K_Extent>(chunk->bytes.data(), chunk->size, key.data());
+            if (pos == chunk->size) {
+                return iterator(_root.get(), next_chunk(_root.get(), key.data()), 0);
+            }
+            return iterator(_root.get(), chunk, pos);
+        }
+
+        // Inserts if the key isn't already in the map
+        bool insert(const key_stride &key, const value_stride &value) {
+            return update(key, value, false);
+        }
+
+        // Returns true if the key was inserted, false if its value was replaced
+        bool insert_or_assign(const key_stride &key, const value_stride &value) {
+            return update(key, value, true);
+        }
+
+        size_type erase(const key_stride &key) {
+            if (!_root) {
+                return 0;
+            }
+            auto res = erase_from(_root, key.data());
+            if (!res.second) {
+                return 0;
+            }
+            _root = std::move(res.first);
+            while (_root && !_root->leaf() && _root->children.size() == 1) {
+                _root = _root->children.front();
+            }
+            return 1;
+        }
+
+        void clear() noexcept {
+            _root = nullptr;
+        }
+
+        // The chunk the key is in (or would be inserted into), as a sorted view
+        view_type chunk_for(const key_stride &key) const {
+            return _root ? chunk_view(chunk_node(key.data())) : view_type(false);
+        }
+
+        // Calls f with a view of each chunk, in key order
+        template<typename F>
+        void for_each_chunk(F &&f) const {
+            if (_root) {
+                visit_chunks(_root.get(), f);
+            }
+        }
+
+        // Write all entries in the contiguous layout of small_byte_map::to_vector
+        std::vector<byte_type> to_vector() const {
+            std::vector<byte_type> vec(size() * (K_Extent + V_Extent));
+            size_type i = 0;
+            for_each_chunk([&](const view_type &chunk) {
+                const size_type n = chunk.size();
+                std::memcpy(vec.data() + i * K_Extent, chunk.begin()->first.data(), n * K_Extent);
+                std::memcpy(vec.data() + size() * K_Extent + i * V_Extent, chunk.begin()->second.data(), n * V_Extent);
+                i += n;
+            });
+            return vec;
+        }
+
+    private:
+
+        friend iterator;
+
+        static node_ptr make_chunk(const byte_type *keys, const byte_type *values, size_type count) {
+            auto chunk = std::make_shared<node>();
+            chunk->size = count;
+            chunk->bytes.resize(count * (K_Extent + V_Extent));
+            std::memcpy(chunk->bytes.data(), keys, count * K_Extent);
+            std::memcpy(chunk->bytes.data() + count * K_Extent, values, count * V_Extent);
+            return chunk;
+        }
+
+        static node_ptr make_branch(const node_ptr *children, size_type count) {
+            auto branch = std::make_shared<node>();
+            branch->children.assign(children, children + count);
+            branch->bytes.resize(count * K_Extent);
+            for (size_type i = 0; i < count; ++i) {
+                branch->size += children[i]->size;
+                std::memcpy(branch->bytes.data() + i * K_Extent, children[i]->bytes.data(), K_Extent);
+            }
+            return branch;
+        }
+
+        static view_type chunk_view(const node *chunk) {
+            const byte_type *keys = chunk->bytes.data();
+            return view_type(keys, keys + chunk->size * K_Extent, chunk->size, true);
+        }
+
+        // The child of a branch whose keys would include key: the last one whose first key is not greater
+        static size_type child_index(const node *branch, const byte_type *key) noexcept {
+            const size_type n = branch->children.size();
+            const size_type pos = lower_bound_stride<K_Extent>(branch->bytes.data(), n, key);
+            if (pos < n && equal_strides<K_Extent>(branch->bytes.data() + pos * K_Extent, key)) {
+                return pos;
+            }
+            return pos == 0 ? 0 : pos - 1;
+        }
+
+        const node *chunk_node(const byte_type *key) const noexcept {
+            const node *n = _root.get();
+            while (!n->leaf()) {
+                n = n->children[child_index(n, key)].get();
+            }
+            return n;
+        }
+
+        static const node *first_chunk(const node *n) noexcept {
+            while (!n->leaf()) {
+                n = n->children.front().get();
+            }
+            return n;
+        }
+
+        // The first chunk whose first key is greater than key, or nullptr
+        static const node *next_chunk(const node *n, const byte_type *key) noexcept {
+            if (n->leaf()) {
+                return less_strides<K_Extent>(key, n->bytes.data()) ? n : nullptr;
+            }
+            const size_type i = child_index(n, key);
+            if (const node *found = next_chunk(n->children[i].get(), key)) {
+                return found;
+            }
+            return i + 1 < n->children.size() ? first_chunk(n->children[i + 1].get()) : nullptr;
+        }
+
+        template<typename F>
+        static void visit_chunks(const node *n, F &f) {
+            if (n->leaf()) {
+                f(chunk_view(n));
+                return;
+            }
+            for (const auto &child : n->children) {
+                visit_chunks(child.get(), f);
+            }
+        }
+
+        bool update(const key_stride &key, const value_stride &value, bool assign) {
+            if (!_root) {
+                _root = make_chunk(key.data(), value.data(), 1);
+                return true;
+            }
+            auto res = insert_into(_root, key.data(), value.data(), assign);
+            if (res.replacement) {
+                if (res.split) {
+                    const node_ptr children[2] = {std::move(res.replacement), std::move(res.split)};
+                    _root = make_branch(children, 2);
+                } else {
+                    _root = std::move(res.replacement);
+                }
+            }
+            return res.inserted;
+        }
+
+        struct insert_result {
+            node_ptr replacement; // nullptr if the node is unchanged
+            node_ptr split; // The right half, if the replacement overflowed
+            bool inserted;
+        };
+
+        static insert_result insert_into(const node_ptr &n, const byte_type *key, const byte_type *value, bool assign) {
+            if (n->leaf()) {
+                const size_type count = n->size;
+                const byte_type *keys = n->bytes.data();
+                const byte_type *values = keys + count * K_Extent;
+                const size_type pos = lower_bound_stride<K_Extent>(keys, count, key);
+                if (pos < count && equal_strides<K_Extent>(keys + pos * K_Extent, key)) {
+                    if (!assign || std::memcmp(values + pos * V_Extent, value, V_Extent) == 0) {
+                        return {nullptr, nullptr, false};
+                    }
+                    auto chunk = std::make_shared<node>(*n);
+                    std::memcpy(chunk->bytes.data() + count * K_Extent + pos * V_Extent, value, V_Extent);
+                    return {std::move(chunk), nullptr, false};
+                }
+                // The chunk's entries with the new one at pos, cut in two halves if they overflow it
+                std::vector<byte_type> merged((count + 1) * (K_Extent + V_Extent));
+                byte_type *merged_keys = merged.data();
+                byte_type *merged_values = merged_keys + (count + 1) * K_Extent;
+                std::memcpy(merged_keys, keys, pos * K_Extent);
+                std::memcpy(merged_keys + pos * K_Extent, key, K_Extent);
+                std::memcpy(merged_keys + (pos + 1) * K_Extent, keys + pos * K_Extent, (count - pos) * K_Extent);
+                std::memcpy(merged_values, values, pos * V_Extent);
+                std::memcpy(merged_values + pos * V_Extent, value, V_Extent);
+                std::memcpy(merged_values + (pos + 1) * V_Extent, values + pos * V_Extent, (count - pos) * V_Extent);
+                if (count + 1 <= ChunkEntries) {
+                    auto chunk = std::make_shared<node>();
+                    chunk->size = count + 1;
+                    chunk->bytes = std::move(merged);
+                    return {std::move(chunk), nullptr, true};
+                }
+                const size_type half = (count + 1) / 2;
+                return {make_chunk(merged_keys, merged_values, half),
+                        make_chunk(merged_keys + half * K_Extent, merged_values + half * V_Extent, count + 1 - half), true};
+            }
+            const size_type i = child_index(n.get(), key);
+            auto res = insert_into(n->children[i], key, value, assign);
+            if (!res.replacement) {
+                return res;
+            }
+            std::vector<node_ptr> children(n->children);
+            children[i] = std::move(res.replacement);
+            if (res.split) {
+                children.insert(children.begin() + i + 1, std::move(res.split));
+            }
+            if (children.size() <= Fanout) {
+                return {make_branch(children.data(), children.size()), nullptr, res.inserted};
+            }
+            const size_type half = children.size() / 2;
+            return {make_branch(children.data(), half), make_branch(children.data() + half, children.size() - half), res.inserted};
+        }
+
+        // Returns the replacement of the node (nullptr once it has no entries left) and whether the key was erased
+        static std::pair<node_ptr, bool> erase_from(const node_ptr &n, const byte_type *key) {
+            if (n->leaf()) {
+                const size_type count = n->size;
+                const byte_type *keys = n->bytes.data();
+                const byte_type *values = keys + count * K_Extent;
+                const size_type pos = lower_bound_stride<K_Extent>(keys, count, key);
+                if (pos == count || !equal_strides<K_Extent>(keys + pos * K_Extent, key)) {
+                    return {nullptr, false};
+                }
+                if (count == 1) {
+                    return {nullptr, true};
+                }
+                auto chunk = std::make_shared<node>();
+                chunk->size = count - 1;
+                chunk->bytes.resize((count - 1) * (K_Extent + V_Extent));
+                byte_type *to_keys = chunk->bytes.data();
+                byte_type *to_values = to_keys + (count - 1) * K_Extent;
+                std::memcpy(to_keys, keys, pos * K_Extent);
+                std::memcpy(to_keys + pos * K_Extent, keys + (pos + 1) * K_Extent, (count - pos - 1) * K_Extent);
+                std::memcpy(to_values, values, pos * V_Extent);
+                std::memcpy(to_values + pos * V_Extent, values + (pos + 1) * V_Extent, (count - pos - 1) * V_Extent);
+                return {std::move(chunk), true};
+            }
+            const size_type i = child_index(n.get(), key);
+            auto res = erase_from(n->children[i], key);
+            if (!res.second) {
+                return res;
+            }
+            std::vector<node_ptr> children(n->children);
+            if (!res.first) {
+                children.erase(children.begin() + i);
+                if (children.empty()) {
+                    return {nullptr, true};
+                }
+            } else {
+                children[i] = std::move(res.first);
+                // A child below a quarter full is merged into a neighbour when the two fit in one node, so erases do
+                // not leave long runs of near empty chunks behind
+                if (children.size() > 1 && underfull(*children[i])) {
+                    const size_type left = i + 1 < children.size() ? i : i - 1;
+                    if (auto merged = merge(*children[left], *children[left + 1])) {
+                        children[left] = std::move(merged);
+                        children.erase(children.begin() + left + 1);
+                    }
+                }
+            }
+            return {make_branch(children.data(), children.size()), true};
+        }
+
+        static bool underfull(const node &n) noexcept {
+            return n.leaf() ? n.size < ChunkEntries / 4 : n.children.size() < Fanout / 4;
+        }
+
+        // Both nodes' entries in one node, or nullptr if they do not fit
+        static node_ptr merge(const node &a, const node &b) {
+            if (a.leaf()) {
+                if (a.size + b.size > ChunkEntries) {
+                    return nullptr;
+                }
+                const size_type count = a.size + b.size;
+                auto chunk = std::make_shared<node>();
+                chunk->size = count;
+                chunk->bytes.resize(count * (K_Extent + V_Extent));
+                byte_type *keys = chunk->bytes.data();
+                std::memcpy(keys, a.bytes.data(), a.size * K_Extent);
+                std::memcpy(keys + a.size * K_Extent, b.bytes.data(), b.size * K_Extent);
+                std::memcpy(keys + count * K_Extent, a.bytes.data() + a.size * K_Extent, a.size * V_Extent);
+                std::memcpy(keys + count * K_Extent + a.size * V_Extent, b.bytes.data() + b.size * K_Extent, b.size * V_Extent);
+                return chunk;
+            }
+            if (a.children.size() + b.children.size() > Fanout) {
+                return nullptr;
+            }
+            std::vector<node_ptr> children(a.children);
+            children.insert(children.end(), b.children.begin(), b.children.end());
+            return make_branch(children.data(), children.size());
+        }
+
+        node_ptr _root;
+
+    };
+
+} //ns gnt
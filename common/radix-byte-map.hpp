@@ -0,0 +1,1120 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "nonstd/span.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace gnt {
+
+    // An ordered map from variable length byte keys to T, as an adaptive radix tree (Leis et al., "The Adaptive Radix
+    // Tree: ARTful Indexing for Main-Memory Databases"), for composite keys (e.g. a pack_uuid followed by a string)
+    // that do not fit the fixed K_Extent of small_byte_map.
+    // Each inner node consumes one byte of the key and picks the smallest of four layouts that holds its children:
+    //   node4   up to 4 children, keys and children searched linearly (one cache line)
+    //   node16  up to 16 children, the sorted keys compared in one SSE2 instruction
+    //   node48  up to 48 children, a 256 byte index from key byte to child slot
+    //   node256 a child per key byte
+    // so a lookup is at most one node per key byte instead of log n full key comparisons, and runs of bytes that only
+    // one path takes are compressed into the node's prefix. The first radix_inline_prefix bytes of a prefix are kept in
+    // the node; lookups skip over the rest and compare the whole key once they reach a leaf, and the updates that need
+    // the rest read it from a leaf below.
+    // A key that ends at an inner node (a prefix of other keys) is that node's terminal leaf, so any bytes are allowed in
+    // keys and there is no terminator byte.
+    // Leaves are linked in key order, so iteration, lower_bound and prefix_range ranges are list walks and iterators are
+    // one pointer. Iterators and references stay valid until their entry is erased.
+    // Keys are taken as nonstd::span<const byte_type>, which vector_view, spans, std::vector and std::array convert to, so
+    // lookups do not copy the key. Entries hand their key back as a span over the leaf's own copy.
+
+    template<typename T, typename byte_type>
+    class radix_byte_map;
+
+    namespace detail {
+
+        // Node children are tagged pointers: the low bit is set for a leaf, whose T the node code does not need to know
+        using radix_ref = std::uintptr_t;
+
+        constexpr std::size_t radix_inline_prefix = 8;
+
+        inline bool radix_is_leaf(radix_ref ref) noexcept {
+            return (ref & 1) != 0;
+        }
+
+        template<typename Leaf>
+        inline radix_ref radix_leaf_ref(Leaf *leaf) noexcept {
+            return reinterpret_cast<radix_ref>(leaf) | 1;
+        }
+
+        template<typename Leaf>
+        inline Leaf *radix_leaf_of(radix_ref ref) noexcept {
+            return reinterpret_cast<Leaf *>(ref & ~static_cast<radix_ref>(1));
+        }
+
+        enum class radix_node_kind : std::uint8_t {
+            node4, node16, node48, node256
+        };
+
+        struct radix_node {
+
+            explicit radix_node(radix_node_kind k) noexcept : kind(k) {}
+
+            radix_node_kind kind;
+            std::uint16_t count = 0; // Children, not counting the terminal leaf
+            std::uint32_t prefix_size = 0;
+            unsigned char prefix[radix_inline_prefix] = {}; // The first bytes of the prefix
+            radix_ref terminal = 0; // The leaf whose key ends at this node, if any
+
+        };
+
+        struct radix_node4 : radix_node {
+            radix_node4() noexcept : radix_node(radix_node_kind::node4) {}
+            unsigned char keys[4] = {}; // Sorted
+            radix_ref children[4] = {};
+        };
+
+        struct radix_node16 : radix_node {
+            radix_node16() noexcept : radix_node(radix_node_kind::node16) {}
+            unsigned char keys[16] = {}; // Sorted
+            radix_ref children[16] = {};
+        };
+
+        struct radix_node48 : radix_node {
+            radix_node48() noexcept : radix_node(radix_node_kind::node48) {}
+            unsigned char index[256] = {}; // Slot + 1 of the child for each key byte, 0 for none
+            radix_ref children[48] = {};
+        };
+
+        struct radix_node256 : radix_node {
+            radix_node256() noexcept : radix_node(radix_node_kind::node256) {}
+            radix_ref children[256] = {};
+        };
+
+        inline radix_node *radix_inner(radix_ref ref) noexcept {
+            return reinterpret_cast<radix_node *>(ref);
+        }
+
+        inline radix_ref radix_inner_ref(radix_node *node) noexcept {
+            return reinterpret_cast<radix_ref>(node);
+        }
+
+        inline void delete_radix_node(radix_node *node) noexcept {
+            switch (node->kind) {
+                case radix_node_kind::node4:
+                    delete static_cast<radix_node4 *>(node);
+                    break;
+                case radix_node_kind::node16:
+                    delete static_cast<radix_node16 *>(node);
+                    break;
+                case radix_node_kind::node48:
+                    delete static_cast<radix_node48 *>(node);
+                    break;
+                case radix_node_kind::node256:
+                    delete static_cast<radix_node256 *>(node);
+                    break;
+            }
+        }
+
+        inline void copy_radix_header(radix_node *to, const radix_node *from) noexcept {
+            to->count = from->count;
+            to->prefix_size = from->prefix_size;
+            std::memcpy(to->prefix, from->prefix, radix_inline_prefix);
+            to->terminal = from->terminal;
+        }
+
+        // The slot of the child for key byte c, or nullptr
+        inline radix_ref *find_radix_child(radix_node *node, unsigned char c) noexcept {
+            switch (node->kind) {
+                case radix_node_kind::node4: {
+                    auto *n = static_cast<radix_node4 *>(node);
+                    for (unsigned i = 0; i < n->count; ++i) {
+                        if (n->keys[i] == c) {
+                            return &n->children[i];
+                        }
+                    }
+                    return nullptr;
+                }
+                case radix_node_kind::node16: {
+                    auto *n = static_cast<radix_node16 *>(node);
+#if defined(__SSE2__)
+                    const __m128i eq = _mm_cmpeq_epi8(_mm_set1_epi8(static_cast<char>(c)), _mm_loadu_si128(reinterpret_cast<const __m128i *>(n->keys)));
+                    const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(eq)) & ((1u << n->count) - 1);
+                    return mask != 0 ? &n->children[__builtin_ctz(mask)] : nullptr;
+#else
+                    for (unsigned i = 0; i < n->count; ++i) {
+                        if (n->keys[i] == c) {
+                            return &n->children[i];
+                        }
+                    }
+                    return nullptr;
+#endif
+                }
+                case radix_node_kind::node48: {
+                    auto *n = static_cast<radix_node48 *>(node);
+                    return n->index[c] != 0 ? &n->children[n->index[c] - 1] : nullptr;
+                }
+                case radix_node_kind::node256: {
+                    auto *n = static_cast<radix_node256 *>(node);
+                    return n->children[c] != 0 ? &n->children[c] : nullptr;
+                }
+            }
+            return nullptr;
+        }
+
+        // The child with the smallest key byte greater than c (or the smallest of all if c is negative), or 0
+        inline radix_ref next_radix_child(const radix_node *node, int c) noexcept {
+            switch (node->kind) {
+                case radix_node_kind::node4:
+                case radix_node_kind::node16: {
+                    const unsigned char *keys;
+                    const radix_ref *children;
+                    if (node->kind == radix_node_kind::node4) {
+                        keys = static_cast<const radix_node4 *>(node)->keys;
+                        children = static_cast<const radix_node4 *>(node)->children;
+                    } else {
+                        keys = static_cast<const radix_node16 *>(node)->keys;
+                        children = static_cast<const radix_node16 *>(node)->children;
+                    }
+                    for (unsigned i = 0; i < node->count; ++i) {
+                        if (keys[i] > c) {
+                            return children[i];
+                        }
+                    }
+                    return 0;
+                }
+                case radix_node_kind::node48: {
+                    auto *n = static_cast<const radix_node48 *>(node);
+                    for (int b = c + 1; b < 256; ++b) {
+                        if (n->index[b] != 0) {
+                            return n->children[n->index[b] - 1];
+                        }
+                    }
+                    return 0;
+                }
+                case radix_node_kind::node256: {
+                    auto *n = static_cast<const radix_node256 *>(node);
+                    for (int b = c + 1; b < 256; ++b) {
+                        if (n->children[b] != 0) {
+                            return n->children[b];
+                        }
+                    }
+                    return 0;
+                }
+            }
+            return 0;
+        }
+
+        // The child with the greatest key byte, or 0
+        inline radix_ref last_radix_child(const radix_node *node) noexcept {
+            if (node->count == 0) {
+                return 0;
+            }
+            switch (node->kind) {
+                case radix_node_kind::node4:
+                    return static_cast<const radix_node4 *>(node)->children[node->count - 1];
+                case radix_node_kind::node16:
+                    return static_cast<const radix_node16 *>(node)->children[node->count - 1];
+                case radix_node_kind::node48: {
+                    auto *n = static_cast<const radix_node48 *>(node);
+                    for (int b = 255; b >= 0; --b) {
+                        if (n->index[b] != 0) {
+                            return n->children[n->index[b] - 1];
+                        }
+                    }
+                    return 0;
+                }
+                case radix_node_kind::node256: {
+                    auto *n = static_cast<const radix_node256 *>(node);
+                    for (int b = 255; b >= 0; --b) {
+                        if (n->children[b] != 0) {
+                            return n->children[b];
+                        }
+                    }
+                    return 0;
+                }
+            }
+            return 0;
+        }
+
+        // Sorted insert into the keys and children of a node4 or node16 with room
+        inline void insert_sorted_radix_child(unsigned char *keys, radix_ref *children, unsigned count, unsigned char c, radix_ref child) noexcept {
+            unsigned pos = 0;
+            while (pos < count && keys[pos] < c) {
+                ++pos;
+            }
+            std::memmove(keys + pos + 1, keys + pos, count - pos);
+            std::memmove(children + pos + 1, children + pos, (count - pos) * sizeof(radix_ref));
+            keys[pos] = c;
+            children[pos] = child;
+        }
+
+        // Makes room for one more child, replacing the node (and the slot that points at it) with the next larger
+        // layout if it is full. Only allocates, so a throw leaves the tree as it was.
+        inline radix_node *reserve_radix_child(radix_ref &slot, radix_node *node) {
+            switch (node->kind) {
+                case radix_node_kind::node4: {
+                    auto *n = static_cast<radix_node4 *>(node);
+                    if (n->count < 4) {
+                        return node;
+                    }
+                    auto *grown = new radix_node16();
+                    copy_radix_header(grown, n);
+                    std::memcpy(grown->keys, n->keys, 4);
+                    std::memcpy(grown->children, n->children, 4 * sizeof(radix_ref));
+                    delete n;
+                    slot = radix_inner_ref(grown);
+                    return grown;
+                }
+                case radix_node_kind::node16: {
+                    auto *n = static_cast<radix_node16 *>(node);
+                    if (n->count < 16) {
+                        return node;
+                    }
+                    auto *grown = new radix_node48();
+                    copy_radix_header(grown, n);
+                    for (unsigned i = 0; i < 16; ++i) {
+                        grown->index[n->keys[i]] = static_cast<unsigned char>(i + 1);
+                        grown->children[i] = n->children[i];
+                    }
+                    delete n;
+                    slot = radix_inner_ref(grown);
+                    return grown;
+                }
+                case radix_node_kind::node48: {
+                    auto *n = static_cast<radix_node48 *>(node);
+                    if (n->count < 48) {
+                        return node;
+                    }
+                    auto *grown = new radix_node256();
+                    copy_radix_header(grown, n);
+                    for (unsigned b = 0; b < 256; ++b) {
+                        if (n->index[b] != 0) {
+                            grown->children[b] = n->children[n->index[b] - 1];
+                        }
+                    }
+                    delete n;
+                    slot = radix_inner_ref(grown);
+                    return grown;
+                }
+                case radix_node_kind::node256:
+                    return node;
+            }
+            return node;
+        }
+
+        // Adds a child for key byte c, which the node does not have, after reserve_radix_child
+        inline void add_radix_child(radix_node *node, unsigned char c, radix_ref child) noexcept {
+            switch (node->kind) {
+                case radix_node_kind::node4: {
+                    auto *n = static_cast<radix_node4 *>(node);
+                    insert_sorted_radix_child(n->keys, n->children, n->count, c, child);
+                    break;
+                }
+                case radix_node_kind::node16: {
+                    auto *n = static_cast<radix_node16 *>(node);
+                    insert_sorted_radix_child(n->keys, n->children, n->count, c, child);
+                    break;
+                }
+                case radix_node_kind::node48: {
+                    auto *n = static_cast<radix_node48 *>(node);
+                    unsigned slot = 0;
+                    while (n->children[slot] != 0) {
+                        ++slot;
+                    }
+                    n->children[slot] = child;
+                    n->index[c] = static_cast<unsigned char>(slot + 1);
+                    break;
+                }
+                case radix_node_kind::node256:
+                    static_cast<radix_node256 *>(node)->children[c] = child;
+                    break;
+            }
+            ++node->count;
+        }
+
+        // Removes the child for key byte c, replacing the node (and the slot that points at it) with the next smaller
+        // layout once it is well below that layout's capacity, so alternating inserts and erases do not resize it.
+        // Collapsing a node down to its only child is up to the caller, which knows the keys.
+        inline radix_node *remove_radix_child(radix_ref &slot, radix_node *node, unsigned char c) noexcept {
+            switch (node->kind) {
+                case radix_node_kind::node4:
+                case radix_node_kind::node16: {
+                    unsigned char *keys;
+                    radix_ref *children;
+                    if (node->kind == radix_node_kind::node4) {
+                        keys = static_cast<radix_node4 *>(node)->keys;
+                        children = static_cast<radix_node4 *>(node)->children;
+                    } else {
+                        keys = static_cast<radix_node16 *>(node)->keys;
+                        children = static_cast<radix_node16 *>(node)->children;
+                    }
+                    unsigned pos = 0;
+                    while (keys[pos] != c) {
+                        ++pos;
+                    }
+                    std::memmove(keys + pos, keys + pos + 1, node->count - pos - 1);
+                    std::memmove(children + pos, children + pos + 1, (node->count - pos - 1) * sizeof(radix_ref));
+                    --node->count;
+                    if (node->kind == radix_node_kind::node16 && node->count <= 3) {
+                        auto *n = static_cast<radix_node16 *>(node);
+                        auto *shrunk = new(std::nothrow) radix_node4();
+                        if (shrunk != nullptr) {
+                            copy_radix_header(shrunk, n);
+                            std::memcpy(shrunk->keys, n->keys, n->count);
+                            std::memcpy(shrunk->children, n->children, n->count * sizeof(radix_ref));
+                            delete n;
+                            slot = radix_inner_ref(shrunk);
+                            return shrunk;
+                        }
+                    }
+                    return node;
+                }
+                case radix_node_kind::node48: {
+                    auto *n = static_cast<radix_node48 *>(node);
+                    n->children[n->index[c] - 1] = 0;
+                    n->index[c] = 0;
+                    --n->count;
+                    if (n->count <= 12) {
+                        auto *shrunk = new(std::nothrow) radix_node16();
+                        if (shrunk != nullptr) {
+                            copy_radix_header(shrunk, n);
+                            unsigned i = 0;
+                            for (unsigned b = 0; b < 256; ++b) {
+                                if (n->index[b] != 0) {
+                                    shrunk->keys[i] = static_cast<unsigned char>(b);
+                                    shrunk->children[i++] = n->children[n->index[b] - 1];
+                                }
+                            }
+                            delete n;
+                            slot = radix_inner_ref(shrunk);
+                            return shrunk;
+                        }
+                    }
+                    return node;
+                }
+                case radix_node_kind::node256: {
+                    auto *n = static_cast<radix_node256 *>(node);
+                    n->children[c] = 0;
+                    --n->count;
+                    if (n->count <= 40) {
+                        auto *shrunk = new(std::nothrow) radix_node48();
+                        if (shrunk != nullptr) {
+                            copy_radix_header(shrunk, n);
+                            unsigned i = 0;
+                            for (unsigned b = 0; b < 256; ++b) {
+                                if (n->children[b] != 0) {
+                                    shrunk->children[i] = n->children[b];
+                                    shrunk->index[b] = static_cast<unsigned char>(++i);
+                                }
+                            }
+                            delete n;
+                            slot = radix_inner_ref(shrunk);
+                            return shrunk;
+                        }
+                    }
+                    return node;
+                }
+            }
+            return node;
+        }
+
+        // Deletes the inner nodes of a tree (the leaves are freed through their list)
+        inline void delete_radix_nodes(radix_ref ref) noexcept {
+            if (ref == 0 || radix_is_leaf(ref)) {
+                return;
+            }
+            radix_node *node = radix_inner(ref);
+            switch (node->kind) {
+                case radix_node_kind::node4:
+                    for (unsigned i = 0; i < node->count; ++i) {
+                        delete_radix_nodes(static_cast<radix_node4 *>(node)->children[i]);
+                    }
+                    break;
+                case radix_node_kind::node16:
+                    for (unsigned i = 0; i < node->count; ++i) {
+                        delete_radix_nodes(static_cast<radix_node16 *>(node)->children[i]);
+                    }
+                    break;
+                case radix_node_kind::node48:
+                    for (radix_ref child : static_cast<radix_node48 *>(node)->children) {
+                        delete_radix_nodes(child);
+                    }
+                    break;
+                case radix_node_kind::node256:
+                    for (radix_ref child : static_cast<radix_node256 *>(node)->children) {
+                        delete_radix_nodes(child);
+                    }
+                    break;
+            }
+            delete_radix_node(node);
+        }
+
+        // One entry, followed in the same allocation by the bytes of its key
+        template<typename T, typename byte_type>
+        struct radix_leaf {
+
+            using key_span = nonstd::span<const byte_type>;
+            using value_type = std::pair<const key_span, T>;
+
+            template<typename... Args>
+            explicit radix_leaf(std::size_t key_size, Args &&... args)
+                : entry(std::piecewise_construct, std::forward_as_tuple(reinterpret_cast<const byte_type *>(this + 1), key_size),
+                        std::forward_as_tuple(std::forward<Args>(args)...)) {}
+
+            const unsigned char *key_bytes() const noexcept {
+                return reinterpret_cast<const unsigned char *>(this + 1);
+            }
+
+            std::size_t key_size() const noexcept {
+                return entry.first.size();
+            }
+
+            radix_leaf *prev = nullptr;
+            radix_leaf *next = nullptr;
+            value_type entry;
+
+        };
+
+    } //ns detail
+
+    // Walks the entries of a radix_byte_map in key order
+    template<typename Leaf, typename Value>
+    struct radix_byte_map_iterator {
+
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::remove_const_t<Value>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = Value *;
+        using reference = Value &;
+
+        radix_byte_map_iterator() = default;
+
+        explicit radix_byte_map_iterator(Leaf *leaf) noexcept : _leaf(leaf) {}
+
+        // An iterator converts to a const_iterator
+        template<typename Value2, typename = std::enable_if_t<std::is_same_v<const Value2, Value> && !std::is_same_v<Value2, Value>>>
+        radix_byte_map_iterator(const radix_byte_map_iterator<Leaf, Value2> &it) noexcept : _leaf(it._leaf) {}
+
+        reference operator*() const noexcept {
+            return _leaf->entry;
+        }
+
+        pointer operator->() const noexcept {
+            return &_leaf->entry;
+        }
+
+        radix_byte_map_iterator &operator++() noexcept {
+            _leaf = _leaf->next;
+            return *this;
+        }
+
+        radix_byte_map_iterator operator++(int) noexcept {
+            auto prev = *this;
+            ++(*this);
+            return prev;
+        }
+
+        template<typename Value2>
+        bool operator==(const radix_byte_map_iterator<Leaf, Value2> &b) const noexcept {
+            return _leaf == b._leaf;
+        }
+
+        template<typename Value2>
+        bool operator!=(const radix_byte_map_iterator<Leaf, Value2> &b) const noexcept {
+            return _leaf != b._leaf;
+        }
+
+    private:
+
+        template<typename, typename>
+        friend struct radix_byte_map_iterator;
+
+        template<typename, typename>
+        friend class radix_byte_map;
+
+        Leaf *_leaf = nullptr;
+
+    };
+
+    template<typename T, typename byte_type = std::byte>
+    class radix_byte_map {
+
+        using leaf = detail::radix_leaf<T, byte_type>;
+        using radix_ref = detail::radix_ref;
+        using radix_node = detail::radix_node;
+
+    public:
+
+        using key_span = nonstd::span<const byte_type>;
+        using key_type = key_span;
+        using mapped_type = T;
+        using value_type = std::pair<const key_span, T>;
+        using size_type = std::size_t;
+        using iterator = radix_byte_map_iterator<leaf, value_type>;
+        using const_iterator = radix_byte_map_iterator<leaf, const value_type>;
+
+        radix_byte_map() = default;
+
+        radix_byte_map(const radix_byte_map &other) : radix_byte_map() {
+            for (const auto &kv : other) {
+                try_emplace(kv.first, kv.second);
+            }
+        }
+
+        radix_byte_map(radix_byte_map &&other) noexcept
+            : _root(std::exchange(other._root, 0)), _head(std::exchange(other._head, nullptr)), _tail(std::exchange(other._tail, nullptr)),
+              _size(std::exchange(other._size, 0)) {}
+
+        radix_byte_map &operator=(radix_byte_map other) noexcept {
+            swap(other);
+            return *this;
+        }
+
+        ~radix_byte_map() {
+            clear();
+        }
+
+        void swap(radix_byte_map &other) noexcept {
+            std::swap(_root, other._root);
+            std::swap(_head, other._head);
+            std::swap(_tail, other._tail);
+            std::swap(_size, other._size);
+        }
+
+        iterator begin() noexcept {
+            return iterator(_head);
+        }
+
+        const_iterator begin() const noexcept {
+            return const_iterator(_head);
+        }
+
+        iterator end() noexcept {
+            return iterator();
+        }
+
+        const_iterator end() const noexcept {
+            return const_iterator();
+        }
+
+        [[nodiscard]] bool empty() const noexcept {
+            return _size == 0;
+        }
+
+        size_type size() const noexcept {
+            return _size;
+        }
+
+        void clear() noexcept {
+            detail::delete_radix_nodes(_root);
+            for (leaf *l = _head; l != nullptr;) {
+                leaf *next = l->next;
+                destroy_leaf(l);
+                l = next;
+            }
+            _root = 0;
+            _head = _tail = nullptr;
+            _size = 0;
+        }
+
+        iterator find(key_span key) noexcept {
+            return iterator(find_leaf(bytes_of(key), key.size()));
+        }
+
+        const_iterator find(key_span key) const noexcept {
+            return const_iterator(find_leaf(bytes_of(key), key.size()));
+        }
+
+        bool contains(key_span key) const noexcept {
+            return find_leaf(bytes_of(key), key.size()) != nullptr;
+        }
+
+        size_type count(key_span key) const noexcept {
+            return contains(key) ? 1 : 0;
+        }
+
+        T &at(key_span key) {
+            leaf *l = find_leaf(bytes_of(key), key.size());
+            if (l == nullptr) {
+                throw std::out_of_range("key is not in radix_byte_map");
+            }
+            return l->entry.second;
+        }
+
+        const T &at(key_span key) const {
+            return const_cast<radix_byte_map *>(this)->at(key);
+        }
+
+        // Inserts a default constructed T if the key isn't already in the map
+        T &operator[](key_span key) {
+            return try_emplace(key).first->second;
+        }
+
+        // Constructs the value from args only if the key isn't already in the map
+        template<typename... Args>
+        std::pair<iterator, bool> try_emplace(key_span key, Args &&... args) {
+            const unsigned char *k = bytes_of(key);
+            const size_type n = key.size();
+            radix_ref *slot = &_root;
+            size_type depth = 0;
+            while (true) {
+                const radix_ref ref = *slot;
+                if (ref == 0) { // Only the root of an empty map
+                    leaf *l = make_leaf(key, std::forward<Args>(args)...);
+                    *slot = detail::radix_leaf_ref(l);
+                    link_leaf(l, nullptr);
+                    return {iterator(l), true};
+                }
+                if (detail::radix_is_leaf(ref)) {
+                    leaf *existing = detail::radix_leaf_of<leaf>(ref);
+                    const unsigned char *e = existing->key_bytes();
+                    const size_type en = existing->key_size();
+                    size_type i = depth;
+                    while (i < n && i < en && e[i] == k[i]) {
+                        ++i;
+                    }
+                    if (i == n && i == en) {
+                        return {iterator(existing), false};
+                    }
+                    // Both keys go under a new node4 whose prefix is the bytes they share past depth
+                    std::unique_ptr<detail::radix_node4> node(new detail::radix_node4());
+                    set_prefix(node.get(), k + depth, i - depth);
+                    leaf *l = make_leaf(key, std::forward<Args>(args)...);
+                    attach_leaf(node.get(), existing, i);
+                    attach_leaf(node.get(), l, i);
+                    *slot = detail::radix_inner_ref(node.release());
+                    const bool before = i == n || (i < en && k[i] < e[i]);
+                    link_leaf(l, before ? existing : existing->next);
+                    return {iterator(l), true};
+                }
+                radix_node *node = detail::radix_inner(ref);
+                if (node->prefix_size > 0) {
+                    const size_type p = prefix_mismatch(node, k, n, depth);
+                    if (p < node->prefix_size) {
+                        // The key leaves the prefix after p bytes: split it with a node4 holding the p shared bytes
+                        const unsigned char old_byte = prefix_byte(node, depth, p);
+                        const bool key_ends = depth + p == n;
+                        leaf *successor = key_ends || k[depth + p] < old_byte ? min_leaf(ref) : max_leaf(ref)->next;
+                        std::unique_ptr<detail::radix_node4> parent(new detail::radix_node4());
+                        set_prefix(parent.get(), k + depth, p);
+                        leaf *l = make_leaf(key, std::forward<Args>(args)...);
+                        drop_prefix(node, depth, p + 1);
+                        detail::add_radix_child(parent.get(), old_byte, ref);
+                        if (key_ends) {
+                            parent->terminal = detail::radix_leaf_ref(l);
+                        } else {
+                            detail::add_radix_child(parent.get(), k[depth + p], detail::radix_leaf_ref(l));
+                        }
+                        *slot = detail::radix_inner_ref(parent.release());
+                        link_leaf(l, successor);
+                        return {iterator(l), true};
+                    }
+                    depth += node->prefix_size;
+                }
+                if (depth == n) {
+                    if (node->terminal != 0) {
+                        return {iterator(detail::radix_leaf_of<leaf>(node->terminal)), false};
+                    }
+                    // Without a terminal leaf a node has at least two children, and the key is before all of them
+                    leaf *successor = min_leaf(ref);
+                    leaf *l = make_leaf(key, std::forward<Args>(args)...);
+                    node->terminal = detail::radix_leaf_ref(l);
+                    link_leaf(l, successor);
+                    return {iterator(l), true};
+                }
+                const unsigned char c = k[depth];
+                if (radix_ref *child = detail::find_radix_child(node, c)) {
+                    slot = child;
+                    ++depth;
+                    continue;
+                }
+                const radix_ref after = detail::next_radix_child(node, c);
+                leaf *successor = after != 0 ? min_leaf(after) : max_leaf(ref)->next;
+                node = detail::reserve_radix_child(*slot, node);
+                leaf *l = make_leaf(key, std::forward<Args>(args)...);
+                detail::add_radix_child(node, c, detail::radix_leaf_ref(l));
+                link_leaf(l, successor);
+                return {iterator(l), true};
+            }
+        }
+
+        std::pair<iterator, bool> insert(key_span key, const T &value) {
+            return try_emplace(key, value);
+        }
+
+        std::pair<iterator, bool> insert(key_span key, T &&value) {
+            return try_emplace(key, std::move(value));
+        }
+
+        template<typename M>
+        std::pair<iterator, bool> insert_or_assign(key_span key, M &&value) {
+            auto res = try_emplace(key, std::forward<M>(value));
+            if (!res.second) {
+                res.first->second = std::forward<M>(value);
+            }
+            return res;
+        }
+
+        size_type erase(key_span key) noexcept {
+            const unsigned char *k = bytes_of(key);
+            const size_type n = key.size();
+            radix_ref *slot = &_root;
+            radix_ref *parent_slot = nullptr; // The slot of the node the current slot is in
+            int parent_byte = -1; // The key byte of the current slot in that node, -1 for its terminal leaf
+            size_type depth = 0;
+            while (*slot != 0) {
+                const radix_ref ref = *slot;
+                if (detail::radix_is_leaf(ref)) {
+                    leaf *l = detail::radix_leaf_of<leaf>(ref);
+                    if (!equal_key(l, k, n)) {
+                        return 0;
+                    }
+                    if (parent_slot == nullptr) {
+                        _root = 0;
+                    } else {
+                        radix_node *parent = detail::radix_inner(*parent_slot);
+                        if (parent_byte < 0) {
+                            parent->terminal = 0;
+                        } else {
+                            parent = detail::remove_radix_child(*parent_slot, parent, static_cast<unsigned char>(parent_byte));
+                        }
+                        collapse(*parent_slot, parent);
+                    }
+                    unlink_leaf(l);
+                    destroy_leaf(l);
+                    return 1;
+                }
+                radix_node *node = detail::radix_inner(ref);
+                if (node->prefix_size > 0) {
+                    // Like find, only the inline prefix bytes are compared: the leaf compare checks the rest
+                    if (depth + node->prefix_size > n ||
+                        std::memcmp(node->prefix, k + depth, std::min<size_type>(node->prefix_size, detail::radix_inline_prefix)) != 0) {
+                        return 0;
+                    }
+                    depth += node->prefix_size;
+                }
+                parent_slot = slot;
+                if (depth == n) {
+                    parent_byte = -1;
+                    slot = &node->terminal;
+                } else {
+                    slot = detail::find_radix_child(node, k[depth]);
+                    if (slot == nullptr) {
+                        return 0;
+                    }
+                    parent_byte = k[depth++];
+                }
+            }
+            return 0;
+        }
+
+        iterator erase(const_iterator pos) noexcept {
+            leaf *next = pos._leaf->next;
+            erase(pos._leaf->entry.first);
+            return iterator(next);
+        }
+
+        // The first entry whose key is not less than key (keys compare like std::string: bytewise, then shorter first)
+        iterator lower_bound(key_span key) noexcept {
+            return iterator(lower_bound_leaf(bytes_of(key), key.size()));
+        }
+
+        const_iterator lower_bound(key_span key) const noexcept {
+            return const_iterator(lower_bound_leaf(bytes_of(key), key.size()));
+        }
+
+        // The first entry whose key is greater than key
+        iterator upper_bound(key_span key) noexcept {
+            return iterator(upper_bound_leaf(bytes_of(key), key.size()));
+        }
+
+        const_iterator upper_bound(key_span key) const noexcept {
+            return const_iterator(upper_bound_leaf(bytes_of(key), key.size()));
+        }
+
+        // The entries whose keys start with prefix, in key order (an empty prefix is every entry). The subtree of the
+        // prefix is found in one descent, and its first and last leaves bound the range.
+        std::pair<iterator, iterator> prefix_range(key_span prefix) noexcept {
+            const auto range = prefix_leaves(bytes_of(prefix), prefix.size());
+            return {iterator(range.first), iterator(range.second)};
+        }
+
+        std::pair<const_iterator, const_iterator> prefix_range(key_span prefix) const noexcept {
+            const auto range = prefix_leaves(bytes_of(prefix), prefix.size());
+            return {const_iterator(range.first), const_iterator(range.second)};
+        }
+
+    private:
+
+        static const unsigned char *bytes_of(key_span key) noexcept {
+            return reinterpret_cast<const unsigned char *>(key.data());
+        }
+
+        // Bytewise, then shorter first
+        static int compare_keys(const unsigned char *a, size_type an, const unsigned char *b, size_type bn) noexcept {
+            const int c = an == 0 || bn == 0 ? 0 : std::memcmp(a, b, std::min(an, bn));
+            return c != 0 ? c : (an < bn ? -1 : (an > bn ? 1 : 0));
+        }
+
+        static bool equal_key(const leaf *l, const unsigned char *k, size_type n) noexcept {
+            return l->key_size() == n && (n == 0 || std::memcmp(l->key_bytes(), k, n) == 0);
+        }
+
+        template<typename... Args>
+        static leaf *make_leaf(key_span key, Args &&... args) {
+            void *mem = ::operator new(sizeof(leaf) + key.size());
+            leaf *l;
+            try {
+                l = new(mem) leaf(key.size(), std::forward<Args>(args)...);
+            } catch (...) {
+                ::operator delete(mem);
+                throw;
+            }
+            if (!key.empty()) {
+                std::memcpy(reinterpret_cast<unsigned char *>(l + 1), key.data(), key.size());
+            }
+            return l;
+        }
+
+        static void destroy_leaf(leaf *l) noexcept {
+            l->~leaf();
+            ::operator delete(static_cast<void *>(l));
+        }
+
+        // Links a new leaf in before successor (at the end if it is nullptr)
+        void link_leaf(leaf *l, leaf *successor) noexcept {
+            l->next = successor;
+            l->prev = successor != nullptr ? successor->prev : _tail;
+            (l->prev != nullptr ? l->prev->next : _head) = l;
+            (successor != nullptr ? successor->prev : _tail) = l;
+            ++_size;
+        }
+
+        void unlink_leaf(leaf *l) noexcept {
+            (l->prev != nullptr ? l->prev->next : _head) = l->next;
+            (l->next != nullptr ? l->next->prev : _tail) = l->prev;
+            --_size;
+        }
+
+        // Hangs a leaf off a fresh node4 whose prefix ends at depth: as its terminal leaf if its key ends there
+        static void attach_leaf(radix_node *node, leaf *l, size_type depth) noexcept {
+            if (l->key_size() == depth) {
+                node->terminal = detail::radix_leaf_ref(l);
+            } else {
+                detail::add_radix_child(node, l->key_bytes()[depth], detail::radix_leaf_ref(l));
+            }
+        }
+
+        static void set_prefix(radix_node *node, const unsigned char *prefix, size_type size) noexcept {
+            node->prefix_size = static_cast<std::uint32_t>(size);
+            std::memcpy(node->prefix, prefix, std::min(size, detail::radix_inline_prefix));
+        }
+
+        static leaf *min_leaf(radix_ref ref) noexcept {
+            while (!detail::radix_is_leaf(ref)) {
+                const radix_node *node = detail::radix_inner(ref);
+                ref = node->terminal != 0 ? node->terminal : detail::next_radix_child(node, -1);
+            }
+            return detail::radix_leaf_of<leaf>(ref);
+        }
+
+        static leaf *max_leaf(radix_ref ref) noexcept {
+            while (!detail::radix_is_leaf(ref)) {
+                const radix_node *node = detail::radix_inner(ref);
+                const radix_ref last = detail::last_radix_child(node);
+                ref = last != 0 ? last : node->terminal;
+            }
+            return detail::radix_leaf_of<leaf>(ref);
+        }
+
+        // Byte i of the prefix of a node whose prefix starts at depth
+        static unsigned char prefix_byte(const radix_node *node, size_type depth, size_type i) noexcept {
+            if (i < detail::radix_inline_prefix) {
+                return node->prefix[i];
+            }
+            return min_leaf(detail::radix_inner_ref(const_cast<radix_node *>(node)))->key_bytes()[depth + i];
+        }
+
+        // How many bytes of the node's prefix the key matches from depth (fewer than the prefix if it ends first)
+        static size_type prefix_mismatch(const radix_node *node, const unsigned char *k, size_type n, size_type depth) noexcept {
+            const size_type limit = std::min<size_type>(node->prefix_size, n - depth);
+            const size_type inline_limit = std::min(limit, detail::radix_inline_prefix);
+            size_type i = 0;
+            while (i < inline_limit && node->prefix[i] == k[depth + i]) {
+                ++i;
+            }
+            if (i < inline_limit || i == limit) {
+                return i;
+            }
+            const unsigned char *full = min_leaf(detail::radix_inner_ref(const_cast<radix_node *>(node)))->key_bytes() + depth;
+            while (i < limit && full[i] == k[depth + i]) {
+                ++i;
+            }
+            return i;
+        }
+
+        // Removes the first count bytes of the prefix of a node whose prefix starts at depth
+        static void drop_prefix(radix_node *node, size_type depth, size_type count) noexcept {
+            const size_type remaining = node->prefix_size - count;
+            if (node->prefix_size <= detail::radix_inline_prefix) {
+                std::memmove(node->prefix, node->prefix + count, remaining);
+            } else {
+                const unsigned char *full = min_leaf(detail::radix_inner_ref(node))->key_bytes() + depth + count;
+                std::memcpy(node->prefix, full, std::min(remaining, detail::radix_inline_prefix));
+            }
+            node->prefix_size = static_cast<std::uint32_t>(remaining);
+        }
+
+        // After an erase, replaces a node left with a single entry by that entry, merging prefixes when it is a node
+        static void collapse(radix_ref &slot, radix_node *node) noexcept {
+            if (node->kind != detail::radix_node_kind::node4 || node->count + (node->terminal != 0 ? 1 : 0) != 1) {
+                return;
+            }
+            if (node->count == 0) {
+                slot = node->terminal;
+            } else {
+                auto *n4 = static_cast<detail::radix_node4 *>(node);
+                const radix_ref child = n4->children[0];
+                if (!detail::radix_is_leaf(child)) {
+                    radix_node *below = detail::radix_inner(child);
+                    unsigned char merged[detail::radix_inline_prefix];
+                    size_type m = std::min<size_type>(node->prefix_size, detail::radix_inline_prefix);
+                    std::memcpy(merged, node->prefix, m);
+                    if (m < detail::radix_inline_prefix) {
+                        merged[m++] = n4->keys[0];
+                        const size_type take = std::min<size_type>(below->prefix_size, detail::radix_inline_prefix - m);
+                        std::memcpy(merged + m, below->prefix, take);
+                        m += take;
+                    }
+                    std::memcpy(below->prefix, merged, m);
+                    below->prefix_size += node->prefix_size + 1;
+                }
+                slot = child;
+            }
+            detail::delete_radix_node(node);
+        }
+
+        leaf *find_leaf(const unsigned char *k, size_type n) const noexcept {
+            radix_ref ref = _root;
+            size_type depth = 0;
+            while (ref != 0) {
+                if (detail::radix_is_leaf(ref)) {
+                    leaf *l = detail::radix_leaf_of<leaf>(ref);
+                    return equal_key(l, k, n) ? l : nullptr;
+                }
+                radix_node *node = detail::radix_inner(ref);
+                if (node->prefix_size > 0) {
+                    // Optimistic past the inline bytes: the leaf compare checks the rest
+                    if (depth + node->prefix_size > n ||
+                        std::memcmp(node->prefix, k + depth, std::min<size_type>(node->prefix_size, detail::radix_inline_prefix)) != 0) {
+                        return nullptr;
+                    }
+                    depth += node->prefix_size;
+                }
+                if (depth == n) {
+                    ref = node->terminal;
+                } else {
+                    const radix_ref *child = detail::find_radix_child(node, k[depth++]);
+                    if (child == nullptr) {
+                        return nullptr;
+                    }
+                    ref = *child;
+                }
+            }
+            return nullptr;
+        }
+
+        leaf *lower_bound_leaf(const unsigned char *k, size_type n) const noexcept {
+            radix_ref ref = _root;
+            size_type depth = 0;
+            while (ref != 0) {
+                if (detail::radix_is_leaf(ref)) {
+                    leaf *l = detail::radix_leaf_of<leaf>(ref);
+                    return compare_keys(l->key_bytes(), l->key_size(), k, n) >= 0 ? l : l->next;
+                }
+                const radix_node *node = detail::radix_inner(ref);
+                if (node->prefix_size > 0) {
+                    const size_type p = prefix_mismatch(node, k, n, depth);
+                    if (p < node->prefix_size) {
+                        // Either every key below is greater (the key ended or has a smaller byte) or every one is less
+                        if (depth + p == n || k[depth + p] < prefix_byte(node, depth, p)) {
+                            return min_leaf(ref);
+                        }
+                        return max_leaf(ref)->next;
+                    }
+                    depth += node->prefix_size;
+                }
+                if (depth == n) {
+                    return min_leaf(ref);
+                }
+                const unsigned char c = k[depth];
+                if (const radix_ref *child = detail::find_radix_child(const_cast<radix_node *>(node), c)) {
+                    ref = *child;
+                    ++depth;
+                    continue;
+                }
+                const radix_ref after = detail::next_radix_child(node, c);
+                return after != 0 ? min_leaf(after) : max_leaf(ref)->next;
+            }
+            return nullptr;
+        }
+
+        leaf *upper_bound_leaf(const unsigned char *k, size_type n) const noexcept {
+            leaf *l = lower_bound_leaf(k, n);
+            if (l != nullptr && equal_key(l, k, n)) {
+                return l->next;
+            }
+            return l;
+        }
+
+        std::pair<leaf *, leaf *> prefix_leaves(const unsigned char *k, size_type n) const noexcept {
+            radix_ref ref = _root;
+            size_type depth = 0;
+            while (ref != 0) {
+                if (detail::radix_is_leaf(ref)) {
+                    leaf *l = detail::radix_leaf_of<leaf>(ref);
+                    if (l->key_size() >= n && (n == 0 || std::memcmp(l->key_bytes(), k, n) == 0)) {
+                        return {l, l->next};
+                    }
+                    return {nullptr, nullptr};
+                }
+                const radix_node *node = detail::radix_inner(ref);
+                if (node->prefix_size > 0) {
+                    const size_type p = prefix_mismatch(node, k, n, depth);
+                    if (p < node->prefix_size && depth + p < n) {
+                        return {nullptr, nullptr};
+                    }
+                    depth += node->prefix_size;
+                }
+                if (depth >= n) { // The prefix ends at or inside this node, so it is a prefix of every key below
+                    return {min_leaf(ref), max_leaf(ref)->next};
+                }
+                const radix_ref *child = detail::find_radix_child(const_cast<radix_node *>(node), k[depth++]);
+                if (child == nullptr) {
+                    return {nullptr, nullptr};
+                }
+                ref = *child;
+            }
+            return {nullptr, nullptr};
+        }
+
+        radix_ref _root = 0;
+        leaf *_head = nullptr; // The leaf with the smallest key
+        leaf *_tail = nullptr;
+        size_type _size = 0;
+
+    };
+
+} //ns gnt
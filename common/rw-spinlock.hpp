@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+namespace gnt {
+
+    // A reader-writer spinlock in one 32 bit word, for critical sections of a few hundred nanoseconds (e.g. one
+    // small_byte_map lookup) where a std::shared_mutex costs more than the work it guards.
+    // Writers are preferred: a writer waiting for readers to drain blocks new readers, so a steady stream of lookups
+    // cannot starve updates. Waiters spin with a pause, then yield, so oversubscribed threads hand their core over to
+    // the lock holder. Meets the Lockable and SharedLockable requirements (std::unique_lock, std::shared_lock).
+    class rw_spinlock {
+
+    public:
+
+        rw_spinlock() = default;
+
+        rw_spinlock(const rw_spinlock &) = delete;
+
+        rw_spinlock &operator=(const rw_spinlock &) = delete;
+
+        void lock() noexcept {
+            std::uint32_t state = _state.load(std::memory_order_relaxed);
+            for (unsigned spins = 0;; state = _state.load(std::memory_order_relaxed)) {
+                if ((state & writer) == 0 && _state.compare_exchange_weak(state, state | writer, std::memory_order_acquire, std::memory_order_relaxed)) {
+                    break;
+                }
+                backoff(spins);
+            }
+            // The writer bit is ours, so no new readers come in: wait for the ones inside to leave
+            for (unsigned spins = 0; (_state.load(std::memory_order_acquire) & readers) != 0;) {
+                backoff(spins);
+            }
+        }
+
+        bool try_lock() noexcept {
+            std::uint32_t state = 0;
+            return _state.compare_exchange_strong(state, writer, std::memory_order_acquire, std::memory_order_relaxed);
+        }
+
+        void unlock() noexcept {
+            _state.store(0, std::memory_order_release);
+        }
+
+        void lock_shared() noexcept {
+            for (unsigned spins = 0; !try_lock_shared(); ) {
+                backoff(spins);
+            }
+        }
+
+        bool try_lock_shared() noexcept {
+            std::uint32_t state = _state.load(std::memory_order_relaxed);
+            return (state & writer) == 0 && _state.compare_exchange_weak(state, state + 1, std::memory_order_acquire, std::memory_order_relaxed);
+        }
+
+        void unlock_shared() noexcept {
+            _state.fetch_sub(1, std::memory_order_release);
+        }
+
+    private:
+
+        constexpr const static std::uint32_t writer = 1u << 31;
+        constexpr const static std::uint32_t readers = writer - 1;
+        constexpr const static unsigned spins_before_yield = 64;
+
+        static void backoff(unsigned &spins) noexcept {
+            if (++spins < spins_before_yield) {
+#if defined(__x86_64__) || defined(__i386__)
+                __builtin_ia32_pause();
+#endif
+            } else {
+                std::this_thread::yield();
+            }
+        }
+
+        std::atomic<std::uint32_t> _state{0};
+
+    };
+
+} //ns gnt
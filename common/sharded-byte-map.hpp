@@ -0,0 +1,279 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <vector>
+
+#include "rw-spinlock.hpp"
+#include "small-byte-map.hpp"
+#include "stride-hash.hpp"
+#include "stride-sort.hpp"
+
+namespace gnt {
+
+    // A byte map that several threads (CAF workers, blocking actors) can share without one global mutex. Keys are hash
+    // partitioned across Shards small_byte_maps, each behind its own rw_spinlock, so threads only contend when they
+    // touch the same shard, and lookups in a shard run side by side.
+    // Nothing hands out iterators or spans into a shard, which a concurrent writer could move: lookups copy the value
+    // out (at, find_many) or run a callback under the shard's read lock (visit).
+    // The batched operations (insert_bulk, find_many, erase_many) group their entries by shard first and take each
+    // shard's lock once per batch, running small_byte_map's own bulk paths under it. A batch is atomic per shard, not
+    // across shards. to_vector is a consistent snapshot: it holds every shard's read lock while copying.
+    template<size_t K_Extent = 1, size_t V_Extent = 1, typename byte_type = std::byte, size_t Shards = 16, size_t LinearExtent = 128>
+    class sharded_byte_map {
+
+    public:
+
+        using map_type = small_byte_map<K_Extent, V_Extent, byte_type, LinearExtent>;
+        using view_type = small_byte_map_view<K_Extent, V_Extent, byte_type, LinearExtent>;
+        using size_type = std::size_t;
+        using key_stride = typename map_type::key_stride;
+        using value_stride = typename map_type::value_stride;
+        using value_array = std::array<byte_type, V_Extent>;
+
+        constexpr const static std::size_t key_extent = K_Extent;
+        constexpr const static std::size_t value_extent = V_Extent;
+        constexpr const static std::size_t shard_count = Shards;
+
+        static_assert(Shards > 0 && (Shards & (Shards - 1)) == 0, "sharded_byte_map needs a power of two number of shards");
+
+        sharded_byte_map() = default;
+
+        sharded_byte_map(const sharded_byte_map &) = delete;
+
+        sharded_byte_map &operator=(const sharded_byte_map &) = delete;
+
+        static size_type shard_of(const byte_type *key) noexcept {
+            return static_cast<size_type>(hash_stride<K_Extent>(key) >> 32) & (Shards - 1);
+        }
+
+        // Not a snapshot: each shard is counted under its own lock, one after the other
+        size_type size() const {
+            size_type n = 0;
+            for (const auto &s : _shards) {
+                std::shared_lock<rw_spinlock> lock(s.lock);
+                n += s.map.size();
+            }
+            return n;
+        }
+
+        [[nodiscard]] bool empty() const {
+            return size() == 0;
+        }
+
+        void clear() {
+            for (auto &s : _shards) {
+                std::unique_lock<rw_spinlock> lock(s.lock);
+                s.map.clear();
+            }
+        }
+
+        bool contains(const key_stride &key) const {
+            const auto &s = _shards[shard_of(key.data())];
+            std::shared_lock<rw_spinlock> lock(s.lock);
+            return s.map.contains(key);
+        }
+
+        size_type count(const key_stride &key) const {
+            return contains(key) ? 1 : 0;
+        }
+
+        // A copy of the key's value
+        value_array at(const key_stride &key) const {
+            value_array value;
+            if (!visit(key, [&value](nonstd::span<const byte_type, V_Extent> found) { std::memcpy(value.data(), found.data(), V_Extent); })) {
+                throw std::out_of_range("key is not in sharded_byte_map");
+            }
+            return value;
+        }
+
+        // Calls f with a read-only span of the key's value, under the shard's read lock, and returns whether the key was
+        // found. f must not call back into the map.
+        template<typename F>
+        bool visit(const key_stride &key, F &&f) const {
+            const auto &s = _shards[shard_of(key.data())];
+            std::shared_lock<rw_spinlock> lock(s.lock);
+            auto it = s.map.find(key);
+            if (it == s.map.end()) {
+                return false;
+            }
+            f(nonstd::span<const byte_type, V_Extent>(it->second.data(), V_Extent));
+            return true;
+        }
+
+        // Inserts if the key isn't already in the map
+        bool insert(const key_stride &key, const value_stride &value) {
+            auto &s = _shards[shard_of(key.data())];
+            std::unique_lock<rw_spinlock> lock(s.lock);
+            return s.map.insert(std::make_pair(key, value)).second;
+        }
+
+        // Returns true if the key was inserted, false if its value was replaced
+        bool insert_or_assign(const key_stride &key, const value_stride &value) {
+            auto &s = _shards[shard_of(key.data())];
+            std::unique_lock<rw_spinlock> lock(s.lock);
+            return s.map.insert_or_assign(key, value).second;
+        }
+
+        size_type erase(const key_stride &key) {
+            auto &s = _shards[shard_of(key.data())];
+            std::unique_lock<rw_spinlock> lock(s.lock);
+            return s.map.erase(key);
+        }
+
+        // Bulk load of count entries from separate contiguous key and value regions, with small_byte_map::insert_bulk's
+        // duplicate policies. Entries keep their batch order within a shard, so the policies apply as they would to one map.
+        void insert_bulk(const byte_type *keys, const byte_type *values, size_type count, duplicate_policy policy = duplicate_policy::keep_existing) {
+            if (count == 0) {
+                return;
+            }
+            std::vector<size_type> shard_ids(count);
+            std::array<size_type, Shards + 1> offsets{};
+            for (size_type i = 0; i < count; ++i) {
+                shard_ids[i] = shard_of(keys + i * K_Extent);
+                ++offsets[shard_ids[i] + 1];
+            }
+            for (size_type s = 0; s < Shards; ++s) {
+                offsets[s + 1] += offsets[s];
+            }
+            std::vector<byte_type> grouped_keys(count * K_Extent), grouped_values(count * V_Extent);
+            std::array<size_type, Shards> next;
+            std::copy(offsets.begin(), offsets.end() - 1, next.begin());
+            for (size_type i = 0; i < count; ++i) {
+                const size_type to = next[shard_ids[i]]++;
+                std::memcpy(grouped_keys.data() + to * K_Extent, keys + i * K_Extent, K_Extent);
+                std::memcpy(grouped_values.data() + to * V_Extent, values + i * V_Extent, V_Extent);
+            }
+            for (size_type s = 0; s < Shards; ++s) {
+                const size_type n = offsets[s + 1] - offsets[s];
+                if (n > 0) {
+                    std::unique_lock<rw_spinlock> lock(_shards[s].lock);
+                    _shards[s].map.insert_bulk(grouped_keys.data() + offsets[s] * K_Extent, grouped_values.data() + offsets[s] * V_Extent, n, policy);
+                }
+            }
+        }
+
+        // Copies the value of needles[i] to values + i * V_Extent and sets found[i], for every needle; returns the
+        // number found. Each shard is searched once, with small_byte_map::find_many.
+        size_type find_many(nonstd::span<const key_stride> needles, byte_type *values, bool *found) const {
+            return for_each_shard_group(needles, [&](size_type index, nonstd::span<const key_stride> group, const size_type *indices) {
+                const auto &s = _shards[index];
+                std::vector<typename map_type::const_iterator> out(group.size());
+                std::shared_lock<rw_spinlock> lock(s.lock);
+                const size_type hits = s.map.find_many(group, nonstd::span<typename map_type::const_iterator>(out.data(), out.size()));
+                for (size_type j = 0; j < group.size(); ++j) {
+                    const size_type i = indices[j];
+                    found[i] = out[j] != s.map.end();
+                    if (found[i]) {
+                        std::memcpy(values + i * V_Extent, out[j]->second.data(), V_Extent);
+                    }
+                }
+                return hits;
+            });
+        }
+
+        // Erases every needle, one write lock per shard; returns the number erased
+        size_type erase_many(nonstd::span<const key_stride> needles) {
+            return for_each_shard_group(needles, [this](size_type index, nonstd::span<const key_stride> group, const size_type *) {
+                auto &s = _shards[index];
+                std::unique_lock<rw_spinlock> lock(s.lock);
+                size_type erased = 0;
+                for (const auto &key : group) {
+                    erased += s.map.erase(key);
+                }
+                return erased;
+            });
+        }
+
+        // A consistent snapshot of every entry, sorted, in the contiguous layout of small_byte_map::to_vector (the input
+        // of view_type::build_from_contiguous_bytes). The shards are only locked while their bytes are copied; the
+        // sort runs after.
+        std::vector<byte_type> to_vector() const {
+            std::vector<std::vector<byte_type>> parts(Shards);
+            {
+                // Shards are locked in order, and nothing else holds two shard locks, so this cannot deadlock
+                std::array<std::shared_lock<rw_spinlock>, Shards> locks;
+                for (size_type s = 0; s < Shards; ++s) {
+                    locks[s] = std::shared_lock<rw_spinlock>(_shards[s].lock);
+                }
+                for (size_type s = 0; s < Shards; ++s) {
+                    parts[s] = _shards[s].map.to_vector();
+                }
+            }
+            size_type total = 0;
+            for (const auto &part : parts) {
+                total += part.size() / (K_Extent + V_Extent);
+            }
+            std::vector<byte_type> vec(total * (K_Extent + V_Extent));
+            if (total == 0) {
+                return vec;
+            }
+            byte_type *keys = vec.data();
+            byte_type *values = keys + total * K_Extent;
+            size_type at = 0;
+            for (const auto &part : parts) {
+                const size_type n = part.size() / (K_Extent + V_Extent);
+                if (n == 0) { // An empty part may have no buffer at all, and memcpy must not see a null pointer
+                    continue;
+                }
+                std::memcpy(keys + at * K_Extent, part.data(), n * K_Extent);
+                std::memcpy(values + at * V_Extent, part.data() + n * K_Extent, n * V_Extent);
+                at += n;
+            }
+            sort_strides<K_Extent, V_Extent>(keys, values, total);
+            return vec;
+        }
+
+    private:
+
+        // Its own cache line, so threads working on neighbouring shards do not bounce each other's lock word
+        struct alignas(64) shard {
+            mutable rw_spinlock lock;
+            map_type map;
+        };
+
+        // Groups needles by shard and calls f(shard index, needles of that shard, their indices in needles) for each
+        // shard that has any, summing what f returns
+        template<typename F>
+        static size_type for_each_shard_group(nonstd::span<const key_stride> needles, F &&f) {
+            const size_type count = needles.size();
+            std::vector<size_type> shard_ids(count);
+            std::array<size_type, Shards + 1> offsets{};
+            for (size_type i = 0; i < count; ++i) {
+                shard_ids[i] = shard_of(needles[i].data());
+                ++offsets[shard_ids[i] + 1];
+            }
+            for (size_type s = 0; s < Shards; ++s) {
+                offsets[s + 1] += offsets[s];
+            }
+            std::vector<key_stride> grouped;
+            grouped.reserve(count);
+            std::vector<size_type> indices(count);
+            std::array<size_type, Shards> next;
+            std::copy(offsets.begin(), offsets.end() - 1, next.begin());
+            for (size_type i = 0; i < count; ++i) {
+                indices[next[shard_ids[i]]++] = i;
+            }
+            for (size_type j = 0; j < count; ++j) {
+                grouped.push_back(needles[indices[j]]);
+            }
+            size_type total = 0;
+            for (size_type s = 0; s < Shards; ++s) {
+                const size_type n = offsets[s + 1] - offsets[s];
+                if (n > 0) {
+                    total += f(s, nonstd::span<const key_stride>(grouped.data() + offsets[s], n), indices.data() + offsets[s]);
+                }
+            }
+            return total;
+        }
+
+        std::array<shard, Shards> _shards;
+
+    };
+
+} //ns gnt
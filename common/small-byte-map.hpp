@@ -1,15 +1,28 @@
 #pragma once
 
+#include <array>
 #include <utility>
 #include <cstddef>
-
+#include <functional>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+#include "byte-map-layout.hpp"
 #include "small-vector.hpp"
 #include "vector-view.hpp"
 #include "stride.hpp"
+#include "stride-search.hpp"
+#include "stride-compare.hpp"
+#include "stride-sort.hpp"
 
 namespace gnt {
     //Note neither K_Extent nor V_Extent may be 0.
-    template<size_t K_Extent, size_t V_Extent, typename byte_type = std::byte>
+    // KeyPitch / ValuePitch are the distances between consecutive keys / values (see byte-map-layout.hpp).
+    template<size_t K_Extent, size_t V_Extent, typename byte_type = std::byte, size_t KeyPitch = K_Extent, size_t ValuePitch = V_Extent>
     struct small_byte_map_iterator {
 
         using key_stride = nonstd::span<byte_type, K_Extent>;
@@ -30,6 +43,12 @@ namespace gnt {
                                 value_stride &&value_span)
             : impl(std::move(key_span), std::move(value_span)) {}
 
+        // iterator -> const_iterator
+        template<typename other_byte_type, typename = std::enable_if_t<std::is_same_v<const other_byte_type, byte_type> && !std::is_same_v<other_byte_type, byte_type>>>
+        small_byte_map_iterator(const small_byte_map_iterator<K_Extent, V_Extent, other_byte_type, KeyPitch, ValuePitch> &other)
+            : impl(key_stride(other.impl.first.data(), other.impl.first.size()),
+                   value_stride(other.impl.second.data(), other.impl.second.size())) {}
+
         value_type &operator*() {
             return impl;
         }
@@ -38,57 +57,61 @@ namespace gnt {
             return &impl;
         }
 
-        small_byte_map_iterator<K_Extent, V_Extent> &operator++() {
-            impl.first = key_stride(impl.first.data() + K_Extent, K_Extent);
-            impl.second = value_stride(impl.second.data() + V_Extent, V_Extent);
+        small_byte_map_iterator &operator++() {
+            impl.first = key_stride(impl.first.data() + KeyPitch, K_Extent);
+            impl.second = value_stride(impl.second.data() + ValuePitch, V_Extent);
             return *this;
         }
 
-        small_byte_map_iterator<K_Extent, V_Extent> operator++(int) {
-            return small_byte_map_iterator<K_Extent, V_Extent>(
-                key_stride(impl.first.data() + K_Extent, K_Extent),
-                value_stride(impl.second.data() + V_Extent, V_Extent)
-            );
+        small_byte_map_iterator operator++(int) {
+            auto prev = *this;
+            ++(*this);
+            return prev;
         }
 
         //Fixme: this should be difference type
         small_byte_map_iterator operator+(const std::size_t n) const {
-            return small_byte_map_iterator<K_Extent, V_Extent>(
-                key_stride(impl.first.data() + n * K_Extent, K_Extent),
-                value_stride(impl.second.data() + n * V_Extent, V_Extent)
+            return small_byte_map_iterator(
+                key_stride(impl.first.data() + n * KeyPitch, K_Extent),
+                value_stride(impl.second.data() + n * ValuePitch, V_Extent)
             );
         }
 
         //Fixme: this should be difference type
         small_byte_map_iterator operator-(const std::size_t n) const {
-            return small_byte_map_iterator<K_Extent, V_Extent>(
-                key_stride(impl.first.data() - n * K_Extent, K_Extent),
-                value_stride(impl.second.data() - n * V_Extent, V_Extent)
+            return small_byte_map_iterator(
+                key_stride(impl.first.data() - n * KeyPitch, K_Extent),
+                value_stride(impl.second.data() - n * ValuePitch, V_Extent)
             );
         }
 
+        // Number of entries between two iterators over the same map
+        std::ptrdiff_t operator-(const small_byte_map_iterator &b) const {
+            return (impl.first.data() - b.impl.first.data()) / static_cast<std::ptrdiff_t>(KeyPitch);
+        }
+
         // Comparison behaviour is the same as comparison of the key pointer, with no extent (so end can have 0 extent)
-        bool operator==(const small_byte_map_iterator<K_Extent, V_Extent> &b) const {
+        bool operator==(const small_byte_map_iterator &b) const {
             return impl.first.data() == b.impl.first.data();
         }
 
-        bool operator!=(const small_byte_map_iterator<K_Extent, V_Extent> &b) const {
+        bool operator!=(const small_byte_map_iterator &b) const {
             return impl.first.data() != b.impl.first.data();
         }
 
-        bool operator>(const small_byte_map_iterator<K_Extent, V_Extent> &b) const {
+        bool operator>(const small_byte_map_iterator &b) const {
             return impl.first.data() > b.impl.first.data();
         }
 
-        bool operator<(const small_byte_map_iterator<K_Extent, V_Extent> &b) const {
+        bool operator<(const small_byte_map_iterator &b) const {
             return impl.first.data() < b.impl.first.data();
         }
 
-        bool operator>=(const small_byte_map_iterator<K_Extent, V_Extent> &b) const {
+        bool operator>=(const small_byte_map_iterator &b) const {
             return impl.first.data() >= b.impl.first.data();
         }
 
-        bool operator<=(const small_byte_map_iterator<K_Extent, V_Extent> &b) const {
+        bool operator<=(const small_byte_map_iterator &b) const {
             return impl.first.data() <= b.impl.first.data();
         }
 
@@ -96,22 +119,15 @@ namespace gnt {
 
     };
 
-    //TODO iter_swap
-
-} //ns gnt
-
-namespace std {
-
-    // Specialised to enable sorting maps using these iters.
-    template<size_t K_Extent, size_t V_Extent, typename byte_type = std::byte>
-    constexpr void iter_swap(gnt::small_byte_map_iterator<K_Extent, V_Extent, byte_type> lhs, gnt::small_byte_map_iterator<K_Extent, V_Extent, byte_type> rhs) {
-        std::swap_ranges(lhs->first.begin(), lhs->first.end(), rhs->first.begin());
-        std::swap_ranges(lhs->second.begin(), lhs->second.end(), rhs->second.begin());
-    }
-
-} //ns std
+    // How bulk loads treat a key that is already in the map, or repeated within the batch.
+    enum class duplicate_policy {
+        keep_existing, // The first entry wins: existing entries, then the earliest in the batch (as insert does)
+        overwrite, // The last entry wins: the latest in the batch replaces existing values (as insert_or_assign does)
+        keep_all // Multimap: every entry is kept, batch entries going after existing equal keys
+    };
 
-namespace gnt {
+    template<typename View>
+    class byte_map_cursor;
 
     //TODO don't use ensure_mode - just infer_mode(sorted_hint).
 
@@ -120,34 +136,43 @@ namespace gnt {
      *
      * @tparam K_Extent
      * @tparam V_Extent
-     * @tparam byte_type
+     * @tparam byte_type Keys are ordered as unsigned bytes (memcmp order) even when this is char, see stride-compare.hpp
      * @tparam LinearExtent The extent before which linear search is prefered over binary search for small stack optimisations
+     * @tparam SearchPolicy How sorted keys are searched (see binary_search_policy in stride-search.hpp)
+     * @tparam Layout Separate key and value ranges, or interleaved [key|value] records (see byte-map-layout.hpp)
      */
-    template<size_t K_Extent = 1, size_t V_Extent = 1, typename byte_type = std::byte, size_t LinearExtent = 128>
+    template<size_t K_Extent = 1, size_t V_Extent = 1, typename byte_type = std::byte, size_t LinearExtent = 128,
+        typename SearchPolicy = binary_search_policy, typename Layout = separate_layout>
     class small_byte_map_view {
 
     public:
 
-        using iterator = small_byte_map_iterator<K_Extent, V_Extent, byte_type>;
-        using const_iterator = small_byte_map_iterator<K_Extent, V_Extent, const byte_type>;
+        using layout = Layout;
+        constexpr const static std::size_t key_pitch = Layout::template key_pitch<K_Extent, V_Extent>;
+        constexpr const static std::size_t value_pitch = Layout::template value_pitch<K_Extent, V_Extent>;
+
+        using iterator = small_byte_map_iterator<K_Extent, V_Extent, byte_type, key_pitch, value_pitch>;
+        using const_iterator = small_byte_map_iterator<K_Extent, V_Extent, const byte_type, key_pitch, value_pitch>;
         using size_type = std::size_t;
         using key_stride = nonstd::span<byte_type, K_Extent>; //Individual key view
         using value_stride = nonstd::span<byte_type, V_Extent>; //Individual value view
 
+        // With interleaved_layout the key range is the whole record range, and the value range starts K_Extent into it
         using key_range_view = vector_view<byte_type>;
         using value_range_view = vector_view<byte_type>;
 
         //The extent after which the key and value vectors are sorted.
         constexpr const static std::size_t linear_extent = LinearExtent;
+        constexpr const static std::size_t key_extent = K_Extent;
+        constexpr const static std::size_t value_extent = V_Extent;
 
-        // Helper function to build a view over a single contiguous underlying byte_type array
+        // Helper function to build a view over a single contiguous underlying byte_type array, in the Layout's order
         static auto build_from_contiguous_bytes(byte_type *data, size_type size_bytes, bool sorted_hint = false) {
             if ((size_bytes % (K_Extent + V_Extent)) != 0) {
                 throw std::range_error("small_byte_map_view cannot be built from contiguous bytes that are no divisible by K_Extent + V_step");
             }
             const size_type num_elems = size_bytes / (K_Extent + V_Extent);
-            return small_byte_map_view<K_Extent, V_Extent, byte_type, LinearExtent>(data,
-                                                                                     data + (K_Extent * num_elems), num_elems, sorted_hint);
+            return small_byte_map_view(data, data + Layout::template value_offset<K_Extent, V_Extent>(num_elems), num_elems, sorted_hint);
         }
 
         template<size_type Extent>
@@ -163,7 +188,7 @@ namespace gnt {
         small_byte_map_view(bool linear_mode = true) : _linear_mode(linear_mode), _keys(), _values() {}
 
         small_byte_map_view(byte_type *k_ptr, byte_type *v_ptr, size_type num_elems, bool sorted_hint = false)
-            : _linear_mode(false), _keys(k_ptr, num_elems * K_Extent), _values(v_ptr, num_elems * V_Extent) {
+            : _linear_mode(false), _keys(k_ptr, num_elems * key_pitch), _values(v_ptr, pitched_bytes<V_Extent, value_pitch>(num_elems)) {
             infer_mode(sorted_hint);
         }
 
@@ -202,55 +227,78 @@ namespace gnt {
             reset(key_cont.data(), value_cont.data(), key_cont.size(), value_cont.size());
         }
 
-        // Has the usual find semantics - i.e. if not found will return end()
-        constexpr typename key_range_view::template stride_iterator<K_Extent> find_key(key_stride needle) noexcept {
-            if (_linear_mode) {
-                return std::find(_keys.template begin_stride<K_Extent>(), _keys.template end_stride<K_Extent>(), needle);
-            } else {
-                auto it = std::lower_bound(_keys.template begin_stride<K_Extent>(), _keys.template end_stride<K_Extent>(), needle);
-                if(it != _keys.template end_stride<K_Extent>() && it.to_span() == needle) { //Fixme: span cast so that 0 Stride will work
-                    return it;
-                }
-                return _keys.template end_stride<K_Extent>();
-            }
+        // Points the view at num_elems entries laid out as Layout says (values is keys + K_Extent when interleaved)
+        void reset_entries(byte_type *k_ptr, byte_type *v_ptr, size_type num_elems) {
+            reset(k_ptr, v_ptr, num_elems * key_pitch, pitched_bytes<V_Extent, value_pitch>(num_elems));
         }
 
-        // Has the usual find semantics - i.e. if not found will return end()
-        constexpr typename key_range_view::template const_stride_iterator<K_Extent> find_key(key_stride needle) const noexcept {
+        // Index of the entry with key needle, or size() if there is none
+        size_type find_index(const key_stride &needle) const noexcept {
+            const size_type n = size();
             if (_linear_mode) {
-                return std::find(_keys.template begin_stride<K_Extent>(), _keys.template end_stride<K_Extent>(), needle);
-            } else {
-                auto it = std::lower_bound(_keys.template begin_stride<K_Extent>(), _keys.template end_stride<K_Extent>(), needle);
-                if(it != _keys.template end_stride<K_Extent>() && it.to_span() == needle) { //Fixme: span cast so that 0 Stride will work
-                    return it;
-                }
-                return _keys.template end_stride<K_Extent>();
+                return find_stride<K_Extent, key_pitch>(_keys.data(), n, needle.data());
             }
+            const size_type pos = lower_bound_index(needle);
+            if (pos != n && equal_strides<K_Extent>(_keys.data() + pos * key_pitch, needle.data())) {
+                return pos;
+            }
+            return n;
         }
 
-        constexpr typename value_range_view::template stride_iterator<K_Extent> find_value_by_key(key_stride needle) noexcept {
-            auto pos = find_key(needle);
-            if (pos == _keys.template end_stride<K_Extent>()) {
-                return _values.template end_stride<V_Extent>();
-            }
-            auto diff = pos - _keys.begin(); //Which could be 0!
-            return _values.template begin_stride<V_Extent>() + diff;
+        // The entry at index i (which may be size(), for end)
+        template<typename It>
+        It iterator_at(size_type i) const noexcept {
+            // A view's constness is shallow, as with std::span
+            auto *keys = const_cast<byte_type *>(_keys.data());
+            auto *values = const_cast<byte_type *>(_values.data());
+            return It(typename It::key_stride(keys + i * key_pitch, K_Extent), typename It::value_stride(values + i * value_pitch, V_Extent));
         }
 
-        constexpr typename value_range_view::template const_stride_iterator<K_Extent> find_value_by_key(key_stride needle) const noexcept {
-            auto pos = find_key(needle);
-            if (pos == _keys.template end_stride<K_Extent>()) {
-                return _values.template end_stride<V_Extent>();
+        // Keys only, stepping over the values in between when interleaved. stride_less<K_Extent> compares just the keys.
+        stride_iterator<const byte_type, key_pitch> key_iterator(size_type i) const noexcept {
+            return stride_iterator<const byte_type, key_pitch>(_keys.data() + i * key_pitch);
+        }
+
+        // Index of the first key not less than needle. Only meaningful in sorted mode.
+        size_type lower_bound_index(const key_stride &needle) const noexcept {
+            return SearchPolicy::template lower_bound<K_Extent, key_pitch>(_keys.data(), size(), needle.data());
+        }
+
+        // Index of the first key greater than needle, searching from first. Only meaningful in sorted mode.
+        size_type upper_bound_index(const key_stride &needle, size_type first = 0) const noexcept {
+            auto begin = key_iterator(0);
+            return std::upper_bound(begin + first, key_iterator(size()), needle, stride_less<K_Extent>()) - begin;
+        }
+
+        // [first, last) indices of the keys starting with prefix. Only meaningful in sorted mode.
+        std::pair<size_type, size_type> prefix_bounds(nonstd::span<const byte_type> prefix) const {
+            if (prefix.size() > K_Extent) {
+                throw std::length_error("small_byte_map_view prefix is longer than the keys");
+            }
+            const auto *p = prefix.data();
+            const size_type len = prefix.size();
+            if (len == 0) {
+                return {0, size()};
             }
-            auto diff = pos - _keys.begin(); //Which could be 0!
-            return _values.template begin_stride<V_Extent>() + diff;
+            auto begin = key_iterator(0), end = key_iterator(size());
+            auto first = std::partition_point(begin, end, [p, len](const auto &key) {
+                return std::memcmp(key.data(), p, len) < 0;
+            });
+            auto last = std::partition_point(first, end, [p, len](const auto &key) {
+                return std::memcmp(key.data(), p, len) == 0;
+            });
+            return {static_cast<size_type>(first - begin), static_cast<size_type>(last - begin)};
         }
 
+        void require_sorted() const {
+            if (!is_sorted()) {
+                throw std::logic_error("small_byte_map_view ordered queries need sorted keys");
+            }
+        }
 
+        // Unsorted data can only be searched linearly, sorted data is only worth binary searching above LinearExtent
         void infer_mode(bool presorted_hint = false) {
-            if(size() > LinearExtent && presorted_hint) {
-                _linear_mode = false;
-            }
+            _linear_mode = !(presorted_hint && size() > LinearExtent);
         }
 
         //TODO move this into small_byte_map
@@ -261,36 +309,27 @@ namespace gnt {
             return _linear_mode;
         }
 
+        // Whether the keys are in order: always in sorted mode, checked (at most LinearExtent keys) in linear mode
+        bool is_sorted() const {
+            return !_linear_mode || std::is_sorted(key_iterator(0), key_iterator(size()), stride_less<K_Extent>());
+        }
+
         iterator begin() noexcept {
             if(_keys.empty()) {
                 return iterator();
             }
-            return iterator(
-                _keys.template begin_stride<K_Extent>().to_span(),
-                _values.template begin_stride<V_Extent>().to_span()
-            );
+            return iterator_at<iterator>(0);
         }
 
         const_iterator begin() const noexcept {
             if(_keys.empty()) {
                 return const_iterator();
             }
-            // Note this always assumes that the key and value iterators have steps.
-            return const_iterator(
-                _keys.template begin_stride<K_Extent>().to_span(),
-                _values.template begin_stride<V_Extent>().to_span()
-            );
+            return iterator_at<const_iterator>(0);
         }
 
         const_iterator cbegin() const noexcept {
-            if(_keys.empty()) {
-                return const_iterator();
-            }
-            // Note this always assumes that the key and value iterators have steps.
-            return const_iterator(
-                _keys.template cbegin_stride<K_Extent>().to_span(),
-                _values.template cbegin_stride<V_Extent>().to_span()
-            );
+            return begin();
         }
 
 
@@ -299,99 +338,242 @@ namespace gnt {
             if(_keys.empty()) {
                 return iterator();
             }
-            // Note this always assumes that the key and value iterators have steps.
-            return iterator(
-                _keys.template end_stride<K_Extent>().to_span(), // Note: this should be safe since the pointer is never de-reffed
-                _values.template end_stride<V_Extent>().to_span()
-            );
+            return iterator_at<iterator>(size()); // Note: this should be safe since the pointers are never de-reffed
         }
 
         const_iterator end() const noexcept {
             if(_keys.empty()) {
                 return const_iterator();
             }
-            // Note this always assumes that the key and value iterators have steps.
-            return const_iterator(
-                _keys.template end_stride<K_Extent>().to_span(), // Note: this should be safe since the pointer is never de-reffed
-                _values.template end_stride<V_Extent>().to_span()
-            );
+            return iterator_at<const_iterator>(size());
         }
 
         const_iterator cend() const noexcept {
-            if(_keys.empty()) {
-                return const_iterator();
-            }
-            // Note this always assumes that the key and value iterators have steps.
-            return const_iterator(
-                _keys.template cend_stride<K_Extent>().to_span(), // Note: this should be safe since the pointer is never de-reffed
-                _values.template cend_stride<V_Extent>().to_span()
-            );
+            return end();
         }
 
         [[nodiscard]] bool empty() const noexcept {
             return _keys.empty();
         }
 
+        // Number of entries (not bytes)
         size_type size() const noexcept {
-            return _keys.size();
+            return _keys.template strides<key_pitch>();
         }
 
         //Fixme: size_type max_size() const noexcept;
 
         value_stride at(key_stride key) {
-            auto val_pos = find_value_by_key(key);
-            if(val_pos == _values.template end_stride<V_Extent>()) {
+            const size_type pos = find_index(key);
+            if(pos == size()) {
                 throw std::out_of_range("key is not in small_byte_map_view");
             }
-            return *val_pos;
+            return value_stride(_values.data() + pos * value_pitch, V_Extent);
         }
 
-        const value_stride &at(key_stride key) const {
-            auto val_pos = find_value_by_key(key);
-            if(val_pos == _values.template end_stride<V_Extent>()) {
-                throw std::out_of_range("key is not in small_byte_map_view");
-            }
-            return *val_pos;
+        value_stride at(key_stride key) const {
+            return const_cast<small_byte_map_view *>(this)->at(key);
         }
 
         size_type count(const key_stride &key) const {
             if(!_linear_mode) { // Our heuristic for whether it's worth searching.
-                auto lower = std::lower_bound(_keys.template begin_stride<K_Extent>(), _keys.template end_stride<K_Extent>(), key);
-                auto upper = std::upper_bound(lower, _keys.template end_stride<K_Extent>(), key);
-                return std::count(lower, upper, key);
+                const size_type lower = lower_bound_index(key);
+                return upper_bound_index(key, lower) - lower;
             } else { // This is faster for small vectors which we leave unsorted
-                auto lower = _keys.template begin_stride<K_Extent>;
-                auto upper = _keys.template end_stride<K_Extent>();
-                return std::count(lower, upper, key);
+                return count_stride<K_Extent, key_pitch>(_keys.data(), size(), key.data());
             }
         }
 
-        //Fixme: test the "find-key plus diff" approach against the "find-iterator" approach. Either may be faster.
         iterator find(const key_stride& key) {
-            auto pos = find_key(key); //Gives me an iterator that gives me a span here
-            if(pos == _keys.template end_stride<K_Extent>()) {
-                return end();
-            }
-            auto diff = _keys.template end_stride<K_Extent>() - pos;
-            return iterator(*pos, *(_values.template begin_stride<V_Extent>() + diff));
+            const size_type pos = find_index(key);
+            return pos == size() ? end() : iterator_at<iterator>(pos);
         }
 
         const_iterator find(const key_stride& key) const {
-            auto pos = find_key(key); //Gives me an iterator that gives me a span here
-            if(pos == _keys.template end_stride<K_Extent>()) {
-                return end();
-            }
-            auto diff = _keys.template end_stride<K_Extent>() - pos;
-            return const_iterator(*pos, *(_values.template begin_stride<V_Extent>() + diff));
+            const size_type pos = find_index(key);
+            return pos == size() ? end() : iterator_at<const_iterator>(pos);
         }
 
         bool contains(const key_stride& key) const {
-            return find_key(key) != _keys.template end_stride<K_Extent>();
+            return find_index(key) != size();
+        }
+
+        // Batched lookups, for resolving many keys against the same map. Sorted needles are found in one merge-like
+        // pass, galloping forward from the previous match. Unsorted needles are binary searched find_many_group at a
+        // time in lock step, prefetching each search's next probe, so their cache misses overlap instead of queueing.
+        // positions[i] is the index of needles[i] (the first of equal keys in sorted mode), or size() if it is missing.
+        // Returns the number of needles found.
+        size_type find_many(nonstd::span<const key_stride> needles, nonstd::span<size_type> positions) const {
+            check_find_many_output(needles.size(), positions.size());
+            return find_many_impl(needles, [&positions](size_type i, size_type pos) {
+                positions[i] = pos;
+            });
+        }
+
+        // As above, with out[i] = find(needles[i])
+        size_type find_many(nonstd::span<const key_stride> needles, nonstd::span<iterator> out) {
+            check_find_many_output(needles.size(), out.size());
+            const size_type n = size();
+            return find_many_impl(needles, [this, n, &out](size_type i, size_type pos) {
+                out[i] = pos == n ? end() : begin() + pos;
+            });
         }
 
-        //Fixme: std::pair<iterator,iterator> equal_range( const Key& key );
+        size_type find_many(nonstd::span<const key_stride> needles, nonstd::span<const_iterator> out) const {
+            check_find_many_output(needles.size(), out.size());
+            const size_type n = size();
+            return find_many_impl(needles, [this, n, &out](size_type i, size_type pos) {
+                out[i] = pos == n ? end() : begin() + pos;
+            });
+        }
+
+        // Number of binary searches find_many interleaves: enough independent loads in flight to cover memory latency
+        constexpr const static size_type find_many_group = 16;
+        // Sorted needles are merged rather than searched while there are fewer than this many keys per needle
+        constexpr const static size_type find_many_merge_density = 32;
 
-        //Fixme: std::pair<iterator,iterator> equal_range( const Key& key );
+        // Ordered queries. These need sorted keys: always the case in sorted mode, and checked in linear mode (at most
+        // LinearExtent keys, which are sorted if the view was built with a sorted hint), throwing std::logic_error if not.
+
+        iterator lower_bound(const key_stride &key) {
+            require_sorted();
+            return begin() + lower_bound_index(key);
+        }
+
+        const_iterator lower_bound(const key_stride &key) const {
+            require_sorted();
+            return begin() + lower_bound_index(key);
+        }
+
+        iterator upper_bound(const key_stride &key) {
+            require_sorted();
+            return begin() + upper_bound_index(key);
+        }
+
+        const_iterator upper_bound(const key_stride &key) const {
+            require_sorted();
+            return begin() + upper_bound_index(key);
+        }
+
+        std::pair<iterator, iterator> equal_range(const key_stride &key) {
+            require_sorted();
+            const size_type lower = lower_bound_index(key);
+            return {begin() + lower, begin() + upper_bound_index(key, lower)};
+        }
+
+        std::pair<const_iterator, const_iterator> equal_range(const key_stride &key) const {
+            require_sorted();
+            const size_type lower = lower_bound_index(key);
+            return {begin() + lower, begin() + upper_bound_index(key, lower)};
+        }
+
+        // Range queries hand out sub-views over the same key and value regions, so nothing is copied. Like any view
+        // they are invalidated by whatever invalidates this one (e.g. inserts into the small_byte_map underneath).
+
+        // The entries [first, first + count) by position
+        small_byte_map_view subview(size_type first, size_type count) const {
+            if (first > size() || count > size() - first) {
+                throw std::out_of_range("small_byte_map_view subview is out of range");
+            }
+            // A view's constness is shallow, as with std::span
+            auto *keys = const_cast<byte_type *>(_keys.data());
+            auto *values = const_cast<byte_type *>(_values.data());
+            return small_byte_map_view(keys + first * key_pitch, values + first * value_pitch, count, !_linear_mode);
+        }
+
+        // Entries with keys in [from, to)
+        small_byte_map_view range(const key_stride &from, const key_stride &to) const {
+            require_sorted();
+            const size_type first = lower_bound_index(from);
+            const size_type last = std::max(first, lower_bound_index(to));
+            return subview(first, last - first);
+        }
+
+        // Entries whose keys start with prefix (of at most K_Extent bytes; an empty prefix matches everything)
+        small_byte_map_view prefix_range(nonstd::span<const byte_type> prefix) const {
+            require_sorted();
+            const auto bounds = prefix_bounds(prefix);
+            return subview(bounds.first, bounds.second - bounds.first);
+        }
+
+        byte_map_cursor<small_byte_map_view> cursor() const {
+            return byte_map_cursor<small_byte_map_view>(*this, 0, size());
+        }
+
+        byte_map_cursor<small_byte_map_view> cursor(const key_stride &from, const key_stride &to) const {
+            require_sorted();
+            const size_type first = lower_bound_index(from);
+            return byte_map_cursor<small_byte_map_view>(*this, first, std::max(first, lower_bound_index(to)));
+        }
+
+        byte_map_cursor<small_byte_map_view> prefix_cursor(nonstd::span<const byte_type> prefix) const {
+            require_sorted();
+            const auto bounds = prefix_bounds(prefix);
+            return byte_map_cursor<small_byte_map_view>(*this, bounds.first, bounds.second);
+        }
+
+    private:
+
+        static void check_find_many_output(size_type needles, size_type outputs) {
+            if (outputs < needles) {
+                throw std::length_error("find_many needs an output for every needle");
+            }
+        }
+
+        template<typename Emit>
+        size_type find_many_impl(nonstd::span<const key_stride> needles, Emit &&emit) const {
+            const size_type n = size(), m = needles.size();
+            const auto *keys = _keys.data();
+            size_type found = 0;
+            // pos is where needles[i] would be, so it only remains to check whether it is there
+            auto resolve = [&](size_type i, size_type pos) {
+                if (pos < n && equal_strides<K_Extent>(keys + pos * key_pitch, needles[i].data())) {
+                    ++found;
+                    emit(i, pos);
+                } else {
+                    emit(i, n);
+                }
+            };
+            if (_linear_mode) {
+                for (size_type i = 0; i < m; ++i) {
+                    resolve(i, find_stride<K_Extent, key_pitch>(keys, n, needles[i].data()));
+                }
+                return found;
+            }
+            // A merge pass costs O(m log(n / m)) comparisons, but they are dependent loads walking forward through the
+            // map, so it only pays while the needles are dense in it.
+            if (n < find_many_merge_density * m && std::is_sorted(needles.begin(), needles.end(), stride_less<K_Extent>())) {
+                size_type pos = 0;
+                for (size_type i = 0; i < m; ++i) {
+                    pos = gallop_lower_bound_stride<K_Extent, key_pitch>(keys, n, pos, needles[i].data());
+                    resolve(i, pos);
+                }
+                return found;
+            }
+            for (size_type first = 0; first < m; first += find_many_group) {
+                const size_type group = std::min(find_many_group, m - first);
+                size_type base[find_many_group] = {};
+                stride_needle<K_Extent> group_needles[find_many_group];
+                for (size_type j = 0; j < group; ++j) {
+                    group_needles[j] = stride_needle<K_Extent>(needles[first + j].data());
+                }
+                // All the searches are over the same n keys, so they take the same number of steps of the same size
+                // (see lower_bound_stride) and can advance together.
+                for (size_type len = n; len > 1;) {
+                    const size_type half = len / 2;
+                    len -= half;
+                    for (size_type j = 0; j < group; ++j) {
+                        base[j] += group_needles[j].follows(keys + (base[j] + half) * key_pitch) ? half : 0;
+                        __builtin_prefetch(keys + (base[j] + len / 2) * key_pitch);
+                    }
+                }
+                for (size_type j = 0; j < group; ++j) {
+                    const size_type pos = n == 0 ? 0 : base[j] + group_needles[j].follows(keys + base[j] * key_pitch);
+                    resolve(first + j, pos);
+                }
+            }
+            return found;
+        }
 
     protected:
 
@@ -404,13 +586,66 @@ namespace gnt {
 
     };
 
+    // Walks a contiguous range of a sorted view a page at a time, handing out sub-views of it (no copies).
+    template<typename View>
+    class byte_map_cursor {
+
+    public:
+
+        using size_type = typename View::size_type;
+        using key_stride = typename View::key_stride;
+
+        byte_map_cursor(const View &view, size_type first, size_type last) : _view(view), _pos(first), _last(last) {}
+
+        [[nodiscard]] bool done() const noexcept {
+            return _pos >= _last;
+        }
+
+        size_type remaining() const noexcept {
+            return done() ? 0 : _last - _pos;
+        }
+
+        // The next (up to) max_entries entries of the range
+        View next(size_type max_entries) {
+            const size_type count = std::min(max_entries, remaining());
+            View page = _view.subview(_pos, count);
+            _pos += count;
+            return page;
+        }
+
+        // The rest of the range in one sub-view
+        View rest() {
+            return next(remaining());
+        }
+
+        // Skips forward to the first remaining entry whose key is not less than key (never backwards)
+        void seek(const key_stride &key) {
+            if (done()) {
+                return;
+            }
+            auto tail = _view.subview(_pos, _last - _pos);
+            _pos += tail.lower_bound(key) - tail.begin();
+        }
+
+    private:
+
+        View _view;
+        size_type _pos;
+        size_type _last;
+
+    };
+
+    // Allocator supplies every heap buffer the map uses (the spilled key and value vectors and the write buffer), e.g. a
+    // std::pmr::polymorphic_allocator<byte_type> over a per-message arena.
     template<size_t K_Extent = 1, size_t V_Extent = 1, typename byte_type = std::byte,
-        size_t LinearExtent = 128, size_t KStackExtent = LinearExtent, size_t VStackExtent = LinearExtent>
-    class small_byte_map : public small_byte_map_view<K_Extent, V_Extent, byte_type, LinearExtent> {
+        size_t LinearExtent = 128, size_t KStackExtent = LinearExtent, size_t VStackExtent = LinearExtent,
+        typename SearchPolicy = binary_search_policy, typename Layout = separate_layout,
+        typename Allocator = std::allocator<byte_type>>
+    class small_byte_map : public small_byte_map_view<K_Extent, V_Extent, byte_type, LinearExtent, SearchPolicy, Layout> {
 
     public:
 
-        using super = small_byte_map_view<K_Extent, V_Extent, byte_type, LinearExtent>;
+        using super = small_byte_map_view<K_Extent, V_Extent, byte_type, LinearExtent, SearchPolicy, Layout>;
         using iterator = typename super::iterator;
         using const_iterator = typename super::const_iterator;
         using size_type = typename super::size_type;
@@ -418,26 +653,80 @@ namespace gnt {
         using value_stride = typename super::value_stride;
         //The extent after which the key and value vectors are sorted.
         using super::linear_extent;
+        using super::key_pitch;
+        using super::value_pitch;
         using value_type = typename iterator::value_type;
+        using allocator_type = Allocator;
 
         // Construct with a reserve in *number of elements* (not byte size)!
-        small_byte_map(std::size_t reserve_num_entries) : _keys_impl(reserve_num_entries * K_Extent), _values_impl(reserve_num_entries * V_Extent) {
-            //TODO may not work == try putting this back
-            //sync();
-            super::reset(_keys_impl, _values_impl);
+        small_byte_map(std::size_t reserve_num_entries, const Allocator &alloc = Allocator())
+            : _keys_impl(reserve_num_entries * key_pitch, alloc), _values_impl(Layout::interleaved ? 0 : reserve_num_entries * V_Extent, alloc),
+              _delta_keys(alloc), _delta_values(alloc), _delta_tombstones(alloc) {
+            sync();
         }
 
         small_byte_map() : _keys_impl(), _values_impl() {
-            //TODO may not work -- try putting this back
-            //sync();
-            super::reset(_keys_impl, _values_impl);
+            sync();
+        }
+
+        explicit small_byte_map(const Allocator &alloc)
+            : _keys_impl(alloc), _values_impl(alloc), _delta_keys(alloc), _delta_values(alloc), _delta_tombstones(alloc) {
+            sync();
         }
 
-        //Fixme: some copy constructors
+        allocator_type get_allocator() const noexcept {
+            return _keys_impl.get_allocator();
+        }
+
+        // The view base points into our own storage, so copies and moves must re-point it.
+        small_byte_map(const small_byte_map &other)
+            : super(other), _keys_impl(other._keys_impl), _values_impl(other._values_impl),
+              _write_buffer_threshold(other._write_buffer_threshold), _delta_keys(other._delta_keys),
+              _delta_values(other._delta_values), _delta_tombstones(other._delta_tombstones),
+              _tombstone_count(other._tombstone_count), _shadow_count(other._shadow_count) {
+            sync();
+        }
+
+        small_byte_map(small_byte_map &&other)
+            : super(other), _keys_impl(std::move(other._keys_impl)), _values_impl(std::move(other._values_impl)),
+              _write_buffer_threshold(other._write_buffer_threshold), _delta_keys(std::move(other._delta_keys)),
+              _delta_values(std::move(other._delta_values)), _delta_tombstones(std::move(other._delta_tombstones)),
+              _tombstone_count(other._tombstone_count), _shadow_count(other._shadow_count) {
+            sync();
+        }
+
+        small_byte_map &operator=(const small_byte_map &other) {
+            super::operator=(other);
+            _keys_impl = other._keys_impl;
+            _values_impl = other._values_impl;
+            _write_buffer_threshold = other._write_buffer_threshold;
+            _delta_keys = other._delta_keys;
+            _delta_values = other._delta_values;
+            _delta_tombstones = other._delta_tombstones;
+            _tombstone_count = other._tombstone_count;
+            _shadow_count = other._shadow_count;
+            sync();
+            return *this;
+        }
+
+        small_byte_map &operator=(small_byte_map &&other) {
+            super::operator=(other);
+            _keys_impl = std::move(other._keys_impl);
+            _values_impl = std::move(other._values_impl);
+            _write_buffer_threshold = other._write_buffer_threshold;
+            _delta_keys = std::move(other._delta_keys);
+            _delta_values = std::move(other._delta_values);
+            _delta_tombstones = std::move(other._delta_tombstones);
+            _tombstone_count = other._tombstone_count;
+            _shadow_count = other._shadow_count;
+            sync();
+            return *this;
+        }
 
         //Extra APIs
 
-        // Write the key range then the value range to a concatenated vector - useful for serialising
+        // Write the key range then the value range (or the records, when interleaved) to a concatenated vector - useful
+        // for serialising. build_from_contiguous_bytes on a view with the same Layout reads it back.
         std::vector<byte_type> to_vector() const {
             std::vector<byte_type> vec;
             to_range(vec);
@@ -454,6 +743,13 @@ namespace gnt {
         // Generic version nice for serialising to e.g. rocks Slices.
         template<template<typename, typename> typename C, typename Alloc>
         void to_range(C<byte_type, Alloc> &target) const {
+            if(!_delta_tombstones.empty()) { // Serialise what a compacted copy would hold
+                small_byte_map compacted(*this);
+                compacted.compact();
+                compacted.to_range(target);
+                return;
+            }
+            // Interleaved records are all in _keys_impl, so the second copy is empty
             target.resize(_keys_impl.size() + _values_impl.size());
             std::copy(_keys_impl.data(), _keys_impl.data() + _keys_impl.size(), target.begin());
             std::copy(_values_impl.data(), _values_impl.data() + _values_impl.size(), target.begin() + _keys_impl.size());
@@ -462,7 +758,7 @@ namespace gnt {
     protected:
 
         void sync() {
-            this->reset(_keys_impl, _values_impl);
+            this->reset_entries(keys_data(), values_data(), _keys_impl.size() / key_pitch);
         }
 
         // Ensures linear mode is disabled if we're above the linear extent
@@ -476,12 +772,10 @@ namespace gnt {
 
         // Call this only once the underlying range has been sorted due to expansions
         void force_linear_mode(bool linear_mode = true, bool presorted_hint = false) {
+            compact();
             if(!linear_mode && super::_linear_mode && !presorted_hint) {
                 // To disable linear search mode from before, need to sort the data so we can do binary search
-                // Note! This is relying on the assumption that std::sort implementation will use std::iter_swap under-the-hood.
-                std::sort(this->begin(), this->end(), [](const typename iterator::value_type &lhs, const typename iterator::value_type &rhs) -> bool {
-                    return lhs.first < rhs.second();
-                });
+                sort_strides<K_Extent, V_Extent, Layout>(keys_data(), values_data(), this->size());
             }
             super::_linear_mode = linear_mode;
         }
@@ -489,30 +783,183 @@ namespace gnt {
         // map-like APIs
 
         void reserve(size_type count) {
-            _keys_impl.reserve(count * K_Extent);
-            _values_impl.reserve(count * V_Extent);
+            _keys_impl.reserve(count * key_pitch);
+            if constexpr (!Layout::interleaved) {
+                _values_impl.reserve(count * V_Extent);
+            }
+            sync();
         }
 
         void clear() noexcept {
             _keys_impl.clear();
             _values_impl.clear();
+            clear_write_buffer();
+            sync();
+            super::_linear_mode = true;
+        }
+
+        // Write buffered mode (LSM-style). Once the map is sorted (above LinearExtent), every insert and erase has to
+        // shift both the key and the value arrays. With a write buffer, writes instead go to a small unsorted delta of
+        // at most threshold entries beside the sorted run (erases of sorted entries become tombstones there), and the
+        // delta is merged into the sorted run in one linear pass when it fills: amortised O(log n) writes.
+        // Point lookups (find, contains, count, at, size) check the delta then the sorted run. Iteration, the
+        // small_byte_map_view API and views taken over this map see only the sorted run until compact() is called;
+        // to_vector / to_range always serialise the merged contents, so the serialised layout is unchanged.
+        // A threshold of 0 (the default) turns buffering off, compacting anything still buffered.
+        void set_write_buffer(size_type threshold) {
+            _write_buffer_threshold = threshold;
+            if(threshold == 0) {
+                compact();
+            } else {
+                _delta_keys.reserve(threshold * K_Extent);
+                _delta_values.reserve(threshold * V_Extent);
+            }
+        }
+
+        size_type write_buffer() const noexcept {
+            return _write_buffer_threshold;
+        }
+
+        // Number of buffered writes (including tombstones) waiting to be merged into the sorted run
+        size_type buffered() const noexcept {
+            return _delta_tombstones.size();
+        }
+
+        // Merges the write buffer into the sorted run
+        void compact() {
+            const size_type delta = buffered();
+            if(delta == 0) {
+                return;
+            }
+            // Keys are unique within the delta, so any sort order of it will do.
+            std::vector<std::uint32_t> order(delta);
+            std::iota(order.begin(), order.end(), 0);
+            std::sort(order.begin(), order.end(), [this](std::uint32_t lhs, std::uint32_t rhs) {
+                return less_strides<K_Extent>(_delta_keys.data() + lhs * K_Extent, _delta_keys.data() + rhs * K_Extent);
+            });
+            const size_type existing = super::size();
+            resize_entries(existing + delta);
+            byte_type *k_data = keys_data();
+            byte_type *v_data = values_data();
+            std::vector<bool> tombstones(delta);
+            for(size_type i = 0; i < delta; ++i) {
+                std::copy_n(_delta_keys.data() + order[i] * K_Extent, K_Extent, k_data + (existing + i) * key_pitch);
+                std::copy_n(_delta_values.data() + order[i] * V_Extent, V_Extent, v_data + (existing + i) * value_pitch);
+                tombstones[i] = _delta_tombstones[order[i]];
+            }
+            const size_type total = merge_sorted_runs(k_data, v_data, existing, delta, duplicate_policy::overwrite, &tombstones);
+            resize_entries(total);
+            clear_write_buffer();
+            sync();
+        }
+
+        // Lookups that also see the write buffer (the view versions only see the sorted run)
+
+        size_type size() const noexcept {
+            return super::size() - _shadow_count + buffered() - _tombstone_count;
+        }
+
+        [[nodiscard]] bool empty() const noexcept {
+            return size() == 0;
+        }
+
+        iterator find(const key_stride &key) {
+            if(buffered() > 0) {
+                const size_type d = find_in_delta(key);
+                if(d < buffered()) {
+                    return _delta_tombstones[d] ? this->end() : delta_iterator(d);
+                }
+            }
+            return super::find(key);
+        }
+
+        const_iterator find(const key_stride &key) const {
+            if(buffered() > 0) {
+                const size_type d = find_in_delta(key);
+                if(d < buffered()) {
+                    return _delta_tombstones[d] ? this->end() : const_cast<small_byte_map *>(this)->delta_iterator(d);
+                }
+            }
+            return super::find(key);
+        }
+
+        bool contains(const key_stride &key) const {
+            return find(key) != this->end();
+        }
+
+        size_type count(const key_stride &key) const {
+            if(buffered() > 0) {
+                const size_type d = find_in_delta(key);
+                if(d < buffered()) {
+                    return _delta_tombstones[d] ? 0 : 1;
+                }
+            }
+            return super::count(key);
+        }
+
+        value_stride at(const key_stride &key) {
+            auto it = find(key);
+            if(it == this->end()) {
+                throw std::out_of_range("key is not in small_byte_map");
+            }
+            return it->second;
+        }
+
+        value_stride at(const key_stride &key) const {
+            return const_cast<small_byte_map *>(this)->at(key);
+        }
+
+        using super::find_many;
+
+        // Positions index the sorted run, so anything still buffered is merged into it first
+        size_type find_many(nonstd::span<const key_stride> needles, nonstd::span<size_type> positions) {
+            compact();
+            return super::find_many(needles, positions);
+        }
+
+        // A const map can't merge its buffer, and positions can't refer to buffered entries
+        size_type find_many(nonstd::span<const key_stride> needles, nonstd::span<size_type> positions) const {
+            if(buffered() > 0) {
+                throw std::logic_error("small_byte_map find_many positions need the write buffer compacted first");
+            }
+            return super::find_many(needles, positions);
+        }
+
+        // With writes buffered, falls back to one find per needle
+        size_type find_many(nonstd::span<const key_stride> needles, nonstd::span<iterator> out) {
+            if(buffered() == 0) {
+                return super::find_many(needles, out);
+            }
+            return find_many_buffered(needles, out);
+        }
+
+        size_type find_many(nonstd::span<const key_stride> needles, nonstd::span<const_iterator> out) const {
+            if(buffered() == 0) {
+                return super::find_many(needles, out);
+            }
+            return find_many_buffered(needles, out);
         }
 
         //Inserts element(s) into the container, if the container doesn't already contain an element with an equivalent key.
         std::pair<iterator,bool> insert(const value_type& value) {
+            if(buffering()) {
+                return buffered_insert(value.first, value.second);
+            }
             auto it = this->find(value.first);
             if(it != this->end()) {
-                return {false, it};
+                return {it, false};
             }
             if(this->linear_mode()) { //Linear insert: just put on the end
-                _keys_impl.template push_back_stride<K_Extent>(value.first);
-                _values_impl.template push_back_stride<V_Extent>(value.second);
-                return {true, this->begin() + this->size()};
+                push_back_entry(value.first.data(), value.second.data());
+                if(this->size() > LinearExtent) {
+                    ensure_mode();
+                    return {this->find(value.first), true};
+                }
+                return {this->begin() + (this->size() - 1), true};
             } else {
-                constexpr auto diff = it - this->begin();
-                _keys_impl.insert_stride(_keys_impl.template begin_stride<K_Extent>() + diff, value.first);
-                _values_impl.insert_stride(_values_impl.template begin_stride<V_Extent>() + diff, value.second);
-                return {true, this->begin() + diff};
+                const auto diff = this->lower_bound_index(value.first);
+                insert_entry(diff, value.first.data(), value.second.data());
+                return {this->begin() + diff, true};
             }
         }
 
@@ -520,19 +967,107 @@ namespace gnt {
 
         template< class InputIt >
         void insert( InputIt first, InputIt last ) {
-            for(auto it = first; it < last; ++it) {
-                insert(*it);
+            insert_bulk(first, last);
+        }
+
+        // Bulk load of count entries from separate contiguous key and value regions (e.g. a RocksDB scan).
+        // In sorted mode the batch is appended, sorted on its own, and merged into the existing sorted run in one linear
+        // pass, so loading n entries is O(n log n) rather than the O(n^2) of one insert per entry.
+        void insert_bulk(const byte_type *keys, const byte_type *values, size_type count,
+                         duplicate_policy policy = duplicate_policy::keep_existing) {
+            if(count == 0) {
+                return;
+            }
+            compact();
+            const size_type existing = this->size();
+            if(this->linear_mode() && existing + count <= LinearExtent) {
+                // Small enough to stay linear: one at a time is cheapest here.
+                for(size_type i = 0; i < count; ++i) {
+                    insert_one(keys + i * K_Extent, values + i * V_Extent, policy);
+                }
+                return;
+            }
+            force_linear_mode(false);
+
+            // Append and sort just the batch
+            resize_entries(existing + count);
+            byte_type *k_data = keys_data();
+            byte_type *v_data = values_data();
+            store_entries(existing, keys, values, count);
+            sort_strides<K_Extent, V_Extent, Layout>(k_data + existing * key_pitch, v_data + existing * value_pitch, count);
+            const size_type batch = dedupe_sorted_run(k_data + existing * key_pitch, v_data + existing * value_pitch, count, policy);
+
+            const size_type total = merge_sorted_runs(k_data, v_data, existing, batch, policy);
+            resize_entries(total);
+            sync();
+            super::_linear_mode = total <= LinearExtent;
+        }
+
+        // As above, for any range of (key_stride, value_stride) pairs
+        template< class InputIt >
+        void insert_bulk(InputIt first, InputIt last, duplicate_policy policy = duplicate_policy::keep_existing) {
+            std::vector<byte_type> keys, values;
+            for(auto it = first; it != last; ++it) {
+                keys.insert(keys.end(), (*it).first.begin(), (*it).first.end());
+                values.insert(values.end(), (*it).second.begin(), (*it).second.end());
+            }
+            insert_bulk(keys.data(), values.data(), keys.size() / K_Extent, policy);
+        }
+
+        // Replaces the contents with count entries that are already sorted by key (e.g. the key and value regions of
+        // another sorted map). No sorting or searching is done: this is just two copies.
+        // Like insert_bulk and append_sorted, this takes separate key and value regions whatever the Layout.
+        void assign_sorted(const byte_type *keys, const byte_type *values, size_type count) {
+            clear_write_buffer();
+            resize_entries(count);
+            store_entries(0, keys, values, count);
+            sync();
+            super::_linear_mode = count <= LinearExtent;
+        }
+
+        // As above, from the contiguous bytes of to_vector / build_from_contiguous_bytes (in this map's Layout)
+        void assign_sorted(const byte_type *data, size_type size_bytes) {
+            if ((size_bytes % (K_Extent + V_Extent)) != 0) {
+                throw std::range_error("small_byte_map cannot assign from contiguous bytes that are no divisible by K_Extent + V_Extent");
+            }
+            const size_type count = size_bytes / (K_Extent + V_Extent);
+            if constexpr (Layout::interleaved) {
+                clear_write_buffer();
+                _keys_impl.resize(size_bytes);
+                std::copy(data, data + size_bytes, _keys_impl.data());
+                sync();
+                super::_linear_mode = count <= LinearExtent;
+            } else {
+                assign_sorted(data, data + count * K_Extent, count);
+            }
+        }
+
+        // Appends count entries whose keys sort at or after every key already in the map, without searching or
+        // merging. This is how the set operations (byte-map-set-ops.hpp) write their already ordered results.
+        void append_sorted(const byte_type *keys, const byte_type *values, size_type count) {
+            if(count == 0) {
+                return;
+            }
+            compact();
+            const size_type existing = super::size();
+            const bool leaves_linear_mode = this->linear_mode() && existing + count > LinearExtent;
+            const bool was_sorted = leaves_linear_mode && this->is_sorted();
+            resize_entries(existing + count);
+            store_entries(existing, keys, values, count);
+            sync();
+            if(leaves_linear_mode) {
+                force_linear_mode(false, was_sorted);
             }
         }
 
         std::pair<iterator, bool> insert_or_assign(const key_stride &k_stride, value_stride v_stride) {
-            auto b_it_pair = insert(std::make_pair(k_stride, v_stride));
-            if(!b_it_pair.first) { //No insert happened - we need to assign it
+            auto it_b_pair = insert(std::make_pair(k_stride, v_stride));
+            if(!it_b_pair.second) { //No insert happened - we need to assign it
                 //Note: by convention the V_Strides should be equal here, so the copy should be safe
-                auto current_v_stride = b_it_pair.second->second;
-                std::copy(current_v_stride.begin(), current_v_stride.end(), v_stride.begin());
+                auto current_v_stride = it_b_pair.first->second;
+                std::copy(v_stride.begin(), v_stride.end(), current_v_stride.begin());
             }
-            return b_it_pair;
+            return it_b_pair;
         }
 
         //Fixme: template <class M>
@@ -542,14 +1077,66 @@ namespace gnt {
         //Fixme: std::pair<iterator,bool> emplace( Args&&... args );
 
         iterator erase(const_iterator pos) {
-            constexpr auto diff = pos - this->cbegin();
-            _keys_impl.erase(_keys_impl.template begin_stride<K_Extent>() + diff);
-            _values_impl.erase(_values_impl.template begin_stride<V_Extent>() + diff);
+            if(buffering()) { // pos may be in the sorted run or the write buffer: erase by key instead
+                // Iteration only walks the sorted run, so carry on from its first key after the erased one. The erase
+                // may compact, so that is found by key, not by pos's old position; a pos into the write buffer has no
+                // place in the run and gives end().
+                const byte_type *at = pos->first.data();
+                const byte_type *run = keys_data();
+                const bool in_run = !std::less<const byte_type *>()(at, run) && std::less<const byte_type *>()(at, run + super::size() * key_pitch);
+                std::array<byte_type, K_Extent> key;
+                std::copy_n(at, K_Extent, key.data());
+                const key_stride needle(key.data(), K_Extent);
+                erase(needle);
+                return in_run ? this->begin() + super::upper_bound_index(needle) : this->end();
+            }
+            const auto diff = pos - this->cbegin();
+            erase_entry(diff);
+            return this->begin() + diff;
         }
 
         //Fixme iterator erase( const_iterator first, const_iterator last );
 
-        //Fixme size_type erase( const key_type& key );
+        // Returns the number of entries erased (0 or 1)
+        size_type erase(const key_stride &key) {
+            if(buffering()) {
+                const size_type d = find_in_delta(key);
+                if(d < buffered()) {
+                    if(_delta_tombstones[d]) {
+                        return 0;
+                    }
+                    if(super::contains(key)) { // Shadowing a sorted entry: becomes its tombstone
+                        _delta_tombstones[d] = true;
+                        ++_tombstone_count;
+                    } else { // Only ever buffered: just drop it (the delta is unsorted, so swap with the last)
+                        const size_type last = buffered() - 1;
+                        std::copy_n(_delta_keys.data() + last * K_Extent, K_Extent, _delta_keys.data() + d * K_Extent);
+                        std::copy_n(_delta_values.data() + last * V_Extent, V_Extent, _delta_values.data() + d * V_Extent);
+                        _delta_tombstones[d] = _delta_tombstones[last];
+                        _delta_keys.resize(last * K_Extent);
+                        _delta_values.resize(last * V_Extent);
+                        _delta_tombstones.pop_back();
+                    }
+                    return 1;
+                }
+                if(!super::contains(key)) {
+                    return 0;
+                }
+                _delta_keys.insert(_delta_keys.end(), key.begin(), key.end());
+                _delta_values.resize(_delta_values.size() + V_Extent);
+                _delta_tombstones.push_back(true);
+                ++_tombstone_count;
+                ++_shadow_count;
+                compact_if_full();
+                return 1;
+            }
+            auto it = this->find(key);
+            if(it == this->end()) {
+                return 0;
+            }
+            erase(const_iterator(it));
+            return 1;
+        }
 
         //Fixme: void swap( unordered_map& other );
 
@@ -557,8 +1144,232 @@ namespace gnt {
 
     private:
 
-        small_vector<byte_type, KStackExtent> _keys_impl; // We create a small vector optimised buffer, with no underlying step.
-        small_vector<byte_type, VStackExtent> _values_impl;
+        bool buffering() const noexcept {
+            return _write_buffer_threshold > 0 && !this->linear_mode();
+        }
+
+        template<typename It>
+        size_type find_many_buffered(nonstd::span<const key_stride> needles, nonstd::span<It> out) const {
+            if(out.size() < needles.size()) {
+                throw std::length_error("find_many needs an output for every needle");
+            }
+            size_type found = 0;
+            for(size_type i = 0; i < needles.size(); ++i) {
+                auto *self = const_cast<small_byte_map *>(this);
+                const auto it = self->find(needles[i]);
+                found += it != self->end();
+                out[i] = it;
+            }
+            return found;
+        }
+
+        size_type find_in_delta(const key_stride &key) const noexcept {
+            return find_stride<K_Extent>(_delta_keys.data(), buffered(), key.data());
+        }
+
+        iterator delta_iterator(size_type d) {
+            return iterator(key_stride(_delta_keys.data() + d * K_Extent, K_Extent),
+                            value_stride(_delta_values.data() + d * V_Extent, V_Extent));
+        }
+
+        void clear_write_buffer() noexcept {
+            _delta_keys.clear();
+            _delta_values.clear();
+            _delta_tombstones.clear();
+            _tombstone_count = 0;
+            _shadow_count = 0;
+        }
+
+        void compact_if_full() {
+            if(buffered() >= _write_buffer_threshold) {
+                compact();
+            }
+        }
+
+        std::pair<iterator, bool> buffered_insert(const key_stride &key, const value_stride &value) {
+            const size_type d = find_in_delta(key);
+            if(d < buffered()) {
+                if(!_delta_tombstones[d]) {
+                    return {delta_iterator(d), false};
+                }
+                // Re-inserting an erased sorted entry: the tombstone becomes the new value
+                _delta_tombstones[d] = false;
+                --_tombstone_count;
+                std::copy(value.begin(), value.end(), _delta_values.data() + d * V_Extent);
+                return {delta_iterator(d), true};
+            }
+            auto it = super::find(key);
+            if(it != super::end()) {
+                return {it, false};
+            }
+            _delta_keys.insert(_delta_keys.end(), key.begin(), key.end());
+            _delta_values.insert(_delta_values.end(), value.begin(), value.end());
+            _delta_tombstones.push_back(false);
+            if(buffered() >= _write_buffer_threshold) {
+                compact();
+                return {this->find(key), true};
+            }
+            return {delta_iterator(buffered() - 1), true};
+        }
+
+        void insert_one(const byte_type *key, const byte_type *value, duplicate_policy policy) {
+            key_stride k(const_cast<byte_type *>(key), K_Extent);
+            value_stride v(const_cast<byte_type *>(value), V_Extent);
+            if(policy == duplicate_policy::overwrite) {
+                insert_or_assign(k, v);
+            } else if(policy == duplicate_policy::keep_existing) {
+                insert(std::make_pair(k, v));
+            } else {
+                push_back_entry(key, value);
+            }
+        }
+
+        // Removes repeated keys from a sorted run according to the policy, returning the new number of entries.
+        static size_type dedupe_sorted_run(byte_type *keys, byte_type *values, size_type count, duplicate_policy policy) {
+            if(policy == duplicate_policy::keep_all || count == 0) {
+                return count;
+            }
+            size_type out = 0;
+            for(size_type i = 0; i < count; ++i) {
+                if(out > 0 && equal_strides<K_Extent>(keys + (out - 1) * key_pitch, keys + i * key_pitch)) {
+                    if(policy == duplicate_policy::overwrite) { // The sort is stable, so later is later in the batch
+                        std::copy_n(values + i * value_pitch, V_Extent, values + (out - 1) * value_pitch);
+                    }
+                    continue;
+                }
+                if(out != i) {
+                    Layout::template copy_entries<K_Extent, V_Extent, byte_type>(keys + out * key_pitch, values + out * value_pitch,
+                                                                                 keys + i * key_pitch, values + i * value_pitch, 1);
+                }
+                ++out;
+            }
+            return out;
+        }
+
+        // Merges the sorted runs [0, existing) and [existing, existing + batch) in place, returning the merged count.
+        // Only the batch is copied out to scratch; the merge then runs backwards from the end so it never overwrites
+        // entries it has yet to read. Dropped duplicates leave a gap at the front, which is closed with one move.
+        // Batch entries flagged in batch_tombstones are not written, and with overwrite also remove their existing key.
+        static size_type merge_sorted_runs(byte_type *keys, byte_type *values, size_type existing, size_type batch,
+                                           duplicate_policy policy, const std::vector<bool> *batch_tombstones = nullptr) {
+            std::vector<byte_type> scratch(batch * (K_Extent + V_Extent));
+            byte_type *batch_keys = scratch.data();
+            byte_type *batch_values = scratch.data() + Layout::template value_offset<K_Extent, V_Extent>(batch);
+            Layout::template copy_entries<K_Extent, V_Extent, byte_type>(batch_keys, batch_values, keys + existing * key_pitch,
+                                                                         values + existing * value_pitch, batch);
+
+            auto put = [keys, values](size_type to, const byte_type *k, const byte_type *v) {
+                std::copy_n(k, K_Extent, keys + to * key_pitch);
+                std::copy_n(v, V_Extent, values + to * value_pitch);
+            };
+
+            size_type i = existing, j = batch, w = existing + batch;
+            while(j > 0) {
+                const byte_type *bk = batch_keys + (j - 1) * key_pitch;
+                const byte_type *bv = batch_values + (j - 1) * value_pitch;
+                const int cmp = i > 0 ? compare_strides<K_Extent>(keys + (i - 1) * key_pitch, bk) : -1;
+                const bool tombstone = batch_tombstones != nullptr && (*batch_tombstones)[j - 1];
+                if(cmp > 0) {
+                    --i;
+                    put(--w, keys + i * key_pitch, values + i * value_pitch);
+                } else if(cmp < 0 || policy == duplicate_policy::keep_all) {
+                    if(!tombstone) {
+                        put(--w, bk, bv);
+                    }
+                    --j;
+                } else if(policy == duplicate_policy::overwrite) {
+                    --i;
+                    if(!tombstone) {
+                        put(--w, bk, bv);
+                    }
+                    --j;
+                } else { // keep_existing: drop the batch entry
+                    --j;
+                }
+            }
+            // Whatever is left of the existing run is already in place below w, so only a gap (if any) needs closing.
+            if(w > i) {
+                Layout::template move_entries<K_Extent, V_Extent>(keys, values, i, w, existing + batch - w);
+            }
+            return existing + batch - (w - i);
+        }
+
+        // Entry storage in the Layout's order. Interleaved records all live in _keys_impl, and _values_impl stays empty.
+
+        byte_type *keys_data() noexcept {
+            return _keys_impl.data();
+        }
+
+        byte_type *values_data() noexcept {
+            if constexpr (Layout::interleaved) {
+                return _keys_impl.data() + K_Extent;
+            } else {
+                return _values_impl.data();
+            }
+        }
+
+        void resize_entries(size_type count) {
+            _keys_impl.resize(count * key_pitch);
+            if constexpr (!Layout::interleaved) {
+                _values_impl.resize(count * V_Extent);
+            }
+        }
+
+        // Copies count entries from separate key and value regions into entries [at, at + count), which must exist
+        void store_entries(size_type at, const byte_type *keys, const byte_type *values, size_type count) {
+            if constexpr (Layout::interleaved) {
+                byte_type *record = _keys_impl.data() + at * key_pitch;
+                for(size_type i = 0; i < count; ++i, record += key_pitch) {
+                    std::copy_n(keys + i * K_Extent, K_Extent, record);
+                    std::copy_n(values + i * V_Extent, V_Extent, record + K_Extent);
+                }
+            } else {
+                std::copy(keys, keys + count * K_Extent, _keys_impl.data() + at * K_Extent);
+                std::copy(values, values + count * V_Extent, _values_impl.data() + at * V_Extent);
+            }
+        }
+
+        void push_back_entry(const byte_type *key, const byte_type *value) {
+            const size_type n = super::size();
+            resize_entries(n + 1);
+            store_entries(n, key, value, 1);
+            sync();
+        }
+
+        void insert_entry(size_type pos, const byte_type *key, const byte_type *value) {
+            if constexpr (Layout::interleaved) {
+                byte_type record[key_pitch];
+                std::copy_n(key, K_Extent, record);
+                std::copy_n(value, V_Extent, record + K_Extent);
+                _keys_impl.insert_stride(_keys_impl.template begin_stride<key_pitch>() + pos, nonstd::span<byte_type, key_pitch>(record, key_pitch));
+            } else {
+                _keys_impl.insert_stride(_keys_impl.template begin_stride<K_Extent>() + pos, key_stride(const_cast<byte_type *>(key), K_Extent));
+                _values_impl.insert_stride(_values_impl.template begin_stride<V_Extent>() + pos, value_stride(const_cast<byte_type *>(value), V_Extent));
+            }
+            sync();
+        }
+
+        void erase_entry(size_type pos) {
+            _keys_impl.erase_stride(_keys_impl.template begin_stride<key_pitch>() + pos);
+            if constexpr (!Layout::interleaved) {
+                _values_impl.erase_stride(_values_impl.template begin_stride<V_Extent>() + pos);
+            }
+            sync();
+        }
+
+        constexpr const static std::size_t key_stack_extent = Layout::interleaved ? KStackExtent + VStackExtent : KStackExtent;
+        constexpr const static std::size_t value_stack_extent = Layout::interleaved ? 1 : VStackExtent;
+
+        small_vector<byte_type, key_stack_extent, Allocator> _keys_impl; // We create a small vector optimised buffer, with no underlying step.
+        small_vector<byte_type, value_stack_extent, Allocator> _values_impl;
+
+        // Write buffer (see set_write_buffer): unsorted entries with unique keys, plus a tombstone flag for each.
+        size_type _write_buffer_threshold = 0;
+        std::vector<byte_type, Allocator> _delta_keys;
+        std::vector<byte_type, Allocator> _delta_values;
+        std::vector<bool, typename std::allocator_traits<Allocator>::template rebind_alloc<bool>> _delta_tombstones;
+        size_type _tombstone_count = 0;
+        size_type _shadow_count = 0; // Buffered entries (tombstones or not) whose key is also in the sorted run
 
     };
 
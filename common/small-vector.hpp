@@ -1,9 +1,12 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
-#include <variant>
 #include <vector>
 #include <cstddef>
+#include <cstring>
+#include <memory>
+#include <memory_resource>
 #include <type_traits>
 #include <utility>
 #include <cmath>
@@ -13,7 +16,6 @@
 //TODO enable the comparison features! TODO TODO
 #include "nonstd/span.hpp"
 
-#include "variant-match.hpp"
 #include "vector-view.hpp"
 #include "stack-vector.hpp"
 #include "pack.hpp"
@@ -26,10 +28,48 @@
 
 namespace gnt {
 
+    // Growth policies decide how far a small_vector's heap buffer grows and when it gives memory back. A policy is a
+    // type with static grow(capacity, needed), the capacity to grow to (at least needed), and shrink(size, capacity),
+    // the capacity to keep once removals leave size elements (capacity itself to keep the buffer).
+    // geometric_growth grows by FactorNum / FactorDen. With a ShrinkDivisor, a removal that leaves the buffer at most
+    // 1 / ShrinkDivisor full shrinks it to FactorNum / FactorDen times the size, which is back into inline storage once
+    // that fits. Shrinking only well below the point the last growth came from is the hysteresis: a vector hovering
+    // around one size does not reallocate back and forth.
+    template<size_t FactorNum = 2, size_t FactorDen = 1, size_t ShrinkDivisor = 0>
+    struct geometric_growth {
+
+        static_assert(FactorNum > FactorDen, "geometric_growth needs a factor above one");
+        static_assert(ShrinkDivisor == 0 || ShrinkDivisor * FactorDen > FactorNum, "geometric_growth must shrink below the point it would grow back from");
+
+        constexpr static std::size_t grow(std::size_t capacity, std::size_t needed) noexcept {
+            return std::max(needed, capacity * FactorNum / FactorDen);
+        }
+
+        constexpr static std::size_t shrink(std::size_t size, std::size_t capacity) noexcept {
+            if (ShrinkDivisor == 0 || size * ShrinkDivisor > capacity) {
+                return capacity;
+            }
+            return size * FactorNum / FactorDen;
+        }
+    };
+
+    // Doubles and never shrinks on its own, like std::vector
+    using default_growth_policy = geometric_growth<>;
+
+    // Doubles, and halves once a quarter full: for long-lived vectors (per-connection or actor state) that see bursts
+    using bursty_growth_policy = geometric_growth<2, 1, 4>;
+
     //Fixme: performance tune StackExtent default value.
 
-    //
-    template<typename T, size_t StackExtent = (128 / sizeof(T)) + 1> // Random guess
+    // A vector that keeps up to StackExtent elements in inline storage and moves to the heap past that.
+    // There is one buffer at a time: the vector_view base's span is the pointer and size, _heap.capacity says how much
+    // room the buffer has, and the buffer is on the heap exactly when the pointer isn't at _inline. So every operation
+    // works on one pointer with no dispatch on the storage mode, and only growing past the capacity changes buffer.
+    // Heap buffers come from Allocator, which is propagated on copies and moves by the standard container rules; see
+    // gnt::pmr::small_vector to spill into a std::pmr arena or pool. GrowthPolicy (see geometric_growth) sizes them,
+    // and may hand a buffer back after removals.
+    template<typename T, size_t StackExtent = (128 / sizeof(T)) + 1, typename Allocator = std::allocator<T>, // Random guess
+        typename GrowthPolicy = default_growth_policy>
     class small_vector : public vector_view<T> {
 
     public:
@@ -39,52 +79,76 @@ namespace gnt {
         using typename vector_view<T>::const_iterator;
         using typename vector_view<T>::reference;
         using typename vector_view<T>::value_type;
+        using allocator_type = Allocator;
 
-        using heap_vector = std::vector<T>;
-        using stack_vector = gnt::stack_vector<T, StackExtent>;
-        using vector_variant = std::variant<stack_vector, heap_vector>;
+        static_assert(StackExtent > 0, "small_vector needs room for at least one inline element");
 
         //Warning: notice the change of API - reserve not fill!
-        small_vector(size_type reserve_cap) : _impl(make_impl_with_reserve(reserve_cap)) {
-            //TODO try to put this back to sync()
-            std::visit([this](auto &vec) { vector_view<T>::reset(vec.data(), vec.size()); }, _impl);
+        small_vector(size_type reserve_cap, const Allocator &alloc = Allocator()) : small_vector(alloc) {
+            reserve(reserve_cap);
+        }
+
+        small_vector() : small_vector(Allocator()) {}
+
+        explicit small_vector(const Allocator &alloc) : vector_view<T>(inline_data(), 0), _heap(alloc, StackExtent) {}
+
+        small_vector(const small_vector &other)
+            : small_vector(other, alloc_traits::select_on_container_copy_construction(other.get_allocator())) {}
+
+        small_vector(const small_vector &other, const Allocator &alloc) : small_vector(alloc) {
+            copy_from(other);
         }
 
-        small_vector() : _impl(stack_vector()) {
-            //TODO check if this is enough...
-            std::visit([this](auto &vec) { vector_view<T>::reset(vec.data(), vec.size()); }, _impl);
+        // Steals a heap buffer; inline elements have to be moved across one by one. Leaves other empty and inline.
+        small_vector(small_vector &&other) noexcept(is_nothrow_relocatable_v<T>) : small_vector(other.get_allocator()) {
+            take(std::move(other));
         }
 
-    private:
+        // As above when the allocators are equal, otherwise moves every element into a buffer from alloc
+        small_vector(small_vector &&other, const Allocator &alloc) : small_vector(alloc) {
+            move_from(std::move(other));
+        }
 
-        static constexpr vector_variant make_impl_with_reserve(size_type reserve_cap) {
-            if(reserve_cap > StackExtent) {
-                auto hv = heap_vector();
-                hv.reserve(reserve_cap);
-                return hv;
+        small_vector &operator=(const small_vector &other) {
+            if (this != &other) {
+                if constexpr (alloc_traits::propagate_on_container_copy_assignment::value) {
+                    if (get_allocator() != other.get_allocator()) {
+                        release();
+                    }
+                    static_cast<Allocator &>(_heap) = other.get_allocator();
+                }
+                clear();
+                copy_from(other);
             }
-            return stack_vector();
+            return *this;
         }
 
-        // Ensures the view base class has exactly what the variant has below
-        void sync() {
-            std::visit([this](auto &vec) { this->reset(vec.data(), vec.size()); }, _impl);
+        small_vector &operator=(small_vector &&other) noexcept(is_nothrow_relocatable_v<T> && (alloc_traits::is_always_equal::value
+                                                              || alloc_traits::propagate_on_container_move_assignment::value)) {
+            if (this != &other) {
+                release();
+                if constexpr (alloc_traits::propagate_on_container_move_assignment::value) {
+                    static_cast<Allocator &>(_heap) = std::move(static_cast<Allocator &>(other._heap));
+                }
+                move_from(std::move(other));
+            }
+            return *this;
         }
 
-        template<typename Visitor>
-        auto visit(Visitor &&vis) -> decltype(std::visit(Visitor(), vector_variant())) {
-            return std::visit(std::forward<Visitor>(vis), _impl);
+        ~small_vector() {
+            release();
         }
 
     public:
 
-        //TODO operator=
-
         // CAPACITY
 
         constexpr size_type max_size() const noexcept {
-            //Fixme: consider this API a bit...
-            return visit([](const auto &vec){ return vec.max_size(); });
+            return alloc_traits::max_size(_heap);
+        }
+
+        allocator_type get_allocator() const noexcept {
+            return _heap;
         }
 
         template<size_t N>
@@ -92,67 +156,52 @@ namespace gnt {
             reserve(num_strides * N);
         }
 
-        constexpr void reserve(size_type new_cap_bytes) {
-            // Guaranteed by convention, since will never be heap if < StackExtent
-            if(new_cap_bytes < StackExtent) {
-                return;
-            }
-            // Must be exceeding stack extent, need to switch to heap.
-            if (std::holds_alternative<stack_vector>(_impl)) {
-                heap_vector next;
-                next.reserve(new_cap_bytes);
-                next.resize(this->size());
-                std::copy(this->begin(), this->end(), next.begin());
-                _impl = std::move(next);
-            } else {
-                // Reserve on heap
-                std::get<heap_vector>(_impl).reserve(new_cap_bytes);
+        // Exactly new_cap, like std::vector::reserve; the inserts grow geometrically instead
+        constexpr void reserve(size_type new_cap) {
+            if (new_cap > _heap.capacity) {
+                reallocate(new_cap);
             }
-            sync();
         }
 
         constexpr size_type capacity() const noexcept {
-            return visit([](const auto &vec){ return vec.capacity(); });
+            return _heap.capacity;
         }
 
-        // This only has an effect if in vector mode
+        // Moves back into inline storage if the elements fit, otherwise shrinks the heap buffer to the size
         constexpr void shrink_to_fit() {
-            if (std::holds_alternative<heap_vector>(_impl)) {
-                std::get<heap_vector>(_impl).shrink_to_fit();
-            }
+            shrink_to(this->size());
         }
 
         //MODIFIERS
 
         constexpr void clear() noexcept {
-            visit([](const auto &vec){ vec.clear(); });
+            if (is_heap() && GrowthPolicy::shrink(0, _heap.capacity) < _heap.capacity) {
+                release();
+            } else {
+                std::destroy(this->begin(), this->end());
+                set_size(0);
+            }
         }
 
         //TODO work out what's gone wrong with value type...
         // Element type is a single T if Stride = 0, otherwise a span of Ts
         constexpr iterator insert(const_iterator pos, const value_type &value) {
-            const auto diff = pos - this->begin();
-            reserve(this->size() + 1);
-            pos = this->begin() + diff;
-            return visit([pos, &value](const auto &vec){ return vec.insert(pos, value); });
+            return emplace(pos, value);
         }
 
         constexpr iterator insert(const_iterator pos, T &&value) {
-            const auto diff = pos - this->begin();
-            reserve(this->size() + 1);
-            pos = this->begin() + diff;
-            return visit([pos, &value](const auto &vec){ return vec.insert(pos, std::move(value)); });
+            return emplace(pos, std::move(value));
         }
 
         //Fixme: skipped: constexpr iterator insert( const_iterator pos, size_type count,
         //                           const T& value );
 
+        // The range must not come from this vector
         template<class InputIt>
         constexpr iterator insert(const_iterator pos, InputIt first, InputIt last) {
-            const auto diff = pos - this->begin();
-            reserve(this->size() + 1);
-            pos = this->begin() + diff;
-            return visit([pos, first, last](const auto &vec){ return vec.insert(pos, first, last); });
+            return insert_with(pos - this->cbegin(), std::distance(first, last), [&](T *gap) {
+                std::uninitialized_copy(first, last, gap);
+            });
         }
 
         template<size_t N>
@@ -167,16 +216,34 @@ namespace gnt {
 
         template<class... Args>
         constexpr iterator emplace(const_iterator pos, Args &&... args) {
-            //Fixme be more clever about this and move the args in with the capture
-            return insert(pos, T(std::forward<Args>(args)...));
+            const size_type idx = pos - this->cbegin();
+            // Built before the gap opens, since args may refer to an element that is about to move
+            T value(std::forward<Args>(args)...);
+            return insert_with(idx, 1, [&](T *gap) {
+                ::new (static_cast<void *>(gap)) T(std::move(value));
+            });
         }
 
-        constexpr iterator erase(iterator pos) {
-            return visit([pos](const auto &vec){ return vec.erase(pos); });
+        constexpr iterator erase(const_iterator pos) {
+            return erase(pos, pos + 1);
         }
 
         constexpr iterator erase(const_iterator first, const_iterator last) {
-            return visit([first, last](const auto &vec){ return vec.erase(first, last); });
+            const size_type idx = first - this->cbegin();
+            const size_type count = last - first;
+            const size_type n = this->size();
+            T *const p = this->data();
+            if constexpr (is_nothrow_relocatable_v<T>) {
+                std::destroy(p + idx, p + idx + count);
+                relocate(p + idx + count, p + n, p + idx);
+            } else {
+                // A throwing move would leave a hole mid-vector, so assign down and destroy the leftovers instead
+                std::move(p + idx + count, p + n, p + idx);
+                std::destroy(p + n - count, p + n);
+            }
+            set_size(n - count);
+            shrink_after_removal();
+            return this->begin() + idx;
         }
 
         template<size_t Extent>
@@ -185,24 +252,31 @@ namespace gnt {
         }
 
         constexpr void push_back(const T &value) {
-            reserve(this->size() + 1);
-            visit([&value](const auto &vec){ vec.push_back(value); });
+            emplace_back(value);
         }
 
         constexpr void push_back(T &&value) {
-            reserve(this->size() + 1);
-            visit([&value](const auto &vec){ vec.push_back(std::move(value)); });
+            emplace_back(std::move(value));
         }
 
         template<size_t Extent>
         constexpr void push_back_stride(const stride<T, Extent> &value) {
-            reserve(this->size() + Extent);
-            visit([&value](const auto &vec){ vec.insert(vec.end(), value.begin(), value.end()); });
+            insert(this->cend(), value.begin(), value.end());
         }
 
         template<class... Args>
         constexpr iterator emplace_back(Args &&... args) {
-            return emplace(this->end(), std::move(args)...);
+            const size_type n = this->size();
+            if (n < _heap.capacity) {
+                ::new (static_cast<void *>(this->data() + n)) T(std::forward<Args>(args)...);
+                set_size(n + 1);
+            } else {
+                // rebuffer constructs before moving the old elements across, in case args refers to one
+                rebuffer(grown_capacity(n + 1), n, 1, [&](T *gap) {
+                    ::new (static_cast<void *>(gap)) T(std::forward<Args>(args)...);
+                });
+            }
+            return this->end() - 1;
         }
 
         constexpr void pop_back() {
@@ -210,8 +284,19 @@ namespace gnt {
         }
 
         constexpr void resize(size_type count) {
-            reserve(count);
-            visit([&count](const auto &vec){ vec.resize(count); });
+            const size_type n = this->size();
+            if (count > n) {
+                if (count > _heap.capacity) {
+                    reallocate(grown_capacity(count));
+                }
+                std::uninitialized_value_construct(this->data() + n, this->data() + count);
+            } else {
+                std::destroy(this->data() + count, this->data() + n);
+            }
+            set_size(count);
+            if (count < n) {
+                shrink_after_removal();
+            }
         }
 
         //Fixme: skipped: constexpr void resize( size_type count, const value_type& value );
@@ -223,10 +308,205 @@ namespace gnt {
 
     private:
 
-        vector_variant _impl;
+        using alloc_traits = std::allocator_traits<Allocator>;
+
+        T *inline_data() noexcept {
+            return reinterpret_cast<T *>(_inline);
+        }
+
+        bool is_heap() const noexcept {
+            return this->data() != reinterpret_cast<const T *>(_inline);
+        }
+
+        void set_size(size_type n) noexcept {
+            this->reset(this->data(), n);
+        }
+
+        T *allocate(size_type cap) {
+            return alloc_traits::allocate(_heap, cap);
+        }
+
+        size_type grown_capacity(size_type needed) const noexcept {
+            return GrowthPolicy::grow(_heap.capacity, needed);
+        }
+
+        // Asks the growth policy whether a heap buffer should shrink now that elements have gone
+        void shrink_after_removal() {
+            if (is_heap()) {
+                const size_type cap = GrowthPolicy::shrink(this->size(), _heap.capacity);
+                if (cap < _heap.capacity) {
+                    shrink_to(cap);
+                }
+            }
+        }
+
+        // Moves a heap buffer into inline storage when cap fits there, or reallocates it to cap (at least the size)
+        void shrink_to(size_type cap) {
+            if (!is_heap()) {
+                return;
+            }
+            const size_type n = this->size();
+            cap = std::max(cap, n);
+            if (cap <= StackExtent || cap < _heap.capacity) {
+                reallocate(cap);
+            }
+        }
+
+        // Frees the old heap buffer, if any, and switches to next; the elements must already be in next
+        void adopt(T *next, size_type cap, size_type n) noexcept {
+            if (is_heap()) {
+                alloc_traits::deallocate(_heap, this->data(), _heap.capacity);
+            }
+            this->reset(next, n);
+            _heap.capacity = cap;
+        }
+
+        // Moves the elements to a heap buffer of cap, or inline storage if cap fits there (when we are on the heap)
+        void reallocate(size_type cap) {
+            rebuffer(cap, this->size(), 0, [](T *) {});
+        }
+
+        // Moves the elements across to a new buffer of cap (inline storage if it fits) around a gap of count at idx,
+        // which construct fills first. If anything throws, we are left as we were and the new buffer is freed; when
+        // moving could throw the elements are copied instead, as std::vector does, and the originals kept until the end.
+        template<typename Construct>
+        void rebuffer(size_type cap, size_type idx, size_type count, Construct &&construct) {
+            const size_type n = this->size();
+            T *const old = this->data();
+            const bool to_inline = cap <= StackExtent;
+            T *const next = to_inline ? inline_data() : allocate(cap);
+            const auto discard = [&] {
+                if (!to_inline) {
+                    alloc_traits::deallocate(_heap, next, cap);
+                }
+            };
+            try {
+                construct(next + idx);
+            } catch (...) {
+                discard();
+                throw;
+            }
+            if constexpr (is_nothrow_relocatable_v<T>) {
+                relocate(old, old + idx, next);
+                relocate(old + idx, old + n, next + idx + count);
+            } else {
+                T *built = next;
+                try {
+                    built = uninitialized_move_if_noexcept(old, old + idx, next);
+                    uninitialized_move_if_noexcept(old + idx, old + n, next + idx + count);
+                } catch (...) {
+                    std::destroy(next, built);
+                    std::destroy(next + idx, next + idx + count);
+                    discard();
+                    throw;
+                }
+                std::destroy(old, old + n);
+            }
+            adopt(next, to_inline ? StackExtent : cap, n + count);
+        }
+
+        // Fills a gap of count at idx with construct, growing if need be, and only then counts the new elements.
+        // Returns the first of them.
+        template<typename Construct>
+        iterator insert_with(size_type idx, size_type count, Construct &&construct) {
+            const size_type n = this->size();
+            T *const p = this->data();
+            if (n + count > _heap.capacity) {
+                rebuffer(grown_capacity(n + count), idx, count, construct);
+            } else if constexpr (is_nothrow_relocatable_v<T>) {
+                relocate(p + idx, p + n, p + idx + count);
+                try {
+                    construct(p + idx);
+                } catch (...) {
+                    relocate(p + idx + count, p + n + count, p + idx);
+                    throw;
+                }
+                set_size(n + count);
+            } else {
+                // Moving could throw, so build on the end and rotate into place: a throw from construct changes
+                // nothing, and one from the rotation leaves every element alive (std::vector's basic guarantee)
+                construct(p + n);
+                set_size(n + count);
+                std::rotate(p + idx, p + n, p + n + count);
+            }
+            return this->data() + idx;
+        }
+
+        // Destroys our elements and frees any heap buffer, leaving us empty and inline
+        void release() noexcept {
+            std::destroy(this->begin(), this->end());
+            if (is_heap()) {
+                alloc_traits::deallocate(_heap, this->data(), _heap.capacity);
+            }
+            this->reset(inline_data(), 0);
+            _heap.capacity = StackExtent;
+        }
+
+        // Appends copies of other's elements, assuming we are empty
+        void copy_from(const small_vector &other) {
+            reserve(other.size());
+            std::uninitialized_copy(other.begin(), other.end(), this->data());
+            set_size(other.size());
+        }
+
+        // A heap buffer can only change hands between equal allocators; otherwise the elements move across
+        void move_from(small_vector &&other) {
+            if (get_allocator() == other.get_allocator()) {
+                take(std::move(other));
+            } else {
+                reserve(other.size());
+                adopt_elements(other);
+            }
+        }
+
+        // Takes other's elements, assuming we are empty and inline, and that our allocators are equal
+        void take(small_vector &&other) noexcept(is_nothrow_relocatable_v<T>) {
+            if (other.is_heap()) {
+                this->reset(other.data(), other.size());
+                _heap.capacity = other._heap.capacity;
+                other.reset(other.inline_data(), 0);
+                other._heap.capacity = StackExtent;
+            } else {
+                adopt_elements(other);
+            }
+        }
+
+        // Moves other's elements into our buffer, assuming we are empty and have room. If a move throws, other keeps
+        // all of its elements.
+        void adopt_elements(small_vector &other) {
+            T *const from = other.data();
+            const size_type n = other.size();
+            if constexpr (is_nothrow_relocatable_v<T>) {
+                relocate(from, from + n, this->data());
+            } else {
+                uninitialized_move_if_noexcept(from, from + n, this->data());
+                std::destroy(from, from + n);
+            }
+            set_size(n);
+            other.set_size(0);
+        }
+
+        // The allocator is the base of the capacity, so an empty one (std::allocator) takes no space
+        struct heap_state : Allocator {
+            heap_state(const Allocator &alloc, size_type cap) : Allocator(alloc), capacity(cap) {}
+
+            size_type capacity;
+        };
+
+        heap_state _heap;
+        alignas(T) unsigned char _inline[StackExtent * sizeof(T)];
 
     };
 
 
 
+    namespace pmr {
+
+        // A small_vector whose heap buffers come from a std::pmr::memory_resource, e.g. a per-message
+        // std::pmr::monotonic_buffer_resource or a per-actor std::pmr::unsynchronized_pool_resource
+        template<typename T, size_t StackExtent = (128 / sizeof(T)) + 1, typename GrowthPolicy = default_growth_policy>
+        using small_vector = gnt::small_vector<T, StackExtent, std::pmr::polymorphic_allocator<T>, GrowthPolicy>;
+
+    } //ns pmr
+
 } //ns gnt
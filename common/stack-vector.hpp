@@ -1,15 +1,22 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
 
+#include "displace.hpp"
 #include "vector-view.hpp"
 #include "stride.hpp"
 
 namespace gnt {
 
     /**
-     * A vector of up to Extent size consisting of an array and a count.
-     * Usually used with small_vector for small stack optimisations.
+     * A vector of up to Extent size consisting of uninitialised inline storage and a count.
+     * Only the first count elements are alive: creating one constructs nothing, and clear, erase and destruction
+     * destroy what they remove.
      *
      * @tparam T
      * @tparam Extent Size of the underlying array. By default, at least one or enough
@@ -26,9 +33,43 @@ namespace gnt {
         using typename vector_view<T>::reference;
         using typename vector_view<T>::value_type;
 
-        stack_vector() : _impl(), _count(0) {}
+        stack_vector() : _count(0) {
+            sync();
+        }
 
-        //Fixme operator=
+        // The view base points into _impl, so copies and moves must re-point it at their own storage.
+        stack_vector(const stack_vector &other) : vector_view<T>(), _count(other._count) {
+            std::uninitialized_copy(other.begin(), other.end(), storage());
+            sync();
+        }
+
+        // Moves the elements across and leaves other empty
+        stack_vector(stack_vector &&other) noexcept(is_nothrow_relocatable_v<T>) : vector_view<T>(), _count(0) {
+            sync();
+            take(other);
+        }
+
+        stack_vector &operator=(const stack_vector &other) {
+            if (this != &other) {
+                clear();
+                std::uninitialized_copy(other.begin(), other.end(), storage());
+                _count = other._count;
+                sync();
+            }
+            return *this;
+        }
+
+        stack_vector &operator=(stack_vector &&other) noexcept(is_nothrow_relocatable_v<T>) {
+            if (this != &other) {
+                clear();
+                take(other);
+            }
+            return *this;
+        }
+
+        ~stack_vector() {
+            std::destroy(storage(), storage() + _count);
+        }
 
         //Fixme comparators
 
@@ -45,7 +86,9 @@ namespace gnt {
         }
 
         constexpr void clear() noexcept {
+            std::destroy(storage(), storage() + _count);
             _count = 0;
+            sync();
         }
 
         //Fixme: for all the inserts, investigate what would usually throw
@@ -60,10 +103,7 @@ namespace gnt {
          * @return
          */
         constexpr iterator insert(const_iterator pos, const value_type &value) {
-            displace_right_n(pos, this->end(), 1);
-            *pos = value;
-            ++_count;
-            return pos;
+            return emplace(pos, value);
         }
 
         /**
@@ -75,10 +115,7 @@ namespace gnt {
          * @return
          */
         constexpr iterator insert(const_iterator pos, value_type &&value) {
-            displace_right_n(pos, this->end(), 1);
-            *pos = std::move(value);
-            ++_count;
-            return pos;
+            return emplace(pos, std::move(value));
         }
 
         //Fixme: skipped: constexpr iterator insert( const_iterator pos, size_type count,
@@ -94,11 +131,9 @@ namespace gnt {
          */
         template<class InputIt>
         constexpr iterator insert(const_iterator pos, InputIt first, InputIt last) {
-            constexpr auto range_size = last-first;
-            displace_right_n(pos, this->end(), range_size);
-            std::copy(first, last, pos);
-            _count += range_size;
-            return pos;
+            return insert_with(pos, std::distance(first, last), [&](T *gap) {
+                std::uninitialized_copy(first, last, gap);
+            });
         }
 
         template<size_t N>
@@ -111,26 +146,33 @@ namespace gnt {
 
         //Fixme: skipped: constexpr iterator insert( const_iterator pos, std::initializer_list<T> ilist );
 
-        //TODO pick up with emplace etc.
         template<class... Args>
         constexpr iterator emplace(const_iterator pos, Args &&... args) {
-            displace_right_n(pos, this->end(), 1);
-            *pos = T(std::move(args)...);
-            ++_count;
-            return pos;
+            // Built before the gap opens, since args may refer to an element that is about to move
+            T value(std::forward<Args>(args)...);
+            return insert_with(pos, 1, [&](T *gap) {
+                ::new (static_cast<void *>(gap)) T(std::move(value));
+            });
         }
 
         constexpr iterator erase(iterator pos) {
-            displace_left_n(pos, this->end(), 1);
-            --_count;
-            return pos;
+            return erase(pos, pos + 1);
         }
 
         constexpr iterator erase(const_iterator first, const_iterator last) {
-            constexpr auto diff = last-first;
-            displace_left_n(last, this->end(), diff);
+            const auto diff = last-first;
+            auto it = mutable_pos(first);
+            if constexpr (is_nothrow_relocatable_v<T>) {
+                std::destroy(it, it + diff);
+                relocate(it + diff, this->end(), it);
+            } else {
+                // A throwing move would leave a hole mid-vector, so assign down and destroy the leftovers instead
+                std::move(it + diff, this->end(), it);
+                std::destroy(this->end() - diff, this->end());
+            }
             _count -= diff;
-            return first;
+            sync();
+            return it;
         }
 
         /**
@@ -146,21 +188,19 @@ namespace gnt {
         }
 
         constexpr void push_back(const T &value) {
-            *(this->end()) = value;
-            ++_count;
+            emplace_back(value);
         }
 
         constexpr void push_back(T &&value) {
-            *(this->end()) = std::move(value);
-            ++_count;
+            emplace_back(std::move(value));
         }
 
         template<class... Args>
         constexpr iterator emplace_back(Args &&... args) {
-            auto it = this->end();
-            *it = T(std::move(args)...);
+            ::new (static_cast<void *>(storage() + _count)) T(std::forward<Args>(args)...);
             ++_count;
-            return it;
+            sync();
+            return this->end() - 1;
         }
 
         constexpr void pop_back() {
@@ -168,12 +208,13 @@ namespace gnt {
         }
 
         constexpr void resize(size_type count) {
-            if(count <= this->size()) {
-                return;
+            if(count > _count) {
+                std::uninitialized_value_construct(storage() + _count, storage() + count);
+            } else {
+                std::destroy(storage() + count, storage() + _count);
             }
-            constexpr const auto diff = this->size() - count;
-            std::fill(this->end() - diff, this->end(), T());
-            _count += count;
+            _count = count;
+            sync();
         }
 
         //Fixme: skipped: constexpr void resize( size_type count, const value_type& value );
@@ -192,7 +233,62 @@ namespace gnt {
 
     private:
 
-        std::array<T, Extent> _impl;
+        // Keeps the view base in step with the storage and count
+        void sync() {
+            this->reset(storage(), _count);
+        }
+
+        T *storage() noexcept {
+            return reinterpret_cast<T *>(_impl);
+        }
+
+        iterator mutable_pos(const_iterator pos) {
+            return storage() + (pos - storage());
+        }
+
+        // Fills a gap of n at pos with construct, moving the elements from pos on up, and only then counts the new
+        // elements. If construct throws nothing changes; types whose move may throw are built on the end and
+        // rotated into place instead, as small_vector does.
+        template<typename Construct>
+        iterator insert_with(const_iterator pos, size_type n, Construct &&construct) {
+            auto it = mutable_pos(pos);
+            T *const end = storage() + _count;
+            if constexpr (is_nothrow_relocatable_v<T>) {
+                relocate(it, end, it + n);
+                try {
+                    construct(it);
+                } catch (...) {
+                    relocate(it + n, end + n, it);
+                    throw;
+                }
+                _count += n;
+                sync();
+            } else {
+                construct(end);
+                _count += n;
+                sync();
+                std::rotate(it, end, end + n);
+            }
+            return it;
+        }
+
+        // Moves other's elements in, assuming we are empty, and leaves other empty. If a move throws, other keeps
+        // all of its elements.
+        void take(stack_vector &other) {
+            T *const from = other.storage();
+            if constexpr (is_nothrow_relocatable_v<T>) {
+                relocate(from, from + other._count, storage());
+            } else {
+                uninitialized_move_if_noexcept(from, from + other._count, storage());
+                std::destroy(from, from + other._count);
+            }
+            _count = other._count;
+            other._count = 0;
+            other.sync();
+            sync();
+        }
+
+        alignas(T) unsigned char _impl[Extent * sizeof(T)];
         size_type _count;
 
 
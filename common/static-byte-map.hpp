@@ -0,0 +1,386 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+
+#include "small-byte-map.hpp"
+#include "stride-compare.hpp"
+#include "stride-hash.hpp"
+
+namespace gnt {
+
+    // Byte maps whose contents are known at build time (opcode tables, routing tables keyed by packed ids), built by
+    // the compiler into static storage instead of through small_byte_map::insert at startup:
+    //
+    //     constexpr auto routes = gnt::make_static_byte_map<8, 4>({
+    //         {gnt::packed_bytes<8>(17), gnt::packed_bytes<4>(3)},
+    //         {gnt::packed_bytes<8>(42), gnt::packed_bytes<4>(1)},
+    //     });
+    //
+    // The entries are stored sorted, in the key range then value range layout of small_byte_map::to_vector, so view()
+    // is a plain (sorted mode) small_byte_map_view over them for iteration, ordered and range queries, cursors and
+    // find_many. Point lookups (find, contains, count, at) use a perfect hash that is also built at compile time: one
+    // hash, two table loads and one key comparison, with no linear or sorted mode to branch on and no probing.
+    //
+    // The hash is PTHash style. Keys are split into buckets by the high bits of their hash, and each bucket (largest
+    // first) searches for a pilot whose mix, xor'd into the hash of every key in the bucket and multiplied, sends them
+    // all to free slots of a power of two table. Slots hold entry indices; empty ones point at entry 0, and its key
+    // comparison fails.
+    //
+    // Constant evaluation is slow: with GCC's default -fconstexpr-ops-limit a table of about 5000 entries still builds
+    // (in a few seconds). Bigger ones need the limit raised, or can use the same constructor at runtime.
+
+    template<size_t K_Extent, size_t V_Extent, typename byte_type = std::byte>
+    struct static_byte_map_entry {
+        std::array<byte_type, K_Extent> key;
+        std::array<byte_type, V_Extent> value;
+    };
+
+    // value as Extent big-endian bytes (the low 8 if Extent is larger), so that packed keys sort as their values do
+    template<size_t Extent, typename byte_type = std::byte>
+    constexpr std::array<byte_type, Extent> packed_bytes(std::uint64_t value) noexcept {
+        std::array<byte_type, Extent> bytes{};
+        for (std::size_t b = 0; b < Extent && b < 8; ++b) {
+            bytes[Extent - 1 - b] = static_cast<byte_type>((value >> (8 * b)) & 0xFF);
+        }
+        return bytes;
+    }
+
+    namespace detail {
+
+        template<size_t K, typename byte_type>
+        constexpr int compare_static_keys(const byte_type *lhs, const byte_type *rhs) noexcept {
+            for (std::size_t b = 0; b < K; ++b) {
+                const auto l = static_cast<unsigned char>(lhs[b]), r = static_cast<unsigned char>(rhs[b]);
+                if (l != r) {
+                    return l < r ? -1 : 1;
+                }
+            }
+            return 0;
+        }
+
+        template<size_t K, typename byte_type>
+        constexpr bool equal_static_keys(const byte_type *lhs, const byte_type *rhs) noexcept {
+            if (!__builtin_is_constant_evaluated()) {
+                return equal_strides<K>(lhs, rhs);
+            }
+            unsigned diff = 0;
+            for (std::size_t b = 0; b < K; ++b) {
+                diff |= static_cast<unsigned char>(lhs[b]) ^ static_cast<unsigned char>(rhs[b]);
+            }
+            return diff == 0;
+        }
+
+        // Power of two (at least 2) with room for n keys at a load factor of at most 0.8
+        constexpr std::size_t static_table_size(std::size_t n) noexcept {
+            std::size_t size = 2;
+            while (size * 4 < n * 5) {
+                size *= 2;
+            }
+            return size;
+        }
+
+        // Two keys per bucket on average: pilots are found in a few tries at this density
+        constexpr std::size_t static_bucket_count(std::size_t n) noexcept {
+            return n / 2 + 1;
+        }
+
+        // Constant evaluation is slow, and slower still through std::array's operator[], so the compile time helpers
+        // work on raw pointers
+
+        template<typename Less>
+        constexpr void static_sift_down(std::size_t *heap, std::size_t root, std::size_t size, Less &less) noexcept {
+            while (2 * root + 1 < size) {
+                std::size_t child = 2 * root + 1;
+                if (child + 1 < size && less(heap[child], heap[child + 1])) {
+                    ++child;
+                }
+                if (!less(heap[root], heap[child])) {
+                    return;
+                }
+                const std::size_t tmp = heap[root];
+                heap[root] = heap[child];
+                heap[child] = tmp;
+                root = child;
+            }
+        }
+
+        // std::sort is not constexpr until C++20
+        template<typename Less>
+        constexpr void static_heap_sort(std::size_t *items, std::size_t n, Less less) noexcept {
+            for (std::size_t i = n / 2; i > 0; --i) {
+                static_sift_down(items, i - 1, n, less);
+            }
+            for (std::size_t end = n; end > 1; --end) {
+                const std::size_t tmp = items[0];
+                items[0] = items[end - 1];
+                items[end - 1] = tmp;
+                static_sift_down(items, 0, end - 1, less);
+            }
+        }
+
+    } //ns detail
+
+    template<size_t K_Extent, size_t V_Extent, size_t N, typename byte_type = std::byte>
+    class static_byte_map {
+
+    public:
+
+        using entry = static_byte_map_entry<K_Extent, V_Extent, byte_type>;
+        using view_type = small_byte_map_view<K_Extent, V_Extent, const byte_type, 0>;
+        using const_iterator = typename view_type::const_iterator;
+        using iterator = const_iterator;
+        using size_type = std::size_t;
+        using key_stride = typename view_type::key_stride;
+        using value_stride = typename view_type::value_stride;
+        using index_type = std::conditional_t<(N < 65536), std::uint16_t, std::uint32_t>;
+
+        constexpr const static std::size_t key_extent = K_Extent;
+        constexpr const static std::size_t value_extent = V_Extent;
+        constexpr const static std::size_t table_size = detail::static_table_size(N);
+        constexpr const static unsigned table_bits = __builtin_ctzll(table_size);
+        constexpr const static std::size_t bucket_count = detail::static_bucket_count(N);
+        // Pilots tried per bucket before starting over with the next hash seed, and seeds tried before giving up
+        constexpr const static std::uint64_t max_pilot = 1 << 16;
+        constexpr const static std::uint64_t max_seeds = 64;
+
+        // Throws std::invalid_argument on a repeated key, so a constexpr map with one does not compile
+        constexpr explicit static_byte_map(const std::array<entry, N> &entries) : _bytes(), _pilots(), _slots() {
+            sort_entries(entries);
+            for (std::uint64_t seed = 0; seed < max_seeds; ++seed) {
+                if (build_table(seed)) {
+                    _seed = seed;
+                    return;
+                }
+            }
+            throw std::logic_error("static_byte_map found no perfect hash for its keys");
+        }
+
+        constexpr size_type size() const noexcept {
+            return N;
+        }
+
+        [[nodiscard]] constexpr bool empty() const noexcept {
+            return N == 0;
+        }
+
+        // Index of the entry with key (in key order), or size() if there is none. Usable in constant expressions.
+        constexpr size_type find_index(const byte_type *key) const noexcept {
+            if constexpr (N == 0) {
+                return 0;
+            } else {
+                const std::uint64_t h = constexpr_hash_stride<K_Extent>(key, _seed);
+                const size_type i = _slots[slot_of(h, _pilots[bucket_of(h)])];
+                return detail::equal_static_keys<K_Extent>(key_data(i), key) ? i : N;
+            }
+        }
+
+        constexpr bool contains(const byte_type *key) const noexcept {
+            return find_index(key) != N;
+        }
+
+        // The small_byte_map_view point lookups
+
+        const_iterator find(const key_stride &key) const {
+            return iterator_at(find_index(key.data()));
+        }
+
+        bool contains(const key_stride &key) const noexcept {
+            return contains(key.data());
+        }
+
+        size_type count(const key_stride &key) const noexcept {
+            return contains(key.data()) ? 1 : 0;
+        }
+
+        value_stride at(const key_stride &key) const {
+            const size_type i = find_index(key.data());
+            if (i == N) {
+                throw std::out_of_range("key is not in static_byte_map");
+            }
+            return value_stride(_bytes.data() + N * K_Extent + i * V_Extent, V_Extent);
+        }
+
+        const_iterator begin() const noexcept {
+            return iterator_at(0);
+        }
+
+        const_iterator end() const noexcept {
+            return iterator_at(N);
+        }
+
+        // Everything else (ordered queries, ranges, cursors, find_many) through a sorted view over the entries
+        view_type view() const {
+            return view_type::build_from_contiguous_bytes(_bytes.data(), _bytes.size(), true);
+        }
+
+        operator view_type() const {
+            return view();
+        }
+
+        // The sorted keys then values: what small_byte_map_view::build_from_contiguous_bytes reads
+        constexpr const std::array<byte_type, N * (K_Extent + V_Extent)> &bytes() const noexcept {
+            return _bytes;
+        }
+
+    private:
+
+        constexpr const byte_type *key_data(size_type i) const noexcept {
+            return _bytes.data() + i * K_Extent;
+        }
+
+        // As the view's iterators, including the default constructed ones of an empty map
+        const_iterator iterator_at(size_type i) const noexcept {
+            if constexpr (N == 0) {
+                return const_iterator();
+            } else {
+                return const_iterator(key_stride(key_data(i), K_Extent), value_stride(_bytes.data() + N * K_Extent + i * V_Extent, V_Extent));
+            }
+        }
+
+        // The high 32 bits scaled to [0, bucket_count), which is cheaper than a modulo
+        constexpr static std::size_t bucket_of(std::uint64_t h) noexcept {
+            return static_cast<std::size_t>(((h >> 32) * bucket_count) >> 32);
+        }
+
+        // The top bits of a multiplicative hash: unlike masking off the low bits, keys that share those still land
+        // apart for most pilots
+        constexpr static std::size_t slot_of(std::uint64_t h, std::uint64_t pilot_mix) noexcept {
+            return static_cast<std::size_t>(((h ^ pilot_mix) * 0x9e3779b97f4a7c15ULL) >> (64 - table_bits));
+        }
+
+        constexpr void sort_entries(const std::array<entry, N> &entries) {
+            std::array<std::size_t, N> order_storage{};
+            std::array<std::uint64_t, N> prefix_storage{};
+            std::size_t *order = order_storage.data();
+            std::uint64_t *prefixes = prefix_storage.data();
+            const entry *in = entries.data();
+            // The first 8 bytes of each key as one big-endian word, so most comparisons are one integer compare
+            for (std::size_t i = 0; i < N; ++i) {
+                const byte_type *key = in[i].key.data();
+                order[i] = i;
+                for (std::size_t b = 0; b < 8; ++b) {
+                    prefixes[i] = (prefixes[i] << 8) | (b < K_Extent ? static_cast<unsigned char>(key[b]) : 0);
+                }
+            }
+            detail::static_heap_sort(order, N, [in, prefixes](std::size_t lhs, std::size_t rhs) {
+                if (prefixes[lhs] != prefixes[rhs] || K_Extent <= 8) {
+                    return prefixes[lhs] < prefixes[rhs];
+                }
+                return detail::compare_static_keys<K_Extent>(in[lhs].key.data(), in[rhs].key.data()) < 0;
+            });
+            byte_type *keys = _bytes.data();
+            byte_type *values = keys + N * K_Extent;
+            for (std::size_t i = 0; i < N; ++i) {
+                const byte_type *key = in[order[i]].key.data();
+                const byte_type *value = in[order[i]].value.data();
+                for (std::size_t b = 0; b < K_Extent; ++b) {
+                    keys[i * K_Extent + b] = key[b];
+                }
+                for (std::size_t b = 0; b < V_Extent; ++b) {
+                    values[i * V_Extent + b] = value[b];
+                }
+                if (i > 0 && prefixes[order[i - 1]] == prefixes[order[i]]
+                    && detail::compare_static_keys<K_Extent>(keys + (i - 1) * K_Extent, keys + i * K_Extent) == 0) {
+                    throw std::invalid_argument("static_byte_map keys must be unique");
+                }
+            }
+        }
+
+        // False if some bucket found no pilot (e.g. two keys with the same 64 bit hash under this seed)
+        constexpr bool build_table(std::uint64_t seed) {
+            std::array<std::uint64_t, N> hash_storage{};
+            std::array<std::size_t, bucket_count + 1> start_storage{};
+            std::uint64_t *hashes = hash_storage.data();
+            std::size_t *starts = start_storage.data();
+            for (std::size_t i = 0; i < N; ++i) {
+                hashes[i] = constexpr_hash_stride<K_Extent>(key_data(i), seed);
+                ++starts[bucket_of(hashes[i]) + 1];
+            }
+            // The buckets ordered largest first (a counting sort on size)
+            std::array<std::size_t, N + 2> by_size_storage{};
+            std::array<std::size_t, bucket_count> order_storage{};
+            std::size_t *by_size = by_size_storage.data();
+            std::size_t *order = order_storage.data();
+            for (std::size_t b = 0; b < bucket_count; ++b) {
+                ++by_size[starts[b + 1]];
+            }
+            for (std::size_t s = N + 1; s > 0; --s) {
+                by_size[s - 1] += by_size[s];
+            }
+            for (std::size_t b = bucket_count; b > 0; --b) {
+                order[--by_size[starts[b]]] = b - 1;
+            }
+            // Then the entries grouped by bucket, with their hashes alongside
+            for (std::size_t b = 0; b < bucket_count; ++b) {
+                starts[b + 1] += starts[b];
+            }
+            std::array<std::size_t, bucket_count> fill_storage{};
+            std::array<std::size_t, N> member_storage{};
+            std::array<std::uint64_t, N> member_hash_storage{};
+            std::size_t *fill = fill_storage.data();
+            std::size_t *members = member_storage.data();
+            std::uint64_t *member_hashes = member_hash_storage.data();
+            for (std::size_t i = 0; i < N; ++i) {
+                const std::size_t b = bucket_of(hashes[i]);
+                members[starts[b] + fill[b]] = i;
+                member_hashes[starts[b] + fill[b]++] = hashes[i];
+            }
+
+            std::array<bool, table_size> taken_storage{};
+            bool *taken = taken_storage.data();
+            index_type *slots = _slots.data();
+            for (std::size_t s = 0; s < table_size; ++s) {
+                slots[s] = 0;
+            }
+            for (std::size_t o = 0; o < bucket_count; ++o) {
+                const std::size_t b = order[o], first = starts[b], last = starts[b + 1];
+                if (first == last) {
+                    break; // Only empty buckets are left
+                }
+                bool placed_all = false;
+                for (std::uint64_t pilot = 0; pilot < max_pilot && !placed_all; ++pilot) {
+                    const std::uint64_t mix = detail::fmix64(pilot + 1);
+                    std::size_t placed = first;
+                    for (; placed < last && !taken[slot_of(member_hashes[placed], mix)]; ++placed) {
+                        taken[slot_of(member_hashes[placed], mix)] = true;
+                    }
+                    if (placed == last) {
+                        _pilots.data()[b] = mix;
+                        for (std::size_t m = first; m < last; ++m) {
+                            slots[slot_of(member_hashes[m], mix)] = static_cast<index_type>(members[m]);
+                        }
+                        placed_all = true;
+                    } else {
+                        for (std::size_t m = first; m < placed; ++m) {
+                            taken[slot_of(member_hashes[m], mix)] = false;
+                        }
+                    }
+                }
+                if (!placed_all) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        std::array<byte_type, N * (K_Extent + V_Extent)> _bytes;
+        std::array<std::uint64_t, bucket_count> _pilots; // Stored mixed, so a lookup is just an xor
+        std::array<index_type, table_size> _slots;
+        std::uint64_t _seed = 0;
+
+    };
+
+    template<size_t K_Extent, size_t V_Extent, typename byte_type = std::byte, size_t N>
+    constexpr auto make_static_byte_map(const static_byte_map_entry<K_Extent, V_Extent, byte_type> (&entries)[N]) {
+        std::array<static_byte_map_entry<K_Extent, V_Extent, byte_type>, N> copy{};
+        for (std::size_t i = 0; i < N; ++i) {
+            copy[i] = entries[i];
+        }
+        return static_byte_map<K_Extent, V_Extent, N, byte_type>(copy);
+    }
+
+} //ns gnt
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace gnt {
+
+    // Lexicographic (memcmp order) comparison of fixed extent byte strides, specialised on the extent.
+    // For 2, 4, 8 and 16 byte strides the keys are loaded as big-endian words so one integer compare replaces a byte
+    // loop, which is also exactly the order gnt::pack_int produces. Every other extent uses a fixed length memcmp.
+    // Bytes are always unsigned here, whatever a map's byte_type: for std::byte (the default) that is the order
+    // operator< always gave, but for char maps it replaces the signed order the span operator< used, so a key with
+    // a high bit byte (0x80 and up) now sorts after 0x7F rather than before 0x00. Data presorted in the old order
+    // must be re-sorted (pass sorted_hint = false) before being searched in sorted mode.
+
+    namespace detail {
+
+        template<typename U>
+        inline U load_big_endian(const void *p) noexcept {
+            U u;
+            std::memcpy(&u, p, sizeof(U));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            if constexpr (sizeof(U) == 2) {
+                u = __builtin_bswap16(u);
+            } else if constexpr (sizeof(U) == 4) {
+                u = __builtin_bswap32(u);
+            } else {
+                u = __builtin_bswap64(u);
+            }
+#endif
+            return u;
+        }
+
+        template<typename U>
+        inline int three_way(U a, U b) noexcept {
+            return (a > b) - (a < b);
+        }
+
+    } //ns detail
+
+    // Returns <0, 0 or >0 as memcmp(lhs, rhs, K) would.
+    template<size_t K>
+    inline int compare_strides(const void *lhs, const void *rhs) noexcept {
+        if constexpr (K == 2) {
+            return detail::three_way(detail::load_big_endian<std::uint16_t>(lhs), detail::load_big_endian<std::uint16_t>(rhs));
+        } else if constexpr (K == 4) {
+            return detail::three_way(detail::load_big_endian<std::uint32_t>(lhs), detail::load_big_endian<std::uint32_t>(rhs));
+        } else if constexpr (K == 8) {
+            return detail::three_way(detail::load_big_endian<std::uint64_t>(lhs), detail::load_big_endian<std::uint64_t>(rhs));
+        } else if constexpr (K == 16) {
+            const auto *l = static_cast<const unsigned char *>(lhs);
+            const auto *r = static_cast<const unsigned char *>(rhs);
+            const auto l_hi = detail::load_big_endian<std::uint64_t>(l), r_hi = detail::load_big_endian<std::uint64_t>(r);
+            if (l_hi != r_hi) {
+                return l_hi < r_hi ? -1 : 1;
+            }
+            return detail::three_way(detail::load_big_endian<std::uint64_t>(l + 8), detail::load_big_endian<std::uint64_t>(r + 8));
+        } else {
+            return std::memcmp(lhs, rhs, K);
+        }
+    }
+
+    template<size_t K>
+    inline bool less_strides(const void *lhs, const void *rhs) noexcept {
+        if constexpr (K == 2) {
+            return detail::load_big_endian<std::uint16_t>(lhs) < detail::load_big_endian<std::uint16_t>(rhs);
+        } else if constexpr (K == 4) {
+            return detail::load_big_endian<std::uint32_t>(lhs) < detail::load_big_endian<std::uint32_t>(rhs);
+        } else if constexpr (K == 8) {
+            return detail::load_big_endian<std::uint64_t>(lhs) < detail::load_big_endian<std::uint64_t>(rhs);
+        } else {
+            return compare_strides<K>(lhs, rhs) < 0;
+        }
+    }
+
+    // Equality needs no byte swapping, a fixed length memcmp compiles to word compares.
+    template<size_t K>
+    inline bool equal_strides(const void *lhs, const void *rhs) noexcept {
+        return std::memcmp(lhs, rhs, K) == 0;
+    }
+
+    // Number of leading bytes lhs and rhs have in common, up to K, a word at a time.
+    template<size_t K>
+    inline std::size_t common_prefix_length(const void *lhs, const void *rhs) noexcept {
+        const auto *l = static_cast<const unsigned char *>(lhs);
+        const auto *r = static_cast<const unsigned char *>(rhs);
+        std::size_t shared = 0;
+        for (; shared + 8 <= K; shared += 8) {
+            const std::uint64_t diff = detail::load_big_endian<std::uint64_t>(l + shared) ^ detail::load_big_endian<std::uint64_t>(r + shared);
+            if (diff != 0) {
+                return shared + __builtin_clzll(diff) / 8;
+            }
+        }
+        while (shared < K && l[shared] == r[shared]) {
+            ++shared;
+        }
+        return shared;
+    }
+
+    // A needle that is compared against many strides (e.g. by a search): for 2, 4 and 8 byte strides its big-endian
+    // word is loaded once up front rather than on every comparison.
+    template<size_t K>
+    class stride_needle {
+
+    public:
+
+        stride_needle() = default;
+
+        explicit stride_needle(const void *needle) noexcept : _needle(needle) {
+            if constexpr (has_word) {
+                _word = detail::load_big_endian<word_type>(needle);
+            }
+        }
+
+        // less_strides<K>(stride, needle)
+        bool follows(const void *stride) const noexcept {
+            if constexpr (has_word) {
+                return detail::load_big_endian<word_type>(stride) < _word;
+            } else {
+                return less_strides<K>(stride, _needle);
+            }
+        }
+
+        const void *data() const noexcept {
+            return _needle;
+        }
+
+    private:
+
+        constexpr static bool has_word = K == 2 || K == 4 || K == 8;
+        using word_type = std::conditional_t<K == 2, std::uint16_t, std::conditional_t<K == 4, std::uint32_t, std::uint64_t>>;
+
+        const void *_needle = nullptr;
+        word_type _word = 0;
+
+    };
+
+    // Functor versions over anything with a data() (spans, stride iterators), for use with std algorithms.
+
+    template<size_t K>
+    struct stride_less {
+        template<typename L, typename R>
+        bool operator()(const L &lhs, const R &rhs) const noexcept {
+            return less_strides<K>(lhs.data(), rhs.data());
+        }
+    };
+
+    template<size_t K>
+    struct stride_equal {
+        template<typename L, typename R>
+        bool operator()(const L &lhs, const R &rhs) const noexcept {
+            return equal_strides<K>(lhs.data(), rhs.data());
+        }
+    };
+
+} //ns gnt
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace gnt {
+
+    // 64 bit hash of a K byte stride, for the hashed side structures over byte maps.
+    // Keys are consumed a word at a time (K is a constant, so the loop unrolls) and finished with the murmur3 64 bit
+    // finaliser, so every output bit depends on every key bit: safe to use the low bits for a slot and the high bits as
+    // a fingerprint. Not for hostile keys.
+
+    namespace detail {
+
+        constexpr std::uint64_t fmix64(std::uint64_t h) noexcept {
+            h ^= h >> 33;
+            h *= 0xff51afd7ed558ccdULL;
+            h ^= h >> 33;
+            h *= 0xc4ceb9fe1a85ec53ULL;
+            h ^= h >> 33;
+            return h;
+        }
+
+    } //ns detail
+
+    template<size_t K>
+    inline std::uint64_t hash_stride(const void *stride, std::uint64_t seed = 0) noexcept {
+        const auto *bytes = static_cast<const unsigned char *>(stride);
+        std::uint64_t h = seed ^ (K * 0x9e3779b97f4a7c15ULL);
+        std::size_t i = 0;
+        for (; i + 8 <= K; i += 8) {
+            std::uint64_t w;
+            std::memcpy(&w, bytes + i, 8);
+            h = (h ^ w) * 0x9e3779b97f4a7c15ULL;
+            h ^= h >> 29;
+        }
+        if constexpr (K % 8 != 0) {
+            std::uint64_t w = 0;
+            std::memcpy(&w, bytes + i, K % 8);
+            h = (h ^ w) * 0x9e3779b97f4a7c15ULL;
+        }
+        return detail::fmix64(h);
+    }
+
+    namespace detail {
+
+        // count (at most 8) bytes as a little-endian word. At runtime on little-endian hosts this is just a load.
+        template<typename byte_type>
+        constexpr std::uint64_t load_little_endian_word(const byte_type *bytes, std::size_t count) noexcept {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            if (!__builtin_is_constant_evaluated()) {
+                std::uint64_t w = 0;
+                std::memcpy(&w, bytes, count);
+                return w;
+            }
+#endif
+            std::uint64_t w = 0;
+            for (std::size_t b = 0; b < count; ++b) {
+                w |= static_cast<std::uint64_t>(static_cast<unsigned char>(bytes[b])) << (8 * b);
+            }
+            return w;
+        }
+
+    } //ns detail
+
+    // hash_stride that can also run at compile time (see static_byte_map). The words are read little-endian, so on
+    // little-endian hosts the hashes are the same as hash_stride's.
+    template<size_t K, typename byte_type>
+    constexpr std::uint64_t constexpr_hash_stride(const byte_type *bytes, std::uint64_t seed = 0) noexcept {
+        std::uint64_t h = seed ^ (K * 0x9e3779b97f4a7c15ULL);
+        std::size_t i = 0;
+        for (; i + 8 <= K; i += 8) {
+            h = (h ^ detail::load_little_endian_word(bytes + i, 8)) * 0x9e3779b97f4a7c15ULL;
+            h ^= h >> 29;
+        }
+        if constexpr (K % 8 != 0) {
+            h = (h ^ detail::load_little_endian_word(bytes + i, K % 8)) * 0x9e3779b97f4a7c15ULL;
+        }
+        return detail::fmix64(h);
+    }
+
+} //ns gnt
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+
+#include "stride-compare.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace gnt {
+
+    // Vectorised linear search over contiguous K-byte strides (e.g. the key range of a small_byte_map_view).
+    // The SSE2 path is available on any x86-64 build, the AVX2 path needs -mavx2 (or -march=...) at compile time.
+    // Both fall back to the scalar search for stride extents other than 4, 8, 16 and 32.
+    // Every search takes an optional Pitch, the distance between the starts of consecutive strides, for keys that are
+    // not packed back to back (the keys of interleaved [key|value] records, see byte-map-layout.hpp). Pitched linear
+    // searches are scalar.
+
+    // Returns the index of the first stride in [data, data + n * K) equal to needle, or n if there is none.
+    template<size_t K, size_t Pitch = K>
+    std::size_t find_stride_scalar(const void *data, std::size_t n, const void *needle) noexcept {
+        const auto *bytes = static_cast<const unsigned char *>(data);
+        for (std::size_t i = 0; i < n; ++i) {
+            if (std::memcmp(bytes + i * Pitch, needle, K) == 0) { // K is a constant, so this gets inlined
+                return i;
+            }
+        }
+        return n;
+    }
+
+    namespace detail {
+
+        template<size_t K>
+        constexpr bool has_simd_stride_search = (K == 4 || K == 8 || K == 16 || K == 32);
+
+#if defined(__AVX2__)
+
+        constexpr std::size_t simd_stride_search_width = 32;
+
+        // Compare a register full of keys against the broadcast needle so that every byte of a key's lane is 0xFF iff
+        // the whole key matched.
+        template<size_t K>
+        inline __m256i stride_lanes_equal(const unsigned char *p, const __m256i *needles) noexcept {
+            const __m256i needle = needles[0];
+            const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+            if constexpr (K == 4) {
+                return _mm256_cmpeq_epi32(block, needle);
+            } else if constexpr (K == 8) {
+                return _mm256_cmpeq_epi64(block, needle);
+            } else {
+                __m256i eq = _mm256_cmpeq_epi64(block, needle);
+                eq = _mm256_and_si256(eq, _mm256_shuffle_epi32(eq, 0x4E)); // Swap 64 bit halves of each 128 bit lane
+                if constexpr (K == 32) {
+                    eq = _mm256_and_si256(eq, _mm256_permute2x128_si256(eq, eq, 0x01));
+                }
+                return eq;
+            }
+        }
+
+        inline int stride_lanes_mask(__m256i eq) noexcept {
+            return _mm256_movemask_epi8(eq);
+        }
+
+        inline __m256i load_stride_needle(const unsigned char *repeated) noexcept {
+            return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(repeated));
+        }
+
+#elif defined(__SSE2__)
+
+        constexpr std::size_t simd_stride_search_width = 16;
+
+        template<size_t K>
+        inline __m128i stride_lanes_equal_16(const unsigned char *p, __m128i needle) noexcept {
+            const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+            __m128i eq = _mm_cmpeq_epi32(block, needle);
+            if constexpr (K >= 8) {
+                eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, 0xB1)); // Swap 32 bit halves of each 64 bit lane
+            }
+            if constexpr (K >= 16) {
+                eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, 0x4E)); // Swap the 64 bit halves
+            }
+            return eq;
+        }
+
+        // With 16 byte registers a 32 byte key is two registers, so we fold them into one lane mask per key.
+        template<size_t K>
+        inline __m128i stride_lanes_equal(const unsigned char *p, const __m128i *needles) noexcept {
+            if constexpr (K == 32) {
+                return _mm_and_si128(stride_lanes_equal_16<16>(p, needles[0]), stride_lanes_equal_16<16>(p + 16, needles[1]));
+            } else {
+                return stride_lanes_equal_16<K>(p, needles[0]);
+            }
+        }
+
+        inline int stride_lanes_mask(__m128i eq) noexcept {
+            return _mm_movemask_epi8(eq);
+        }
+
+        inline __m128i load_stride_needle(const unsigned char *repeated) noexcept {
+            return _mm_loadu_si128(reinterpret_cast<const __m128i *>(repeated));
+        }
+
+#endif
+
+    } //ns detail
+
+    // Returns the index of the first stride in [data, data + n * K) equal to needle, or n if there is none.
+    template<size_t K, size_t Pitch = K>
+    std::size_t find_stride(const void *data, std::size_t n, const void *needle) noexcept {
+#if defined(__AVX2__) || defined(__SSE2__)
+        if constexpr (Pitch == K && detail::has_simd_stride_search<K>) {
+            constexpr std::size_t width = detail::simd_stride_search_width;
+            // A 32 byte key in a 16 byte register is handled one key (two loads) per step.
+            constexpr std::size_t step_bytes = K > width ? K : width;
+            constexpr std::size_t keys_per_step = step_bytes / K;
+            constexpr std::size_t lane_bytes = K > width ? width : K;
+
+            const auto *bytes = static_cast<const unsigned char *>(data);
+            // The needle repeated across one step, loaded as one register per width bytes.
+            unsigned char repeated[step_bytes];
+            for (std::size_t i = 0; i < step_bytes; i += K) {
+                std::memcpy(repeated + i, needle, K);
+            }
+            decltype(detail::load_stride_needle(repeated)) needle_regs[step_bytes / width];
+            for (std::size_t r = 0; r < step_bytes / width; ++r) {
+                needle_regs[r] = detail::load_stride_needle(repeated + r * width);
+            }
+
+            std::size_t i = 0;
+            // Two steps per iteration so the loads and compares of the second overlap with the first.
+            for (; i + 2 * keys_per_step <= n; i += 2 * keys_per_step) {
+                const int mask_lo = detail::stride_lanes_mask(detail::stride_lanes_equal<K>(bytes + i * K, needle_regs));
+                const int mask_hi = detail::stride_lanes_mask(detail::stride_lanes_equal<K>(bytes + (i + keys_per_step) * K, needle_regs));
+                if ((mask_lo | mask_hi) != 0) {
+                    if (mask_lo != 0) {
+                        return i + static_cast<std::size_t>(__builtin_ctz(static_cast<unsigned>(mask_lo))) / lane_bytes;
+                    }
+                    return i + keys_per_step + static_cast<std::size_t>(__builtin_ctz(static_cast<unsigned>(mask_hi))) / lane_bytes;
+                }
+            }
+            for (; i + keys_per_step <= n; i += keys_per_step) {
+                const int mask = detail::stride_lanes_mask(detail::stride_lanes_equal<K>(bytes + i * K, needle_regs));
+                if (mask != 0) {
+                    return i + static_cast<std::size_t>(__builtin_ctz(static_cast<unsigned>(mask))) / lane_bytes;
+                }
+            }
+            return i + find_stride_scalar<K>(bytes + i * K, n - i, needle);
+        }
+#endif
+        return find_stride_scalar<K, Pitch>(data, n, needle);
+    }
+
+    // Counts the strides in [data, data + n * K) equal to needle.
+    template<size_t K, size_t Pitch = K>
+    std::size_t count_stride(const void *data, std::size_t n, const void *needle) noexcept {
+        const auto *bytes = static_cast<const unsigned char *>(data);
+        std::size_t count = 0;
+        for (std::size_t i = find_stride<K, Pitch>(bytes, n, needle); i < n;
+             i = i + 1 + find_stride<K, Pitch>(bytes + (i + 1) * Pitch, n - i - 1, needle)) {
+            ++count;
+        }
+        return count;
+    }
+
+    // Searches over sorted strides.
+
+    // Index of the first stride in [data, data + n * K) not less than needle. Branch free: every step is a conditional
+    // move, so the only stalls are the loads themselves, and the next probe is prefetched either way.
+    template<size_t K, size_t Pitch = K>
+    std::size_t lower_bound_stride(const void *data, std::size_t n, const void *needle) noexcept {
+        if (n == 0) {
+            return 0;
+        }
+        const auto *bytes = static_cast<const unsigned char *>(data);
+        const stride_needle<K> prepared(needle);
+        std::size_t base = 0;
+        while (n > 1) {
+            const std::size_t half = n / 2;
+            // Both possible next probes, so the load after this one is already on its way whichever way we go
+            __builtin_prefetch(bytes + (base + half / 2) * Pitch);
+            __builtin_prefetch(bytes + (base + half + half / 2) * Pitch);
+            base += prepared.follows(bytes + (base + half) * Pitch) ? half : 0;
+            n -= half;
+        }
+        return base + static_cast<std::size_t>(prepared.follows(bytes + base * Pitch));
+    }
+
+    // lower_bound_stride for a needle known to be no smaller than the stride at from (e.g. the previous needle of a
+    // sorted batch): gallops forward in doubling steps, then binary searches the last step. O(log d) for a distance d.
+    template<size_t K, size_t Pitch = K>
+    std::size_t gallop_lower_bound_stride(const void *data, std::size_t n, std::size_t from, const void *needle) noexcept {
+        const auto *bytes = static_cast<const unsigned char *>(data);
+        std::size_t lo = from, hi = from, step = 1;
+        while (hi < n && less_strides<K>(bytes + hi * Pitch, needle)) {
+            lo = hi + 1;
+            hi = lo + step;
+            step *= 2;
+        }
+        if (hi > n) {
+            hi = n;
+        }
+        return lo + lower_bound_stride<K, Pitch>(bytes + lo * Pitch, hi - lo, needle);
+    }
+
+    // Search policies pick how a sorted small_byte_map_view finds the first key not less than a needle. A policy is a
+    // type with a static lower_bound<K, Pitch>(keys, n, needle) returning that index (n if every key is less); see
+    // interpolation-search.hpp for the alternative to this default.
+    struct binary_search_policy {
+        template<size_t K, size_t Pitch = K>
+        static std::size_t lower_bound(const void *keys, std::size_t n, const void *needle) noexcept {
+            return lower_bound_stride<K, Pitch>(keys, n, needle);
+        }
+    };
+
+} //ns gnt
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+#include "byte-map-layout.hpp"
+#include "stride-compare.hpp"
+
+namespace gnt {
+
+    // Sorts n key strides of K bytes and, in lock step, the n value strides of V bytes that belong to them.
+    // By default keys and values live in separate contiguous regions, as in small_byte_map; with interleaved_layout
+    // values is keys + K and each [key|value] record moves as one (see byte-map-layout.hpp). Scratch buffers use the
+    // same layout as the entries.
+
+    // Applies a permutation (order[i] is the old position of the entry that belongs at i) to both regions using a
+    // single scratch buffer.
+    template<size_t K, size_t V, typename Layout = separate_layout, typename byte_type, typename Index>
+    void permute_strides(byte_type *keys, byte_type *values, const std::vector<Index> &order) {
+        constexpr std::size_t key_pitch = Layout::template key_pitch<K, V>;
+        constexpr std::size_t value_pitch = Layout::template value_pitch<K, V>;
+        const std::size_t n = order.size();
+        std::vector<byte_type> scratch(n * (K + V));
+        byte_type *scratch_keys = scratch.data();
+        byte_type *scratch_values = scratch.data() + Layout::template value_offset<K, V>(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            Layout::template copy_entries<K, V>(scratch_keys + i * key_pitch, scratch_values + i * value_pitch,
+                                                keys + order[i] * key_pitch, values + order[i] * value_pitch, 1);
+        }
+        Layout::template copy_entries<K, V, byte_type>(keys, values, scratch_keys, scratch_values, n);
+    }
+
+    // Comparison sort: sorts an index array with the extent specialised comparator, then moves every stride once.
+    template<size_t K, size_t V, typename Layout = separate_layout, typename byte_type>
+    void comparison_sort_strides(byte_type *keys, byte_type *values, std::size_t n) {
+        constexpr std::size_t key_pitch = Layout::template key_pitch<K, V>;
+        if (n < 2) {
+            return;
+        }
+        std::vector<std::uint32_t> order(n); //Fixme: 64 bit indices for maps over 4G entries
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [keys](std::uint32_t lhs, std::uint32_t rhs) {
+            return less_strides<K>(keys + lhs * key_pitch, keys + rhs * key_pitch);
+        });
+        permute_strides<K, V, Layout>(keys, values, order);
+    }
+
+    namespace detail {
+
+        // Stable insertion sort of a handful of strides, used for the small buckets of the radix sort.
+        template<size_t K, size_t V, typename Layout>
+        void insertion_sort_strides(unsigned char *keys, unsigned char *values, std::size_t n) {
+            constexpr std::size_t key_pitch = Layout::template key_pitch<K, V>;
+            constexpr std::size_t value_pitch = Layout::template value_pitch<K, V>;
+            unsigned char key[K], value[V];
+            for (std::size_t i = 1; i < n; ++i) {
+                if (!less_strides<K>(keys + i * key_pitch, keys + (i - 1) * key_pitch)) {
+                    continue;
+                }
+                std::size_t pos = i - 1;
+                while (pos > 0 && less_strides<K>(keys + i * key_pitch, keys + (pos - 1) * key_pitch)) {
+                    --pos;
+                }
+                std::memcpy(key, keys + i * key_pitch, K);
+                std::memcpy(value, values + i * value_pitch, V);
+                Layout::template move_entries<K, V>(keys, values, pos + 1, pos, i - pos);
+                std::memcpy(keys + pos * key_pitch, key, K);
+                std::memcpy(values + pos * value_pitch, value, V);
+            }
+        }
+
+        constexpr std::size_t radix_bucket_insertion_threshold = 32;
+
+        // Sorts the n entries at keys on key bytes [b, K), given that the bytes before b are equal across the range.
+        // scratch_keys / scratch_values are the same sized slice of the shared scratch buffer.
+        template<size_t K, size_t V, typename Layout>
+        void msd_radix_sort_strides(unsigned char *keys, unsigned char *values, std::size_t n, std::size_t b,
+                                    unsigned char *scratch_keys, unsigned char *scratch_values) {
+            constexpr std::size_t key_pitch = Layout::template key_pitch<K, V>;
+            constexpr std::size_t value_pitch = Layout::template value_pitch<K, V>;
+            std::size_t counts[256];
+            while (true) {
+                if (n <= radix_bucket_insertion_threshold) {
+                    insertion_sort_strides<K, V, Layout>(keys, values, n);
+                    return;
+                }
+                if (b == K) {
+                    return; // All the keys in this bucket are equal
+                }
+                std::fill(std::begin(counts), std::end(counts), 0);
+                for (std::size_t i = 0; i < n; ++i) {
+                    ++counts[keys[i * key_pitch + b]];
+                }
+                if (counts[keys[b]] == n) {
+                    ++b; // Every key has the same byte here (e.g. the high bytes of small pack_int'd ids), nothing to move
+                    continue;
+                }
+                std::size_t offsets[256];
+                std::size_t running = 0;
+                for (std::size_t d = 0; d < 256; ++d) {
+                    offsets[d] = running;
+                    running += counts[d];
+                }
+                for (std::size_t i = 0; i < n; ++i) {
+                    const std::size_t to = offsets[keys[i * key_pitch + b]]++;
+                    Layout::template copy_entries<K, V, unsigned char>(scratch_keys + to * key_pitch, scratch_values + to * value_pitch,
+                                                                       keys + i * key_pitch, values + i * value_pitch, 1);
+                }
+                Layout::template copy_entries<K, V, unsigned char>(keys, values, scratch_keys, scratch_values, n);
+
+                std::size_t start = 0;
+                for (std::size_t d = 0; d < 256; ++d) {
+                    if (counts[d] > 1) {
+                        msd_radix_sort_strides<K, V, Layout>(keys + start * key_pitch, values + start * value_pitch, counts[d], b + 1,
+                                                             scratch_keys + start * key_pitch, scratch_values + start * value_pitch);
+                    }
+                    start += counts[d];
+                }
+                return;
+            }
+        }
+
+    } //ns detail
+
+    // MSD radix sort: each level is one stable counting scatter of whole key and value strides into a single scratch
+    // buffer (allocated once, n * (K + V) bytes) and back, so nothing is swapped byte range by byte range. Bytes shared
+    // by every key in a bucket are skipped, and small buckets finish with an insertion sort. Stable, like
+    // comparison_sort_strides.
+    template<size_t K, size_t V, typename Layout = separate_layout, typename byte_type>
+    void radix_sort_strides(byte_type *keys, byte_type *values, std::size_t n) {
+        if (n < 2) {
+            return;
+        }
+        std::vector<unsigned char> scratch(n * (K + V));
+        detail::msd_radix_sort_strides<K, V, Layout>(reinterpret_cast<unsigned char *>(keys), reinterpret_cast<unsigned char *>(values), n, 0,
+                                                     scratch.data(), scratch.data() + Layout::template value_offset<K, V>(n));
+    }
+
+    // Below this many entries the comparison sort is as fast as the radix sort (see BM_SortStrides).
+    constexpr std::size_t radix_sort_threshold = 64;
+
+    template<size_t K, size_t V, typename Layout = separate_layout, typename byte_type>
+    void sort_strides(byte_type *keys, byte_type *values, std::size_t n) {
+        if (n < radix_sort_threshold) {
+            comparison_sort_strides<K, V, Layout>(keys, values, n);
+        } else {
+            radix_sort_strides<K, V, Layout>(keys, values, n);
+        }
+    }
+
+} //ns gnt
@@ -19,8 +19,9 @@ namespace gnt {
         using span = nonstd::span<T, Stride>;
         using pointer = T *;
 
-        using difference_type = std::size_t; //Fixme: parameterize
-        using iterator_category = std::bidirectional_iterator_tag;
+        // Signed and random access, so that std::lower_bound and friends take O(1) jumps rather than O(n) advances
+        using difference_type = std::ptrdiff_t;
+        using iterator_category = std::random_access_iterator_tag;
 
         stride_iterator(pointer data) : p_data(data) {}
 
@@ -86,7 +87,9 @@ namespace gnt {
         }
 
         stride_iterator<T, Stride> operator++(int) {
-            return stride_iterator(p_data + Stride);
+            auto prev = *this;
+            p_data += Stride;
+            return prev;
         }
 
         stride_iterator<T, Stride> &operator--() {
@@ -95,26 +98,44 @@ namespace gnt {
         }
 
         stride_iterator<T, Stride> operator--(int) {
-            return stride_iterator(p_data - Stride);
+            auto prev = *this;
+            p_data -= Stride;
+            return prev;
+        }
+
+        stride_iterator<T, Stride> &operator+= (difference_type n) {
+            p_data += n * static_cast<difference_type>(Stride);
+            return *this;
+        }
+
+        stride_iterator<T, Stride> &operator-= (difference_type n) {
+            p_data -= n * static_cast<difference_type>(Stride);
+            return *this;
         }
 
-        //Fixme: this should be difference type in the argument
         stride_iterator<T, Stride> operator+ (difference_type n) const {
-            return stride_iterator(p_data + n * Stride);
+            return stride_iterator(p_data + n * static_cast<difference_type>(Stride));
+        }
+
+        friend stride_iterator<T, Stride> operator+ (difference_type n, const stride_iterator<T, Stride> &it) {
+            return it + n;
         }
 
-        //Fixme: this should be difference type in the argument
         stride_iterator<T, Stride> operator- (difference_type n) const {
-            return stride_iterator(p_data - n * Stride);
+            return stride_iterator(p_data - n * static_cast<difference_type>(Stride));
         }
 
         // Gets the number of steps between this iterator and the other
         difference_type operator- (const stride_iterator<T, Stride> &other) const {
-            return (p_data - other.p_data) / Stride;
+            return (p_data - other.p_data) / static_cast<difference_type>(Stride);
         }
 
-        //TODO no this is not how you compare iterators!
-        //TODO or we break end()
+        // The n'th stride from here
+        span operator[] (difference_type n) const {
+            return span(p_data + n * static_cast<difference_type>(Stride), Stride);
+        }
+
+        // Comparison behaviour is the same as comparison of the underlying pointer, so end() needs no extent
 
         bool operator== (const stride_iterator<T, Stride> &other) const {
             return p_data == other.p_data;
@@ -124,6 +145,22 @@ namespace gnt {
             return p_data != other.p_data;
         }
 
+        bool operator< (const stride_iterator<T, Stride> &other) const {
+            return p_data < other.p_data;
+        }
+
+        bool operator> (const stride_iterator<T, Stride> &other) const {
+            return p_data > other.p_data;
+        }
+
+        bool operator<= (const stride_iterator<T, Stride> &other) const {
+            return p_data <= other.p_data;
+        }
+
+        bool operator>= (const stride_iterator<T, Stride> &other) const {
+            return p_data >= other.p_data;
+        }
+
         pointer p_data;
 
     };
@@ -0,0 +1,441 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "small-byte-map.hpp"
+#include "stride-compare.hpp"
+
+namespace gnt {
+
+    // Byte maps with fixed extent keys and variable length values.
+    // Serialised layout (all integers big-endian, like pack_int):
+    //   [n: 4 bytes][n keys: n * K_Extent bytes][n + 1 value offsets: 4 bytes each][value heap]
+    // Value i is heap[offsets[i], offsets[i + 1]), so values are packed back to back with no padding, and the offsets
+    // double as the fixed extent "values" of a small_byte_map_view over the keys, which does all the searching.
+
+    namespace detail {
+
+        inline void store_big_endian_u32(void *p, std::uint32_t u) noexcept {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            u = __builtin_bswap32(u);
+#endif
+            std::memcpy(p, &u, sizeof(u));
+        }
+
+    } //ns detail
+
+    // Iterates a var_byte_map_view or var_byte_map by position, dereferencing to a (key, value) pair of spans.
+    template<typename Map>
+    struct var_byte_map_iterator {
+
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = typename Map::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = value_type *;
+        using reference = value_type &;
+        using size_type = std::size_t;
+        using key_stride = typename Map::key_stride;
+        using value_span = typename Map::value_span;
+
+        var_byte_map_iterator() : var_byte_map_iterator(nullptr, 0) {}
+
+        var_byte_map_iterator(const Map *map, size_type pos)
+            : _map(map), _pos(pos), impl(key_stride(static_cast<typename key_stride::pointer>(nullptr), (size_t) 0), value_span()) {}
+
+        value_type &operator*() {
+            impl = _map->entry(_pos);
+            return impl;
+        }
+
+        value_type *operator->() {
+            return &**this;
+        }
+
+        var_byte_map_iterator &operator++() {
+            ++_pos;
+            return *this;
+        }
+
+        var_byte_map_iterator operator++(int) {
+            auto prev = *this;
+            ++(*this);
+            return prev;
+        }
+
+        var_byte_map_iterator operator+(const std::size_t n) const {
+            return var_byte_map_iterator(_map, _pos + n);
+        }
+
+        std::ptrdiff_t operator-(const var_byte_map_iterator &b) const {
+            return static_cast<std::ptrdiff_t>(_pos) - static_cast<std::ptrdiff_t>(b._pos);
+        }
+
+        bool operator==(const var_byte_map_iterator &b) const {
+            return _pos == b._pos;
+        }
+
+        bool operator!=(const var_byte_map_iterator &b) const {
+            return _pos != b._pos;
+        }
+
+        bool operator<(const var_byte_map_iterator &b) const {
+            return _pos < b._pos;
+        }
+
+    private:
+
+        const Map *_map;
+        size_type _pos;
+        value_type impl;
+
+    };
+
+    // A view over the serialised layout above, e.g. as received off the wire.
+    template<size_t K_Extent = 1, typename byte_type = std::byte, size_t LinearExtent = 128>
+    class var_byte_map_view {
+
+    public:
+
+        using size_type = std::size_t;
+        using key_stride = nonstd::span<byte_type, K_Extent>;
+        using value_span = nonstd::span<byte_type>;
+        using value_type = std::pair<key_stride, value_span>;
+        using iterator = var_byte_map_iterator<var_byte_map_view>;
+        using const_iterator = iterator;
+
+        constexpr const static std::size_t linear_extent = LinearExtent;
+        constexpr const static std::size_t key_extent = K_Extent;
+        constexpr const static size_type header_bytes = 4;
+        constexpr const static size_type offset_bytes = 4;
+
+        // Size of the serialised form of num_elems entries whose values total heap_bytes
+        static constexpr size_type serialized_size(size_type num_elems, size_type heap_bytes) noexcept {
+            return header_bytes + num_elems * K_Extent + (num_elems + 1) * offset_bytes + heap_bytes;
+        }
+
+        static var_byte_map_view build_from_contiguous_bytes(byte_type *data, size_type size_bytes, bool sorted_hint = false) {
+            if (size_bytes < serialized_size(0, 0)) {
+                throw std::range_error("var_byte_map_view cannot be built from fewer bytes than an empty map's");
+            }
+            const size_type n = detail::load_big_endian<std::uint32_t>(data);
+            if (serialized_size(n, 0) > size_bytes) {
+                throw std::range_error("var_byte_map_view bytes are too short for their entry count");
+            }
+            byte_type *offsets = data + header_bytes + n * K_Extent;
+            std::uint32_t previous = 0;
+            for (size_type i = 0; i <= n; ++i) {
+                const std::uint32_t offset = detail::load_big_endian<std::uint32_t>(offsets + i * offset_bytes);
+                if (offset < previous || (i == 0 && offset != 0)) {
+                    throw std::range_error("var_byte_map_view value offsets are not in order");
+                }
+                previous = offset;
+            }
+            if (serialized_size(n, previous) != size_bytes) {
+                throw std::range_error("var_byte_map_view bytes do not match their value heap size");
+            }
+            return var_byte_map_view(data + header_bytes, offsets, offsets + (n + 1) * offset_bytes, n, sorted_hint);
+        }
+
+        template<template<typename, typename> typename C, typename Alloc>
+        static var_byte_map_view build_from_contiguous_bytes(C<byte_type, Alloc> &cont, bool sorted_hint = false) {
+            return build_from_contiguous_bytes(cont.data(), cont.size(), sorted_hint);
+        }
+
+        var_byte_map_view() : _index(), _heap(nullptr), _num_elems(0) {}
+
+        var_byte_map_view(byte_type *keys, byte_type *offsets, byte_type *heap, size_type num_elems, bool sorted_hint = false)
+            : _index(keys, offsets, num_elems, sorted_hint), _heap(heap), _num_elems(num_elems) {
+            _end_offset = offsets + num_elems * offset_bytes;
+        }
+
+        bool linear_mode() const {
+            return _index.linear_mode();
+        }
+
+        iterator begin() const noexcept {
+            return iterator(this, 0);
+        }
+
+        iterator end() const noexcept {
+            return iterator(this, _num_elems);
+        }
+
+        [[nodiscard]] bool empty() const noexcept {
+            return _num_elems == 0;
+        }
+
+        // Number of entries (not bytes)
+        size_type size() const noexcept {
+            return _num_elems;
+        }
+
+        // Total bytes of all the values
+        size_type heap_bytes() const noexcept {
+            return _num_elems == 0 ? 0 : detail::load_big_endian<std::uint32_t>(_end_offset);
+        }
+
+        iterator find(const key_stride &key) const {
+            auto it = _index.find(key);
+            return it == _index.end() ? end() : iterator(this, it - _index.begin());
+        }
+
+        bool contains(const key_stride &key) const {
+            return _index.contains(key);
+        }
+
+        size_type count(const key_stride &key) const {
+            return _index.count(key);
+        }
+
+        value_span at(const key_stride &key) const {
+            auto it = _index.find(key);
+            if (it == _index.end()) {
+                throw std::out_of_range("key is not in var_byte_map_view");
+            }
+            return entry(it - _index.begin()).second;
+        }
+
+        value_type entry(size_type pos) const {
+            auto it = _index.begin() + pos;
+            const auto *start = it->second.data();
+            const std::uint32_t first = detail::load_big_endian<std::uint32_t>(start);
+            const std::uint32_t last = detail::load_big_endian<std::uint32_t>(start + offset_bytes);
+            return value_type(key_stride(const_cast<byte_type *>(it->first.data()), K_Extent), value_span(_heap + first, last - first));
+        }
+
+    private:
+
+        small_byte_map_view<K_Extent, offset_bytes, byte_type, LinearExtent> _index; // key -> start offset
+        byte_type *_heap;
+        byte_type *_end_offset = nullptr;
+        size_type _num_elems;
+
+    };
+
+    // Owning map with variable length values. Keys map to (offset, length) references into an append-only value heap:
+    // an insert appends its value, an erase or a value that outgrows its slot leaves dead bytes behind until compact()
+    // (or to_vector, which always writes the packed layout above).
+    template<size_t K_Extent = 1, typename byte_type = std::byte, size_t LinearExtent = 128>
+    class var_byte_map {
+
+    public:
+
+        using view_type = var_byte_map_view<K_Extent, byte_type, LinearExtent>;
+        using size_type = std::size_t;
+        using key_stride = nonstd::span<byte_type, K_Extent>;
+        using value_span = nonstd::span<byte_type>;
+        using value_type = std::pair<key_stride, value_span>;
+        using iterator = var_byte_map_iterator<var_byte_map>;
+        using const_iterator = iterator;
+
+        constexpr const static std::size_t linear_extent = LinearExtent;
+        constexpr const static std::size_t key_extent = K_Extent;
+
+        var_byte_map() = default;
+
+        // Copies the entries of a serialised view
+        explicit var_byte_map(const view_type &view) {
+            const size_type n = view.size();
+            std::vector<byte_type> keys(n * K_Extent), refs(n * ref_bytes);
+            for (size_type i = 0; i < n; ++i) {
+                auto kv = view.entry(i);
+                std::copy(kv.first.begin(), kv.first.end(), keys.data() + i * K_Extent);
+                write_ref(refs.data() + i * ref_bytes, _heap.size(), kv.second.size());
+                _heap.insert(_heap.end(), kv.second.begin(), kv.second.end());
+            }
+            if (view.linear_mode()) {
+                _index.insert_bulk(keys.data(), refs.data(), n, duplicate_policy::keep_existing);
+            } else {
+                _index.assign_sorted(keys.data(), refs.data(), n);
+            }
+        }
+
+        // Write the packed serialised layout - the input of var_byte_map_view::build_from_contiguous_bytes
+        std::vector<byte_type> to_vector() const {
+            std::vector<byte_type> vec;
+            to_range(vec);
+            return vec;
+        }
+
+        template<template<typename, typename> typename C, typename Alloc>
+        void to_range(C<byte_type, Alloc> &target) const {
+            const size_type n = size();
+            const size_type live = heap_bytes() - _dead_bytes;
+            if (live > 0xFFFFFFFF || n > 0xFFFFFFFF) {
+                throw std::length_error("var_byte_map serialises up to 4GB of values and 2^32 - 1 entries"); //Fixme: 64 bit offsets
+            }
+            target.resize(view_type::serialized_size(n, live));
+            byte_type *out = target.data();
+            detail::store_big_endian_u32(out, static_cast<std::uint32_t>(n));
+            byte_type *keys = out + view_type::header_bytes;
+            byte_type *offsets = keys + n * K_Extent;
+            byte_type *heap = offsets + (n + 1) * view_type::offset_bytes;
+            std::uint32_t offset = 0;
+            size_type i = 0;
+            for (auto it = _index.begin(); it != _index.end(); ++it, ++i) {
+                std::copy(it->first.begin(), it->first.end(), keys + i * K_Extent);
+                const auto ref = read_ref(it->second.data());
+                detail::store_big_endian_u32(offsets + i * view_type::offset_bytes, offset);
+                std::copy(_heap.data() + ref.first, _heap.data() + ref.first + ref.second, heap + offset);
+                offset += static_cast<std::uint32_t>(ref.second);
+            }
+            detail::store_big_endian_u32(offsets + n * view_type::offset_bytes, offset);
+        }
+
+        bool linear_mode() const {
+            return _index.linear_mode();
+        }
+
+        iterator begin() const noexcept {
+            return iterator(this, 0);
+        }
+
+        iterator end() const noexcept {
+            return iterator(this, size());
+        }
+
+        [[nodiscard]] bool empty() const noexcept {
+            return _index.empty();
+        }
+
+        size_type size() const noexcept {
+            return _index.size();
+        }
+
+        // Bytes in the value heap, including dead ones
+        size_type heap_bytes() const noexcept {
+            return _heap.size();
+        }
+
+        // Bytes of erased or replaced values waiting for compact()
+        size_type dead_bytes() const noexcept {
+            return _dead_bytes;
+        }
+
+        void reserve(size_type num_entries, size_type value_bytes) {
+            _index.reserve(num_entries);
+            _heap.reserve(value_bytes);
+        }
+
+        void clear() noexcept {
+            _index.clear();
+            _heap.clear();
+            _dead_bytes = 0;
+        }
+
+        iterator find(const key_stride &key) const {
+            auto &index = const_cast<index_type &>(_index);
+            auto it = index.find(key);
+            return it == index.end() ? end() : iterator(this, it - index.begin());
+        }
+
+        bool contains(const key_stride &key) const {
+            return _index.contains(key);
+        }
+
+        size_type count(const key_stride &key) const {
+            return _index.count(key);
+        }
+
+        value_span at(const key_stride &key) const {
+            auto it = find(key);
+            if (it == end()) {
+                throw std::out_of_range("key is not in var_byte_map");
+            }
+            return it->second;
+        }
+
+        // Inserts if the key isn't already in the map
+        std::pair<iterator, bool> insert(const key_stride &key, nonstd::span<const byte_type> value) {
+            auto it = find(key);
+            if (it != end()) {
+                return {it, false};
+            }
+            byte_type ref[ref_bytes];
+            write_ref(ref, _heap.size(), value.size());
+            _heap.insert(_heap.end(), value.begin(), value.end());
+            auto index_it = _index.insert(std::make_pair(key, typename index_type::value_stride(ref, ref_bytes))).first;
+            return {iterator(this, index_it - _index.begin()), true};
+        }
+
+        // Replaces the value of an existing key, in place if the new value fits in the old one's bytes
+        std::pair<iterator, bool> insert_or_assign(const key_stride &key, nonstd::span<const byte_type> value) {
+            auto index_it = _index.find(key);
+            if (index_it == _index.end()) {
+                return insert(key, value);
+            }
+            const auto ref = read_ref(index_it->second.data());
+            if (value.size() <= ref.second) {
+                std::copy(value.begin(), value.end(), _heap.data() + ref.first);
+                _dead_bytes += ref.second - value.size();
+                write_ref(index_it->second.data(), ref.first, value.size());
+            } else {
+                _dead_bytes += ref.second;
+                write_ref(index_it->second.data(), _heap.size(), value.size());
+                _heap.insert(_heap.end(), value.begin(), value.end());
+            }
+            return {iterator(this, index_it - _index.begin()), false};
+        }
+
+        size_type erase(const key_stride &key) {
+            auto index_it = _index.find(key);
+            if (index_it == _index.end()) {
+                return 0;
+            }
+            _dead_bytes += read_ref(index_it->second.data()).second;
+            _index.erase(index_it);
+            return 1;
+        }
+
+        // Rewrites the value heap without dead bytes, in key order
+        void compact() {
+            std::vector<byte_type> heap;
+            heap.reserve(_heap.size() - _dead_bytes);
+            for (auto it = _index.begin(); it != _index.end(); ++it) {
+                const auto ref = read_ref(it->second.data());
+                write_ref(it->second.data(), heap.size(), ref.second);
+                heap.insert(heap.end(), _heap.data() + ref.first, _heap.data() + ref.first + ref.second);
+            }
+            _heap = std::move(heap);
+            _dead_bytes = 0;
+        }
+
+        value_type entry(size_type pos) const {
+            auto it = const_cast<index_type &>(_index).begin() + pos;
+            const auto ref = read_ref(it->second.data());
+            return value_type(it->first, value_span(const_cast<byte_type *>(_heap.data()) + ref.first, ref.second));
+        }
+
+    private:
+
+        // (offset, length) of a value in the heap, in native byte order since it never leaves memory
+        constexpr const static size_type ref_bytes = 2 * sizeof(std::uint32_t);
+        using index_type = small_byte_map<K_Extent, ref_bytes, byte_type, LinearExtent>;
+
+        static void write_ref(byte_type *ref, size_type offset, size_type length) {
+            if (offset + length > 0xFFFFFFFF) {
+                throw std::length_error("var_byte_map holds up to 4GB of values"); //Fixme: 64 bit offsets
+            }
+            const std::uint32_t words[2] = {static_cast<std::uint32_t>(offset), static_cast<std::uint32_t>(length)};
+            std::memcpy(ref, words, ref_bytes);
+        }
+
+        static std::pair<size_type, size_type> read_ref(const byte_type *ref) noexcept {
+            std::uint32_t words[2];
+            std::memcpy(words, ref, ref_bytes);
+            return {words[0], words[1]};
+        }
+
+        index_type _index;
+        std::vector<byte_type> _heap;
+        size_type _dead_bytes = 0;
+
+    };
+
+} //ns gnt
@@ -163,12 +163,12 @@ namespace gnt {
 
         template<size_t N>
         constexpr const_stride_iterator<N> begin_stride() const noexcept {
-            return stride_iterator<N>(begin());
+            return const_stride_iterator<N>(begin());
         }
 
         template<size_t N>
         constexpr const_stride_iterator<N> cbegin_stride() const noexcept {
-            return stride_iterator<N>(cbegin());
+            return const_stride_iterator<N>(cbegin());
         }
 
         constexpr iterator end() noexcept {
@@ -190,12 +190,12 @@ namespace gnt {
 
         template<size_t N>
         constexpr const_stride_iterator<N> end_stride() const noexcept {
-            return stride_iterator<N>(end());
+            return const_stride_iterator<N>(end());
         }
 
         template<size_t N>
         constexpr const_stride_iterator<N> cend_stride() const noexcept {
-            return stride_iterator<N>(end());
+            return const_stride_iterator<N>(cend());
         }
 
         constexpr reverse_iterator rbegin() noexcept {
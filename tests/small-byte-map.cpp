@@ -0,0 +1,1590 @@
+#include <vector>
+#include <random>
+#include <cstring>
+#include <numeric>
+#include <algorithm>
+#include <array>
+#include <map>
+#include <string>
+#include <thread>
+
+#include "common/small-byte-map.hpp"
+#include "common/eytzinger-byte-map.hpp"
+#include "common/byte-map-hash-index.hpp"
+#include "common/byte-map-set-ops.hpp"
+#include "common/var-byte-map.hpp"
+#include "common/front-coded-byte-map.hpp"
+#include "common/interpolation-search.hpp"
+#include "common/byte-map-bloom-filter.hpp"
+#include "common/static-byte-map.hpp"
+#include "common/radix-byte-map.hpp"
+#include "common/persistent-byte-map.hpp"
+#include "common/sharded-byte-map.hpp"
+#include "common/stride-search.hpp"
+#include "common/stride-compare.hpp"
+#include "common/stride-sort.hpp"
+
+#include "gtest/gtest.h"
+
+namespace {
+
+    // K + V bytes per entry: key i is i packed big-endian into K bytes, value is the same shifted by one.
+    template<size_t K, size_t V>
+    std::vector<std::byte> make_contiguous_entries(std::size_t n) {
+        std::vector<std::byte> bytes(n * (K + V));
+        for (std::size_t i = 0; i < n; ++i) {
+            for (std::size_t b = 0; b < K; ++b) {
+                bytes[i * K + b] = std::byte((i >> (8 * (K - 1 - b))) & 0xFF);
+            }
+            for (std::size_t b = 0; b < V; ++b) {
+                bytes[n * K + i * V + b] = std::byte(((i + 1) >> (8 * (V - 1 - b))) & 0xFF);
+            }
+        }
+        return bytes;
+    }
+
+    // Interpolation search against lower_bound_stride on n sorted keys (with repeats) drawn by draw, for needles that
+    // are keys, near keys, and off either end
+    template<size_t K, typename Policy, typename Draw>
+    void check_search_policy(std::size_t n, Draw &&draw) {
+        std::mt19937_64 rng(n);
+        std::vector<std::uint64_t> values(n);
+        for (auto &v : values) {
+            v = draw(rng);
+        }
+        std::sort(values.begin(), values.end());
+        auto pack = [](std::uint64_t v, unsigned char *key) {
+            std::memset(key, 0x5A, K); // A shared prefix in front of the packed value when K > 8
+            for (std::size_t b = 0; b < std::min<std::size_t>(K, 8); ++b) {
+                key[K - 1 - b] = static_cast<unsigned char>((v >> (8 * b)) & 0xFF);
+            }
+        };
+        std::vector<unsigned char> keys(n * K);
+        for (std::size_t i = 0; i < n; ++i) {
+            pack(values[i], keys.data() + i * K);
+        }
+        unsigned char needle[K];
+        for (std::size_t probe = 0; probe < 500; ++probe) {
+            std::uint64_t v = values[rng() % n] + (rng() % 3) - 1;
+            if (probe % 50 == 0) {
+                v = probe % 100 == 0 ? 0 : ~std::uint64_t(0);
+            }
+            pack(v, needle);
+            ASSERT_EQ(gnt::lower_bound_stride<K>(keys.data(), n, needle), Policy::template lower_bound<K>(keys.data(), n, needle)) << "n " << n << " probe " << probe;
+        }
+    }
+
+    // Scattered packed ids, as a routing table known at build time would have
+    constexpr std::array<gnt::static_byte_map_entry<8, 4>, 300> make_route_entries() {
+        std::array<gnt::static_byte_map_entry<8, 4>, 300> entries{};
+        for (std::size_t i = 0; i < entries.size(); ++i) {
+            entries[i] = {gnt::packed_bytes<8>(i * 7919 % 100003), gnt::packed_bytes<4>(i)};
+        }
+        return entries;
+    }
+
+    template<size_t K>
+    void check_find_stride_matches_scalar() {
+        std::mt19937 rng(42);
+        std::uniform_int_distribution<int> byte_dist(0, 3); // Small alphabet so that partial matches are common
+        for (std::size_t n = 0; n < 70; ++n) {
+            std::vector<unsigned char> data(n * K);
+            for (auto &b : data) {
+                b = byte_dist(rng);
+            }
+            for (std::size_t probe = 0; probe < 20; ++probe) {
+                unsigned char needle[K];
+                for (auto &b : needle) {
+                    b = byte_dist(rng);
+                }
+                if (n > 0 && probe % 2 == 0) {
+                    std::memcpy(needle, data.data() + (probe % n) * K, K);
+                }
+                EXPECT_EQ(gnt::find_stride_scalar<K>(data.data(), n, needle), gnt::find_stride<K>(data.data(), n, needle));
+            }
+        }
+    }
+
+}
+
+TEST(CommonSmallByteMapTests, FindStrideMatchesScalar) {
+    check_find_stride_matches_scalar<4>();
+    check_find_stride_matches_scalar<8>();
+    check_find_stride_matches_scalar<16>();
+    check_find_stride_matches_scalar<32>();
+    check_find_stride_matches_scalar<3>();
+}
+
+TEST(CommonSmallByteMapTests, LinearModeFind) {
+    auto bytes = make_contiguous_entries<8, 8>(100);
+    auto view = gnt::small_byte_map_view<8, 8>::build_from_contiguous_bytes(bytes);
+    EXPECT_TRUE(view.linear_mode());
+    EXPECT_EQ(100, view.size());
+    for (std::size_t i = 0; i < 100; ++i) {
+        auto key = gnt::stride<std::byte, 8>(bytes.data() + i * 8, 8);
+        auto it = view.find(key);
+        ASSERT_NE(it, view.end());
+        EXPECT_EQ(std::byte((i + 1) & 0xFF), it->second[7]);
+        EXPECT_EQ(1, view.count(key));
+    }
+    std::byte missing[8] = {std::byte(0xFF)};
+    EXPECT_EQ(view.end(), view.find(missing));
+    EXPECT_FALSE(view.contains(missing));
+}
+
+TEST(CommonSmallByteMapTests, StrideIteratorIsRandomAccess) {
+    using it_type = gnt::stride_iterator<std::byte, 4>;
+    static_assert(std::is_same_v<std::random_access_iterator_tag, std::iterator_traits<it_type>::iterator_category>);
+    static_assert(std::is_signed_v<std::iterator_traits<it_type>::difference_type>);
+    std::byte bytes[4 * 10];
+    it_type first(bytes), last(bytes + sizeof(bytes));
+    EXPECT_EQ(10, last - first);
+    EXPECT_EQ(-10, first - last);
+    auto it = first;
+    it += 7;
+    EXPECT_EQ(bytes + 28, it[0].data());
+    EXPECT_EQ(bytes + 20, it[-2].data());
+    it -= 3;
+    EXPECT_EQ(first + 4, it);
+    EXPECT_EQ(4 + first, it);
+    EXPECT_TRUE(first < it && it <= last && last > it && it >= first);
+    EXPECT_EQ(first, it++ - 4);
+    EXPECT_EQ(first + 5, it);
+}
+
+TEST(CommonSmallByteMapTests, SortedModeFind) {
+    const std::size_t n = 1000;
+    auto bytes = make_contiguous_entries<8, 4>(n);
+    auto view = gnt::small_byte_map_view<8, 4>::build_from_contiguous_bytes(bytes, true);
+    EXPECT_FALSE(view.linear_mode());
+    for (std::size_t i = 0; i < n; ++i) {
+        auto key = gnt::stride<std::byte, 8>(bytes.data() + i * 8, 8);
+        auto it = view.find(key);
+        ASSERT_NE(it, view.end());
+        EXPECT_EQ(key.data(), it->first.data());
+        EXPECT_EQ(1, view.count(key));
+    }
+    std::byte missing[8] = {std::byte(0xFF)};
+    EXPECT_FALSE(view.contains(missing));
+}
+
+TEST(CommonSmallByteMapTests, StrideComparatorsMatchMemcmp) {
+    std::mt19937 rng(3);
+    std::uniform_int_distribution<int> byte_dist(0, 2);
+    auto check = [&](auto extent) {
+        constexpr size_t K = decltype(extent)::value;
+        unsigned char a[K], b[K];
+        for (int round = 0; round < 500; ++round) {
+            for (size_t i = 0; i < K; ++i) {
+                a[i] = byte_dist(rng) * 127;
+                b[i] = byte_dist(rng) * 127;
+            }
+            const int expected = std::memcmp(a, b, K);
+            EXPECT_EQ(expected < 0, gnt::less_strides<K>(a, b));
+            EXPECT_EQ(expected == 0, gnt::equal_strides<K>(a, b));
+            const int actual = gnt::compare_strides<K>(a, b);
+            EXPECT_EQ((expected > 0) - (expected < 0), (actual > 0) - (actual < 0));
+        }
+    };
+    check(std::integral_constant<size_t, 2>());
+    check(std::integral_constant<size_t, 4>());
+    check(std::integral_constant<size_t, 8>());
+    check(std::integral_constant<size_t, 16>());
+    check(std::integral_constant<size_t, 5>());
+}
+
+TEST(CommonSmallByteMapTests, CharKeysSortAsUnsignedBytes) {
+    // Keys compare in memcmp order whatever the byte type, so with (signed) char a high bit byte sorts after 0x7F
+    using char_map = gnt::small_byte_map<2, 1, char, 4>;
+    const unsigned char firsts[] = {0x00, 0x01, 0x7F, 0x80, 0x81, 0xFE, 0xFF};
+    std::vector<std::array<char, 2>> keys;
+    for (unsigned char first : firsts) {
+        for (unsigned char second : {0x00, 0x7F, 0x80, 0xFF}) {
+            keys.push_back({static_cast<char>(first), static_cast<char>(second)});
+        }
+    }
+    auto shuffled = keys;
+    std::shuffle(shuffled.begin(), shuffled.end(), std::mt19937(23));
+    char_map smap;
+    for (auto &key : shuffled) {
+        char value = key[0];
+        EXPECT_TRUE(smap.insert(std::make_pair(char_map::key_stride(key.data(), 2), char_map::value_stride(&value, 1))).second);
+    }
+    EXPECT_FALSE(smap.linear_mode());
+    std::size_t i = 0;
+    for (auto it = smap.begin(); it != smap.end(); ++it, ++i) {
+        ASSERT_LT(i, keys.size());
+        EXPECT_EQ(0, std::memcmp(keys[i].data(), it->first.data(), 2));
+    }
+    EXPECT_EQ(keys.size(), i);
+    for (auto &key : keys) {
+        EXPECT_TRUE(smap.contains(char_map::key_stride(key.data(), 2)));
+    }
+
+    // The fixed length memcmp path agrees
+    std::vector<char> odd_keys, odd_values;
+    for (auto it = shuffled.rbegin(); it != shuffled.rend(); ++it) {
+        odd_keys.insert(odd_keys.end(), {(*it)[0], (*it)[1], 0});
+        odd_values.push_back((*it)[0]);
+    }
+    gnt::sort_strides<3, 1>(odd_keys.data(), odd_values.data(), keys.size());
+    for (std::size_t k = 0; k < keys.size(); ++k) {
+        EXPECT_EQ(0, std::memcmp(keys[k].data(), odd_keys.data() + k * 3, 2));
+        EXPECT_EQ(keys[k][0], odd_values[k]);
+    }
+    EXPECT_TRUE(gnt::less_strides<3>("\x7F\x00", "\x80\x00"));
+}
+
+TEST(CommonSmallByteMapTests, SortStridesKeepsValuesWithKeys) {
+    const std::size_t n = 300;
+    auto sorted = make_contiguous_entries<8, 4>(n);
+    auto shuffled = sorted;
+    std::vector<std::size_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), std::mt19937(5));
+    for (std::size_t i = 0; i < n; ++i) {
+        std::copy_n(sorted.begin() + order[i] * 8, 8, shuffled.begin() + i * 8);
+        std::copy_n(sorted.begin() + n * 8 + order[i] * 4, 4, shuffled.begin() + n * 8 + i * 4);
+    }
+    gnt::sort_strides<8, 4>(shuffled.data(), shuffled.data() + n * 8, n);
+    EXPECT_EQ(sorted, shuffled);
+}
+
+TEST(CommonSmallByteMapTests, RadixSortMatchesComparisonSort) {
+    std::mt19937 rng(11);
+    for (std::size_t n : {0, 1, 2, 255, 256, 1000, 5000}) {
+        std::vector<std::byte> keys(n * 8), values(n * 3);
+        for (std::size_t i = 0; i < n; ++i) {
+            // Shared high bytes (skipped passes) and duplicate keys (stability) both occur.
+            keys[i * 8 + 6] = std::byte(rng() % 7);
+            keys[i * 8 + 7] = std::byte(rng() % 200);
+            keys[i * 8 + 3] = std::byte(rng() % 3);
+            values[i * 3] = std::byte(i & 0xFF);
+            values[i * 3 + 1] = std::byte((i >> 8) & 0xFF);
+        }
+        auto radix_keys = keys, radix_values = values;
+        gnt::comparison_sort_strides<8, 3>(keys.data(), values.data(), n);
+        gnt::radix_sort_strides<8, 3>(radix_keys.data(), radix_values.data(), n);
+        EXPECT_EQ(keys, radix_keys);
+        EXPECT_EQ(values, radix_values);
+    }
+}
+
+namespace {
+
+    using test_map = gnt::small_byte_map<8, 4, std::byte, 16>;
+
+    std::array<std::byte, 8> make_key(std::uint64_t i) {
+        std::array<std::byte, 8> key;
+        for (std::size_t b = 0; b < 8; ++b) {
+            key[b] = std::byte((i >> (8 * (7 - b))) & 0xFF);
+        }
+        return key;
+    }
+
+    std::uint64_t load_key(const std::byte *key) {
+        std::uint64_t k = 0;
+        for (std::size_t b = 0; b < 8; ++b) {
+            k = (k << 8) | std::uint64_t(key[b]);
+        }
+        return k;
+    }
+
+    std::uint32_t value_of(nonstd::span<const std::byte, 4> v) {
+        return (std::uint32_t(v[0]) << 24) | (std::uint32_t(v[1]) << 16) | (std::uint32_t(v[2]) << 8) | std::uint32_t(v[3]);
+    }
+
+    // A batch of count entries with keys drawn from [0, range) and values numbering them from value_base.
+    void make_batch(std::size_t count, std::uint64_t range, std::uint32_t value_base, std::mt19937 &rng,
+                    std::vector<std::byte> &keys, std::vector<std::byte> &values) {
+        keys.clear();
+        values.clear();
+        for (std::size_t i = 0; i < count; ++i) {
+            auto key = make_key(rng() % range);
+            keys.insert(keys.end(), key.begin(), key.end());
+            const std::uint32_t v = value_base + i;
+            for (int b = 3; b >= 0; --b) {
+                values.push_back(std::byte((v >> (8 * b)) & 0xFF));
+            }
+        }
+    }
+
+}
+
+TEST(CommonSmallByteMapTests, InsertSwitchesToSortedMode) {
+    test_map smap;
+    for (std::uint64_t i = 40; i > 0; --i) {
+        auto key = make_key(i * 3);
+        std::byte value[4] = {std::byte(0), std::byte(0), std::byte(0), std::byte(i)};
+        auto res = smap.insert(std::make_pair(test_map::key_stride(key.data(), 8), test_map::value_stride(value, 4)));
+        EXPECT_TRUE(res.second);
+        EXPECT_EQ(i, value_of(res.first->second));
+    }
+    EXPECT_EQ(40, smap.size());
+    EXPECT_FALSE(smap.linear_mode());
+    for (std::uint64_t i = 1; i <= 40; ++i) {
+        auto key = make_key(i * 3);
+        EXPECT_EQ(i, value_of(smap.at(test_map::key_stride(key.data(), 8))));
+        EXPECT_FALSE(smap.contains(test_map::key_stride(make_key(i * 3 + 1).data(), 8)));
+    }
+    auto key = make_key(30);
+    std::byte value[4] = {};
+    EXPECT_FALSE(smap.insert(std::make_pair(test_map::key_stride(key.data(), 8), test_map::value_stride(value, 4))).second);
+    smap.erase(smap.find(test_map::key_stride(key.data(), 8)));
+    EXPECT_EQ(39, smap.size());
+    EXPECT_FALSE(smap.contains(test_map::key_stride(key.data(), 8)));
+}
+
+TEST(CommonSmallByteMapTests, InsertBulkPolicies) {
+    for (auto policy : {gnt::duplicate_policy::keep_existing, gnt::duplicate_policy::overwrite, gnt::duplicate_policy::keep_all}) {
+        std::mt19937 rng(17);
+        test_map smap;
+        std::multimap<std::uint64_t, std::uint32_t> reference;
+        std::vector<std::byte> keys, values;
+        std::uint32_t value_base = 0;
+        for (std::size_t count : {5, 7, 300, 1, 2000}) {
+            make_batch(count, 1500, value_base, rng, keys, values);
+            for (std::size_t i = 0; i < count; ++i) {
+                std::uint64_t k = 0;
+                for (std::size_t b = 0; b < 8; ++b) {
+                    k = (k << 8) | std::uint64_t(keys[i * 8 + b]);
+                }
+                const auto v = value_base + std::uint32_t(i);
+                if (policy == gnt::duplicate_policy::keep_all || reference.count(k) == 0) {
+                    reference.emplace(k, v);
+                } else if (policy == gnt::duplicate_policy::overwrite) {
+                    reference.find(k)->second = v;
+                }
+            }
+            smap.insert_bulk(keys.data(), values.data(), count, policy);
+            value_base += count;
+            ASSERT_EQ(reference.size(), smap.size());
+        }
+        EXPECT_FALSE(smap.linear_mode());
+        auto it = smap.begin();
+        for (const auto &kv : reference) {
+            EXPECT_EQ(make_key(kv.first), (std::array<std::byte, 8>{it->first[0], it->first[1], it->first[2], it->first[3],
+                                                                     it->first[4], it->first[5], it->first[6], it->first[7]}));
+            EXPECT_EQ(kv.second, value_of(it->second));
+            ++it;
+        }
+    }
+}
+
+TEST(CommonSmallByteMapTests, AssignSortedRoundTrip) {
+    std::mt19937 rng(23);
+    test_map smap;
+    std::vector<std::byte> keys, values;
+    make_batch(500, 100000, 0, rng, keys, values);
+    smap.insert_bulk(keys.data(), values.data(), 500);
+    auto bytes = smap.to_vector();
+    test_map copy;
+    copy.assign_sorted(bytes.data(), bytes.size());
+    EXPECT_EQ(smap.size(), copy.size());
+    EXPECT_FALSE(copy.linear_mode());
+    EXPECT_EQ(bytes, copy.to_vector());
+    for (std::size_t i = 0; i < 500; ++i) {
+        EXPECT_TRUE(copy.contains(test_map::key_stride(keys.data() + i * 8, 8)));
+    }
+}
+
+TEST(CommonSmallByteMapTests, WriteBufferedModeMatchesReference) {
+    std::mt19937 rng(29);
+    test_map smap;
+    std::map<std::uint64_t, std::uint32_t> reference;
+    std::vector<std::byte> keys, values;
+    make_batch(400, 2000, 0, rng, keys, values);
+    smap.insert_bulk(keys.data(), values.data(), 400);
+    for (std::size_t i = 0; i < 400; ++i) {
+        std::uint64_t k = 0;
+        for (std::size_t b = 0; b < 8; ++b) {
+            k = (k << 8) | std::uint64_t(keys[i * 8 + b]);
+        }
+        reference.emplace(k, std::uint32_t(i));
+    }
+    smap.set_write_buffer(32);
+    for (std::uint32_t op = 0; op < 5000; ++op) {
+        const std::uint64_t k = rng() % 2000;
+        auto key = make_key(k);
+        const test_map::key_stride key_stride(key.data(), 8);
+        std::byte value[4] = {std::byte(op >> 24), std::byte(op >> 16), std::byte(op >> 8), std::byte(op)};
+        switch (rng() % 4) {
+            case 0:
+                EXPECT_EQ(reference.emplace(k, op).second,
+                          smap.insert(std::make_pair(key_stride, test_map::value_stride(value, 4))).second);
+                break;
+            case 1:
+                reference[k] = op;
+                smap.insert_or_assign(key_stride, test_map::value_stride(value, 4));
+                break;
+            case 2:
+                EXPECT_EQ(reference.erase(k), smap.erase(key_stride));
+                break;
+            default:
+                auto it = reference.find(k);
+                ASSERT_EQ(it != reference.end(), smap.contains(key_stride));
+                if (it != reference.end()) {
+                    EXPECT_EQ(it->second, value_of(smap.at(key_stride)));
+                }
+        }
+        ASSERT_EQ(reference.size(), smap.size());
+        ASSERT_LT(smap.buffered(), 32);
+    }
+    auto bytes = smap.to_vector();
+    smap.compact();
+    EXPECT_EQ(0, smap.buffered());
+    EXPECT_EQ(bytes, smap.to_vector());
+    auto it = smap.begin();
+    for (const auto &kv : reference) {
+        EXPECT_EQ(kv.second, value_of(it->second));
+        ++it;
+    }
+    EXPECT_EQ(smap.end(), it);
+}
+
+TEST(CommonSmallByteMapTests, WriteBufferedEraseByIteratorAcrossCompactions) {
+    test_map smap;
+    std::byte value[4] = {};
+    for (std::uint64_t k = 0; k < 600; k += 2) {
+        auto key = make_key(k);
+        smap.insert(std::make_pair(test_map::key_stride(key.data(), 8), test_map::value_stride(value, 4)));
+    }
+    ASSERT_FALSE(smap.linear_mode());
+    smap.set_write_buffer(4);
+
+    // Every fourth erase fills the write buffer and compacts, dropping the erased entries from the sorted run
+    std::size_t compactions = 0;
+    for (auto it = smap.begin(); it != smap.end();) {
+        const std::uint64_t k = load_key(it->first.data());
+        if (k % 4 != 0) {
+            ++it;
+            continue;
+        }
+        const std::size_t before = smap.buffered();
+        it = smap.erase(test_map::const_iterator(it));
+        compactions += smap.buffered() < before;
+        if (k + 2 < 600) {
+            ASSERT_NE(smap.end(), it);
+            EXPECT_EQ(k + 2, load_key(it->first.data()));
+        } else {
+            EXPECT_EQ(smap.end(), it);
+        }
+    }
+    EXPECT_GT(compactions, 0);
+    EXPECT_EQ(150, smap.size());
+    for (std::uint64_t k = 0; k < 600; k += 2) {
+        auto key = make_key(k);
+        EXPECT_EQ(k % 4 != 0, smap.contains(test_map::key_stride(key.data(), 8)));
+    }
+
+    // An entry only in the write buffer isn't part of the iteration, so erasing it gives end()
+    auto key = make_key(601);
+    const test_map::key_stride buffered_key(key.data(), 8);
+    smap.insert(std::make_pair(buffered_key, test_map::value_stride(value, 4)));
+    auto it = smap.find(buffered_key);
+    ASSERT_NE(smap.end(), it);
+    EXPECT_EQ(smap.end(), smap.erase(test_map::const_iterator(it)));
+    EXPECT_FALSE(smap.contains(buffered_key));
+    EXPECT_EQ(150, smap.size());
+}
+
+TEST(CommonSmallByteMapTests, EytzingerMatchesSortedMap) {
+    std::mt19937 rng(31);
+    for (std::size_t n : {0, 1, 2, 3, 7, 8, 15, 16, 100, 1000}) {
+        test_map smap;
+        std::vector<std::byte> keys, values;
+        const std::uint64_t range = 2 * n + 1;
+        make_batch(n, range, 0, rng, keys, values);
+        smap.insert_bulk(keys.data(), values.data(), n, gnt::duplicate_policy::keep_all);
+        gnt::eytzinger_byte_map<8, 4> emap(smap);
+        ASSERT_EQ(smap.size(), emap.size());
+
+        // Iteration gives back key order, whichever mode smap was in
+        std::vector<std::pair<std::uint64_t, std::uint32_t>> sorted;
+        for (auto &kv : smap) {
+            std::uint64_t k = 0;
+            for (std::size_t b = 0; b < 8; ++b) {
+                k = (k << 8) | std::uint64_t(kv.first[b]);
+            }
+            sorted.emplace_back(k, value_of(kv.second));
+        }
+        std::stable_sort(sorted.begin(), sorted.end(), [](const auto &l, const auto &r) { return l.first < r.first; });
+        auto it = emap.begin();
+        for (const auto &kv : sorted) {
+            ASSERT_NE(emap.end(), it);
+            EXPECT_EQ(make_key(kv.first), (std::array<std::byte, 8>{it->first[0], it->first[1], it->first[2], it->first[3],
+                                                                   it->first[4], it->first[5], it->first[6], it->first[7]}));
+            EXPECT_EQ(kv.second, value_of(it->second));
+            ++it;
+        }
+        EXPECT_EQ(emap.end(), it);
+
+        // Serialised bytes read back as a view, and the sorted form as a small_byte_map_view
+        auto bytes = emap.to_vector();
+        auto view = gnt::eytzinger_byte_map_view<8, 4>::build_from_contiguous_bytes(bytes);
+        auto sorted_bytes = view.to_sorted_vector();
+        auto sorted_view = gnt::small_byte_map_view<8, 4>::build_from_contiguous_bytes(sorted_bytes, true);
+        for (std::uint64_t k = 0; k <= range; ++k) {
+            auto key = make_key(k);
+            const test_map::key_stride key_stride(key.data(), 8);
+            ASSERT_EQ(smap.count(key_stride), view.count(key_stride));
+            ASSERT_EQ(smap.contains(key_stride), view.contains(key_stride));
+            EXPECT_EQ(smap.count(key_stride), sorted_view.count(key_stride));
+            if (smap.contains(key_stride)) {
+                EXPECT_EQ(value_of(smap.at(key_stride)), value_of(view.at(key_stride)));
+                EXPECT_EQ(value_of(smap.at(key_stride)), value_of(view.find(key_stride)->second));
+            } else {
+                EXPECT_EQ(view.end(), view.find(key_stride));
+                EXPECT_THROW(view.at(key_stride), std::out_of_range);
+            }
+        }
+    }
+}
+
+TEST(CommonSmallByteMapTests, FindManyMatchesFind) {
+    std::mt19937 rng(37);
+    for (std::size_t n : {0, 10, 1000}) {
+        test_map smap;
+        std::vector<std::byte> keys, values;
+        make_batch(n, 2 * n + 1, 0, rng, keys, values);
+        smap.insert_bulk(keys.data(), values.data(), n);
+        for (bool sorted_needles : {false, true}) {
+            std::vector<std::array<std::byte, 8>> needle_keys;
+            for (std::size_t i = 0; i < 300; ++i) {
+                needle_keys.push_back(make_key(rng() % (2 * n + 2)));
+            }
+            if (sorted_needles) {
+                std::sort(needle_keys.begin(), needle_keys.end());
+            }
+            std::vector<test_map::key_stride> needles;
+            for (auto &key : needle_keys) {
+                needles.emplace_back(key.data(), 8);
+            }
+            std::vector<std::size_t> positions(needles.size());
+            std::vector<test_map::iterator> found(needles.size());
+            const auto hits = smap.find_many(needles, positions);
+            EXPECT_EQ(hits, smap.find_many(needles, found));
+            std::size_t expected_hits = 0;
+            for (std::size_t i = 0; i < needles.size(); ++i) {
+                auto it = smap.find(needles[i]);
+                EXPECT_EQ(it, found[i]);
+                EXPECT_EQ(it == smap.end() ? smap.size() : std::size_t(it - smap.begin()), positions[i]);
+                expected_hits += it != smap.end();
+            }
+            EXPECT_EQ(expected_hits, hits);
+
+            // Buffered writes are visible to find_many too
+            if (n == 1000) {
+                smap.set_write_buffer(64);
+                std::byte value[4] = {};
+                smap.insert(std::make_pair(needles[0], test_map::value_stride(value, 4)));
+                const test_map &const_map = smap;
+                std::vector<test_map::const_iterator> const_found(needles.size());
+                const_map.find_many(needles, const_found);
+                EXPECT_NE(const_map.end(), const_found[0]);
+                for (std::size_t i = 0; i < needles.size(); ++i) {
+                    EXPECT_EQ(const_map.find(needles[i]), const_found[i]);
+                }
+                // Positions index the sorted run, which a const map can't bring up to date
+                auto fresh = make_key(2 * n + 5 + sorted_needles);
+                smap.insert(std::make_pair(test_map::key_stride(fresh.data(), 8), test_map::value_stride(value, 4)));
+                ASSERT_GT(const_map.buffered(), 0);
+                EXPECT_THROW(const_map.find_many(needles, positions), std::logic_error);
+                smap.set_write_buffer(0);
+                EXPECT_EQ(0, const_map.buffered());
+                const_map.find_many(needles, positions);
+                for (std::size_t i = 0; i < needles.size(); ++i) {
+                    auto it = const_map.find(needles[i]);
+                    EXPECT_EQ(it == const_map.end() ? const_map.size() : std::size_t(it - const_map.begin()), positions[i]);
+                }
+            }
+        }
+    }
+    std::vector<std::size_t> too_few(1);
+    auto key = make_key(0);
+    std::vector<test_map::key_stride> two_needles(2, test_map::key_stride(key.data(), 8));
+    EXPECT_THROW(test_map().find_many(two_needles, too_few), std::length_error);
+}
+
+TEST(CommonSmallByteMapTests, HashIndexMatchesFind) {
+    std::mt19937 rng(41);
+    for (std::size_t n : {0, 10, 1000, 20000}) {
+        for (bool sorted : {false, true}) {
+            test_map smap;
+            std::vector<std::byte> keys, values;
+            make_batch(n, 2 * n + 1, 0, rng, keys, values);
+            smap.insert_bulk(keys.data(), values.data(), n, gnt::duplicate_policy::keep_all);
+            if (!sorted) {
+                smap.force_linear_mode(true);
+            }
+            auto bytes = smap.to_vector();
+            auto view = gnt::hash_indexed_byte_map_view<8, 4, std::byte, 16>::build_from_contiguous_bytes(bytes, sorted);
+            auto plain = gnt::small_byte_map_view<8, 4, std::byte, 16>::build_from_contiguous_bytes(bytes, sorted);
+            for (std::uint64_t k = 0; k <= 2 * n + 1; ++k) {
+                auto key = make_key(k);
+                const test_map::key_stride key_stride(key.data(), 8);
+                auto it = view.find(key_stride);
+                auto expected = plain.find(key_stride);
+                ASSERT_EQ(expected == plain.end(), it == view.end());
+                if (it != view.end()) {
+                    EXPECT_EQ(expected - plain.begin(), it - view.begin()); // The first of any equal keys
+                    EXPECT_EQ(value_of(plain.at(key_stride)), value_of(view.at(key_stride)));
+                }
+                EXPECT_EQ(plain.contains(key_stride), view.contains(key_stride));
+                EXPECT_EQ(plain.count(key_stride), view.count(key_stride));
+            }
+            EXPECT_EQ(n > 16, view.indexed());
+        }
+    }
+}
+
+TEST(CommonSmallByteMapTests, RangeQueriesAndCursors) {
+    std::mt19937 rng(43);
+    test_map smap;
+    std::vector<std::byte> keys, values;
+    make_batch(2000, 3000, 0, rng, keys, values);
+    smap.insert_bulk(keys.data(), values.data(), 2000, gnt::duplicate_policy::keep_all);
+    std::multimap<std::uint64_t, std::uint32_t> reference;
+    for (auto &kv : smap) {
+        std::uint64_t k = 0;
+        for (std::size_t b = 0; b < 8; ++b) {
+            k = (k << 8) | std::uint64_t(kv.first[b]);
+        }
+        reference.emplace(k, value_of(kv.second));
+    }
+    auto position = [&](std::multimap<std::uint64_t, std::uint32_t>::iterator it) {
+        return std::size_t(std::distance(reference.begin(), it));
+    };
+    for (std::uint64_t k = 0; k < 3001; k += 7) {
+        auto key = make_key(k);
+        const test_map::key_stride key_stride(key.data(), 8);
+        EXPECT_EQ(position(reference.lower_bound(k)), std::size_t(smap.lower_bound(key_stride) - smap.begin()));
+        EXPECT_EQ(position(reference.upper_bound(k)), std::size_t(smap.upper_bound(key_stride) - smap.begin()));
+        auto range = smap.equal_range(key_stride);
+        EXPECT_EQ(reference.count(k), std::size_t(range.second - range.first));
+
+        auto to = make_key(k + 100);
+        auto sub = smap.range(key_stride, test_map::key_stride(to.data(), 8));
+        EXPECT_EQ(position(reference.lower_bound(k + 100)) - position(reference.lower_bound(k)), sub.size());
+        if (!sub.empty()) {
+            EXPECT_EQ(smap.lower_bound(key_stride)->first.data(), sub.begin()->first.data()); // A view, not a copy
+        }
+    }
+
+    // Keys 0x0100..0x01FF all share the first seven bytes
+    auto prefix_key = make_key(0x100);
+    auto prefixed = smap.prefix_range(nonstd::span<const std::byte>(prefix_key.data(), 7));
+    EXPECT_EQ(position(reference.lower_bound(0x200)) - position(reference.lower_bound(0x100)), prefixed.size());
+    EXPECT_EQ(smap.size(), smap.prefix_range(nonstd::span<const std::byte>()).size());
+
+    // Paging through a prefix with a cursor visits the same entries
+    auto cursor = smap.prefix_cursor(nonstd::span<const std::byte>(prefix_key.data(), 7));
+    std::size_t seen = 0;
+    while (!cursor.done()) {
+        auto page = cursor.next(10);
+        EXPECT_LE(page.size(), 10);
+        for (auto &kv : page) {
+            EXPECT_EQ(prefixed.begin()->first.data() + seen * 8, kv.first.data());
+            ++seen;
+        }
+    }
+    EXPECT_EQ(prefixed.size(), seen);
+
+    auto seek_cursor = smap.cursor();
+    auto seek_key = make_key(1500);
+    seek_cursor.seek(test_map::key_stride(seek_key.data(), 8));
+    EXPECT_EQ(reference.size() - position(reference.lower_bound(1500)), seek_cursor.remaining());
+
+    // Small linear mode maps answer ordered queries only if their keys happen to be sorted
+    auto sorted_bytes = make_contiguous_entries<8, 4>(10);
+    auto small_view = gnt::small_byte_map_view<8, 4>::build_from_contiguous_bytes(sorted_bytes);
+    EXPECT_TRUE(small_view.linear_mode());
+    EXPECT_EQ(3, small_view.lower_bound(test_map::key_stride(sorted_bytes.data() + 3 * 8, 8)) - small_view.begin());
+    std::swap_ranges(sorted_bytes.begin(), sorted_bytes.begin() + 8, sorted_bytes.begin() + 8);
+    EXPECT_THROW(small_view.lower_bound(test_map::key_stride(sorted_bytes.data(), 8)), std::logic_error);
+}
+
+namespace {
+
+    std::vector<std::pair<std::uint64_t, std::uint32_t>> entries_of(const test_map &smap) {
+        std::vector<std::pair<std::uint64_t, std::uint32_t>> entries;
+        for (auto it = smap.begin(); it != smap.end(); ++it) {
+            std::uint64_t k = 0;
+            for (std::size_t b = 0; b < 8; ++b) {
+                k = (k << 8) | std::uint64_t(it->first[b]);
+            }
+            entries.emplace_back(k, value_of(it->second));
+        }
+        return entries;
+    }
+
+}
+
+TEST(CommonSmallByteMapTests, SetOperationsMatchStd) {
+    std::mt19937 rng(47);
+    const auto by_key = [](const auto &l, const auto &r) { return l.first < r.first; };
+    // Similar sizes, skewed sizes, disjoint ranges and an empty side
+    const std::tuple<std::size_t, std::uint64_t, std::size_t, std::uint64_t> cases[] = {
+        {500, 800, 500, 800}, {5000, 20000, 20, 20000}, {30, 100, 3000, 100000}, {200, 300, 0, 1}};
+    for (auto [na, range_a, nb, range_b] : cases) {
+        test_map a, b;
+        std::vector<std::byte> keys, values;
+        make_batch(na, range_a, 0, rng, keys, values);
+        a.insert_bulk(keys.data(), values.data(), na, gnt::duplicate_policy::keep_all);
+        make_batch(nb, range_b, 100000, rng, keys, values);
+        b.insert_bulk(keys.data(), values.data(), nb, gnt::duplicate_policy::keep_all);
+        const auto ea = entries_of(a), eb = entries_of(b);
+
+        test_map out;
+        out.reserve(na + nb);
+        std::vector<std::pair<std::uint64_t, std::uint32_t>> expected;
+        gnt::set_union(a, b, out);
+        std::set_union(ea.begin(), ea.end(), eb.begin(), eb.end(), std::back_inserter(expected), by_key);
+        EXPECT_EQ(expected, entries_of(out));
+        EXPECT_TRUE(out.is_sorted());
+
+        expected.clear();
+        gnt::set_intersection(a, b, out);
+        std::set_intersection(ea.begin(), ea.end(), eb.begin(), eb.end(), std::back_inserter(expected), by_key);
+        EXPECT_EQ(expected, entries_of(out));
+
+        expected.clear();
+        gnt::set_difference(a, b, out);
+        std::set_difference(ea.begin(), ea.end(), eb.begin(), eb.end(), std::back_inserter(expected), by_key);
+        EXPECT_EQ(expected, entries_of(out));
+
+        expected.clear();
+        gnt::set_symmetric_difference(a, b, out);
+        std::set_symmetric_difference(ea.begin(), ea.end(), eb.begin(), eb.end(), std::back_inserter(expected), by_key);
+        EXPECT_EQ(expected, entries_of(out));
+
+        std::size_t expected_pairs = 0;
+        for (const auto &e : ea) {
+            auto range = std::equal_range(eb.begin(), eb.end(), e, by_key);
+            expected_pairs += range.second - range.first;
+        }
+        std::uint64_t previous = 0;
+        const auto calls = gnt::merge_join(a, b, [&](const auto &key, const auto &a_value, const auto &b_value) {
+            std::uint64_t k = 0;
+            for (std::size_t b = 0; b < 8; ++b) {
+                k = (k << 8) | std::uint64_t(key[b]);
+            }
+            EXPECT_LE(previous, k);
+            previous = k;
+            EXPECT_LT(value_of(a_value), 100000);
+            EXPECT_GE(value_of(b_value), 100000);
+        });
+        EXPECT_EQ(expected_pairs, calls);
+    }
+}
+
+TEST(CommonSmallByteMapTests, VarByteMapRoundTrip) {
+    using var_map = gnt::var_byte_map<8, std::byte, 16>;
+    std::mt19937 rng(53);
+    var_map vmap;
+    std::map<std::uint64_t, std::vector<std::byte>> reference;
+    for (std::size_t op = 0; op < 3000; ++op) {
+        const std::uint64_t k = rng() % 500;
+        auto key = make_key(k);
+        const var_map::key_stride key_stride(key.data(), 8);
+        std::vector<std::byte> value(rng() % 3 == 0 ? rng() % 2048 : rng() % 16);
+        for (auto &b : value) {
+            b = std::byte(rng() & 0xFF);
+        }
+        switch (rng() % 4) {
+            case 0:
+                EXPECT_EQ(reference.emplace(k, value).second, vmap.insert(key_stride, value).second);
+                break;
+            case 1:
+                reference[k] = value;
+                vmap.insert_or_assign(key_stride, value);
+                break;
+            case 2:
+                EXPECT_EQ(reference.erase(k), vmap.erase(key_stride));
+                break;
+            default:
+                auto it = reference.find(k);
+                ASSERT_EQ(it != reference.end(), vmap.contains(key_stride));
+                if (it != reference.end()) {
+                    auto found = vmap.at(key_stride);
+                    EXPECT_EQ(it->second, std::vector<std::byte>(found.begin(), found.end()));
+                }
+        }
+        ASSERT_EQ(reference.size(), vmap.size());
+    }
+
+    auto bytes = vmap.to_vector();
+    std::size_t live = 0;
+    for (const auto &kv : reference) {
+        live += kv.second.size();
+    }
+    EXPECT_EQ(var_map::view_type::serialized_size(reference.size(), live), bytes.size()); // No padding, no dead bytes
+    auto view = var_map::view_type::build_from_contiguous_bytes(bytes, !vmap.linear_mode());
+    ASSERT_EQ(reference.size(), view.size());
+    EXPECT_EQ(live, view.heap_bytes());
+    for (const auto &kv : reference) {
+        auto key = make_key(kv.first);
+        auto found = view.at(var_map::key_stride(key.data(), 8));
+        EXPECT_EQ(kv.second, std::vector<std::byte>(found.begin(), found.end()));
+    }
+    auto missing = make_key(1000);
+    EXPECT_EQ(view.end(), view.find(var_map::key_stride(missing.data(), 8)));
+
+    // Back to an owning map, and compaction leaves the contents alone
+    var_map copy(view);
+    EXPECT_EQ(bytes, copy.to_vector());
+    vmap.compact();
+    EXPECT_EQ(0, vmap.dead_bytes());
+    EXPECT_EQ(live, vmap.heap_bytes());
+    EXPECT_EQ(bytes, vmap.to_vector());
+
+    bytes.pop_back();
+    EXPECT_THROW(var_map::view_type::build_from_contiguous_bytes(bytes), std::range_error);
+}
+
+TEST(CommonSmallByteMapTests, FrontCodedMatchesSortedMap) {
+    // uuid + timestamp keys: 40 ids with runs of increasing timestamps, and a few repeated keys
+    constexpr std::size_t K = 24;
+    using sorted_map = gnt::small_byte_map<K, 8, std::byte, 16>;
+    std::mt19937_64 rng(61);
+    std::vector<std::array<std::byte, K>> keys;
+    for (std::size_t id = 0; id < 40; ++id) {
+        std::array<std::byte, K> key;
+        for (std::size_t b = 0; b < 16; ++b) {
+            key[b] = std::byte(rng() & 0xFF);
+        }
+        std::uint64_t timestamp = 1600000000000 + rng() % 1000000;
+        for (std::size_t i = 0, n = 1 + rng() % 120; i < n; ++i) {
+            timestamp += i % 17 == 0 ? 0 : 1 + rng() % 5000;
+            for (std::size_t b = 0; b < 8; ++b) {
+                key[16 + b] = std::byte((timestamp >> (8 * (7 - b))) & 0xFF);
+            }
+            keys.push_back(key);
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+    std::vector<std::byte> key_bytes, value_bytes;
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        key_bytes.insert(key_bytes.end(), keys[i].begin(), keys[i].end());
+        auto value = make_key(i);
+        value_bytes.insert(value_bytes.end(), value.begin(), value.end());
+    }
+    sorted_map map;
+    map.assign_sorted(key_bytes.data(), value_bytes.data(), keys.size());
+
+    for (std::size_t interval : {1, 3, 16}) {
+        gnt::front_coded_byte_map<K, 8> coded(map, interval);
+        ASSERT_EQ(map.size(), coded.size());
+        auto expected = map.begin();
+        for (auto it = coded.begin(); it != coded.end(); ++it, ++expected) {
+            ASSERT_TRUE(std::equal(it->first.begin(), it->first.end(), expected->first.begin()));
+            ASSERT_TRUE(std::equal(it->second.begin(), it->second.end(), expected->second.begin()));
+        }
+        if (interval == 16) {
+            EXPECT_LE(coded.key_bytes() * 3, map.size() * K); // At least 3x smaller keys
+        }
+
+        auto bytes = coded.to_vector();
+        EXPECT_EQ(coded.size_bytes(), bytes.size());
+        auto view = gnt::front_coded_byte_map_view<K, 8>::build_from_contiguous_bytes(bytes);
+        for (std::size_t probe = 0; probe < 2000; ++probe) {
+            std::array<std::byte, K> needle = keys[rng() % keys.size()];
+            if (probe % 2 == 0) {
+                needle[K - 1 - probe % 3] = std::byte(rng() & 0xFF);
+            }
+            const sorted_map::key_stride key(needle.data(), K);
+            auto found = view.find(key);
+            auto lower = view.lower_bound(key);
+            const std::size_t lower_pos = std::lower_bound(keys.begin(), keys.end(), needle) - keys.begin();
+            ASSERT_EQ(lower_pos, lower.position());
+            ASSERT_EQ(map.count(key), view.count(key));
+            ASSERT_EQ(map.contains(key), found != view.end());
+            if (found != view.end()) {
+                EXPECT_EQ(lower_pos, found.position());
+                EXPECT_TRUE(std::equal(found->first.begin(), found->first.end(), needle.begin()));
+                auto value = view.at(key);
+                EXPECT_TRUE(std::equal(value.begin(), value.end(), map.at(key).begin()));
+            } else {
+                EXPECT_THROW(view.at(key), std::out_of_range);
+            }
+        }
+
+        using view_type = gnt::front_coded_byte_map_view<K, 8>;
+        if (interval > 1) { // Shared lengths are not checked when decoding, so malformed ones must not get that far
+            auto corrupt = bytes;
+            const std::size_t blocks = view.block_count();
+            corrupt[view_type::header_bytes + blocks * K + (blocks + 1) * view_type::offset_bytes + map.size() * 8] = std::byte(K + 1);
+            EXPECT_THROW(view_type::build_from_contiguous_bytes(corrupt), std::range_error);
+        }
+        bytes.pop_back();
+        EXPECT_THROW(view_type::build_from_contiguous_bytes(bytes), std::range_error);
+    }
+}
+
+TEST(CommonSmallByteMapTests, InterpolationSearchMatchesBinarySearch) {
+    using policy = gnt::interpolation_search_policy<>;
+    for (std::size_t n : {1, 17, 100, 5000}) {
+        auto uniform = [](auto &rng) { return rng(); };
+        auto narrow = [](auto &rng) { return 1000000 + rng() % 50000; }; // Lots of repeats
+        auto clustered = [](auto &rng) { return (rng() % 4) << 60 | rng() % 1000; };
+        auto skewed = [](auto &rng) { return std::uint64_t(1) << (rng() % 64); };
+        check_search_policy<8, policy>(n, uniform);
+        check_search_policy<8, policy>(n, narrow);
+        check_search_policy<8, policy>(n, clustered);
+        check_search_policy<8, policy>(n, skewed);
+        check_search_policy<4, policy>(n, narrow);
+        check_search_policy<16, policy>(n, uniform);
+        check_search_policy<16, policy>(n, clustered);
+        check_search_policy<8, gnt::interpolation_search_policy<1, 1>>(n, skewed);
+    }
+
+    // As a map's search policy
+    gnt::small_byte_map<8, 8, std::byte, 16, 16, 16, policy> map;
+    gnt::small_byte_map<8, 8, std::byte, 16> reference;
+    std::mt19937 rng(67);
+    for (std::size_t i = 0; i < 2000; ++i) {
+        auto key = make_key(rng() % 100000);
+        auto value = make_key(i);
+        map.insert(std::make_pair(decltype(map)::key_stride(key.data(), 8), decltype(map)::value_stride(value.data(), 8)));
+        reference.insert(std::make_pair(decltype(map)::key_stride(key.data(), 8), decltype(map)::value_stride(value.data(), 8)));
+    }
+    ASSERT_FALSE(map.linear_mode());
+    for (std::size_t i = 0; i < 2000; ++i) {
+        auto key = make_key(rng() % 100000);
+        const decltype(map)::key_stride needle(key.data(), 8);
+        ASSERT_EQ(reference.count(needle), map.count(needle));
+        ASSERT_EQ(reference.lower_bound(needle) - reference.begin(), map.lower_bound(needle) - map.begin());
+        if (reference.contains(needle)) {
+            EXPECT_TRUE(std::equal(reference.at(needle).begin(), reference.at(needle).end(), map.at(needle).begin()));
+        }
+    }
+}
+
+TEST(CommonSmallByteMapTests, BloomFilterRejectsMisses) {
+    using map_type = gnt::small_byte_map<8, 8, std::byte, 16>;
+    std::mt19937_64 rng(71);
+    map_type map;
+    std::vector<std::byte> keys(20000 * 8), values(20000 * 8);
+    for (auto &b : keys) {
+        b = std::byte(rng() & 0xFF);
+    }
+    map.insert_bulk(keys.data(), values.data(), 20000);
+
+    for (double bits_per_key : {4.0, 10.0, 16.0}) {
+        std::vector<std::byte> bytes;
+        gnt::to_filtered_range(map, bytes, bits_per_key);
+        auto view = gnt::filtered_byte_map_view<8, 8, std::byte, 16>::build_from_contiguous_bytes(bytes, true);
+        ASSERT_EQ(map.size(), view.size());
+        EXPECT_NEAR(bits_per_key * map.size() / 8, view.filter().size_bytes(), 64 + gnt::stride_bloom_filter_view<8>::header_bytes);
+        for (auto kv : map) { // No false negatives
+            ASSERT_TRUE(view.filter().may_contain(kv.first.data()));
+            ASSERT_TRUE(view.contains(kv.first));
+            EXPECT_TRUE(std::equal(kv.second.begin(), kv.second.end(), view.at(kv.first).begin()));
+        }
+        std::size_t passed = 0, misses = 0;
+        for (std::size_t i = 0; i < 50000; ++i) {
+            auto key = make_key(rng());
+            const map_type::key_stride needle(key.data(), 8);
+            if (map.contains(needle)) {
+                continue;
+            }
+            ++misses;
+            passed += view.filter().may_contain(key.data());
+            ASSERT_FALSE(view.contains(needle));
+            ASSERT_EQ(0, view.count(needle));
+            ASSERT_EQ(view.end(), view.find(needle));
+        }
+        // The reported rate is what the bits predict, so the measured one should be close to it
+        const double reported = view.filter().false_positive_rate(), measured = double(passed) / double(misses);
+        EXPECT_NEAR(reported, measured, reported * 0.2 + 0.001) << bits_per_key << " bits per key";
+        if (bits_per_key == 10.0) {
+            EXPECT_LT(reported, 0.015);
+        }
+    }
+
+    std::vector<std::byte> truncated(4);
+    EXPECT_THROW((gnt::filtered_byte_map_view<8, 8>::build_from_contiguous_bytes(truncated)), std::range_error);
+}
+
+TEST(CommonSmallByteMapTests, InterleavedLayoutMatchesSeparate) {
+    using separate_map = gnt::small_byte_map<8, 3, std::byte, 16>;
+    using interleaved_map = gnt::small_byte_map<8, 3, std::byte, 16, 16, 16, gnt::binary_search_policy, gnt::interleaved_layout>;
+    static_assert(interleaved_map::key_pitch == 11 && interleaved_map::value_pitch == 11);
+    std::mt19937_64 rng(16);
+    separate_map separate;
+    interleaved_map interleaved;
+    auto check_same = [&]() {
+        ASSERT_EQ(separate.size(), interleaved.size());
+        ASSERT_EQ(separate.linear_mode(), interleaved.linear_mode());
+        auto it = interleaved.begin();
+        for (auto kv : separate) {
+            ASSERT_TRUE(std::equal(kv.first.begin(), kv.first.end(), it->first.begin()));
+            ASSERT_TRUE(std::equal(kv.second.begin(), kv.second.end(), it->second.begin()));
+            ++it;
+        }
+        ASSERT_EQ(interleaved.end(), it);
+    };
+
+    // Through linear mode into sorted mode, one write at a time
+    for (std::size_t i = 0; i < 300; ++i) {
+        auto key = make_key(rng() % 200);
+        std::array<std::byte, 3> value = {std::byte(i & 0xFF), std::byte(i >> 8), std::byte(0x33)};
+        const separate_map::key_stride k(key.data(), 8);
+        const separate_map::value_stride v(value.data(), 3);
+        if (i % 5 == 4) {
+            ASSERT_EQ(separate.erase(k), interleaved.erase(k));
+        } else if (i % 3 == 0) {
+            ASSERT_EQ(separate.insert_or_assign(k, v).second, interleaved.insert_or_assign(k, v).second);
+        } else {
+            ASSERT_EQ(separate.insert(std::make_pair(k, v)).second, interleaved.insert(std::make_pair(k, v)).second);
+        }
+        ASSERT_EQ(separate.count(k), interleaved.count(k));
+        if (separate.contains(k)) {
+            EXPECT_TRUE(std::equal(separate.at(k).begin(), separate.at(k).end(), interleaved.at(k).begin()));
+        }
+        check_same();
+    }
+    ASSERT_FALSE(interleaved.linear_mode());
+
+    // Bulk loads (sort, dedupe and merge) and the write buffer
+    std::vector<std::byte> keys, values;
+    for (std::size_t i = 0; i < 1000; ++i) {
+        auto key = make_key(rng() % 1500);
+        keys.insert(keys.end(), key.begin(), key.end());
+        for (std::size_t b = 0; b < 3; ++b) {
+            values.push_back(std::byte(rng() & 0xFF));
+        }
+    }
+    for (auto policy : {gnt::duplicate_policy::keep_existing, gnt::duplicate_policy::overwrite}) {
+        separate.insert_bulk(keys.data(), values.data(), 500, policy);
+        interleaved.insert_bulk(keys.data(), values.data(), 500, policy);
+        check_same();
+    }
+    separate.set_write_buffer(8);
+    interleaved.set_write_buffer(8);
+    for (std::size_t i = 0; i < 100; ++i) {
+        const separate_map::key_stride k(keys.data() + (500 + i) * 8, 8);
+        const separate_map::value_stride v(values.data() + (500 + i) * 3, 3);
+        if (i % 4 == 0) {
+            separate.erase(k);
+            interleaved.erase(k);
+        } else {
+            separate.insert(std::make_pair(k, v));
+            interleaved.insert(std::make_pair(k, v));
+        }
+    }
+    separate.compact();
+    interleaved.compact();
+    check_same();
+
+    // Serialised as records, and read back by a view of the same layout
+    auto bytes = interleaved.to_vector();
+    ASSERT_EQ(interleaved.size() * 11, bytes.size());
+    auto view = gnt::small_byte_map_view<8, 3, std::byte, 16, gnt::binary_search_policy, gnt::interleaved_layout>::build_from_contiguous_bytes(bytes, true);
+    ASSERT_EQ(separate.size(), view.size());
+    ASSERT_FALSE(view.linear_mode());
+    std::size_t i = 0;
+    for (auto kv : separate) {
+        ASSERT_TRUE(std::equal(kv.first.begin(), kv.first.end(), bytes.begin() + i * 11));
+        ASSERT_TRUE(std::equal(kv.second.begin(), kv.second.end(), bytes.begin() + i * 11 + 8));
+        auto found = view.find(kv.first);
+        ASSERT_EQ(i, static_cast<std::size_t>(found - view.begin()));
+        EXPECT_TRUE(std::equal(kv.second.begin(), kv.second.end(), view.at(kv.first).begin()));
+        ++i;
+    }
+    for (std::size_t probe = 0; probe < 200; ++probe) {
+        auto key = make_key(rng() % 2000);
+        const separate_map::key_stride k(key.data(), 8);
+        ASSERT_EQ(separate.lower_bound(k) - separate.begin(), view.lower_bound(k) - view.begin());
+        ASSERT_EQ(separate.count(k), view.count(k));
+    }
+    auto tail = view.range(separate_map::key_stride(make_key(700).data(), 8), separate_map::key_stride(make_key(900).data(), 8));
+    EXPECT_EQ(separate.range(separate_map::key_stride(make_key(700).data(), 8), separate_map::key_stride(make_key(900).data(), 8)).size(), tail.size());
+
+    interleaved_map copy;
+    copy.assign_sorted(bytes.data(), bytes.size());
+    EXPECT_EQ(bytes, copy.to_vector());
+
+    // A small unsorted view searches its records linearly
+    auto small = gnt::small_byte_map_view<8, 3, std::byte, 16, gnt::binary_search_policy, gnt::interleaved_layout>::build_from_contiguous_bytes(bytes.data(), 10 * 11);
+    ASSERT_TRUE(small.linear_mode());
+    for (std::size_t j = 0; j < 10; ++j) {
+        const separate_map::key_stride k(bytes.data() + j * 11, 8);
+        ASSERT_EQ(j, static_cast<std::size_t>(small.find(k) - small.begin()));
+    }
+}
+
+TEST(CommonSmallByteMapTests, StaticByteMapLookups) {
+    static constexpr gnt::static_byte_map<8, 4, 300> routes(make_route_entries());
+    static_assert(routes.size() == 300);
+    static_assert(routes.contains(gnt::packed_bytes<8>(7919).data()));
+    static_assert(!routes.contains(gnt::packed_bytes<8>(7918).data()));
+    static_assert(routes.find_index(gnt::packed_bytes<8>(0).data()) == 0); // Entries are in key order
+
+    const auto entries = make_route_entries();
+    for (const auto &e : entries) {
+        const decltype(routes)::key_stride key(e.key.data(), 8);
+        ASSERT_TRUE(routes.contains(key));
+        ASSERT_EQ(1, routes.count(key));
+        EXPECT_TRUE(std::equal(e.value.begin(), e.value.end(), routes.at(key).begin()));
+        auto it = routes.find(key);
+        ASSERT_NE(routes.end(), it);
+        EXPECT_TRUE(std::equal(e.key.begin(), e.key.end(), it->first.begin()));
+    }
+    std::size_t misses = 0;
+    for (std::uint64_t id = 0; id < 100003; id += 13) {
+        const auto key = gnt::packed_bytes<8>(id);
+        const bool expected = std::any_of(entries.begin(), entries.end(), [&key](const auto &e) { return e.key == key; });
+        ASSERT_EQ(expected, routes.contains(key.data()));
+        if (!expected) {
+            ++misses;
+            EXPECT_EQ(routes.end(), routes.find(decltype(routes)::key_stride(key.data(), 8)));
+            EXPECT_THROW(routes.at(decltype(routes)::key_stride(key.data(), 8)), std::out_of_range);
+        }
+    }
+    EXPECT_GT(misses, 0);
+
+    // The view has the rest of the read API, over the same sorted bytes
+    auto view = routes.view();
+    ASSERT_EQ(300, view.size());
+    ASSERT_FALSE(view.linear_mode());
+    EXPECT_TRUE(std::is_sorted(view.begin(), view.end(), [](const auto &lhs, const auto &rhs) {
+        return gnt::less_strides<8>(lhs.first.data(), rhs.first.data());
+    }));
+    const auto from = gnt::packed_bytes<8>(50000), to = gnt::packed_bytes<8>(60000);
+    const auto in_range = std::count_if(entries.begin(), entries.end(), [](const auto &e) {
+        return e.key >= gnt::packed_bytes<8>(50000) && e.key < gnt::packed_bytes<8>(60000);
+    });
+    EXPECT_EQ(static_cast<std::size_t>(in_range), view.range(decltype(view)::key_stride(from.data(), 8), decltype(view)::key_stride(to.data(), 8)).size());
+
+    static constexpr auto opcodes = gnt::make_static_byte_map<2, 1>({
+        {gnt::packed_bytes<2>(0x0102), gnt::packed_bytes<1>(1)},
+        {gnt::packed_bytes<2>(0x0001), gnt::packed_bytes<1>(2)},
+        {gnt::packed_bytes<2>(0xFFFF), gnt::packed_bytes<1>(3)},
+    });
+    static_assert(opcodes.find_index(gnt::packed_bytes<2>(0x0001).data()) == 0);
+    static_assert(opcodes.find_index(gnt::packed_bytes<2>(0xFFFF).data()) == 2);
+    static_assert(opcodes.find_index(gnt::packed_bytes<2>(0x0103).data()) == 3);
+    EXPECT_EQ(std::byte(3), opcodes.at(decltype(opcodes)::key_stride(gnt::packed_bytes<2>(0xFFFF).data(), 2))[0]);
+
+    static constexpr gnt::static_byte_map<2, 1, 0> none(std::array<gnt::static_byte_map_entry<2, 1>, 0>{});
+    static_assert(!none.contains(gnt::packed_bytes<2>(0).data()));
+    EXPECT_EQ(none.end(), none.find(decltype(none)::key_stride(gnt::packed_bytes<2>(0).data(), 2)));
+
+    using dup_map = gnt::static_byte_map<2, 1, 2>;
+    EXPECT_THROW(dup_map(std::array<dup_map::entry, 2>{{{gnt::packed_bytes<2>(7), gnt::packed_bytes<1>(1)},
+                                                       {gnt::packed_bytes<2>(7), gnt::packed_bytes<1>(2)}}}),
+                 std::invalid_argument);
+}
+
+namespace {
+
+    nonstd::span<const std::byte> radix_key(const std::string &s) {
+        return {reinterpret_cast<const std::byte *>(s.data()), s.size()};
+    }
+
+    std::string radix_string(nonstd::span<const std::byte> key) {
+        return {reinterpret_cast<const char *>(key.data()), key.size()};
+    }
+
+    // Keys over a small alphabet, so that they share prefixes (some longer than a node's inline prefix) and many are
+    // prefixes of others
+    std::string random_radix_key(std::mt19937_64 &rng) {
+        static const std::string shared[] = {"", "route/", "route/eu-west-1/service/", std::string(2, '\0')};
+        std::string key = shared[rng() % 4];
+        const std::size_t extra = rng() % 6;
+        for (std::size_t i = 0; i < extra; ++i) {
+            key.push_back("ab\xff\0"[rng() % 4]);
+        }
+        return key;
+    }
+
+    void expect_radix_matches(const gnt::radix_byte_map<std::string> &map, const std::map<std::string, std::string> &reference) {
+        ASSERT_EQ(reference.size(), map.size());
+        auto it = map.begin();
+        for (const auto &kv : reference) {
+            ASSERT_NE(map.end(), it);
+            ASSERT_EQ(kv.first, radix_string(it->first));
+            ASSERT_EQ(kv.second, it->second);
+            ++it;
+        }
+        ASSERT_EQ(map.end(), it);
+    }
+
+} //ns
+
+TEST(CommonSmallByteMapTests, RadixByteMapMatchesStdMap) {
+    gnt::radix_byte_map<std::string> map;
+    std::map<std::string, std::string> reference;
+    std::mt19937_64 rng(18);
+    for (int round = 0; round < 20000; ++round) {
+        const std::string key = random_radix_key(rng);
+        switch (rng() % 4) {
+            case 0:
+            case 1: {
+                auto res = map.insert(radix_key(key), std::to_string(round));
+                auto ref = reference.emplace(key, std::to_string(round));
+                ASSERT_EQ(ref.second, res.second);
+                ASSERT_EQ(key, radix_string(res.first->first));
+                ASSERT_EQ(ref.first->second, res.first->second);
+                break;
+            }
+            case 2:
+                ASSERT_EQ(reference.erase(key), map.erase(radix_key(key)));
+                break;
+            default: {
+                auto it = map.find(radix_key(key));
+                auto ref = reference.find(key);
+                ASSERT_EQ(ref == reference.end(), it == map.end());
+                if (ref != reference.end()) {
+                    ASSERT_EQ(ref->second, it->second);
+                    ASSERT_EQ(ref->second, map.at(radix_key(key)));
+                } else {
+                    ASSERT_THROW(map.at(radix_key(key)), std::out_of_range);
+                }
+                auto lower = map.lower_bound(radix_key(key));
+                auto ref_lower = reference.lower_bound(key);
+                ASSERT_EQ(ref_lower == reference.end(), lower == map.end());
+                if (ref_lower != reference.end()) {
+                    ASSERT_EQ(ref_lower->first, radix_string(lower->first));
+                }
+                auto upper = map.upper_bound(radix_key(key));
+                auto ref_upper = reference.upper_bound(key);
+                ASSERT_EQ(ref_upper == reference.end(), upper == map.end());
+                if (ref_upper != reference.end()) {
+                    ASSERT_EQ(ref_upper->first, radix_string(upper->first));
+                }
+                auto range = map.prefix_range(radix_key(key));
+                std::size_t in_range = 0;
+                for (auto r = range.first; r != range.second; ++r, ++in_range) {
+                    ASSERT_EQ(0, radix_string(r->first).compare(0, key.size(), key));
+                }
+                const auto expected = std::count_if(reference.begin(), reference.end(), [&key](const auto &kv) {
+                    return kv.first.compare(0, key.size(), key) == 0;
+                });
+                ASSERT_EQ(static_cast<std::size_t>(expected), in_range);
+                break;
+            }
+        }
+        if (round % 1000 == 0) {
+            expect_radix_matches(map, reference);
+        }
+    }
+    expect_radix_matches(map, reference);
+
+    // Copies are deep, moves steal the tree
+    gnt::radix_byte_map<std::string> copy(map);
+    expect_radix_matches(copy, reference);
+    copy.insert_or_assign(radix_key("route/"), std::string("replaced"));
+    EXPECT_EQ("replaced", copy.at(radix_key("route/")));
+    expect_radix_matches(map, reference);
+    gnt::radix_byte_map<std::string> moved(std::move(copy));
+    EXPECT_TRUE(copy.empty());
+    EXPECT_EQ("replaced", moved.at(radix_key("route/")));
+
+    // Erasing by iterator walks on in order
+    for (auto it = map.begin(); it != map.end();) {
+        it = map.erase(it);
+    }
+    EXPECT_TRUE(map.empty());
+    EXPECT_EQ(map.end(), map.begin());
+}
+
+TEST(CommonSmallByteMapTests, RadixByteMapNodeGrowthAndShrink) {
+    // One node that grows through every layout and back as its children come and go
+    gnt::radix_byte_map<int> map;
+    std::string key = "prefix-longer-than-the-inline-bytes/";
+    map[radix_key(key)] = -1; // The terminal leaf of the node
+    for (int c = 255; c >= 0; --c) {
+        key.push_back(static_cast<char>(c));
+        map[radix_key(key)] = c;
+        key.pop_back();
+        ASSERT_EQ(static_cast<std::size_t>(257 - c), map.size());
+    }
+    int expected = -1;
+    for (const auto &kv : map) {
+        ASSERT_EQ(expected++, kv.second);
+    }
+    for (int c = 0; c < 256; ++c) {
+        key.push_back(static_cast<char>(c));
+        ASSERT_EQ(c, map.at(radix_key(key)));
+        key.pop_back();
+    }
+    auto range = map.prefix_range(radix_key(key));
+    EXPECT_EQ(257, std::distance(range.first, range.second));
+    range = map.prefix_range(radix_key("prefix-longer-than-the-inline-bytes"));
+    EXPECT_EQ(257, std::distance(range.first, range.second));
+    range = map.prefix_range(radix_key("prefix-longer-than-the-inline-bytez"));
+    EXPECT_EQ(range.first, range.second);
+    for (int c = 0; c < 256; c += 2) {
+        key.push_back(static_cast<char>(c));
+        ASSERT_EQ(1, map.erase(radix_key(key)));
+        key.pop_back();
+    }
+    EXPECT_EQ(129, map.size());
+    EXPECT_EQ(1, map.erase(radix_key(key)));
+    for (int c = 1; c < 256; c += 2) {
+        key.push_back(static_cast<char>(c));
+        ASSERT_EQ(c, map.at(radix_key(key)));
+        if (c != 255) {
+            ASSERT_EQ(1, map.erase(radix_key(key)));
+        }
+        key.pop_back();
+    }
+    ASSERT_EQ(1, map.size());
+    EXPECT_EQ(255, map.begin()->second);
+
+    // Lookups take any contiguous bytes without copying them
+    std::vector<std::byte> bytes(key.size() + 1);
+    std::memcpy(bytes.data(), key.data(), key.size());
+    bytes.back() = std::byte(255);
+    const gnt::vector_view<std::byte> view(bytes.data(), bytes.size());
+    EXPECT_TRUE(map.contains(view));
+    EXPECT_TRUE(map.contains(bytes));
+    EXPECT_FALSE(map.contains(nonstd::span<const std::byte>(bytes.data(), bytes.size() - 1)));
+
+    // The empty key is a key like any other
+    map[radix_key("")] = 7;
+    EXPECT_EQ(7, map.begin()->second);
+    EXPECT_EQ(2, map.prefix_range(radix_key("")).first == map.begin() ? map.size() : 0);
+}
+
+TEST(CommonSmallByteMapTests, PersistentByteMapSnapshots) {
+    // Small chunks and branches, so a few thousand entries make a tree several levels deep
+    using persistent_map = gnt::persistent_byte_map<8, 4, std::byte, 8, 4>;
+    persistent_map map;
+    std::map<std::uint64_t, std::uint32_t> reference;
+    std::vector<std::pair<persistent_map, std::map<std::uint64_t, std::uint32_t>>> snapshots;
+    std::mt19937 rng(19);
+    auto check = [](const persistent_map &m, const std::map<std::uint64_t, std::uint32_t> &ref) {
+        ASSERT_EQ(ref.size(), m.size());
+        auto it = m.begin();
+        for (const auto &kv : ref) {
+            ASSERT_NE(m.end(), it);
+            ASSERT_TRUE(std::equal(it->first.begin(), it->first.end(), make_key(kv.first).begin()));
+            ASSERT_EQ(kv.second, value_of(it->second));
+            ++it;
+        }
+        ASSERT_EQ(m.end(), it);
+    };
+    for (std::uint32_t op = 0; op < 6000; ++op) {
+        const std::uint64_t k = rng() % 2000;
+        const auto key = make_key(k);
+        const persistent_map::key_stride key_stride(key.data(), 8);
+        const auto value = make_key(op);
+        const persistent_map::value_stride value_stride(value.data() + 4, 4);
+        switch (rng() % 4) {
+            case 0:
+                ASSERT_EQ(reference.emplace(k, op).second, map.insert(key_stride, value_stride));
+                break;
+            case 1:
+                ASSERT_EQ(reference.count(k) == 0, map.insert_or_assign(key_stride, value_stride));
+                reference[k] = op;
+                break;
+            case 2:
+                ASSERT_EQ(reference.erase(k), map.erase(key_stride));
+                break;
+            default: {
+                auto it = reference.find(k);
+                ASSERT_EQ(it != reference.end(), map.contains(key_stride));
+                if (it != reference.end()) {
+                    ASSERT_EQ(it->second, value_of(map.at(key_stride)));
+                } else {
+                    ASSERT_THROW(map.at(key_stride), std::out_of_range);
+                }
+                auto lower = map.lower_bound(key_stride);
+                auto ref_lower = reference.lower_bound(k);
+                ASSERT_EQ(ref_lower == reference.end(), lower == map.end());
+                if (ref_lower != reference.end()) {
+                    ASSERT_TRUE(std::equal(lower->first.begin(), lower->first.end(), make_key(ref_lower->first).begin()));
+                }
+                // Chunks are sorted views that find what the map finds
+                auto chunk = map.chunk_for(key_stride);
+                ASSERT_FALSE(chunk.linear_mode());
+                ASSERT_EQ(it != reference.end(), chunk.contains(key_stride));
+                break;
+            }
+        }
+        if (op % 500 == 0) {
+            snapshots.emplace_back(map, reference);
+        }
+    }
+    check(map, reference);
+    // Later updates did not touch the earlier snapshots
+    for (const auto &snapshot : snapshots) {
+        check(snapshot.first, snapshot.second);
+    }
+
+    // One update copies one chunk, the rest are shared with the snapshot
+    const persistent_map before = map;
+    const auto key = make_key(100000);
+    map.insert(persistent_map::key_stride(key.data(), 8), persistent_map::value_stride(key.data(), 4));
+    std::vector<const std::byte *> old_chunks, new_chunks;
+    before.for_each_chunk([&old_chunks](const persistent_map::view_type &chunk) { old_chunks.push_back(chunk.begin()->first.data()); });
+    map.for_each_chunk([&new_chunks](const persistent_map::view_type &chunk) { new_chunks.push_back(chunk.begin()->first.data()); });
+    std::sort(old_chunks.begin(), old_chunks.end());
+    std::sort(new_chunks.begin(), new_chunks.end());
+    std::vector<const std::byte *> shared;
+    std::set_intersection(old_chunks.begin(), old_chunks.end(), new_chunks.begin(), new_chunks.end(), std::back_inserter(shared));
+    EXPECT_GE(shared.size() + 2, new_chunks.size());
+    EXPECT_EQ(before.size() + 1, map.size());
+
+    // Bulk loads from a (linear or sorted) small_byte_map, and serialises back to its layout
+    for (std::size_t n : {std::size_t(20), std::size_t(1000)}) {
+        gnt::small_byte_map<8, 4, std::byte, 32> small;
+        for (std::size_t i = 0; i < n; ++i) {
+            auto k = make_key((i * 7919) % 100003);
+            auto v = make_key(i);
+            small.insert(std::make_pair(gnt::stride<std::byte, 8>(k.data(), 8), gnt::stride<std::byte, 4>(v.data() + 4, 4)));
+        }
+        const persistent_map loaded(small);
+        ASSERT_EQ(n, loaded.size());
+        auto bytes = loaded.to_vector();
+        auto view = gnt::small_byte_map_view<8, 4>::build_from_contiguous_bytes(bytes, true);
+        ASSERT_EQ(n, view.size());
+        for (auto it = small.begin(); it != small.end(); ++it) {
+            const persistent_map::key_stride k(it->first.data(), 8);
+            ASSERT_EQ(value_of(it->second), value_of(loaded.at(k)));
+            ASSERT_EQ(value_of(it->second), value_of(view.at(it->first)));
+        }
+    }
+
+    // Erasing everything leaves an empty map
+    for (const auto &kv : reference) {
+        const auto k = make_key(kv.first);
+        ASSERT_EQ(1, map.erase(persistent_map::key_stride(k.data(), 8)));
+    }
+    ASSERT_EQ(1, map.size());
+    EXPECT_EQ(1, map.erase(persistent_map::key_stride(key.data(), 8)));
+    EXPECT_TRUE(map.empty());
+    EXPECT_EQ(map.end(), map.begin());
+}
+
+TEST(CommonSmallByteMapTests, ShardedByteMapMatchesStdMap) {
+    using sharded_map = gnt::sharded_byte_map<8, 4, std::byte, 8, 16>;
+    sharded_map map;
+    std::map<std::uint64_t, std::uint32_t> reference;
+    std::mt19937 rng(20);
+    for (std::uint32_t op = 0; op < 4000; ++op) {
+        const std::uint64_t k = rng() % 1000;
+        auto key = make_key(k);
+        auto value = make_key(op);
+        const sharded_map::key_stride key_stride(key.data(), 8);
+        const sharded_map::value_stride value_stride(value.data() + 4, 4);
+        switch (rng() % 4) {
+            case 0:
+                ASSERT_EQ(reference.emplace(k, op).second, map.insert(key_stride, value_stride));
+                break;
+            case 1:
+                ASSERT_EQ(reference.count(k) == 0, map.insert_or_assign(key_stride, value_stride));
+                reference[k] = op;
+                break;
+            case 2:
+                ASSERT_EQ(reference.erase(k), map.erase(key_stride));
+                break;
+            default: {
+                auto it = reference.find(k);
+                ASSERT_EQ(it != reference.end(), map.contains(key_stride));
+                if (it != reference.end()) {
+                    ASSERT_EQ(it->second, value_of(map.at(key_stride)));
+                } else {
+                    ASSERT_THROW(map.at(key_stride), std::out_of_range);
+                }
+            }
+        }
+    }
+    ASSERT_EQ(reference.size(), map.size());
+
+    // Batches go through each shard once
+    std::vector<std::byte> keys, values;
+    make_batch(500, 2000, 100000, rng, keys, values);
+    std::map<std::uint64_t, std::uint32_t> batch_reference = reference;
+    for (std::size_t i = 0; i < 500; ++i) {
+        batch_reference[load_key(keys.data() + i * 8)] = value_of(nonstd::span<const std::byte, 4>(values.data() + i * 4, 4));
+    }
+    map.insert_bulk(keys.data(), values.data(), 500, gnt::duplicate_policy::overwrite);
+    ASSERT_EQ(batch_reference.size(), map.size());
+
+    std::vector<std::array<std::byte, 8>> needle_keys;
+    for (std::uint64_t k = 0; k < 2000; k += 3) {
+        needle_keys.push_back(make_key(k));
+    }
+    std::vector<sharded_map::key_stride> needles;
+    for (auto &k : needle_keys) {
+        needles.emplace_back(k.data(), 8);
+    }
+    std::vector<std::byte> found_values(needles.size() * 4);
+    std::unique_ptr<bool[]> found(new bool[needles.size()]);
+    const auto hits = map.find_many(needles, found_values.data(), found.get());
+    std::size_t expected_hits = 0;
+    for (std::size_t i = 0; i < needles.size(); ++i) {
+        auto it = batch_reference.find(i * 3);
+        ASSERT_EQ(it != batch_reference.end(), found[i]);
+        if (found[i]) {
+            ++expected_hits;
+            ASSERT_EQ(it->second, value_of(nonstd::span<const std::byte, 4>(found_values.data() + i * 4, 4)));
+        }
+    }
+    ASSERT_EQ(expected_hits, hits);
+
+    // The snapshot is sorted and complete
+    auto bytes = map.to_vector();
+    auto view = gnt::small_byte_map_view<8, 4>::build_from_contiguous_bytes(bytes, true);
+    ASSERT_EQ(batch_reference.size(), view.size());
+    auto ref_it = batch_reference.begin();
+    for (auto it = view.begin(); it != view.end(); ++it, ++ref_it) {
+        ASSERT_EQ(ref_it->first, load_key(it->first.data()));
+        ASSERT_EQ(ref_it->second, value_of(it->second));
+    }
+
+    ASSERT_EQ(expected_hits, map.erase_many(needles));
+    ASSERT_EQ(batch_reference.size() - expected_hits, map.size());
+}
+
+TEST(CommonSmallByteMapTests, ShardedByteMapConcurrentSnapshots) {
+    using sharded_map = gnt::sharded_byte_map<8, 4>;
+    sharded_map map;
+    constexpr std::uint64_t n = 20000;
+    // One writer inserts keys in order, so any consistent snapshot holds exactly the keys 0 .. m - 1 for some m, while
+    // readers look them up
+    std::atomic<bool> done{false};
+    std::thread writer([&map, &done] {
+        for (std::uint64_t k = 0; k < n; ++k) {
+            auto key = make_key(k);
+            auto value = make_key(k * 2);
+            map.insert(sharded_map::key_stride(key.data(), 8), sharded_map::value_stride(value.data() + 4, 4));
+        }
+        done = true;
+    });
+    std::vector<std::thread> readers;
+    std::atomic<std::size_t> bad_values{0};
+    for (int r = 0; r < 3; ++r) {
+        readers.emplace_back([&map, &done, &bad_values, r] {
+            std::mt19937 rng(r);
+            while (!done) {
+                const std::uint64_t k = rng() % n;
+                auto key = make_key(k);
+                map.visit(sharded_map::key_stride(key.data(), 8), [&](nonstd::span<const std::byte, 4> value) {
+                    bad_values += value_of(value) != k * 2;
+                });
+            }
+        });
+    }
+    std::size_t snapshots = 0, last = 0;
+    while (!done || snapshots == 0) {
+        auto bytes = map.to_vector();
+        const std::size_t m = bytes.size() / 12;
+        for (std::size_t i = 0; i < m; ++i) {
+            ASSERT_EQ(i, load_key(bytes.data() + i * 8));
+        }
+        ASSERT_GE(m, last);
+        last = m;
+        ++snapshots;
+    }
+    writer.join();
+    for (auto &t : readers) {
+        t.join();
+    }
+    EXPECT_EQ(0, bad_values.load());
+    EXPECT_EQ(n, map.size());
+}
@@ -1,12 +1,117 @@
 #include <vector>
 #include <iostream>
+#include <memory>
+#include <memory_resource>
+#include <stdexcept>
+#include <string>
+#include <variant>
 
 #include "common/small-vector.hpp"
+#include "common/stack-vector.hpp"
+#include "common/record.hpp"
 #include "common/small-byte-map.hpp"
 
 
 #include "gtest/gtest.h"
 
+namespace {
+
+    // Counts the live instances, to check a container constructs and destroys exactly the elements it holds
+    struct counted {
+        static inline int alive = 0;
+        int value;
+
+        counted(int v = 0) : value(v) { ++alive; }
+        counted(const counted &other) : value(other.value) { ++alive; }
+        counted(counted &&other) noexcept : value(other.value) { ++alive; }
+        counted &operator=(const counted &) = default;
+        counted &operator=(counted &&) = default;
+        ~counted() { --alive; }
+    };
+
+    // Owns its value through a pointer, so it can opt in to relocation by memmove; counts its move constructions
+    struct boxed {
+        static inline int moves = 0;
+        std::unique_ptr<int> value;
+
+        boxed(int v) : value(std::make_unique<int>(v)) {}
+        boxed(boxed &&other) noexcept : value(std::move(other.value)) { ++moves; }
+        boxed &operator=(boxed &&) = default;
+    };
+
+    // Counts its live instances like counted, but its copies (and its moves, unless NothrowMove) throw once
+    // countdown reaches zero; a negative countdown never throws
+    template<bool NothrowMove>
+    struct fragile {
+        static inline int alive = 0;
+        static inline int countdown = -1;
+        int value;
+
+        static void tick() {
+            if (countdown == 0) {
+                throw std::runtime_error("fragile");
+            }
+            if (countdown > 0) {
+                --countdown;
+            }
+        }
+
+        fragile(int v) : value(v) { ++alive; }
+        fragile(const fragile &other) : value(other.value) { tick(); ++alive; }
+        fragile(fragile &&other) noexcept(NothrowMove) : value(other.value) {
+            if constexpr (!NothrowMove) {
+                tick();
+            }
+            ++alive;
+        }
+        fragile &operator=(const fragile &) = default;
+        fragile &operator=(fragile &&) = default;
+        ~fragile() { --alive; }
+    };
+
+    template<typename Vector>
+    std::vector<int> values_of(const Vector &vec) {
+        std::vector<int> values;
+        for (const auto &element : vec) {
+            values.push_back(element.value);
+        }
+        return values;
+    }
+
+}
+
+namespace {
+
+    // Counts what it hands out, passing the work on to the global heap
+    class counting_resource : public std::pmr::memory_resource {
+    public:
+        int allocations = 0;
+        int live = 0;
+
+    private:
+        void *do_allocate(std::size_t bytes, std::size_t align) override {
+            ++allocations;
+            ++live;
+            return std::pmr::new_delete_resource()->allocate(bytes, align);
+        }
+
+        void do_deallocate(void *p, std::size_t bytes, std::size_t align) override {
+            --live;
+            std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+            return this == &other;
+        }
+    };
+
+}
+
+namespace gnt {
+    template<>
+    struct is_trivially_relocatable<boxed> : std::true_type {};
+}
+
 TEST(CommonSmallTests, PilferingAround) {
     std::vector<uint64_t> vec;
     vec.push_back(5);
@@ -45,6 +150,411 @@ TEST(CommonSmallTests, VectorSanityCheck) {
 }
 
 
+TEST(CommonSmallTests, VectorIsNoBiggerThanTheVariant) {
+    // What small_vector<char> held before it was one buffer: a view base plus the variant of the two vectors
+    using variant_layout = std::variant<gnt::stack_vector<char>, std::vector<char>>;
+    EXPECT_LE(sizeof(gnt::small_vector<char>), sizeof(gnt::vector_view<char>) + sizeof(variant_layout));
+    EXPECT_LE(sizeof(gnt::small_vector<uint64_t, 4>), sizeof(gnt::vector_view<uint64_t>) + sizeof(std::size_t) + 4 * sizeof(uint64_t));
+}
+
+TEST(CommonSmallTests, VectorMatchesStdVectorAcrossTheInlineBoundary) {
+    gnt::small_vector<uint64_t, 4> vec;
+    std::vector<uint64_t> expected;
+    EXPECT_EQ(4, vec.capacity());
+    for (uint64_t i = 0; i < 20; ++i) {
+        vec.push_back(i);
+        expected.push_back(i);
+        ASSERT_TRUE(std::equal(vec.begin(), vec.end(), expected.begin(), expected.end()));
+    }
+    EXPECT_GE(vec.capacity(), 20);
+    vec.insert(vec.begin() + 3, 100);
+    expected.insert(expected.begin() + 3, 100);
+    const uint64_t range[] = {7, 8, 9};
+    vec.insert(vec.begin(), std::begin(range), std::end(range));
+    expected.insert(expected.begin(), std::begin(range), std::end(range));
+    vec.erase(vec.begin() + 5, vec.begin() + 10);
+    expected.erase(expected.begin() + 5, expected.begin() + 10);
+    // An element of the vector itself, which moves while the insert makes room
+    vec.insert(vec.begin(), vec.back());
+    expected.insert(expected.begin(), expected.back());
+    EXPECT_TRUE(std::equal(vec.begin(), vec.end(), expected.begin(), expected.end()));
+
+    vec.resize(6);
+    expected.resize(6);
+    vec.shrink_to_fit();
+    EXPECT_EQ(6, vec.capacity());
+    vec.resize(8);
+    expected.resize(8);
+    EXPECT_TRUE(std::equal(vec.begin(), vec.end(), expected.begin(), expected.end()));
+
+    gnt::small_vector<uint64_t, 4> small(3);
+    EXPECT_EQ(4, small.capacity());
+    gnt::small_vector<uint64_t, 4> big(64);
+    EXPECT_EQ(64, big.capacity());
+    EXPECT_EQ(0, big.size());
+}
+
+TEST(CommonSmallTests, VectorCopiesAndMovesInlineAndHeap) {
+    for (size_t n : {2, 40}) {
+        gnt::small_vector<std::string, 3> vec;
+        for (size_t i = 0; i < n; ++i) {
+            vec.emplace_back(std::string(32, char('a' + i % 26)));
+        }
+        gnt::small_vector<std::string, 3> copy(vec);
+        EXPECT_TRUE(std::equal(vec.begin(), vec.end(), copy.begin(), copy.end()));
+        EXPECT_NE(vec.data(), copy.data());
+
+        const std::string *heap_data = vec.data();
+        gnt::small_vector<std::string, 3> moved(std::move(vec));
+        EXPECT_TRUE(std::equal(copy.begin(), copy.end(), moved.begin(), moved.end()));
+        EXPECT_EQ(n > 3, moved.data() == heap_data);
+        EXPECT_EQ(0, vec.size());
+        EXPECT_EQ(3, vec.capacity());
+
+        vec = moved;
+        moved = std::move(copy);
+        EXPECT_TRUE(std::equal(vec.begin(), vec.end(), moved.begin(), moved.end()));
+        vec.erase(vec.begin());
+        vec.pop_back();
+        EXPECT_EQ(n - 2, vec.size());
+        vec.clear();
+        EXPECT_TRUE(vec.empty());
+    }
+}
+
+TEST(CommonSmallTests, StackVectorOnlyHoldsLiveElements) {
+    {
+        gnt::stack_vector<counted, 16> vec;
+        EXPECT_EQ(0, counted::alive);
+        vec.push_back(counted(1));
+        vec.emplace_back(3);
+        vec.insert(vec.begin() + 1, counted(2));
+        vec.emplace(vec.begin(), 0);
+        EXPECT_EQ(4, counted::alive);
+        for (int i = 0; i < 4; ++i) {
+            EXPECT_EQ(i, vec.at(i).value);
+        }
+        // An element of the vector itself, which moves while the insert makes room
+        vec.insert(vec.begin(), vec.back());
+        EXPECT_EQ(3, vec.front().value);
+        EXPECT_EQ(3, vec.back().value);
+
+        vec.erase(vec.begin(), vec.begin() + 2);
+        EXPECT_EQ(3, counted::alive);
+        EXPECT_EQ(1, vec.front().value);
+
+        gnt::stack_vector<counted, 16> copy(vec);
+        EXPECT_EQ(6, counted::alive);
+        gnt::stack_vector<counted, 16> moved(std::move(copy));
+        EXPECT_EQ(0, copy.size());
+        EXPECT_EQ(6, counted::alive);
+        EXPECT_EQ(3, moved.back().value);
+
+        vec.resize(8);
+        EXPECT_EQ(0, vec.back().value);
+        EXPECT_EQ(11, counted::alive);
+        vec.resize(1);
+        EXPECT_EQ(4, counted::alive);
+        vec = moved;
+        EXPECT_EQ(6, counted::alive);
+        vec.clear();
+        EXPECT_EQ(3, counted::alive);
+    }
+    EXPECT_EQ(0, counted::alive);
+
+    gnt::stack_vector<std::string, 4> strings;
+    strings.push_back(std::string(64, 'a'));
+    strings.insert(strings.begin(), std::string(64, 'b'));
+    strings.pop_back();
+    EXPECT_EQ(std::string(64, 'b'), strings.front());
+}
+
+TEST(CommonSmallTests, RelocatableTypesMoveAsBytes) {
+    EXPECT_TRUE(gnt::is_trivially_relocatable_v<std::byte>);
+    EXPECT_TRUE(gnt::is_trivially_relocatable_v<uint64_t>);
+    EXPECT_FALSE(gnt::is_trivially_relocatable_v<std::string>);
+    EXPECT_TRUE(gnt::is_trivially_relocatable_v<boxed>);
+
+    // Growth, the switch from inline to heap, inserts and erases all go through relocate, never the move constructor
+    gnt::small_vector<boxed, 4> vec;
+    for (int i = 0; i < 40; ++i) {
+        vec.insert(vec.begin() + vec.size() / 2, boxed(i));
+    }
+    boxed::moves = 0;
+    for (int i = 0; i < 40; ++i) {
+        vec.emplace_back(i);
+    }
+    vec.erase(vec.begin(), vec.begin() + 10);
+    gnt::small_vector<boxed, 4> moved(std::move(vec));
+    EXPECT_EQ(0, boxed::moves);
+    EXPECT_EQ(70, moved.size());
+    EXPECT_EQ(39, *moved.back().value);
+
+    gnt::stack_vector<boxed, 8> stack;
+    for (int i = 0; i < 6; ++i) {
+        stack.emplace(stack.begin(), i);
+    }
+    boxed::moves = 0;
+    stack.erase(stack.begin() + 1);
+    gnt::stack_vector<boxed, 8> stack_moved(std::move(stack));
+    EXPECT_EQ(0, boxed::moves);
+    EXPECT_EQ(5, *stack_moved.front().value);
+    EXPECT_EQ(0, *stack_moved.back().value);
+
+    uint64_t ints[] = {1, 2, 3, 4, 5, 0};
+    EXPECT_EQ(ints + 1, gnt::displace_right_n(ints, ints + 5, 1));
+    EXPECT_EQ(2, ints[2]);
+    EXPECT_EQ(ints + 5, gnt::displace_left_n(ints + 1, ints + 6, 1));
+    EXPECT_EQ(5, ints[4]);
+
+    // The element by element paths shift by the same amount and return the same positions
+    std::vector<uint64_t> vints{1, 2, 3, 4, 5, 0, 0};
+    EXPECT_EQ(vints.begin() + 2, gnt::displace_right_n(vints.begin(), vints.begin() + 5, 2));
+    EXPECT_EQ((std::vector<uint64_t>{1, 2, 1, 2, 3, 4, 5}), vints);
+    EXPECT_EQ(vints.begin() + 5, gnt::displace_left_n(vints.begin() + 2, vints.begin() + 7, 2));
+    EXPECT_EQ((std::vector<uint64_t>{1, 2, 3, 4, 5, 4, 5}), vints);
+    std::string strings[] = {"a", "b", "c", ""};
+    EXPECT_EQ(strings + 1, gnt::displace_right_n(strings, strings + 3, 1));
+    EXPECT_EQ("a", strings[1]);
+    EXPECT_EQ("c", strings[3]);
+}
+
+TEST(CommonSmallTests, VectorSpillsIntoItsAllocator) {
+    counting_resource arena, other_arena;
+    {
+        gnt::pmr::small_vector<uint64_t, 4> vec(&arena);
+        for (uint64_t i = 0; i < 4; ++i) {
+            vec.push_back(i);
+        }
+        EXPECT_EQ(0, arena.allocations);
+        for (uint64_t i = 4; i < 64; ++i) {
+            vec.push_back(i);
+        }
+        EXPECT_GT(arena.allocations, 0);
+        EXPECT_EQ(1, arena.live);
+        EXPECT_EQ(&arena, vec.get_allocator().resource());
+
+        // Equal allocators hand the buffer over; a different one gets its own copy of the elements
+        gnt::pmr::small_vector<uint64_t, 4> stolen(std::move(vec));
+        EXPECT_EQ(1, arena.live);
+        gnt::pmr::small_vector<uint64_t, 4> elsewhere(&other_arena);
+        elsewhere = std::move(stolen);
+        EXPECT_EQ(&other_arena, elsewhere.get_allocator().resource());
+        EXPECT_EQ(1, other_arena.live);
+        EXPECT_EQ(64, elsewhere.size());
+        EXPECT_EQ(63, elsewhere.back());
+        gnt::pmr::small_vector<uint64_t, 4> copy(elsewhere, &arena);
+        EXPECT_EQ(2, arena.live);
+        EXPECT_TRUE(std::equal(copy.begin(), copy.end(), elsewhere.begin(), elsewhere.end()));
+    }
+    EXPECT_EQ(0, arena.live);
+    EXPECT_EQ(0, other_arena.live);
+
+    // A monotonic arena per message: every spill comes out of the one buffer
+    std::array<std::byte, 4096> buffer;
+    std::pmr::monotonic_buffer_resource message_arena(buffer.data(), buffer.size(), std::pmr::null_memory_resource());
+    gnt::pmr::small_vector<std::byte, 16> bytes(&message_arena);
+    bytes.resize(1000);
+    EXPECT_GE(bytes.data(), buffer.data());
+    EXPECT_LT(bytes.data(), buffer.data() + buffer.size());
+}
+
+TEST(CommonSmallTests, ByteMapAndRecordsUseTheAllocator) {
+    counting_resource arena;
+    using pmr_map = gnt::small_byte_map<sizeof(uint64_t), sizeof(uint64_t), std::byte, 128, 128, 128, gnt::binary_search_policy,
+        gnt::separate_layout, std::pmr::polymorphic_allocator<std::byte>>;
+    {
+        pmr_map map(&arena);
+        std::array<std::byte, 8> key{}, value{};
+        for (uint64_t i = 0; i < 100; ++i) {
+            key[7] = std::byte(i);
+            value[0] = std::byte(i);
+            map.insert(std::make_pair(pmr_map::key_stride(key.data(), 8), pmr_map::value_stride(value.data(), 8)));
+        }
+        EXPECT_EQ(100, map.size());
+        EXPECT_GT(arena.live, 0);
+        EXPECT_EQ(&arena, map.get_allocator().resource());
+        key[7] = std::byte(42);
+        auto it = map.find(pmr_map::key_stride(key.data(), 8));
+        ASSERT_NE(map.end(), it);
+        EXPECT_EQ(std::byte(42), it->second[0]);
+    }
+    EXPECT_EQ(0, arena.live);
+
+    char field_a[] = {'a', 'b', 'c'};
+    std::vector<char> field_b(200, 'z');
+    gnt::record_view<2, char> record{nonstd::span<char>(field_a, 3), nonstd::span<char>(field_b.data(), field_b.size())};
+    auto bytes = gnt::make_vector(record, std::pmr::polymorphic_allocator<char>(&arena));
+    EXPECT_EQ(3 * sizeof(std::size_t) + 203, bytes.size());
+    EXPECT_EQ(1, arena.live);
+    EXPECT_EQ(2, gnt::unpack_int(nonstd::span<char>(bytes.data(), 8)));
+    EXPECT_EQ(200, gnt::unpack_int(nonstd::span<char>(bytes.data() + 16, 8)));
+    EXPECT_EQ('c', bytes.at(3 * sizeof(std::size_t) + 2));
+}
+
+TEST(CommonSmallTests, ByteRecordsRoundTrip) {
+    std::array<std::byte, 3> field_a{std::byte(1), std::byte(0x80), std::byte(0xFF)};
+    std::vector<std::byte> field_b(300, std::byte(0x2A));
+    gnt::record_view<2> record{nonstd::span<std::byte>(field_a.data(), field_a.size()), nonstd::span<std::byte>(field_b.data(), field_b.size())};
+    auto bytes = gnt::make_vector(record);
+    EXPECT_EQ(3 * sizeof(std::size_t) + 303, bytes.size());
+
+    const auto fields = gnt::make_record_view<2>(gnt::vector_view<std::byte>(bytes.data(), bytes.size()));
+    ASSERT_EQ(3, fields[0].size());
+    ASSERT_EQ(300, fields[1].size());
+    EXPECT_TRUE(std::equal(fields[0].begin(), fields[0].end(), field_a.begin()));
+    EXPECT_TRUE(std::equal(fields[1].begin(), fields[1].end(), field_b.begin()));
+    EXPECT_THROW(gnt::make_record_view<3>(gnt::vector_view<std::byte>(bytes.data(), bytes.size())), std::logic_error);
+}
+
+TEST(CommonSmallTests, VectorShrinksBackInline) {
+    static_assert(gnt::geometric_growth<3, 2>::grow(16, 17) == 24);
+    static_assert(gnt::bursty_growth_policy::shrink(40, 128) == 128);
+    static_assert(gnt::bursty_growth_policy::shrink(32, 128) == 64);
+
+    // The default policy keeps its buffer until asked, then goes back inline once the elements fit
+    gnt::small_vector<uint64_t, 8> vec;
+    for (uint64_t i = 0; i < 100; ++i) {
+        vec.push_back(i);
+    }
+    vec.erase(vec.begin() + 6, vec.end());
+    EXPECT_GE(vec.capacity(), 100);
+    vec.shrink_to_fit();
+    EXPECT_EQ(8, vec.capacity());
+    EXPECT_EQ(6, vec.size());
+    EXPECT_EQ(5, vec.back());
+    vec.resize(20);
+    vec.shrink_to_fit();
+    EXPECT_EQ(20, vec.capacity());
+
+    // A burst on a long-lived vector is given back as it drains, and hovering at one size doesn't reallocate
+    counting_resource arena;
+    {
+        gnt::pmr::small_vector<uint64_t, 8, gnt::bursty_growth_policy> state(&arena);
+        for (uint64_t i = 0; i < 1000; ++i) {
+            state.push_back(i);
+        }
+        const size_t peak = state.capacity();
+        while (state.size() > 100) {
+            state.pop_back();
+        }
+        EXPECT_LT(state.capacity(), peak / 2);
+        EXPECT_EQ(99, state.back());
+
+        const int allocations = arena.allocations;
+        for (int round = 0; round < 100; ++round) {
+            state.push_back(7);
+            state.push_back(8);
+            state.pop_back();
+            state.pop_back();
+        }
+        EXPECT_EQ(allocations, arena.allocations);
+
+        state.erase(state.begin() + 3, state.end());
+        EXPECT_EQ(8, state.capacity());
+        EXPECT_EQ(0, arena.live);
+        EXPECT_EQ(2, state.back());
+
+        for (uint64_t i = 0; i < 100; ++i) {
+            state.push_back(i);
+        }
+        state.clear();
+        EXPECT_EQ(8, state.capacity());
+        EXPECT_EQ(0, arena.live);
+    }
+}
+
+TEST(CommonSmallTests, VectorIsUnchangedWhenAnElementThrows) {
+    using sturdy_move = fragile<true>;
+    using flimsy_move = fragile<false>;
+    counting_resource arena;
+    {
+        // Copies throw but moves don't: inserts fail cleanly both in place and while growing
+        gnt::pmr::small_vector<sturdy_move, 4> vec(&arena);
+        const std::vector<sturdy_move> source{7, 8, 9};
+        for (int i = 0; i < 3; ++i) {
+            vec.emplace_back(i);
+        }
+        sturdy_move::countdown = 0;
+        EXPECT_THROW(vec.insert(vec.begin() + 1, source.begin(), source.begin() + 1), std::runtime_error);
+        EXPECT_EQ((std::vector<int>{0, 1, 2}), values_of(vec));
+        EXPECT_THROW(vec.push_back(source[0]), std::runtime_error);
+        sturdy_move::countdown = 1;
+        EXPECT_THROW(vec.insert(vec.begin() + 1, source.begin(), source.end()), std::runtime_error);
+        EXPECT_EQ((std::vector<int>{0, 1, 2}), values_of(vec));
+        EXPECT_EQ(4, vec.capacity());
+        EXPECT_EQ(6, sturdy_move::alive);
+        EXPECT_EQ(0, arena.live);
+
+        sturdy_move::countdown = -1;
+        vec.push_back(source[0]);
+        sturdy_move::countdown = 0;
+        EXPECT_THROW(vec.push_back(source[1]), std::runtime_error);
+        EXPECT_EQ((std::vector<int>{0, 1, 2, 7}), values_of(vec));
+        EXPECT_EQ(0, arena.live);
+        sturdy_move::countdown = -1;
+    }
+    EXPECT_EQ(0, sturdy_move::alive);
+    {
+        // Moves throw too, so growing copies the elements and keeps the originals until every copy is made
+        gnt::pmr::small_vector<flimsy_move, 4> vec(&arena);
+        for (int i = 0; i < 4; ++i) {
+            vec.emplace_back(i);
+        }
+        flimsy_move::countdown = 2;
+        EXPECT_THROW(vec.emplace_back(4), std::runtime_error);
+        EXPECT_EQ((std::vector<int>{0, 1, 2, 3}), values_of(vec));
+        EXPECT_EQ(4, flimsy_move::alive);
+        EXPECT_EQ(0, arena.live);
+
+        flimsy_move::countdown = -1;
+        vec.emplace_back(4);
+        flimsy_move::countdown = 1;
+        EXPECT_THROW(vec.insert(vec.begin(), flimsy_move(9)), std::runtime_error);
+        EXPECT_EQ((std::vector<int>{0, 1, 2, 3, 4}), values_of(vec));
+        EXPECT_EQ(5, flimsy_move::alive);
+
+        flimsy_move::countdown = -1;
+        vec.insert(vec.begin() + 1, flimsy_move(9));
+        vec.erase(vec.begin());
+        EXPECT_EQ((std::vector<int>{9, 1, 2, 3, 4}), values_of(vec));
+        EXPECT_EQ(5, flimsy_move::alive);
+        vec.erase(vec.begin() + 1, vec.end());
+        vec.shrink_to_fit();
+        EXPECT_EQ(4, vec.capacity());
+        EXPECT_EQ(0, arena.live);
+    }
+    EXPECT_EQ(0, flimsy_move::alive);
+    {
+        // stack_vector only counts the gap once it is filled, too
+        gnt::stack_vector<sturdy_move, 8> vec;
+        const std::vector<sturdy_move> source{7, 8, 9};
+        for (int i = 0; i < 3; ++i) {
+            vec.emplace_back(i);
+        }
+        sturdy_move::countdown = 1;
+        EXPECT_THROW(vec.insert(vec.begin(), source.begin(), source.end()), std::runtime_error);
+        EXPECT_EQ((std::vector<int>{0, 1, 2}), values_of(vec));
+        EXPECT_EQ(6, sturdy_move::alive);
+        sturdy_move::countdown = -1;
+
+        gnt::stack_vector<flimsy_move, 8> flimsy;
+        for (int i = 0; i < 3; ++i) {
+            flimsy.emplace_back(i);
+        }
+        flimsy_move::countdown = 1;
+        EXPECT_THROW(flimsy.insert(flimsy.begin(), flimsy_move(9)), std::runtime_error);
+        EXPECT_EQ((std::vector<int>{0, 1, 2}), values_of(flimsy));
+        flimsy_move::countdown = -1;
+        flimsy.insert(flimsy.begin() + 1, flimsy_move(9));
+        flimsy.erase(flimsy.begin());
+        EXPECT_EQ((std::vector<int>{9, 1, 2}), values_of(flimsy));
+        EXPECT_EQ(3, flimsy_move::alive);
+    }
+    EXPECT_EQ(0, sturdy_move::alive);
+    EXPECT_EQ(0, flimsy_move::alive);
+}
+
 TEST(CommonSmallTests, MapSanityCheck) {
     gnt::small_byte_map<sizeof(uint64_t), sizeof(char)> smap;
     EXPECT_EQ(smap.begin(), smap.end());